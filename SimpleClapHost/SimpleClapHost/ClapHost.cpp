@@ -1,43 +1,54 @@
 #include <clap/clap.h>
+#ifdef _WIN32
 #include <Windows.h>
 #include <winnt.h>
 #include <audioclient.h>
 #include <mmdeviceapi.h>
+#endif
+#include <algorithm>
 #include <vector>
+#include <string>
+#include <cstring>
 #include <iostream>
 #include "ClapHost.h"
+#include "ClapHostExtensions.h"
+#include "ClapHostAudio.h"
+#include "ClapHostPorts.h"
+#include "ClapHostThreadPool.h"
+
+// Weight 1/COST_SMOOTHING of a new block in the smoothed cost
+#define COST_SMOOTHING 8
 
 //#define BUFFER_SIZE 19200  // Process 10ms audio data
 
+#ifdef _WIN32
 void process_audio_data(BYTE* pCaptureData, BYTE* pRenderData, UINT32 numFrames, WAVEFORMATEX* pwfx, ClapHostBuffer* input, ClapHostBuffer* output);
+#endif
 
 clap_plugin* plugin = nullptr;
+ClapHostInstance* clapInstance = nullptr;
 
 const void* get_extension(const struct clap_host* host, const char* extension_id) {
     UNREFERENCED_PARAMETER(host);
-    UNREFERENCED_PARAMETER(extension_id);
-	std::cout << "get_extension" << std::endl;
-	return get_extension;
+    return clap_host_extension(extension_id);
 }
 
+// These may be called from the audio thread, so they only raise a flag on the instance
 void request_restart(const struct clap_host* host) {
-    UNREFERENCED_PARAMETER(host);
-    std::cout << "request_restart" << std::endl;
+    static_cast<ClapHostInstance*>(host->host_data)->restartRequested = true;
 }
 
 void request_process(const struct clap_host* host) {
-    UNREFERENCED_PARAMETER(host);
-    std::cout << "request_process" << std::endl;
+    static_cast<ClapHostInstance*>(host->host_data)->processRequested = true;
 }
 
 void request_callback(const struct clap_host* host) {
-    UNREFERENCED_PARAMETER(host);
-    std::cout << "request_callback" << std::endl;
+    static_cast<ClapHostInstance*>(host->host_data)->callbackRequested = true;
 }
 
 //
 //
-bool load_clap_plugin(const char* pluginPath) {
+ClapHostInstance* create_clap_instance(const char* pluginPath, const char* pluginId) {
     const clap_plugin_factory* pluginFactory = nullptr;
     const clap_host host = {
         {4,1,0}, // clap_version
@@ -52,42 +63,376 @@ bool load_clap_plugin(const char* pluginPath) {
 		request_callback, // request_callback
     };
 
-    HMODULE hModule = LoadLibraryA(pluginPath);
-    if (!hModule) {
-        std::cerr << "Failed to load plugin: " << pluginPath << std::endl;
-        return false;
-    }
-    const clap_plugin_entry* pluginEntry = reinterpret_cast<const clap_plugin_entry*>(
-        GetProcAddress(hModule, "clap_entry"));
-
-    if (!pluginEntry || !pluginEntry->init(pluginPath)) {
-        std::cerr << "Failed to initialize CLAP plugin:" << pluginPath << std::endl;
-        return false;
+    const clap_plugin_entry* pluginEntry = get_clap_entry(pluginPath);
+    if (!pluginEntry) {
+        return nullptr;
     }
 
     pluginFactory =
         static_cast<const clap_plugin_factory*>(pluginEntry->get_factory(CLAP_PLUGIN_FACTORY_ID));
+    if (!pluginFactory || pluginFactory->get_plugin_count(pluginFactory) == 0) {
+        std::cerr << "no plugin factory" << std::endl;
+        return nullptr;
+    }
 
-    auto count = pluginFactory->get_plugin_count(pluginFactory);
-
-    auto desc = pluginFactory->get_plugin_descriptor(pluginFactory, 0 /* pluginIndex */);
+    const clap_plugin_descriptor* desc = nullptr;
+    uint32_t pluginCount = pluginFactory->get_plugin_count(pluginFactory);
+    for (uint32_t i = 0; i < pluginCount && !desc; i++) {
+        desc = pluginFactory->get_plugin_descriptor(pluginFactory, i);
+        if (desc && pluginId && strcmp(desc->id, pluginId) != 0) {
+            desc = nullptr;
+        }
+        if (!pluginId) {
+            break;
+        }
+    }
     if (!desc) {
-        std::cerr << "no plugin descriptor" << std::endl;
-        return false;
+        std::cerr << "no plugin descriptor" << (pluginId ? " with id: " : "") << (pluginId ? pluginId : "") << std::endl;
+        return nullptr;
     }
 
-    plugin = const_cast<clap_plugin*>(pluginFactory->create_plugin(pluginFactory, &host, desc->id));
-    if (!plugin) {
+    ClapHostInstance* instance = new ClapHostInstance();
+    instance->host = host;
+    instance->host.host_data = instance;
+
+    instance->plugin = pluginFactory->create_plugin(pluginFactory, &instance->host, desc->id);
+    if (!instance->plugin) {
         std::cerr << "could not create the plugin with id: " << desc->id << std::endl;
-        return false;
+        delete instance;
+        return nullptr;
     }
 
-    if (!plugin) {
-    /* if (!plugin || !plugin->init(plugin)) { */
+    if (!instance->plugin->init(instance->plugin)) {
         std::cerr << "Failed to create CLAP plugin instance." << std::endl;
+        instance->plugin->destroy(instance->plugin);
+        release_clap_host_resources(instance);
+        delete instance;
+        return nullptr;
+    }
+
+    instance->threadPool = static_cast<const clap_plugin_thread_pool*>(
+        instance->plugin->get_extension(instance->plugin, CLAP_EXT_THREAD_POOL));
+    instance->latencyExt = static_cast<const clap_plugin_latency*>(
+        instance->plugin->get_extension(instance->plugin, CLAP_EXT_LATENCY));
+    instance->tailExt = static_cast<const clap_plugin_tail*>(
+        instance->plugin->get_extension(instance->plugin, CLAP_EXT_TAIL));
+    instance->timerSupport = static_cast<const clap_plugin_timer_support*>(
+        instance->plugin->get_extension(instance->plugin, CLAP_EXT_TIMER_SUPPORT));
+    instance->posixFdSupport = static_cast<const clap_plugin_posix_fd_support*>(
+        instance->plugin->get_extension(instance->plugin, CLAP_EXT_POSIX_FD_SUPPORT));
+    instance->paramsExt = static_cast<const clap_plugin_params*>(
+        instance->plugin->get_extension(instance->plugin, CLAP_EXT_PARAMS));
+    instance->voiceInfoExt = static_cast<const clap_plugin_voice_info*>(
+        instance->plugin->get_extension(instance->plugin, CLAP_EXT_VOICE_INFO));
+    instance->voiceInfoChanged = instance->voiceInfoExt != nullptr;
+    instance->tuningExt = static_cast<const clap_plugin_tuning*>(
+        instance->plugin->get_extension(instance->plugin, CLAP_EXT_TUNING));
+
+    instance->inEvents.reserve(CLAP_INSTANCE_MAX_EVENTS, CLAP_INSTANCE_EVENT_BYTES);
+    instance->flushEvents.reserve(CLAP_INSTANCE_MAX_EVENTS, 0);
+    instance->outEvents.reserve(CLAP_INSTANCE_OUTPUT_EVENTS, CLAP_INSTANCE_OUTPUT_BYTES);
+
+    return instance;
+}
+
+bool activate_clap_instance(ClapHostInstance* instance, double sampleRate, uint32_t minFrames, uint32_t maxFrames) {
+    if (instance->active) {
+        return true;
+    }
+    choose_clap_ports(instance);
+    connect_clap_ports(instance, maxFrames);
+    if (!instance->plugin->activate(instance->plugin, sampleRate, minFrames, maxFrames)) {
+        std::cerr << "Failed to activate CLAP plugin." << std::endl;
+        return false;
+    }
+    instance->active = true;
+    instance->sampleRate = sampleRate;
+    instance->minFrames = minFrames;
+    instance->maxFrames = maxFrames;
+
+    // Latency may only change while inactive, so this value holds until the next restart
+    instance->latency = instance->latencyExt ? instance->latencyExt->get(instance->plugin) : 0;
+    instance->latencyChanged = false;
+    instance->tail = instance->tailExt ? instance->tailExt->get(instance->plugin) : 0;
+    instance->tailChanged = false;
+    return true;
+}
+
+// Moves the queued parameter changes into the instance's event list, as many as fit
+static void take_param_changes(ClapHostInstance* instance) {
+    while (const clap_event_param_value* change = instance->paramChanges.front()) {
+        if (!instance->inEvents.push(&change->header)) {
+            break;
+        }
+        instance->paramChanges.pop();
+    }
+}
+
+static bool is_param_event(const clap_event_header* event) {
+    return event->space_id == CLAP_CORE_EVENT_SPACE_ID
+        && (event->type == CLAP_EVENT_PARAM_VALUE || event->type == CLAP_EVENT_PARAM_MOD
+            || event->type == CLAP_EVENT_PARAM_GESTURE_BEGIN || event->type == CLAP_EVENT_PARAM_GESTURE_END);
+}
+
+// Notes, MIDI and parameter changes can make a quiet plugin sound again, transport and other
+// events cannot
+static bool is_sounding_event(const clap_event_header* event) {
+    if (event->space_id != CLAP_CORE_EVENT_SPACE_ID) {
+        return false;
+    }
+    switch (event->type) {
+    case CLAP_EVENT_NOTE_ON:
+    case CLAP_EVENT_NOTE_OFF:
+    case CLAP_EVENT_NOTE_CHOKE:
+    case CLAP_EVENT_NOTE_EXPRESSION:
+    case CLAP_EVENT_MIDI:
+    case CLAP_EVENT_MIDI_SYSEX:
+    case CLAP_EVENT_MIDI2:
+        return true;
+    default:
+        return is_param_event(event);
+    }
+}
+
+// [main-thread & inactive]
+static void flush_inactive_params(ClapHostInstance* instance) {
+    instance->paramsFlushRequested = false;
+    if (!instance->paramsExt) {
+        return;     // the changes wait for the next block
+    }
+    instance->inEvents.clear();
+    instance->outEvents.clear();
+    take_param_changes(instance);
+    instance->paramsExt->flush(instance->plugin, instance->inEvents.list(), instance->outEvents.list());
+    instance->inEvents.clear();
+    instance->outputs.collect(instance->outEvents);
+}
+
+void service_clap_outputs(ClapHostInstance* instance) {
+    uint32_t dropped = instance->outputs.consume(
+        [instance](const ClapHostParamUpdate& update) {
+            if (update.hasValue) {
+                instance->reportedParams[update.paramId] = update.value;
+            }
+            if (update.hasGesture && update.isBegin) {
+                instance->paramGestures.insert(update.paramId);
+            }
+            else if (update.hasGesture) {
+                instance->paramGestures.erase(update.paramId);
+            }
+        },
+        [instance](const ClapHostNoteEnd& note) {
+            UNREFERENCED_PARAMETER(note);
+            instance->notesEnded++;
+        });
+    if (dropped > 0) {
+        std::cerr << "Lost " << dropped << " output events of " << instance->plugin->desc->name << std::endl;
+    }
+    if (uint32_t lost = instance->inEventsDropped.exchange(0, std::memory_order_relaxed)) {
+        std::cerr << "Lost " << lost << " input events of " << instance->plugin->desc->name << std::endl;
+    }
+}
+
+bool set_clap_param(ClapHostInstance* instance, clap_id paramId, double value) {
+    if (!instance->paramChanges.push(paramId, value)) {
         return false;
     }
+    if (!instance->active) {
+        flush_inactive_params(instance);
+    }
+    return true;
+}
+
+bool restart_clap_instance(ClapHostInstance* instance) {
+    instance->restartRequested = false;
+    if (instance->active) {
+        instance->plugin->deactivate(instance->plugin);
+        instance->active = false;
+    }
+    flush_inactive_params(instance);
+    return activate_clap_instance(instance, instance->sampleRate, instance->minFrames, instance->maxFrames);
+}
 
+// The instance must not be used by the audio thread anymore.
+void destroy_clap_instance(ClapHostInstance* instance) {
+    if (!instance) {
+        return;
+    }
+    if (instance->active) {
+        instance->plugin->deactivate(instance->plugin);
+        instance->active = false;
+    }
+    instance->plugin->destroy(instance->plugin);
+    release_clap_host_resources(instance);
+    delete instance;
+}
+
+void schedule_clap_instance(ClapHostInstance* instance, uint32_t workerCount) {
+    uint64_t blocks = instance->blockCount.load(std::memory_order_relaxed);
+
+    // voice_count is the polyphony the patch may use, so it is only read again when it changed.
+    // The news comes a tick after the blocks already played with it, so the prediction starts
+    // from the cost per voice of the tick before rather than from the cost measured since.
+    if (instance->voiceInfoChanged.exchange(false)) {
+        clap_voice_info info = {};
+        if (instance->voiceInfoExt->get(instance->plugin, &info)) {
+            if (instance->voiceCount > 0 && instance->voiceCost > 0) {
+                instance->predictedCost = instance->voiceCost * info.voice_count;
+                instance->predictionEnd = blocks + COST_SMOOTHING;
+            }
+            instance->voiceCount = info.voice_count;
+            instance->voiceCapacity = info.voice_capacity;
+        }
+    }
+
+    // A prediction from the polyphony stands until the smoothed cost has taken in enough
+    // blocks played with it
+    if (blocks >= instance->predictionEnd) {
+        instance->predictedCost = instance->blockCost.load(std::memory_order_relaxed);
+        instance->voiceCost = instance->voiceCount > 0 ? instance->predictedCost / instance->voiceCount : 0;
+    }
+
+    if (!instance->voiceInfoExt) {
+        instance->poolWorkers = workerCount;
+        return;
+    }
+
+    // Enough helpers that every thread's share of the work stays under half the block,
+    // but never more than there are voices to spread; the calling thread counts as one.
+    // Blocks are usually far shorter than maxFrames, so the last one sets the period.
+    uint32_t workers = 0;
+    uint32_t frames = instance->blockFrames.load(std::memory_order_relaxed);
+    if (frames == 0) {
+        frames = instance->maxFrames;
+    }
+    uint64_t period = instance->sampleRate > 0 ? (uint64_t)(frames * 1e9 / instance->sampleRate) : 0;
+    uint32_t voices = instance->voiceCount < instance->voiceCapacity || instance->voiceCapacity == 0
+        ? instance->voiceCount : instance->voiceCapacity;
+    if (voices > 1 && period > 0) {
+        uint64_t threads = (2 * instance->predictedCost + period - 1) / period;
+        workers = (uint32_t)std::min<uint64_t>(threads > 0 ? threads - 1 : 0, std::min(workerCount, voices - 1));
+    }
+    instance->poolWorkers = workers;
+}
+
+bool start_clap_processing(ClapHostInstance* instance) {
+    if (!instance->processing) {
+        instance->processing = instance->plugin->start_processing(instance->plugin);
+        instance->quietFrames = 0;
+    }
+    return instance->processing;
+}
+
+void stop_clap_processing(ClapHostInstance* instance) {
+    if (instance->processing) {
+        instance->plugin->stop_processing(instance->plugin);
+        instance->processing = false;
+    }
+}
+
+clap_process_status process_clap_instance(ClapHostInstance* instance, const clap_process* process) {
+    // The host's parameter changes all sit at time 0, so they go ahead of the block's events,
+    // which stay valid for the whole call and are not copied again
+    ClapHostInputEvents& events = instance->inEvents;
+    events.clear();
+    take_param_changes(instance);
+    uint32_t expected = events.size() + (process->in_events ? process->in_events->size(process->in_events) : 0);
+    if (!events.append(process->in_events, true)) {
+        instance->inEventsDropped.fetch_add(expected - events.size(), std::memory_order_relaxed);
+    }
+
+    clap_process block = map_clap_ports(instance, process);
+    block.in_events = events.list();
+    instance->outEvents.clear();
+    block.out_events = instance->outEvents.list();
+
+    bool inputQuiet = clap_audio_is_quiet(process->audio_inputs, process->audio_inputs_count, process->frames_count);
+    bool soundingEvents = false;
+    for (uint32_t i = 0; i < events.size() && !soundingEvents; i++) {
+        soundingEvents = is_sounding_event(events.get(i));
+    }
+
+    if (!instance->processing) {
+        // Parameter events go through flush() when the plugin has it, without the other events
+        bool wake = !inputQuiet || instance->processRequested.exchange(false);
+        bool flush = instance->paramsFlushRequested.exchange(false);
+        ClapHostInputEvents& params = instance->flushEvents;
+        params.clear();
+        for (uint32_t i = 0; i < events.size() && soundingEvents && !wake; i++) {
+            const clap_event_header* event = events.get(i);
+            if (instance->paramsExt && is_param_event(event)) {
+                params.refer(event);
+                flush = true;
+            }
+            else {
+                wake = is_sounding_event(event);
+            }
+        }
+        if (!wake && (!flush || instance->paramsExt)) {
+            if (flush) {
+                instance->paramsExt->flush(instance->plugin, params.list(), block.out_events);
+            }
+            // Also hands over what the last blocks before the sleep left in the channel
+            instance->outputs.collect(instance->outEvents);
+            clap_audio_clear(process->audio_outputs, process->audio_outputs_count, process->frames_count);
+            return CLAP_PROCESS_SLEEP;
+        }
+        if (!start_clap_processing(instance)) {
+            clap_audio_clear(process->audio_outputs, process->audio_outputs_count, process->frames_count);
+            return CLAP_PROCESS_ERROR;
+        }
+    }
+
+    if (instance->tailChanged.exchange(false)) {
+        instance->tail = instance->tailExt ? instance->tailExt->get(instance->plugin) : 0;
+    }
+
+    // process() flushes the parameters as well
+    instance->paramsFlushRequested = false;
+    uint64_t start = clap_thread_time();
+    instance->inProcess = true;
+    clap_process_status status = instance->plugin->process(instance->plugin, &block);
+    instance->inProcess = false;
+    uint64_t elapsed = clap_thread_time() - start;
+
+    // Work of the block: our own time plus what the pool's workers did for it
+    uint64_t work = elapsed + instance->helperTime;
+    uint64_t cost = instance->blockCost.load(std::memory_order_relaxed);
+    instance->blockCost.store(cost ? cost - cost / COST_SMOOTHING + work / COST_SMOOTHING : work, std::memory_order_relaxed);
+    instance->blockFrames.store(process->frames_count, std::memory_order_relaxed);
+    instance->blockCount.store(instance->blockCount.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    instance->helperTime = 0;
+    finish_clap_ports(instance, process);
+    instance->outputs.collect(instance->outEvents);
+
+    instance->quietFrames = (inputQuiet && !soundingEvents) ? instance->quietFrames + process->frames_count : 0;
+    bool sleep = false;
+    switch (status) {
+    case CLAP_PROCESS_CONTINUE_IF_NOT_QUIET:
+        sleep = instance->quietFrames > 0
+            && clap_audio_is_quiet(process->audio_outputs, process->audio_outputs_count, process->frames_count);
+        break;
+    case CLAP_PROCESS_TAIL:
+        sleep = instance->quietFrames > 0 && instance->tail < INT32_MAX && instance->quietFrames >= instance->tail;
+        break;
+    case CLAP_PROCESS_SLEEP:
+        sleep = instance->quietFrames > 0;
+        break;
+    default:
+        break;
+    }
+    if (sleep) {
+        stop_clap_processing(instance);
+    }
+    return status;
+}
+
+bool load_clap_plugin(const char* pluginPath) {
+    clapInstance = create_clap_instance(pluginPath);
+    if (!clapInstance) {
+        return false;
+    }
+    plugin = const_cast<clap_plugin*>(clapInstance->plugin);
     return true;
 }
 
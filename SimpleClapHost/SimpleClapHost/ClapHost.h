@@ -1,11 +1,45 @@
 #pragma once
 
+#ifdef _WIN32
 #include <Windows.h>
+#else
+#include <cstdint>
+#define UNREFERENCED_PARAMETER(P) (void)(P)
+typedef uint32_t DWORD;
+#endif
+#include <atomic>
 #include <iostream>
+#include <map>
+#include <set>
+#include <vector>
+#include <clap/clap.h>
+#include <clap/ext/draft/tuning.h>
+#include "ClapHostAutomation.h"
+#include "ClapHostEvents.h"
+#include "ClapHostMidiFile.h"
+#include "ClapHostModule.h"
+#include "ClapHostPorts.h"
+#include "ClapHostTransport.h"
+#include "ClapHostTuning.h"
+#include "ClapHostUmp.h"
 
 #define BUFFER_SIZE 9600
 //#define BUFFER_SIZE 19200 // just for test
 
+// Events the host's sources can put in one block, all of them merged into the block's list
+#define CLAP_BLOCK_MAX_EVENTS (TRANSPORT_MAX_EVENTS + TUNING_MAX_EVENTS + MIDI_PLAYER_MAX_EVENTS \
+                               + AUTOMATION_MAX_EVENTS + UMP_MAX_EVENTS)
+#define CLAP_BLOCK_EVENT_BYTES (TRANSPORT_MAX_EVENTS * sizeof(clap_event_transport) \
+                                + TUNING_MAX_EVENTS * sizeof(clap_event_tuning) + MIDI_PLAYER_EVENT_BYTES \
+                                + AUTOMATION_MAX_EVENTS * sizeof(clap_event_param_value) + UMP_EVENT_BYTES)
+// Input events one block can carry to a plugin: the host's parameter changes, copied, then the
+// block's events, referred to
+#define CLAP_INSTANCE_MAX_EVENTS (CLAP_PARAM_QUEUE_SIZE + CLAP_BLOCK_MAX_EVENTS)
+#define CLAP_INSTANCE_EVENT_BYTES (CLAP_PARAM_QUEUE_SIZE * sizeof(clap_event_param_value))
+// Output events one block of a plugin can push, with their storage
+#define CLAP_INSTANCE_OUTPUT_EVENTS 1024
+#define CLAP_INSTANCE_OUTPUT_BYTES (CLAP_INSTANCE_OUTPUT_EVENTS * 64)
+
 class ClapHostBuffer {
 public:
     ClapHostBuffer();
@@ -14,3 +48,128 @@ public:
     DWORD** pReorderedBuffer = nullptr;;
     const int buffer_size = BUFFER_SIZE;
 };
+
+// One plugin instance and the clap_host it was created with.
+// The host struct must outlive the plugin, so it lives here instead of on the stack.
+struct ClapHostInstance {
+    clap_host host = {};
+    const clap_plugin* plugin = nullptr;
+    bool active = false;
+    // [audio-thread] A processing instance goes to sleep by stopping processing, see
+    // process_clap_instance()
+    bool inProcess = false;
+    bool processing = false;
+    uint32_t tail = 0;          // samples, INT32_MAX or more is infinite
+    uint64_t quietFrames = 0;   // since the input went quiet with no events
+
+    // Activation parameters, kept for restarts
+    double sampleRate = 0;
+    uint32_t minFrames = 0;
+    uint32_t maxFrames = 0;
+
+    // Read after each activation, constant until deactivation
+    uint32_t latency = 0;
+
+    // Main port widths, set by choose_clap_ports() before the first activation
+    bool portsChosen = false;
+    uint32_t inputChannels = 0;
+    uint32_t outputChannels = 0;
+    // [audio-thread while active] Buffers of every plugin port, see connect_clap_ports()
+    ClapHostPortMap portMap;
+    // Dialects of the first note input, none without one, also set by choose_clap_ports()
+    uint32_t noteDialects = 0;
+    uint32_t preferredDialect = 0;
+
+    // Plugin extensions, queried once after init
+    const clap_plugin_thread_pool* threadPool = nullptr;
+    const clap_plugin_latency* latencyExt = nullptr;
+    const clap_plugin_tail* tailExt = nullptr;
+    const clap_plugin_timer_support* timerSupport = nullptr;
+    const clap_plugin_posix_fd_support* posixFdSupport = nullptr;
+    const clap_plugin_params* paramsExt = nullptr;
+    const clap_plugin_voice_info* voiceInfoExt = nullptr;
+    const clap_plugin_tuning* tuningExt = nullptr;
+
+    // Scheduling, see schedule_clap_instance()
+    uint32_t voiceCount = 0;                        // [main-thread]
+    uint32_t voiceCapacity = 0;
+    uint64_t predictedCost = 0;                     // ns of work in the next block
+    uint64_t predictionEnd = 0;                     // block count until which predictedCost stands
+    uint64_t voiceCost = 0;                         // ns per voice, from the last measured cost
+    std::atomic<uint32_t> poolWorkers{ UINT32_MAX };  // workers request_exec may use
+    std::atomic<uint64_t> blockCost{ 0 };           // [audio-thread] smoothed ns of work per block
+    std::atomic<uint32_t> blockFrames{ 0 };         // [audio-thread] frames of the last block
+    std::atomic<uint64_t> blockCount{ 0 };          // [audio-thread] blocks processed
+    uint64_t helperTime = 0;                        // [audio-thread] workers' share of this block
+
+    // [main-thread] Tuning list the plugin was told about, see ClapHostTuning::service()
+    uint64_t tuningsSeen = 0;
+
+    // Parameter changes made by the host, see set_clap_param()
+    ClapHostParamQueue paramChanges;
+    // [audio-thread] Events of the current block: the parameter changes, then the host's events,
+    // referred to where they are
+    ClapHostInputEvents inEvents;
+    // [audio-thread] Events of the blocks which did not fit in inEvents, reported by
+    // service_clap_outputs()
+    std::atomic<uint32_t> inEventsDropped{ 0 };
+    // [audio-thread] The parameter events of inEvents, flushed to a sleeping plugin
+    ClapHostInputEvents flushEvents;
+    // [audio-thread] What the plugin pushed in the current block, and its hand-over to the main
+    // thread, see service_clap_outputs()
+    ClapHostOutputEvents outEvents;
+    ClapHostOutputChannel outputs;
+    // [main-thread] Parameter values the plugin reported, the ones in a gesture, ended notes
+    std::map<clap_id, double> reportedParams;
+    std::set<clap_id> paramGestures;
+    uint64_t notesEnded = 0;
+    // [main-thread] Parameters whose automation the plugin asked to clear, taken by the host
+    std::vector<clap_id> clearedAutomation;
+
+    // Set by the plugin through clap_host and its extensions, serviced on the main thread
+    std::atomic<bool> restartRequested{ false };
+    std::atomic<bool> processRequested{ false };
+    std::atomic<bool> callbackRequested{ false };
+    std::atomic<bool> latencyChanged{ false };
+    std::atomic<bool> tailChanged{ false };
+    std::atomic<bool> paramsFlushRequested{ false };
+    std::atomic<bool> stateDirty{ false };
+    std::atomic<bool> voiceInfoChanged{ false };
+};
+
+// Creates the plugin of the module with the given id, or its first plugin without one.
+// [main-thread]
+ClapHostInstance* create_clap_instance(const char* pluginPath, const char* pluginId = nullptr);
+bool activate_clap_instance(ClapHostInstance* instance, double sampleRate, uint32_t minFrames, uint32_t maxFrames);
+// Deactivates and activates again with the same parameters; the audio thread must not use it.
+bool restart_clap_instance(ClapHostInstance* instance);
+void destroy_clap_instance(ClapHostInstance* instance);
+
+// Queues a parameter change for the plugin. An inactive instance gets it through
+// clap_plugin_params::flush() right away, an active one with its next block.
+// Returns false when the queue is full.
+// [main-thread]
+bool set_clap_param(ClapHostInstance* instance, clap_id paramId, double value);
+
+// Takes the parameter changes, gestures and ended notes the plugin reported since the last call.
+// [main-thread]
+void service_clap_outputs(ClapHostInstance* instance);
+
+// Reads the plugin's voice count and capacity, predicts the work of the next block from them
+// and the measured cost, and decides how many of the pool's workers may help the instance
+// within the length of the last block.
+// Plugins without voice info may use every worker.
+// [main-thread]
+void schedule_clap_instance(ClapHostInstance* instance, uint32_t workerCount);
+
+// [audio-thread]
+bool start_clap_processing(ClapHostInstance* instance);
+void stop_clap_processing(ClapHostInstance* instance);
+
+// Calls process() while the instance is awake. Once the returned status and the plugin's tail
+// say there is nothing left to render, the instance is put to sleep and its outputs are cleared
+// without calling the plugin, until the input gets loud again or events arrive.
+// Only notes, MIDI and parameter events wake a sleeping instance, parameter events only when the
+// plugin cannot take them through clap_plugin_params::flush(). Transport and other events do not.
+// [audio-thread]
+clap_process_status process_clap_instance(ClapHostInstance* instance, const clap_process* process);
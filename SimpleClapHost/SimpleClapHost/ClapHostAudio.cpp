@@ -0,0 +1,66 @@
+#include <cmath>
+#include <cstring>
+#if defined(_M_X64) || defined(__SSE2__)
+#include <emmintrin.h>
+#define CLAP_AUDIO_SSE2
+#endif
+#include "ClapHostAudio.h"
+
+static float peak_level(const float* data, uint32_t frames) {
+    uint32_t i = 0;
+    float peak = 0.0f;
+
+#ifdef CLAP_AUDIO_SSE2
+    const __m128 absMask = _mm_castsi128_ps(_mm_set1_epi32(0x7fffffff));
+    __m128 peak4 = _mm_setzero_ps();
+    for (; i + 8 <= frames; i += 8) {
+        __m128 a = _mm_and_ps(_mm_loadu_ps(data + i), absMask);
+        __m128 b = _mm_and_ps(_mm_loadu_ps(data + i + 4), absMask);
+        peak4 = _mm_max_ps(peak4, _mm_max_ps(a, b));
+    }
+    peak4 = _mm_max_ps(peak4, _mm_shuffle_ps(peak4, peak4, _MM_SHUFFLE(1, 0, 3, 2)));
+    peak4 = _mm_max_ps(peak4, _mm_shuffle_ps(peak4, peak4, _MM_SHUFFLE(2, 3, 0, 1)));
+    peak = _mm_cvtss_f32(peak4);
+#endif
+
+    for (; i < frames; i++) {
+        float v = std::fabs(data[i]);
+        peak = v > peak ? v : peak;
+    }
+    return peak;
+}
+
+bool clap_audio_is_quiet(const clap_audio_buffer* buffers, uint32_t count, uint32_t frames) {
+    for (uint32_t p = 0; p < count; p++) {
+        const clap_audio_buffer& buf = buffers[p];
+        for (uint32_t ch = 0; ch < buf.channel_count; ch++) {
+            uint32_t n = (buf.constant_mask & (1ull << (ch & 63))) ? 1 : frames;
+            if (buf.data32 && buf.data32[ch] && peak_level(buf.data32[ch], n) >= CLAP_QUIET_LEVEL) {
+                return false;
+            }
+            if (buf.data64 && buf.data64[ch]) {
+                for (uint32_t i = 0; i < n; i++) {
+                    if (std::fabs(buf.data64[ch][i]) >= CLAP_QUIET_LEVEL) {
+                        return false;
+                    }
+                }
+            }
+        }
+    }
+    return true;
+}
+
+void clap_audio_clear(clap_audio_buffer* buffers, uint32_t count, uint32_t frames) {
+    for (uint32_t p = 0; p < count; p++) {
+        clap_audio_buffer& buf = buffers[p];
+        for (uint32_t ch = 0; ch < buf.channel_count; ch++) {
+            if (buf.data32 && buf.data32[ch]) {
+                memset(buf.data32[ch], 0, sizeof(float) * frames);
+            }
+            if (buf.data64 && buf.data64[ch]) {
+                memset(buf.data64[ch], 0, sizeof(double) * frames);
+            }
+        }
+        buf.constant_mask = ~0ull;
+    }
+}
@@ -0,0 +1,15 @@
+#pragma once
+
+#include <clap/clap.h>
+
+// Peak level under which a buffer counts as quiet, about -96 dBFS
+#define CLAP_QUIET_LEVEL (1.0f / 65536)
+
+// True when every channel of the buffers stays under CLAP_QUIET_LEVEL.
+// Constant channels are judged by their first sample.
+// [audio-thread]
+bool clap_audio_is_quiet(const clap_audio_buffer* buffers, uint32_t count, uint32_t frames);
+
+// Zeroes the buffers and marks their channels constant.
+// [audio-thread]
+void clap_audio_clear(clap_audio_buffer* buffers, uint32_t count, uint32_t frames);
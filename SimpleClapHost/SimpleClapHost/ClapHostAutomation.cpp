@@ -0,0 +1,213 @@
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <limits>
+#include "ClapHostAutomation.h"
+#include "ClapHostTransport.h"
+
+ClapHostAutomation::ClapHostAutomation(uint32_t targetCount)
+    : targets(targetCount), lists(new ClapHostInputEvents[targetCount]) {
+    for (uint32_t i = 0; i < targets; i++) {
+        lists[i].reserve(AUTOMATION_MAX_EVENTS, AUTOMATION_MAX_EVENTS * sizeof(clap_event_param_value));
+    }
+    next.assign(AUTOMATION_MAX_LANES, INT64_MAX);
+    segment.assign(AUTOMATION_MAX_LANES, -1);
+    lastValue.assign(AUTOMATION_MAX_LANES, std::numeric_limits<double>::quiet_NaN());
+
+    // Taken by the audio thread once it uses a tempo map
+    auto none = std::make_shared<ClapHostAutomationSet>();
+    sets.push_back(none);
+}
+
+bool ClapHostAutomation::setLane(uint32_t target, clap_id paramId, std::vector<ClapHostAutomationPoint> points,
+                                 double tolerance) {
+    auto key = std::make_pair(target, paramId);
+    if (target >= targets || (lanes.size() == AUTOMATION_MAX_LANES && lanes.find(key) == lanes.end())) {
+        std::cerr << "Too many automation lanes." << std::endl;
+        return false;
+    }
+    if (points.empty()) {
+        return removeLane(target, paramId);
+    }
+    std::stable_sort(points.begin(), points.end(),
+                     [](const ClapHostAutomationPoint& a, const ClapHostAutomationPoint& b) { return a.beat < b.beat; });
+    lanes[key] = { std::move(points), std::max(0.0, tolerance) };
+    edited = true;
+    return true;
+}
+
+bool ClapHostAutomation::removeLane(uint32_t target, clap_id paramId) {
+    if (lanes.erase(std::make_pair(target, paramId)) == 0) {
+        return false;
+    }
+    edited = true;
+    return true;
+}
+
+void ClapHostAutomation::prepare(double rate) {
+    sampleRate = rate;
+}
+
+void ClapHostAutomation::publish(const ClapHostTempoMap& map) {
+    auto placed = std::make_shared<ClapHostAutomationSet>();
+    placed->generation = nextGeneration++;
+    placed->mapGeneration = map.generation;
+
+    size_t pointCount = 0;
+    for (const auto& entry : lanes) {
+        pointCount += entry.second.points.size();
+    }
+    placed->pointSample.reserve(pointCount);
+    placed->pointValue.reserve(pointCount);
+    placed->pointHold.reserve(pointCount);
+
+    for (const auto& entry : lanes) {
+        placed->target.push_back(entry.first.first);
+        placed->paramId.push_back(entry.first.second);
+        placed->tolerance.push_back(entry.second.tolerance);
+        placed->firstPoint.push_back((uint32_t)placed->pointSample.size());
+        placed->pointCount.push_back((uint32_t)entry.second.points.size());
+        for (const ClapHostAutomationPoint& point : entry.second.points) {
+            // Rounded as the transport rounds the song position
+            placed->pointSample.push_back((int64_t)std::ceil(map.secondsAt(point.beat) * sampleRate));
+            placed->pointValue.push_back(point.value);
+            placed->pointHold.push_back(point.hold);
+        }
+    }
+    sets.push_back(placed);
+    published.store(placed.get(), std::memory_order_release);
+}
+
+void ClapHostAutomation::service(const ClapHostTempoMap& map) {
+    if (edited || sets.back()->mapGeneration != map.generation) {
+        edited = false;
+        publish(map);
+    }
+
+    // The audio thread only ever takes the newest set, so the ones before its current are unused
+    uint64_t inUse = adopted.load(std::memory_order_acquire);
+    size_t unused = 0;
+    while (unused + 1 < sets.size() && sets[unused]->generation < inUse) {
+        unused++;
+    }
+    sets.erase(sets.begin(), sets.begin() + unused);
+}
+
+// Finds the segment of the lane at a song sample and sends its value there
+void ClapHostAutomation::seek(uint32_t lane, int64_t song) {
+    const int64_t* at = set->pointSample.data() + set->firstPoint[lane];
+    const int64_t* end = at + set->pointCount[lane];
+    segment[lane] = (int32_t)(std::upper_bound(at, end, song) - at) - 1;
+    next[lane] = song;
+}
+
+// Sends the events of a lane from its next event up to the end sample, the span starting at
+// start and frame
+void ClapHostAutomation::play(uint32_t lane, int64_t start, int64_t end, uint32_t frame) {
+    const uint32_t first = set->firstPoint[lane];
+    const int32_t count = (int32_t)set->pointCount[lane];
+    const int64_t* at = set->pointSample.data() + first;
+    const double* value = set->pointValue.data() + first;
+    const uint8_t* hold = set->pointHold.data() + first;
+    const double tolerance = set->tolerance[lane];
+    ClapHostInputEvents& list = lists[set->target[lane]];
+
+    int32_t k = segment[lane];
+    while (next[lane] < end) {
+        // An event which did not fit in the last block is sent late rather than never
+        int64_t t = std::max(next[lane], start);
+        while (k + 1 < count && at[k + 1] <= t) {
+            k++;
+        }
+
+        double v;
+        int64_t until;
+        if (k < 0) {
+            v = value[0];
+            until = at[0];
+        }
+        else if (k + 1 == count || hold[k]) {
+            v = value[k];
+            until = k + 1 < count ? at[k + 1] : INT64_MAX;
+        }
+        else {
+            // Held from t for step samples, the curve's value at the middle of them is off by at
+            // most the tolerance at either end
+            double slope = (value[k + 1] - value[k]) / (double)(at[k + 1] - at[k]);
+            int64_t step = at[k + 1] - t;
+            if (slope != 0) {
+                step = std::min(step, std::max<int64_t>(1, (int64_t)(2 * tolerance / std::fabs(slope))));
+            }
+            v = value[k] + slope * ((double)(t - at[k]) + step * 0.5);
+            until = t + step;
+        }
+
+        if (v != lastValue[lane]) {
+            clap_event_param_value event = {};
+            event.header.size = sizeof(clap_event_param_value);
+            event.header.time = frame + (uint32_t)(t - start);
+            event.header.space_id = CLAP_CORE_EVENT_SPACE_ID;
+            event.header.type = CLAP_EVENT_PARAM_VALUE;
+            event.header.flags = 0;
+            event.param_id = set->paramId[lane];
+            event.cookie = nullptr;
+            event.note_id = -1;
+            event.port_index = -1;
+            event.channel = -1;
+            event.key = -1;
+            event.value = v;
+            if (!list.push(&event.header)) {
+                next[lane] = t;
+                break;
+            }
+            lastValue[lane] = v;
+        }
+        next[lane] = until;
+    }
+    segment[lane] = k;
+}
+
+void ClapHostAutomation::process(const ClapHostTransport& transport) {
+    for (uint32_t i = 0; i < targets; i++) {
+        lists[i].clear();
+    }
+
+    // A set placed on another tempo map than the block's waits, the parameters hold meanwhile
+    const ClapHostTempoMap* map = transport.blockTempoMap();
+    const ClapHostAutomationSet* latest = published.load(std::memory_order_acquire);
+    if (latest && latest != set && latest->mapGeneration == map->generation) {
+        set = latest;
+        adopted.store(set->generation, std::memory_order_release);
+        // Lanes may have moved, each sends its value again
+        std::fill(lastValue.begin(), lastValue.end(), std::numeric_limits<double>::quiet_NaN());
+        expected = -1;
+    }
+    if (!set || set->mapGeneration != map->generation) {
+        return;
+    }
+
+    const uint32_t laneCount = (uint32_t)set->target.size();
+    const int64_t* nextEvent = next.data();
+    for (const ClapHostTransport::Span& span : transport.spans()) {
+        if (span.song != expected) {
+            for (uint32_t lane = 0; lane < laneCount; lane++) {
+                seek(lane, span.song);
+            }
+        }
+        int64_t end = span.song + span.frames;
+        expected = end;
+
+        // Most lanes have nothing to send in a block: count the ones which do in one pass without
+        // branches, then visit only as many
+        uint32_t dueCount = 0;
+        for (uint32_t lane = 0; lane < laneCount; lane++) {
+            dueCount += nextEvent[lane] < end;
+        }
+        for (uint32_t lane = 0; dueCount > 0 && lane < laneCount; lane++) {
+            if (nextEvent[lane] < end) {
+                play(lane, span.song, end, span.frame);
+                dueCount--;
+            }
+        }
+    }
+}
@@ -0,0 +1,119 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <utility>
+#include <vector>
+#include <clap/clap.h>
+#include "ClapHostEvents.h"
+
+class ClapHostTempoMap;
+class ClapHostTransport;
+
+// Lanes one automation can play
+#define AUTOMATION_MAX_LANES 4096
+// Parameter events one target's list can carry per block
+#define AUTOMATION_MAX_EVENTS 1024
+// Default error tolerance, as a fraction of the parameter's range
+#define AUTOMATION_TOLERANCE 0.001
+
+struct ClapHostAutomationPoint {
+    double beat;
+    double value;
+    bool hold;                  // the value stays up to the next point, instead of ramping to it
+};
+
+// The lanes at one point in time, placed on a tempo map: one entry per lane in each lane array,
+// the points of every lane one after the other in the point arrays.
+// Never changed once published.
+struct ClapHostAutomationSet {
+    uint64_t generation = 0;
+    uint64_t mapGeneration = 0;
+
+    std::vector<uint32_t> target;
+    std::vector<clap_id> paramId;
+    std::vector<double> tolerance;
+    std::vector<uint32_t> firstPoint;
+    std::vector<uint32_t> pointCount;
+
+    std::vector<int64_t> pointSample;   // song sample
+    std::vector<double> pointValue;
+    std::vector<uint8_t> pointHold;
+};
+
+// Parameter automation: breakpoint envelopes per target and clap_id, played along the host
+// transport as CLAP_EVENT_PARAM_VALUE events.
+//
+// A target is whatever the caller sends a list of events to, an instance in the live host.
+// Edits are kept on the main thread and published by service(), which places the points of
+// every lane on the transport's tempo map and hands the set to the audio thread with an atomic
+// pointer store; the set is placed again when the tempo map changes, and until it arrives the
+// parameters hold their values.
+//
+// Events are thinned: a value is held until the curve strays from it by the lane's tolerance,
+// and each event carries the curve's value at the middle of the stretch it is held for, so a
+// ramp of slope s gets an event every 2 * tolerance / |s| samples instead of one per sample.
+// Each block, process() first finds the lanes whose next event falls in the block with one
+// branch-free pass over the lanes' next event positions, laid out as arrays for the compiler
+// to vectorize, and only those lanes evaluate their curves. After the song position jumps, every
+// lane sends its value at the new position.
+class ClapHostAutomation {
+public:
+    explicit ClapHostAutomation(uint32_t targetCount = 1);
+
+    ClapHostAutomation(const ClapHostAutomation&) = delete;
+    ClapHostAutomation& operator=(const ClapHostAutomation&) = delete;
+
+    // Replaces a lane, tolerance in the parameter's units; points in any order, by beat.
+    // Returns false when there are too many lanes.
+    // [main-thread]
+    bool setLane(uint32_t target, clap_id paramId, std::vector<ClapHostAutomationPoint> points, double tolerance);
+    bool removeLane(uint32_t target, clap_id paramId);
+    size_t laneCount() const { return lanes.size(); }
+
+    // Publishes the edits, or places the lanes again if the tempo map changed, and frees the
+    // sets the audio thread let go of
+    // [main-thread]
+    void service(const ClapHostTempoMap& map);
+
+    // [before the stream starts]
+    void prepare(double sampleRate);
+
+    // Takes the events of the spans the transport covered in this block, call after its process()
+    // [audio-thread]
+    void process(const ClapHostTransport& transport);
+    // The events of a target in this block, valid until the next process()
+    const clap_input_events* events(uint32_t target) const { return lists[target].list(); }
+    uint32_t eventCount(uint32_t target) const { return lists[target].size(); }
+
+private:
+    struct Lane {
+        std::vector<ClapHostAutomationPoint> points;
+        double tolerance;
+    };
+
+    void publish(const ClapHostTempoMap& map);
+    void seek(uint32_t lane, int64_t song);
+    void play(uint32_t lane, int64_t start, int64_t end, uint32_t frame);
+
+    // [main-thread]
+    std::map<std::pair<uint32_t, clap_id>, Lane> lanes;
+    bool edited = false;
+    std::vector<std::shared_ptr<const ClapHostAutomationSet>> sets;    // published, the newest last
+    uint64_t nextGeneration = 1;
+
+    std::atomic<const ClapHostAutomationSet*> published{ nullptr };
+    std::atomic<uint64_t> adopted{ 0 };                 // generation of the audio thread's set
+    double sampleRate = 48000;
+
+    // owned by the audio thread, one entry per lane of the set
+    const ClapHostAutomationSet* set = nullptr;
+    int64_t expected = -1;              // song sample a span continues from, -1 after a break
+    std::vector<int64_t> next;          // song sample of the lane's next event
+    std::vector<int32_t> segment;       // point the lane is past, -1 before the first
+    std::vector<double> lastValue;      // sent last, NaN for none
+    uint32_t targets;
+    std::unique_ptr<ClapHostInputEvents[]> lists;
+};
@@ -0,0 +1,533 @@
+#ifdef _WIN32
+#include <Windows.h>
+#else
+#include <poll.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+#include <sys/inotify.h>
+#endif
+#include <cctype>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <filesystem>
+#include <iostream>
+#include <clap/factory/draft/plugin-invalidation.h>
+#include "ClapHostCatalog.h"
+#include "ClapHostModule.h"
+
+namespace fs = std::filesystem;
+
+#ifdef _WIN32
+#define CATALOG_PATH_SEPARATOR ';'
+#else
+#define CATALOG_PATH_SEPARATOR ':'
+#endif
+
+// Bytes of change notifications read at once
+#define CATALOG_EVENT_BUFFER (64 * 1024)
+
+static bool is_bundle(const fs::path& path) {
+    std::string extension = path.extension().u8string();
+    return extension.size() == 5 && (extension[1] | 0x20) == 'c' && (extension[2] | 0x20) == 'l'
+        && (extension[3] | 0x20) == 'a' && (extension[4] | 0x20) == 'p';
+}
+
+// Glob of clap_plugin_invalidation_source with * and ?, case-insensitive on Windows
+static bool glob_match(const char* glob, const char* name) {
+    const char* star = nullptr;
+    const char* resume = nullptr;
+    while (*name) {
+#ifdef _WIN32
+        bool same = tolower((unsigned char)*glob) == tolower((unsigned char)*name);
+#else
+        bool same = *glob == *name;
+#endif
+        if (*glob == '?' || (*glob != '*' && same)) {
+            glob++;
+            name++;
+        }
+        else if (*glob == '*') {
+            star = glob++;
+            resume = name;
+        }
+        else if (star) {
+            glob = star + 1;
+            name = ++resume;
+        }
+        else {
+            return false;
+        }
+    }
+    while (*glob == '*') {
+        glob++;
+    }
+    return *glob == '\0';
+}
+
+// path lies in directory, or below it when recursive
+static bool is_within(const fs::path& path, const std::string& directory, bool recursive) {
+    fs::path parent = path.parent_path();
+    fs::path root = fs::u8path(directory);
+    if (parent == root) {
+        return true;
+    }
+    if (!recursive) {
+        return false;
+    }
+    auto rel = parent.lexically_relative(root);
+    return !rel.empty() && *rel.begin() != "..";
+}
+
+const ClapHostCatalogBundle* ClapHostCatalogSnapshot::find(const char* pluginId) const {
+    auto found = byPluginId.find(pluginId);
+    return found != byPluginId.end() ? found->second : nullptr;
+}
+
+size_t ClapHostCatalogSnapshot::pluginCount() const {
+    size_t count = 0;
+    for (const auto& entry : bundles) {
+        count += entry.second->plugins.size();
+    }
+    return count;
+}
+
+//
+// Watcher: reports the paths changed in the watched directories.
+// An empty path means notifications were lost and everything has to be checked.
+//
+
+class ClapHostCatalog::Watcher {
+public:
+    Watcher() {
+#ifdef _WIN32
+        wakeEvent = CreateEventA(nullptr, FALSE, FALSE, nullptr);
+#else
+        notifyFd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+        wakeFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+#endif
+    }
+
+    ~Watcher() {
+#ifdef _WIN32
+        for (Directory& directory : watched) {
+            CancelIoEx(directory.handle, &directory.overlapped);
+            DWORD unused = 0;
+            GetOverlappedResult(directory.handle, &directory.overlapped, &unused, TRUE);
+            CloseHandle(directory.handle);
+            CloseHandle(directory.overlapped.hEvent);
+        }
+        CloseHandle(wakeEvent);
+#else
+        close(notifyFd);
+        close(wakeFd);
+#endif
+    }
+
+    // Watches directory, and the directories below it when recursive
+    bool add(const std::string& directory, bool recursive) {
+#ifdef _WIN32
+        if (watched.size() + 1 >= MAXIMUM_WAIT_OBJECTS) {
+            std::cerr << "Too many watched directories: " << directory << std::endl;
+            return false;
+        }
+        Directory entry;
+        entry.path = directory;
+        entry.recursive = recursive;
+        entry.handle = CreateFileW(fs::u8path(directory).wstring().c_str(), FILE_LIST_DIRECTORY,
+                                   FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, nullptr, OPEN_EXISTING,
+                                   FILE_FLAG_BACKUP_SEMANTICS | FILE_FLAG_OVERLAPPED, nullptr);
+        if (entry.handle == INVALID_HANDLE_VALUE) {
+            return false;
+        }
+        entry.overlapped.hEvent = CreateEventA(nullptr, TRUE, FALSE, nullptr);
+        entry.buffer.resize(CATALOG_EVENT_BUFFER / sizeof(DWORD));
+        watched.push_back(std::move(entry));
+        return read_changes(watched.back());
+#else
+        // A time set on its own is reported as IN_MODIFY, not IN_ATTRIB
+        int wd = inotify_add_watch(notifyFd, directory.c_str(),
+                                   IN_MODIFY | IN_CLOSE_WRITE | IN_ATTRIB | IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO | IN_ONLYDIR);
+        if (wd < 0) {
+            return false;
+        }
+        Directory& entry = watched[wd];
+        entry.path = directory;
+        entry.recursive = entry.recursive || recursive;
+        if (recursive) {
+            std::error_code error;
+            for (const fs::directory_entry& child : fs::directory_iterator(fs::u8path(directory), error)) {
+                if (child.is_directory(error) && !child.is_symlink(error)) {
+                    add(child.path().u8string(), true);
+                }
+            }
+        }
+        return true;
+#endif
+    }
+
+    // Waits up to timeoutMs, -1 for ever, and appends the changed paths
+    void wait(int timeoutMs, std::vector<std::string>& changed) {
+#ifdef _WIN32
+        std::vector<HANDLE> handles;
+        handles.push_back(wakeEvent);
+        for (Directory& directory : watched) {
+            handles.push_back(directory.overlapped.hEvent);
+        }
+        DWORD result = WaitForMultipleObjects((DWORD)handles.size(), handles.data(), FALSE,
+                                              timeoutMs < 0 ? INFINITE : (DWORD)timeoutMs);
+        if (result <= WAIT_OBJECT_0 || result >= WAIT_OBJECT_0 + handles.size()) {
+            return;
+        }
+        Directory& directory = watched[result - WAIT_OBJECT_0 - 1];
+        DWORD bytes = 0;
+        if (!GetOverlappedResult(directory.handle, &directory.overlapped, &bytes, FALSE) || bytes == 0) {
+            changed.push_back(std::string());   // the buffer overflowed
+        }
+        for (DWORD offset = 0; bytes > 0;) {
+            auto* info = reinterpret_cast<const FILE_NOTIFY_INFORMATION*>(
+                reinterpret_cast<const char*>(directory.buffer.data()) + offset);
+            std::wstring name(info->FileName, info->FileNameLength / sizeof(WCHAR));
+            changed.push_back((fs::u8path(directory.path) / fs::path(name)).u8string());
+            if (info->NextEntryOffset == 0) {
+                break;
+            }
+            offset += info->NextEntryOffset;
+        }
+        read_changes(directory);
+#else
+        pollfd fds[2] = { { notifyFd, POLLIN, 0 }, { wakeFd, POLLIN, 0 } };
+        if (poll(fds, 2, timeoutMs) <= 0) {
+            return;
+        }
+        uint64_t wakes;
+        if (read(wakeFd, &wakes, sizeof(wakes)) < 0) {
+            // nothing to clear
+        }
+
+        alignas(inotify_event) char buffer[CATALOG_EVENT_BUFFER];
+        for (;;) {
+            ssize_t length = read(notifyFd, buffer, sizeof(buffer));
+            if (length <= 0) {
+                break;
+            }
+            for (ssize_t offset = 0; offset < length;) {
+                const inotify_event* event = reinterpret_cast<const inotify_event*>(buffer + offset);
+                offset += sizeof(inotify_event) + event->len;
+                if (event->mask & IN_Q_OVERFLOW) {
+                    changed.push_back(std::string());
+                    continue;
+                }
+                auto it = watched.find(event->wd);
+                if (it == watched.end() || event->len == 0) {
+                    if (event->mask & IN_IGNORED) {
+                        watched.erase(event->wd);
+                    }
+                    continue;
+                }
+                std::string path = it->second.path + "/" + event->name;
+                changed.push_back(path);
+                if ((event->mask & IN_ISDIR) && (event->mask & (IN_CREATE | IN_MOVED_TO)) && it->second.recursive) {
+                    // Files may have landed in it before the watch was set
+                    add(path, true);
+                    std::error_code error;
+                    for (auto child = fs::recursive_directory_iterator(path, error);
+                         !error && child != fs::recursive_directory_iterator(); child.increment(error)) {
+                        changed.push_back(child->path().u8string());
+                    }
+                }
+            }
+        }
+#endif
+    }
+
+    // Ends a wait() early
+    // [thread-safe]
+    void wake() {
+#ifdef _WIN32
+        SetEvent(wakeEvent);
+#else
+        uint64_t one = 1;
+        if (write(wakeFd, &one, sizeof(one)) < 0) {
+            // already pending
+        }
+#endif
+    }
+
+private:
+    struct Directory {
+        std::string path;
+        bool recursive = false;
+#ifdef _WIN32
+        HANDLE handle = INVALID_HANDLE_VALUE;
+        OVERLAPPED overlapped = {};
+        std::vector<DWORD> buffer;
+#endif
+    };
+
+#ifdef _WIN32
+    bool read_changes(Directory& directory) {
+        ResetEvent(directory.overlapped.hEvent);
+        return ReadDirectoryChangesW(directory.handle, directory.buffer.data(), (DWORD)(directory.buffer.size() * sizeof(DWORD)),
+                                     directory.recursive,
+                                     FILE_NOTIFY_CHANGE_FILE_NAME | FILE_NOTIFY_CHANGE_DIR_NAME | FILE_NOTIFY_CHANGE_SIZE
+                                     | FILE_NOTIFY_CHANGE_LAST_WRITE | FILE_NOTIFY_CHANGE_ATTRIBUTES,
+                                     nullptr, &directory.overlapped, nullptr) != 0;
+    }
+
+    HANDLE wakeEvent = nullptr;
+    std::deque<Directory> watched;      // stable addresses for the pending reads
+#else
+    int notifyFd = -1;
+    int wakeFd = -1;
+    std::map<int, Directory> watched;   // by watch descriptor
+#endif
+};
+
+//
+// ClapHostCatalog
+//
+
+ClapHostCatalog::ClapHostCatalog() : current(std::make_shared<ClapHostCatalogSnapshot>()) {
+}
+
+ClapHostCatalog::~ClapHostCatalog() {
+    stop();
+}
+
+void ClapHostCatalog::addDirectory(const std::string& directory) {
+    directories.push_back(directory);
+}
+
+void ClapHostCatalog::addDefaultDirectories() {
+    if (const char* clapPath = getenv("CLAP_PATH")) {
+        std::string paths = clapPath;
+        for (size_t begin = 0, end; begin <= paths.size(); begin = end + 1) {
+            end = paths.find(CATALOG_PATH_SEPARATOR, begin);
+            end = end == std::string::npos ? paths.size() : end;
+            if (end > begin) {
+                addDirectory(paths.substr(begin, end - begin));
+            }
+        }
+    }
+#ifdef _WIN32
+    if (const char* common = getenv("COMMONPROGRAMFILES")) {
+        addDirectory(std::string(common) + "\\CLAP");
+    }
+    if (const char* local = getenv("LOCALAPPDATA")) {
+        addDirectory(std::string(local) + "\\Programs\\Common\\CLAP");
+    }
+#else
+    if (const char* home = getenv("HOME")) {
+        addDirectory(std::string(home) + "/.clap");
+    }
+    addDirectory("/usr/lib/clap");
+#endif
+}
+
+bool ClapHostCatalog::start() {
+    if (scanner.joinable()) {
+        return true;
+    }
+    stopping = false;
+    watcher.reset(new Watcher());
+    scanner = std::thread(&ClapHostCatalog::run, this);
+    return true;
+}
+
+void ClapHostCatalog::stop() {
+    if (!scanner.joinable()) {
+        return;
+    }
+    stopping = true;
+    watcher->wake();
+    scanner.join();
+    watcher.reset();
+    watchedSources.clear();
+}
+
+void ClapHostCatalog::invalidate(const std::string& bundlePath) {
+    {
+        std::lock_guard<std::mutex> lock(requestMutex);
+        if (bundlePath.empty()) {
+            requestedAll = true;
+        }
+        else {
+            requested.insert(bundlePath);
+        }
+    }
+    if (watcher) {
+        watcher->wake();
+    }
+}
+
+bool ClapHostCatalog::waitForUpdate(uint64_t generation, uint32_t timeoutMs) {
+    std::unique_lock<std::mutex> lock(updateMutex);
+    return updated.wait_for(lock, std::chrono::milliseconds(timeoutMs),
+                            [&]() { return snapshot()->generation > generation; });
+}
+
+void ClapHostCatalog::run() {
+    // Watch first, so nothing changed during the full scan is missed
+    for (const std::string& directory : directories) {
+        watcher->add(directory, true);
+    }
+    rescan({}, {}, true);
+
+    std::vector<std::string> changes;
+    while (!stopping) {
+        changes.clear();
+        watcher->wait(-1, changes);
+        // Let a copy or an installer finish before looking at the files
+        for (size_t seen = SIZE_MAX; !stopping && seen != changes.size();) {
+            seen = changes.size();
+            watcher->wait(CATALOG_SETTLE_MS, changes);
+        }
+
+        std::set<std::string> forced;
+        bool everything = false;
+        {
+            std::lock_guard<std::mutex> lock(requestMutex);
+            forced.swap(requested);
+            everything = requestedAll;
+            requestedAll = false;
+        }
+
+        std::shared_ptr<const ClapHostCatalogSnapshot> previous = snapshot();
+        std::set<std::string> changed;
+        for (const std::string& change : changes) {
+            if (change.empty()) {
+                everything = true;
+                continue;
+            }
+            fs::path path = fs::u8path(change);
+            if (is_bundle(path)) {
+                changed.insert(change);
+            }
+            // A touched invalidation source forces its bundle to be looked at again
+            std::string name = path.filename().u8string();
+            for (const auto& entry : previous->bundles) {
+                for (const ClapHostCatalogSource& source : entry.second->sources) {
+                    if (is_within(path, source.directory, source.recursive) && glob_match(source.glob.c_str(), name.c_str())) {
+                        forced.insert(entry.first);
+                    }
+                }
+            }
+        }
+        if (everything || !changed.empty() || !forced.empty()) {
+            rescan(changed, forced, everything);
+        }
+    }
+}
+
+static std::shared_ptr<const ClapHostCatalogBundle> scan_bundle(const std::string& path, int64_t modified, uint64_t size,
+                                                                 bool invalidated) {
+    auto bundle = std::make_shared<ClapHostCatalogBundle>();
+    bundle->path = path;
+    bundle->modified = modified;
+    bundle->size = size;
+
+    bundle->loaded = scan_clap_module(path.c_str(), [&](const clap_plugin_entry* entry, bool shared) {
+        auto* invalidation = static_cast<const clap_plugin_invalidation_factory*>(
+            entry->get_factory(CLAP_PLUGIN_INVALIDATION_FACTORY_ID));
+        if (invalidation) {
+            // A module loaded only for the scan was initialized afresh and needs no refresh
+            if (shared && invalidated && !invalidation->refresh(invalidation)) {
+                bundle->needsReload = true;
+            }
+            uint32_t count = invalidation->count(invalidation);
+            for (uint32_t i = 0; i < count; i++) {
+                const clap_plugin_invalidation_source* source = invalidation->get(invalidation, i);
+                if (source && source->directory && source->filename_glob) {
+                    bundle->sources.push_back({ source->directory, source->filename_glob, source->recursive_scan });
+                }
+            }
+        }
+
+        auto* factory = static_cast<const clap_plugin_factory*>(entry->get_factory(CLAP_PLUGIN_FACTORY_ID));
+        uint32_t count = factory ? factory->get_plugin_count(factory) : 0;
+        for (uint32_t i = 0; i < count; i++) {
+            const clap_plugin_descriptor* desc = factory->get_plugin_descriptor(factory, i);
+            if (!desc || !desc->id) {
+                continue;
+            }
+            ClapHostCatalogPlugin plugin;
+            plugin.id = desc->id;
+            plugin.name = desc->name ? desc->name : "";
+            plugin.vendor = desc->vendor ? desc->vendor : "";
+            plugin.version = desc->version ? desc->version : "";
+            for (const char* const* feature = desc->features; feature && *feature; feature++) {
+                plugin.features.push_back(*feature);
+            }
+            bundle->plugins.push_back(std::move(plugin));
+        }
+    });
+    return bundle;
+}
+
+void ClapHostCatalog::rescan(const std::set<std::string>& changed, const std::set<std::string>& forced, bool everything) {
+    std::shared_ptr<const ClapHostCatalogSnapshot> previous = snapshot();
+    auto next = std::make_shared<ClapHostCatalogSnapshot>(*previous);
+    next->generation = previous->generation + 1;
+
+    std::set<std::string> candidates = changed;
+    candidates.insert(forced.begin(), forced.end());
+    if (everything) {
+        for (const auto& entry : previous->bundles) {
+            candidates.insert(entry.first);
+        }
+        for (const std::string& directory : directories) {
+            std::error_code error;
+            for (auto it = fs::recursive_directory_iterator(fs::u8path(directory), error);
+                 !error && it != fs::recursive_directory_iterator(); it.increment(error)) {
+                if (is_bundle(it->path()) && it->is_regular_file(error)) {
+                    candidates.insert(it->path().u8string());
+                }
+            }
+        }
+    }
+
+    for (const std::string& path : candidates) {
+        std::error_code error;
+        fs::path file = fs::u8path(path);
+        uint64_t size = fs::file_size(file, error);
+        int64_t modified = error ? 0 : (int64_t)fs::last_write_time(file, error).time_since_epoch().count();
+        if (error) {
+            next->bundles.erase(path);  // removed
+            continue;
+        }
+
+        bool invalidated = forced.count(path) > 0;
+        auto known = next->bundles.find(path);
+        if (!invalidated && known != next->bundles.end()
+            && known->second->modified == modified && known->second->size == size) {
+            continue;   // touched without a change
+        }
+        next->bundles[path] = scan_bundle(path, modified, size, invalidated);
+        watch_sources(*next->bundles[path]);
+    }
+
+    // Lookups by id would otherwise walk every plugin of every bundle
+    next->byPluginId.clear();
+    for (const auto& entry : next->bundles) {
+        for (const ClapHostCatalogPlugin& plugin : entry.second->plugins) {
+            next->byPluginId.emplace(plugin.id, entry.second.get());
+        }
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(updateMutex);
+        std::atomic_store(&current, std::shared_ptr<const ClapHostCatalogSnapshot>(next));
+    }
+    updated.notify_all();
+}
+
+void ClapHostCatalog::watch_sources(const ClapHostCatalogBundle& bundle) {
+    for (const ClapHostCatalogSource& source : bundle.sources) {
+        std::string key = source.directory + (source.recursive ? "/**" : "");
+        if (watchedSources.insert(key).second) {
+            watcher->add(source.directory, source.recursive);
+        }
+    }
+}
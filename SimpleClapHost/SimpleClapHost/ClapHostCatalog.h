@@ -0,0 +1,117 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+#include <clap/clap.h>
+
+// Catalog of the installed plugins, kept current in the background.
+//
+// The first scan loads every bundle under the plugin directories once. After that the
+// directories are watched (inotify on Linux, ReadDirectoryChangesW on Windows), together with
+// the invalidation sources the bundles declare through clap_plugin_invalidation_factory, and
+// only the bundles whose file changed or whose sources were touched are scanned again.
+//
+// Readers take an immutable snapshot; every rescan publishes a new one with a single atomic
+// pointer store, sharing the bundles that did not change with the previous snapshot.
+
+// Quiet time after a change before the rescan starts, so a bundle being copied is scanned once
+#define CATALOG_SETTLE_MS 10
+
+struct ClapHostCatalogPlugin {
+    std::string id;
+    std::string name;
+    std::string vendor;
+    std::string version;
+    std::vector<std::string> features;
+};
+
+struct ClapHostCatalogSource {
+    std::string directory;
+    std::string glob;
+    bool recursive = false;
+};
+
+struct ClapHostCatalogBundle {
+    std::string path;
+    int64_t modified = 0;
+    uint64_t size = 0;
+    bool loaded = false;            // false if the module did not load
+    bool needsReload = false;       // refresh() refused, the process must load the module afresh
+    std::vector<ClapHostCatalogPlugin> plugins;
+    std::vector<ClapHostCatalogSource> sources;
+};
+
+// One consistent state of the catalog, never changed once published
+struct ClapHostCatalogSnapshot {
+    uint64_t generation = 0;
+    std::map<std::string, std::shared_ptr<const ClapHostCatalogBundle>> bundles;   // by path
+    // Bundle of each plugin id, the first in path order when several bundles have it
+    std::map<std::string, const ClapHostCatalogBundle*> byPluginId;
+
+    // Bundle of a plugin id, nullptr if none has it
+    const ClapHostCatalogBundle* find(const char* pluginId) const;
+    size_t pluginCount() const;
+};
+
+class ClapHostCatalog {
+public:
+    ClapHostCatalog();
+    ~ClapHostCatalog();
+
+    ClapHostCatalog(const ClapHostCatalog&) = delete;
+    ClapHostCatalog& operator=(const ClapHostCatalog&) = delete;
+
+    // Directories searched for *.clap bundles, recursively.
+    // [main-thread] before start()
+    void addDirectory(const std::string& directory);
+    // The CLAP_PATH directories, then the standard ones of the platform
+    void addDefaultDirectories();
+
+    // Starts the scanner thread, which publishes the first snapshot after the full scan.
+    // [main-thread]
+    bool start();
+    void stop();
+
+    // Rescans a bundle as if its invalidation sources changed, every bundle without a path.
+    // [thread-safe]
+    void invalidate(const std::string& bundlePath = std::string());
+
+    // [thread-safe]
+    std::shared_ptr<const ClapHostCatalogSnapshot> snapshot() const { return std::atomic_load(&current); }
+
+    // Waits until a snapshot newer than generation is published, false on timeout.
+    // [thread-safe]
+    bool waitForUpdate(uint64_t generation, uint32_t timeoutMs);
+
+private:
+    void run();
+    void rescan(const std::set<std::string>& changed, const std::set<std::string>& forced, bool everything);
+    void watch_sources(const ClapHostCatalogBundle& bundle);
+
+    class Watcher;
+
+    std::vector<std::string> directories;
+    std::unique_ptr<Watcher> watcher;
+    std::thread scanner;
+    std::atomic<bool> stopping{ false };
+
+    std::shared_ptr<const ClapHostCatalogSnapshot> current;
+    std::mutex updateMutex;
+    std::condition_variable updated;
+
+    // Requests of invalidate(), taken by the scanner thread
+    std::mutex requestMutex;
+    std::set<std::string> requested;
+    bool requestedAll = false;
+
+    // [scanner thread] Source directories being watched
+    std::set<std::string> watchedSources;
+};
@@ -0,0 +1,185 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <filesystem>
+#include <iostream>
+#include <mutex>
+#include <thread>
+#include "ClapHostConverter.h"
+#include "ClapHostModule.h"
+#include "ClapHostStateStream.h"
+
+#define CONVERSION_ERROR_SIZE 1024
+
+ClapHostStateConverter::~ClapHostStateConverter() {
+    for (Converter& converter : converters) {
+        if (converter.instance) {
+            converter.instance->destroy(converter.instance);
+        }
+    }
+}
+
+bool ClapHostStateConverter::addModule(const char* modulePath) {
+    const clap_plugin_entry* entry = get_clap_entry(modulePath);
+    if (!entry) {
+        return false;
+    }
+    auto* factory = static_cast<const clap_plugin_state_converter_factory*>(
+        entry->get_factory(CLAP_PLUGIN_STATE_CONVERTER_FACTORY_ID));
+    uint32_t count = factory ? factory->count(factory) : 0;
+    if (count == 0) {
+        std::cerr << "The module has no state converters: " << modulePath << std::endl;
+        return false;
+    }
+    for (uint32_t i = 0; i < count; i++) {
+        const clap_plugin_state_converter_descriptor* desc = factory->get_descriptor(factory, i);
+        if (desc && desc->id && desc->src_plugin_id.abi && desc->src_plugin_id.id
+            && desc->dst_plugin_id.abi && desc->dst_plugin_id.id) {
+            converters.push_back({ factory, desc, nullptr });
+        }
+    }
+    return true;
+}
+
+ClapHostConversionReport ClapHostStateConverter::convert(const char* sourceDir, const char* destinationDir, uint32_t numThreads) {
+    namespace fs = std::filesystem;
+    struct Job {
+        clap_plugin_state_converter* converter;
+        fs::path source;
+        fs::path destination;
+    };
+    std::vector<Job> jobs;
+    ClapHostConversionReport report;
+    auto started = std::chrono::steady_clock::now();
+
+    // <source>/<abi>/<plugin id>/...
+    std::error_code abiError, pluginError, error;
+    fs::path sourceRoot = fs::u8path(sourceDir);
+    fs::path destinationRoot = fs::u8path(destinationDir);
+    for (const fs::directory_entry& abi : fs::directory_iterator(sourceRoot, abiError)) {
+        for (const fs::directory_entry& plugin : fs::directory_iterator(abi.path(), pluginError)) {
+            std::string abiName = abi.path().filename().u8string();
+            std::string pluginId = plugin.path().filename().u8string();
+            Converter* match = nullptr;
+            for (Converter& converter : converters) {
+                if (abiName == converter.desc->src_plugin_id.abi && pluginId == converter.desc->src_plugin_id.id) {
+                    match = &converter;
+                    break;
+                }
+            }
+            if (match && !match->instance) {
+                match->instance = match->factory->create(match->factory, match->desc->id);
+            }
+
+            fs::path target = destinationRoot;
+            if (match) {
+                target /= fs::u8path(match->desc->dst_plugin_id.abi);
+                target /= fs::u8path(match->desc->dst_plugin_id.id);
+            }
+            for (auto it = fs::recursive_directory_iterator(plugin.path(), error);
+                 !error && it != fs::recursive_directory_iterator(); it.increment(error)) {
+                if (!it->is_regular_file(error)) {
+                    continue;
+                }
+                if (!match || !match->instance) {
+                    report.skipped++;
+                    continue;
+                }
+                jobs.push_back({ match->instance, it->path(), target / it->path().lexically_relative(plugin.path()) });
+            }
+        }
+    }
+
+    std::atomic<size_t> next{ 0 };
+    std::atomic<uint32_t> converted{ 0 };
+    std::atomic<uint64_t> bytesRead{ 0 };
+    std::atomic<uint64_t> bytesWritten{ 0 };
+    std::mutex failures;
+    auto fail = [&](const Job& job, const char* message) {
+        std::lock_guard<std::mutex> lock(failures);
+        if (report.errors.size() < CONVERSION_ERRORS_KEPT) {
+            report.errors.push_back(job.source.u8string() + ": " + message);
+        }
+        report.failed++;
+    };
+
+    auto worker = [&]() {
+        char message[CONVERSION_ERROR_SIZE];
+        for (size_t j = next++; j < jobs.size(); j = next++) {
+            const Job& job = jobs[j];
+            std::error_code created;
+            fs::create_directories(job.destination.parent_path(), created);
+
+            ClapHostStateReader reader(job.source.u8string().c_str());
+            if (!reader.isOpen()) {
+                fail(job, "cannot be read");
+                continue;
+            }
+            ClapHostStateWriter writer(job.destination.u8string().c_str());
+            message[0] = '\0';
+            if (!job.converter->convert_state(job.converter, reader.stream(), writer.stream(), message, sizeof(message))) {
+                message[sizeof(message) - 1] = '\0';
+                fail(job, message[0] ? message : "conversion failed");
+                continue;
+            }
+            if (!writer.finish()) {
+                fail(job, "cannot write the converted state");
+                continue;
+            }
+            converted++;
+            bytesRead += reader.size();
+            bytesWritten += writer.written();
+        }
+    };
+
+    numThreads = std::max<uint32_t>(1, std::min<uint32_t>(numThreads, (uint32_t)jobs.size()));
+    std::vector<std::thread> workers;
+    for (uint32_t i = 1; i < numThreads; i++) {
+        workers.emplace_back(worker);
+    }
+    worker();
+    for (std::thread& thread : workers) {
+        thread.join();
+    }
+
+    report.converted = converted;
+    report.bytesRead = bytesRead;
+    report.bytesWritten = bytesWritten;
+    report.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count();
+    return report;
+}
+
+int run_state_conversion(int ac, char** av) {
+    if (ac < 3) {
+        std::cout << "Usage : convert <source dir> <destination dir> <converter module>..." << std::endl;
+        std::cout << "  States are read from <source dir>/<abi>/<plugin id>/" << std::endl;
+        return 1;
+    }
+
+    ClapHostStateConverter converter;
+    for (int i = 2; i < ac; i++) {
+        converter.addModule(av[i]);
+    }
+    if (converter.converterCount() == 0) {
+        std::cerr << "No state converters." << std::endl;
+        return 1;
+    }
+
+    unsigned cores = std::thread::hardware_concurrency();
+    ClapHostConversionReport report = converter.convert(av[0], av[1], cores > 0 ? cores : 1);
+
+    double seconds = report.seconds > 0 ? report.seconds : 1e-9;
+    std::cout << "Converted " << report.converted << " states, " << report.failed << " failed, "
+              << report.skipped << " without a converter" << std::endl;
+    std::cout << report.bytesRead / 1024 << " KiB read, " << report.bytesWritten / 1024 << " KiB written in "
+              << report.seconds << " s: " << (uint64_t)(report.converted / seconds) << " states/s, "
+              << (uint64_t)(report.bytesRead / seconds / (1024 * 1024)) << " MiB/s" << std::endl;
+    for (const std::string& error : report.errors) {
+        std::cerr << "  " << error << std::endl;
+    }
+    if (report.failed > report.errors.size()) {
+        std::cerr << "  and " << report.failed - report.errors.size() << " more" << std::endl;
+    }
+    return report.failed == 0 ? 0 : 1;
+}
@@ -0,0 +1,60 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <clap/clap.h>
+#include <clap/factory/draft/plugin-state-converter.h>
+
+// Batch migration of saved plugin states through clap_plugin_state_converter_factory.
+//
+// The source directory holds the states of each plugin under <abi>/<plugin id>/. Every state
+// there goes through the converter whose src_plugin_id matches, and is written to the same
+// relative path under <abi>/<plugin id>/ of its dst_plugin_id in the destination directory.
+// Workers stream one state at a time from a mapped source into a buffered temporary file, so
+// memory use does not grow with the number or the size of the states. convert_state() is
+// thread-safe, so the workers share one converter per source plugin.
+
+// Failure messages kept in a report; the rest are only counted
+#define CONVERSION_ERRORS_KEPT 20
+
+struct ClapHostConversionReport {
+    uint32_t converted = 0;
+    uint32_t failed = 0;
+    uint32_t skipped = 0;           // states of plugins without a converter
+    uint64_t bytesRead = 0;
+    uint64_t bytesWritten = 0;
+    double seconds = 0;
+    std::vector<std::string> errors;    // "path: message"
+};
+
+class ClapHostStateConverter {
+public:
+    ClapHostStateConverter() = default;
+    ~ClapHostStateConverter();
+
+    ClapHostStateConverter(const ClapHostStateConverter&) = delete;
+    ClapHostStateConverter& operator=(const ClapHostStateConverter&) = delete;
+
+    // Registers the converters of a module, false if it has none.
+    // [main-thread]
+    bool addModule(const char* modulePath);
+
+    size_t converterCount() const { return converters.size(); }
+
+    // Converts every state under sourceDir with numThreads workers.
+    // [main-thread]
+    ClapHostConversionReport convert(const char* sourceDir, const char* destinationDir, uint32_t numThreads);
+
+private:
+    struct Converter {
+        const clap_plugin_state_converter_factory* factory;
+        const clap_plugin_state_converter_descriptor* desc;
+        clap_plugin_state_converter* instance;      // created by the first conversion
+    };
+    std::vector<Converter> converters;
+};
+
+// Command line front end: <source dir> <destination dir> <converter module>...
+// Prints the report and returns the process exit code.
+int run_state_conversion(int ac, char** av);
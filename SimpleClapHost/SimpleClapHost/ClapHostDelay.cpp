@@ -0,0 +1,44 @@
+#include <algorithm>
+#include <cstring>
+#include "ClapHostDelay.h"
+
+void ClapHostDelay::prepare(uint32_t numLines, uint32_t maxDelay, uint32_t maxFrames) {
+    lineSize = 1;
+    while (lineSize < maxDelay + maxFrames) {
+        lineSize <<= 1;
+    }
+    maxDelaySamples = maxDelay;
+
+    arena.assign((size_t)numLines * lineSize, 0.0f);
+    lines.assign(numLines, Line());
+    for (uint32_t i = 0; i < numLines; i++) {
+        lines[i].offset = (size_t)i * lineSize;
+    }
+}
+
+void ClapHostDelay::setDelay(uint32_t line, uint32_t delay) {
+    lines[line].delay = std::min(delay, maxDelaySamples);
+}
+
+void ClapHostDelay::clear(uint32_t line) {
+    memset(&arena[lines[line].offset], 0, sizeof(float) * lineSize);
+}
+
+void ClapHostDelay::process(uint32_t line, float* data, uint32_t frames) {
+    Line& l = lines[line];
+    float* ring = &arena[l.offset];
+    uint32_t mask = lineSize - 1;
+
+    // Write first: with a delay shorter than the block the read overlaps what was just written
+    uint32_t first = std::min(frames, lineSize - l.pos);
+    memcpy(ring + l.pos, data, sizeof(float) * first);
+    memcpy(ring, data + first, sizeof(float) * (frames - first));
+
+    if (l.delay > 0) {
+        uint32_t start = (l.pos - l.delay) & mask;
+        first = std::min(frames, lineSize - start);
+        memcpy(data, ring + start, sizeof(float) * first);
+        memcpy(data + first, ring, sizeof(float) * (frames - first));
+    }
+    l.pos = (l.pos + frames) & mask;
+}
@@ -0,0 +1,41 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Ring-buffer delay lines used for plugin delay compensation.
+//
+// All lines live in one arena allocated by prepare(), each sized to the next power of two above
+// maxDelay + maxFrames. Lines keep recording their input even with no delay, so raising the delay
+// later reads real history instead of silence.
+class ClapHostDelay {
+public:
+    // [main-thread & stream stopped]
+    void prepare(uint32_t numLines, uint32_t maxDelay, uint32_t maxFrames);
+
+    // Delays are clamped to maxDelay.
+    // [audio-thread]
+    void setDelay(uint32_t line, uint32_t delay);
+    uint32_t delay(uint32_t line) const { return lines[line].delay; }
+    uint32_t maxDelay() const { return maxDelaySamples; }
+    void clear(uint32_t line);
+
+    // Delays data in place, frames must not exceed maxFrames.
+    // [audio-thread]
+    void process(uint32_t line, float* data, uint32_t frames);
+
+    size_t memoryUsed() const { return arena.size() * sizeof(float); }
+
+private:
+    struct Line {
+        size_t offset = 0;
+        uint32_t delay = 0;
+        uint32_t pos = 0;
+    };
+
+    std::vector<float> arena;
+    std::vector<Line> lines;
+    uint32_t lineSize = 0;
+    uint32_t maxDelaySamples = 0;
+};
@@ -0,0 +1,312 @@
+#ifdef _WIN32
+#include <Windows.h>
+#endif
+#ifdef __linux__
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/timerfd.h>
+#endif
+#include <algorithm>
+#include "ClapHostEventLoop.h"
+
+// Shortest timer period, plugins asking for less get this
+#define EVENT_LOOP_MIN_PERIOD_MS 1
+
+// Timer ids are (generation << TIMER_INDEX_BITS) | slot, which never reaches CLAP_INVALID_ID
+#define TIMER_INDEX_BITS 20
+#define TIMER_INDEX_MASK ((1u << TIMER_INDEX_BITS) - 1)
+#define TIMER_GENERATION_MASK 0x7ffu
+#define FD_GENERATION_MASK 0xffffffu
+
+#ifdef __linux__
+// epoll data: kind in the top byte, then the generation of the timer or fd, then the slot or fd
+enum { EVENT_WAKE = 0, EVENT_TIMER = 1, EVENT_FD = 2 };
+
+static uint64_t event_data(uint64_t kind, uint32_t generation, uint32_t index) {
+    return (kind << 56) | ((uint64_t)generation << 32) | index;
+}
+
+static uint32_t epoll_flags(clap_posix_fd_flags_t flags) {
+    uint32_t events = 0;
+    if (flags & CLAP_POSIX_FD_READ) {
+        events |= EPOLLIN;
+    }
+    if (flags & CLAP_POSIX_FD_WRITE) {
+        events |= EPOLLOUT;
+    }
+    if (flags & CLAP_POSIX_FD_ERROR) {
+        events |= EPOLLERR;
+    }
+    return events;
+}
+
+static clap_posix_fd_flags_t clap_fd_flags(uint32_t events) {
+    clap_posix_fd_flags_t flags = 0;
+    if (events & (EPOLLIN | EPOLLHUP)) {
+        flags |= CLAP_POSIX_FD_READ;
+    }
+    if (events & EPOLLOUT) {
+        flags |= CLAP_POSIX_FD_WRITE;
+    }
+    if (events & EPOLLERR) {
+        flags |= CLAP_POSIX_FD_ERROR;
+    }
+    return flags;
+}
+#endif
+
+ClapHostEventLoop::ClapHostEventLoop() {
+#ifdef __linux__
+    epollFd = epoll_create1(EPOLL_CLOEXEC);
+    wakeFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    epoll_event ev = {};
+    ev.events = EPOLLIN;
+    ev.data.u64 = event_data(EVENT_WAKE, 0, 0);
+    epoll_ctl(epollFd, EPOLL_CTL_ADD, wakeFd, &ev);
+#else
+    wakeEvent = CreateEventA(nullptr, FALSE, FALSE, nullptr);
+#endif
+}
+
+ClapHostEventLoop::~ClapHostEventLoop() {
+#ifdef __linux__
+    for (Timer& timer : timers) {
+        if (timer.fd >= 0) {
+            ::close(timer.fd);
+        }
+    }
+    ::close(wakeFd);
+    ::close(epollFd);
+#else
+    CloseHandle(wakeEvent);
+#endif
+}
+
+bool ClapHostEventLoop::addTimer(uint32_t periodMs, TimerHandler handler, void* context, clap_id* timerId) {
+    periodMs = std::max<uint32_t>(periodMs, EVENT_LOOP_MIN_PERIOD_MS);
+
+    uint32_t index;
+    if (!freeTimers.empty()) {
+        index = freeTimers.back();
+        freeTimers.pop_back();
+    }
+    else if (timers.size() <= TIMER_INDEX_MASK) {
+        index = (uint32_t)timers.size();
+        timers.emplace_back();
+    }
+    else {
+        return false;
+    }
+
+    Timer& timer = timers[index];
+    timer.handler = handler;
+    timer.context = context;
+    timer.periodMs = periodMs;
+    timer.generation = (timer.generation + 1) & TIMER_GENERATION_MASK;
+
+#ifdef __linux__
+    timer.fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    itimerspec spec = {};
+    spec.it_interval.tv_sec = periodMs / 1000;
+    spec.it_interval.tv_nsec = (long)(periodMs % 1000) * 1000000;
+    spec.it_value = spec.it_interval;
+    epoll_event ev = {};
+    ev.events = EPOLLIN;
+    ev.data.u64 = event_data(EVENT_TIMER, timer.generation, index);
+    if (timer.fd < 0 || timerfd_settime(timer.fd, 0, &spec, nullptr) != 0
+        || epoll_ctl(epollFd, EPOLL_CTL_ADD, timer.fd, &ev) != 0) {
+        if (timer.fd >= 0) {
+            ::close(timer.fd);
+        }
+        timer = Timer{ nullptr, nullptr, 0, timer.generation, -1, {} };
+        freeTimers.push_back(index);
+        return false;
+    }
+#else
+    timer.due = std::chrono::steady_clock::now() + std::chrono::milliseconds(periodMs);
+    schedule.push({ timer.due, index, timer.generation });
+#endif
+
+    *timerId = (timer.generation << TIMER_INDEX_BITS) | index;
+    return true;
+}
+
+bool ClapHostEventLoop::removeTimer(clap_id timerId, void* context) {
+    uint32_t index = timerId & TIMER_INDEX_MASK;
+    if (timerId == CLAP_INVALID_ID || index >= timers.size()) {
+        return false;
+    }
+    Timer& timer = timers[index];
+    if (!timer.handler || timer.context != context || timer.generation != (timerId >> TIMER_INDEX_BITS)) {
+        return false;
+    }
+
+#ifdef __linux__
+    epoll_ctl(epollFd, EPOLL_CTL_DEL, timer.fd, nullptr);
+    ::close(timer.fd);
+    timer.fd = -1;
+#endif
+    // Entries left in the Windows schedule are skipped by their generation
+    timer.handler = nullptr;
+    timer.context = nullptr;
+    freeTimers.push_back(index);
+    return true;
+}
+
+bool ClapHostEventLoop::addFd(int fd, clap_posix_fd_flags_t flags, FdHandler handler, void* context) {
+#ifdef __linux__
+    if (fd < 0) {
+        return false;
+    }
+    if ((size_t)fd >= fds.size()) {
+        fds.resize((size_t)fd + 1);
+    }
+    if (fds[fd].handler) {
+        return false;
+    }
+    uint32_t generation = (fds[fd].generation + 1) & FD_GENERATION_MASK;
+    epoll_event ev = {};
+    ev.events = epoll_flags(flags);
+    ev.data.u64 = event_data(EVENT_FD, generation, (uint32_t)fd);
+    if (epoll_ctl(epollFd, EPOLL_CTL_ADD, fd, &ev) != 0) {
+        return false;
+    }
+    fds[fd] = { handler, context, flags, generation };
+    return true;
+#else
+    (void)fd;
+    (void)flags;
+    (void)handler;
+    (void)context;
+    return false;
+#endif
+}
+
+bool ClapHostEventLoop::modifyFd(int fd, clap_posix_fd_flags_t flags, void* context) {
+#ifdef __linux__
+    if (fd < 0 || (size_t)fd >= fds.size() || !fds[fd].handler || fds[fd].context != context) {
+        return false;
+    }
+    epoll_event ev = {};
+    ev.events = epoll_flags(flags);
+    ev.data.u64 = event_data(EVENT_FD, fds[fd].generation, (uint32_t)fd);
+    if (epoll_ctl(epollFd, EPOLL_CTL_MOD, fd, &ev) != 0) {
+        return false;
+    }
+    fds[fd].flags = flags;
+    return true;
+#else
+    (void)fd;
+    (void)flags;
+    (void)context;
+    return false;
+#endif
+}
+
+bool ClapHostEventLoop::removeFd(int fd, void* context) {
+#ifdef __linux__
+    if (fd < 0 || (size_t)fd >= fds.size() || !fds[fd].handler || fds[fd].context != context) {
+        return false;
+    }
+    epoll_ctl(epollFd, EPOLL_CTL_DEL, fd, nullptr);
+    fds[fd] = { nullptr, nullptr, 0, fds[fd].generation };
+    return true;
+#else
+    (void)fd;
+    (void)context;
+    return false;
+#endif
+}
+
+void ClapHostEventLoop::removeAll(void* context) {
+    for (size_t i = 0; i < timers.size(); i++) {
+        if (timers[i].handler && timers[i].context == context) {
+            removeTimer((timers[i].generation << TIMER_INDEX_BITS) | (uint32_t)i, context);
+        }
+    }
+    for (size_t fd = 0; fd < fds.size(); fd++) {
+        if (fds[fd].handler && fds[fd].context == context) {
+            removeFd((int)fd, context);
+        }
+    }
+}
+
+void ClapHostEventLoop::wakeUp() {
+#ifdef __linux__
+    uint64_t one = 1;
+    ssize_t written = ::write(wakeFd, &one, sizeof(one));
+    (void)written;
+#else
+    SetEvent(wakeEvent);
+#endif
+}
+
+int ClapHostEventLoop::run(int timeoutMs) {
+    int dispatched = 0;
+
+#ifdef __linux__
+    epoll_event events[64];
+    int count = epoll_wait(epollFd, events, 64, timeoutMs);
+    for (int i = 0; i < count; i++) {
+        uint64_t data = events[i].data.u64;
+        uint32_t kind = (uint32_t)(data >> 56);
+        uint32_t generation = (uint32_t)(data >> 32) & 0xffffff;
+        uint32_t index = (uint32_t)data;
+
+        if (kind == EVENT_WAKE) {
+            uint64_t value;
+            ssize_t n = ::read(wakeFd, &value, sizeof(value));
+            (void)n;
+        }
+        else if (kind == EVENT_TIMER) {
+            // An earlier handler of this batch may have removed the timer
+            if (index >= timers.size() || !timers[index].handler || timers[index].generation != generation) {
+                continue;
+            }
+            uint64_t expirations;
+            ssize_t n = ::read(timers[index].fd, &expirations, sizeof(expirations));
+            (void)n;
+            timers[index].handler(timers[index].context, (generation << TIMER_INDEX_BITS) | index);
+            dispatched++;
+        }
+        else if (index < fds.size() && fds[index].handler && fds[index].generation == generation) {
+            // An fd removed and registered again by an earlier handler is reported next time
+            fds[index].handler(fds[index].context, (int)index, clap_fd_flags(events[i].events));
+            dispatched++;
+        }
+    }
+#else
+    using namespace std::chrono;
+
+    // Drop entries of removed timers so the wait is computed from a live one
+    while (!schedule.empty() && (!timers[schedule.top().index].handler
+                                 || timers[schedule.top().index].generation != schedule.top().generation)) {
+        schedule.pop();
+    }
+
+    DWORD wait = timeoutMs < 0 ? INFINITE : (DWORD)timeoutMs;
+    if (!schedule.empty()) {
+        auto untilDue = duration_cast<milliseconds>(schedule.top().due - steady_clock::now()).count();
+        wait = std::min<DWORD>(wait, untilDue > 0 ? (DWORD)untilDue : 0);
+    }
+    WaitForSingleObject(wakeEvent, wait);
+
+    auto now = steady_clock::now();
+    while (!schedule.empty() && schedule.top().due <= now) {
+        Due entry = schedule.top();
+        schedule.pop();
+        Timer& timer = timers[entry.index];
+        if (!timer.handler || timer.generation != entry.generation) {
+            continue;
+        }
+        // Skip missed periods instead of firing them in a burst
+        timer.due = std::max(entry.due + milliseconds(timer.periodMs), now);
+        schedule.push({ timer.due, entry.index, entry.generation });
+        timer.handler(timer.context, (entry.generation << TIMER_INDEX_BITS) | entry.index);
+        dispatched++;
+    }
+#endif
+
+    return dispatched;
+}
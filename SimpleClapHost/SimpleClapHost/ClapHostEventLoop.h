@@ -0,0 +1,83 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <queue>
+#include <vector>
+#include <clap/clap.h>
+
+// Main-thread reactor behind clap_host_timer_support and clap_host_posix_fd_support.
+//
+// On Linux every timer is a timerfd and every registration sits in one epoll set whose event data
+// points straight at its record, so dispatch costs the same with ten or ten thousand timers.
+// Elsewhere timers are kept in a min-heap and fds are not supported.
+//
+// Records are stored in vectors with a free list; a timer id encodes its slot, and fds index
+// their own table, so register, unregister and dispatch never search.
+class ClapHostEventLoop {
+public:
+    typedef void (*TimerHandler)(void* context, clap_id timerId);
+    typedef void (*FdHandler)(void* context, int fd, clap_posix_fd_flags_t flags);
+
+    ClapHostEventLoop();
+    ~ClapHostEventLoop();
+
+    ClapHostEventLoop(const ClapHostEventLoop&) = delete;
+    ClapHostEventLoop& operator=(const ClapHostEventLoop&) = delete;
+
+    // [main-thread]
+    bool addTimer(uint32_t periodMs, TimerHandler handler, void* context, clap_id* timerId);
+    bool removeTimer(clap_id timerId, void* context);
+
+    bool addFd(int fd, clap_posix_fd_flags_t flags, FdHandler handler, void* context);
+    bool modifyFd(int fd, clap_posix_fd_flags_t flags, void* context);
+    bool removeFd(int fd, void* context);
+
+    // Drops every timer and fd registered with this context
+    void removeAll(void* context);
+
+    // Waits up to timeoutMs (-1 for ever) and dispatches what is ready.
+    // Returns the number of handlers called.
+    int run(int timeoutMs);
+
+    // Makes a blocked run() return.
+    // [thread-safe]
+    void wakeUp();
+
+    size_t timerCount() const { return timers.size() - freeTimers.size(); }
+
+private:
+    struct Timer {
+        TimerHandler handler = nullptr;
+        void* context = nullptr;
+        uint32_t periodMs = 0;
+        uint32_t generation = 0;
+        int fd = -1;                        // timerfd on Linux
+        std::chrono::steady_clock::time_point due;
+    };
+
+    struct Fd {
+        FdHandler handler = nullptr;
+        void* context = nullptr;
+        clap_posix_fd_flags_t flags = 0;
+        uint32_t generation = 0;            // kept when removed, so a new registration differs
+    };
+
+    std::vector<Timer> timers;
+    std::vector<uint32_t> freeTimers;
+    std::vector<Fd> fds;                    // indexed by fd
+
+#ifdef __linux__
+    int epollFd = -1;
+    int wakeFd = -1;
+#else
+    struct Due {
+        std::chrono::steady_clock::time_point due;
+        uint32_t index;
+        uint32_t generation;
+        bool operator>(const Due& other) const { return due > other.due; }
+    };
+    std::priority_queue<Due, std::vector<Due>, std::greater<Due>> schedule;
+    void* wakeEvent = nullptr;
+#endif
+};
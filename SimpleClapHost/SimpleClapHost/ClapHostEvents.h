@@ -0,0 +1,208 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <initializer_list>
+#include <vector>
+#include <clap/clap.h>
+
+// Capacity of the per-instance parameter change queue, a power of 2
+#define CLAP_PARAM_QUEUE_SIZE 256
+// Parameters one hand-over of the output channel can carry, a power of 2; the table has twice
+// as many slots
+#define CLAP_OUTPUT_PARAM_SLOTS 1024
+// Ended notes one hand-over of the output channel can carry
+#define CLAP_OUTPUT_NOTE_ENDS 256
+// Lists one merge() can take at once
+#define CLAP_MERGE_MAX_LISTS 16
+
+// Input event list handed to process() and clap_plugin_params::flush().
+//
+// Events of any size are copied one after the other into an arena sized by reserve(), and an
+// index array points at them; clear() only resets the arena's bump pointer and the index, so the
+// audio thread fills the list every block without allocating. push() fails once it is full.
+// refer() takes an event without copying it, for a source whose events outlive the list's use:
+// the lists of the block's event sources, valid until their next process(), or the list a
+// process() call was given.
+//
+// Events may be pushed in any order. Each index entry holds the event's time above its position
+// in push order, which looks up where the event is, so sorting the entries as integers orders
+// the events by time and keeps the push order of events at the same time. The index is sorted by list(),
+// only when an event went in out of order: by insertion for a few events, otherwise by a radix
+// sort on the bytes of the time, which the block length keeps to two or three passes.
+//
+// Event sources which are each in time order are better merged than appended: merge() does a
+// k-way merge over a small heap of the next event time of each list, and takes the events in
+// time order straight into the list, which then needs no sorting. A heap key holds the time
+// above the list's position in the call, so at equal times the lists go in the order they are
+// given, and each list's events keep their own order, the same every block. Lists with many
+// events between them are appended instead: the radix sort of list() gives the same order with
+// less work per event than the heap.
+class ClapHostInputEvents {
+public:
+    ClapHostInputEvents();
+
+    ClapHostInputEvents(const ClapHostInputEvents&) = delete;
+    ClapHostInputEvents& operator=(const ClapHostInputEvents&) = delete;
+
+    // [main-thread]
+    void reserve(uint32_t maxEvents, uint32_t maxBytes);
+
+    bool push(const clap_event_header* event);
+    // Takes the event itself, which must stay valid as long as the list is used
+    bool refer(const clap_event_header* event);
+    // Appends every event of another list, returns false if some did not fit.
+    // Referring takes the events as refer() does instead of copying them.
+    bool append(const clap_input_events* events, bool referring = false);
+    // Appends the events of time ordered lists in time order, at equal times in the order of the
+    // lists, returns false if some did not fit. Null lists are skipped.
+    bool merge(std::initializer_list<const clap_input_events*> lists, bool referring = false);
+    bool merge(const clap_input_events* first, const clap_input_events* second, bool referring = false) {
+        return merge({ first, second }, referring);
+    }
+    void clear();
+
+    uint32_t size() const { return (uint32_t)index.size(); }
+    // The event at a position in time order, the list must be sorted, see list()
+    const clap_event_header* get(uint32_t position) const;
+    // Sorts the events by time if needed, the list is valid until the next change
+    const clap_input_events* list() const;
+
+private:
+    bool add(const clap_event_header* event, bool referring) { return referring ? refer(event) : push(event); }
+
+    static uint32_t CLAP_ABI events_size(const clap_input_events* list);
+    static const clap_event_header* CLAP_ABI events_get(const clap_input_events* list, uint32_t position);
+
+    clap_input_events events;
+    std::vector<uint64_t> arena;        // 8-byte aligned event copies
+    std::vector<const clap_event_header*> taken;    // in push order: the copy, or the event referred to
+    mutable std::vector<uint64_t> index;   // time << 32 | position in taken
+    mutable std::vector<uint64_t> scratch;  // radix sort buffer, as large as the index
+    mutable bool sorted = true;
+    uint32_t used = 0;
+    mutable uint32_t lastTime = 0;     // of the last event in index order
+    uint32_t maxTime = 0;
+};
+
+// Output event list of one plugin instance.
+//
+// try_push() copies the event into an arena sized by reserve(), the same storage the input list
+// uses, and refuses it once the arena is full; nothing is allocated while processing.
+// The events stay readable until clear().
+class ClapHostOutputEvents {
+public:
+    ClapHostOutputEvents();
+
+    ClapHostOutputEvents(const ClapHostOutputEvents&) = delete;
+    ClapHostOutputEvents& operator=(const ClapHostOutputEvents&) = delete;
+
+    // [main-thread]
+    void reserve(uint32_t maxEvents, uint32_t maxBytes) { store.reserve(maxEvents, maxBytes); }
+
+    void clear() { store.clear(); }
+    uint32_t size() const { return store.size(); }
+    const clap_event_header* get(uint32_t position) const { return store.get(position); }
+    const clap_output_events* list() const { return &events; }
+
+private:
+    static bool CLAP_ABI events_try_push(const clap_output_events* list, const clap_event_header* event);
+
+    clap_output_events events;
+    ClapHostInputEvents store;
+};
+
+// Parameter changes and gestures the plugin reported, merged per parameter
+struct ClapHostParamUpdate {
+    clap_id paramId = CLAP_INVALID_ID;
+    bool hasValue = false;
+    double value = 0;
+    bool hasGesture = false;
+    bool isBegin = false;       // of the last gesture event
+};
+
+struct ClapHostNoteEnd {
+    int16_t port;
+    int16_t channel;
+    int16_t key;
+    int32_t noteId;
+};
+
+// Hands what the plugin reported in its output events to the main thread.
+//
+// The producer merges the parameter events of each block into a batch, one entry per parameter
+// id: the latest value, and the latest gesture state, as the engine-to-app queue of plugin-host.hh
+// reduces them. Ended notes are kept in order. When the main thread is done with the previous
+// batch, the filled one is handed over with a pointer swap between two fixed batches; until then
+// the producer keeps merging into the same one, so a main thread running late loses
+// intermediate values but never the latest. Single producer, single consumer, no allocation.
+class ClapHostOutputChannel {
+public:
+    // Takes the parameter and note end events of a block and hands them over if it can.
+    // [audio-thread, or main-thread while inactive]
+    void collect(const ClapHostOutputEvents& events);
+
+    // Calls onParam(const ClapHostParamUpdate&) and onNoteEnd(const ClapHostNoteEnd&) for the
+    // batch handed over, if any. Returns the number of events which did not fit in the batch.
+    // [main-thread]
+    template <typename ParamFn, typename NoteEndFn>
+    uint32_t consume(ParamFn onParam, NoteEndFn onNoteEnd);
+
+private:
+    struct Batch {
+        ClapHostParamUpdate slots[2 * CLAP_OUTPUT_PARAM_SLOTS];    // open addressing by id
+        uint32_t order[CLAP_OUTPUT_PARAM_SLOTS] = {};               // used slots, by first update
+        uint32_t paramCount = 0;
+        ClapHostNoteEnd noteEnds[CLAP_OUTPUT_NOTE_ENDS] = {};
+        uint32_t noteEndCount = 0;
+        uint32_t dropped = 0;
+
+        ClapHostParamUpdate* find(clap_id paramId);
+        void reset();
+    };
+
+    Batch batches[2];
+    Batch* filling = &batches[0];                       // owned by the producer
+    std::atomic<Batch*> ready{ nullptr };               // handed over, until consumed
+    std::atomic<Batch*> spare{ &batches[1] };           // consumed, for the producer to fill next
+};
+
+template <typename ParamFn, typename NoteEndFn>
+uint32_t ClapHostOutputChannel::consume(ParamFn onParam, NoteEndFn onNoteEnd) {
+    Batch* batch = ready.load(std::memory_order_acquire);
+    if (!batch) {
+        return 0;
+    }
+    for (uint32_t i = 0; i < batch->paramCount; i++) {
+        onParam(batch->slots[batch->order[i]]);
+    }
+    for (uint32_t i = 0; i < batch->noteEndCount; i++) {
+        onNoteEnd(batch->noteEnds[i]);
+    }
+    uint32_t dropped = batch->dropped;
+    batch->reset();
+
+    // The spare goes back first, the producer looks at it once it sees nothing is ready
+    spare.store(batch, std::memory_order_release);
+    ready.store(nullptr, std::memory_order_release);
+    return dropped;
+}
+
+// Parameter changes from the main thread to whichever thread delivers them to the plugin:
+// the audio thread while the instance is active, the main thread while it is not.
+// Single producer, single consumer, fixed size.
+class ClapHostParamQueue {
+public:
+    // [main-thread]
+    bool push(clap_id paramId, double value);
+
+    // The oldest change, nullptr when empty. pop() drops it once it has been delivered.
+    // [audio-thread, or main-thread while inactive]
+    const clap_event_param_value* front() const;
+    void pop();
+
+private:
+    clap_event_param_value changes[CLAP_PARAM_QUEUE_SIZE] = {};
+    std::atomic<uint32_t> head{ 0 };    // written by the producer
+    std::atomic<uint32_t> tail{ 0 };    // written by the consumer
+};
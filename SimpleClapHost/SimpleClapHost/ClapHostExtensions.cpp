@@ -0,0 +1,492 @@
+#include <array>
+#include <cstring>
+#include <thread>
+#include "ClapHost.h"
+#include "ClapHostEventLoop.h"
+#include "ClapHostExtensions.h"
+#include "ClapHostThreadPool.h"
+#include "ClapHostTransport.h"
+#include "ClapHostTuning.h"
+#include "ClapHostUndo.h"
+
+static const std::thread::id mainThreadId = std::this_thread::get_id();
+static thread_local bool isAudioThread = false;
+static ClapHostThreadPool* threadPool = nullptr;
+static ClapHostEventLoop* eventLoop = nullptr;
+static ClapHostUndoHistory* undoHistory = nullptr;
+static ClapHostTransport* hostTransport = nullptr;
+static ClapHostTuning* hostTuning = nullptr;
+
+void mark_clap_audio_thread(bool audioThread) {
+    isAudioThread = audioThread;
+}
+
+void use_clap_thread_pool(ClapHostThreadPool* pool) {
+    threadPool = pool;
+}
+
+void use_clap_event_loop(ClapHostEventLoop* loop) {
+    eventLoop = loop;
+}
+
+void use_clap_undo_history(ClapHostUndoHistory* history) {
+    undoHistory = history;
+}
+
+void use_clap_transport(ClapHostTransport* transport) {
+    hostTransport = transport;
+}
+
+void use_clap_tuning(ClapHostTuning* tuning) {
+    hostTuning = tuning;
+}
+
+void release_clap_host_resources(ClapHostInstance* instance) {
+    if (eventLoop) {
+        eventLoop->removeAll(instance);
+    }
+    if (undoHistory) {
+        undoHistory->detach(instance);
+    }
+}
+
+static ClapHostInstance* get_instance(const clap_host* host) {
+    return static_cast<ClapHostInstance*>(host->host_data);
+}
+
+// clap_host_log
+static void CLAP_ABI host_log(const clap_host* host, clap_log_severity severity, const char* msg) {
+    static const char* const names[] = {
+        "debug", "info", "warning", "error", "fatal", "host misbehaving", "plugin misbehaving"
+    };
+    const char* name = (severity >= 0 && severity <= CLAP_LOG_PLUGIN_MISBEHAVING) ? names[severity] : "log";
+    const clap_plugin* plugin = get_instance(host)->plugin;
+    std::cerr << "[" << (plugin ? plugin->desc->name : "plugin") << "] " << name << ": " << msg << std::endl;
+}
+
+static const clap_host_log hostLog = { host_log };
+
+// clap_host_thread_check
+static bool CLAP_ABI host_is_main_thread(const clap_host* host) {
+    UNREFERENCED_PARAMETER(host);
+    return std::this_thread::get_id() == mainThreadId;
+}
+
+static bool CLAP_ABI host_is_audio_thread(const clap_host* host) {
+    UNREFERENCED_PARAMETER(host);
+    return isAudioThread;
+}
+
+static const clap_host_thread_check hostThreadCheck = { host_is_main_thread, host_is_audio_thread };
+
+// clap_host_latency
+static void CLAP_ABI host_latency_changed(const clap_host* host) {
+    ClapHostInstance* instance = get_instance(host);
+    instance->latencyChanged = true;
+    instance->restartRequested = true;
+}
+
+static const clap_host_latency hostLatency = { host_latency_changed };
+
+// clap_host_params
+// The host caches the values the plugin reported and the parameters in a gesture; names and
+// ranges are asked from the plugin when they are needed, so there is nothing else to rescan.
+static void CLAP_ABI host_params_rescan(const clap_host* host, clap_param_rescan_flags flags) {
+    ClapHostInstance* instance = get_instance(host);
+    if (flags & CLAP_PARAM_RESCAN_ALL) {
+        instance->reportedParams.clear();
+        instance->paramGestures.clear();
+        return;
+    }
+    if ((flags & CLAP_PARAM_RESCAN_VALUES) && instance->paramsExt) {
+        for (auto it = instance->reportedParams.begin(); it != instance->reportedParams.end();) {
+            if (instance->paramsExt->get_value(instance->plugin, it->first, &it->second)) {
+                ++it;
+            }
+            else {
+                it = instance->reportedParams.erase(it);
+            }
+        }
+    }
+}
+
+// The host does not modulate parameters, so only references and automation are cleared
+static void CLAP_ABI host_params_clear(const clap_host* host, clap_id paramId, clap_param_clear_flags flags) {
+    ClapHostInstance* instance = get_instance(host);
+    if (flags & CLAP_PARAM_CLEAR_ALL) {
+        instance->reportedParams.erase(paramId);
+        instance->paramGestures.erase(paramId);
+    }
+    if (flags & (CLAP_PARAM_CLEAR_ALL | CLAP_PARAM_CLEAR_AUTOMATIONS)) {
+        instance->clearedAutomation.push_back(paramId);
+    }
+}
+
+static void CLAP_ABI host_params_request_flush(const clap_host* host) {
+    get_instance(host)->paramsFlushRequested = true;
+}
+
+static const clap_host_params hostParams = { host_params_rescan, host_params_clear, host_params_request_flush };
+
+// clap_host_state
+static void CLAP_ABI host_state_mark_dirty(const clap_host* host) {
+    get_instance(host)->stateDirty = true;
+}
+
+static const clap_host_state hostState = { host_state_mark_dirty };
+
+// clap_host_audio_ports
+// Every rescan is handled by restarting the plugin, so all flags are supported.
+static bool CLAP_ABI host_audio_ports_is_rescan_flag_supported(const clap_host* host, uint32_t flag) {
+    UNREFERENCED_PARAMETER(host);
+    UNREFERENCED_PARAMETER(flag);
+    return true;
+}
+
+static void CLAP_ABI host_audio_ports_rescan(const clap_host* host, uint32_t flags) {
+    UNREFERENCED_PARAMETER(flags);
+    get_instance(host)->restartRequested = true;
+}
+
+static const clap_host_audio_ports hostAudioPorts = {
+    host_audio_ports_is_rescan_flag_supported, host_audio_ports_rescan
+};
+
+// clap_host_tail
+static void CLAP_ABI host_tail_changed(const clap_host* host) {
+    get_instance(host)->tailChanged = true;
+}
+
+static const clap_host_tail hostTail = { host_tail_changed };
+
+// clap_host_thread_pool
+// Rejected outside of process(), the plugin then runs the tasks itself.
+static bool CLAP_ABI host_thread_pool_request_exec(const clap_host* host, uint32_t numTasks) {
+    ClapHostInstance* instance = get_instance(host);
+    if (!threadPool || !instance->inProcess) {
+        return false;
+    }
+    // The workers' time is added to the block's cost, see schedule_clap_instance()
+    uint64_t busy = threadPool->busyTime();
+    bool executed = threadPool->exec(instance->plugin, instance->threadPool, numTasks,
+                                     instance->poolWorkers.load(std::memory_order_relaxed));
+    instance->helperTime += threadPool->busyTime() - busy;
+    return executed;
+}
+
+static const clap_host_thread_pool hostThreadPool = { host_thread_pool_request_exec };
+
+// clap_host_voice_info
+static void CLAP_ABI host_voice_info_changed(const clap_host* host) {
+    get_instance(host)->voiceInfoChanged = true;
+}
+
+static const clap_host_voice_info hostVoiceInfo = { host_voice_info_changed };
+
+// clap_host_timer_support
+// Timers run on the main-thread event loop and are dropped with their instance.
+static void on_clap_timer(void* context, clap_id timerId) {
+    ClapHostInstance* instance = static_cast<ClapHostInstance*>(context);
+    if (instance->timerSupport) {
+        instance->timerSupport->on_timer(instance->plugin, timerId);
+    }
+}
+
+static bool CLAP_ABI host_register_timer(const clap_host* host, uint32_t periodMs, clap_id* timerId) {
+    *timerId = CLAP_INVALID_ID;
+    if (!eventLoop) {
+        return false;
+    }
+    return eventLoop->addTimer(periodMs, on_clap_timer, get_instance(host), timerId);
+}
+
+static bool CLAP_ABI host_unregister_timer(const clap_host* host, clap_id timerId) {
+    return eventLoop && eventLoop->removeTimer(timerId, get_instance(host));
+}
+
+static const clap_host_timer_support hostTimerSupport = { host_register_timer, host_unregister_timer };
+
+// clap_host_posix_fd_support
+static void on_clap_fd(void* context, int fd, clap_posix_fd_flags_t flags) {
+    ClapHostInstance* instance = static_cast<ClapHostInstance*>(context);
+    if (instance->posixFdSupport) {
+        instance->posixFdSupport->on_fd(instance->plugin, fd, flags);
+    }
+}
+
+static bool CLAP_ABI host_register_fd(const clap_host* host, int fd, clap_posix_fd_flags_t flags) {
+    return eventLoop && eventLoop->addFd(fd, flags, on_clap_fd, get_instance(host));
+}
+
+static bool CLAP_ABI host_modify_fd(const clap_host* host, int fd, clap_posix_fd_flags_t flags) {
+    return eventLoop && eventLoop->modifyFd(fd, flags, get_instance(host));
+}
+
+static bool CLAP_ABI host_unregister_fd(const clap_host* host, int fd) {
+    return eventLoop && eventLoop->removeFd(fd, get_instance(host));
+}
+
+static const clap_host_posix_fd_support hostPosixFdSupport = { host_register_fd, host_modify_fd, host_unregister_fd };
+
+// clap_host_undo
+// Undo and redo asked for by a plugin run from the main loop, not from inside the plugin's call.
+static void CLAP_ABI host_undo_begin_change(const clap_host* host) {
+    if (undoHistory) {
+        undoHistory->beginChange(get_instance(host));
+    }
+}
+
+static void CLAP_ABI host_undo_cancel_change(const clap_host* host) {
+    if (undoHistory) {
+        undoHistory->cancelChange(get_instance(host));
+    }
+}
+
+static void CLAP_ABI host_undo_change_made(const clap_host* host, const char* name, const void* delta, size_t deltaSize,
+                                           bool deltaCanUndo) {
+    if (undoHistory) {
+        undoHistory->changeMade(get_instance(host), name, delta, deltaSize, deltaCanUndo);
+    }
+}
+
+static void CLAP_ABI host_undo_request_undo(const clap_host* host) {
+    UNREFERENCED_PARAMETER(host);
+    if (undoHistory) {
+        undoHistory->request(false);
+    }
+}
+
+static void CLAP_ABI host_undo_request_redo(const clap_host* host) {
+    UNREFERENCED_PARAMETER(host);
+    if (undoHistory) {
+        undoHistory->request(true);
+    }
+}
+
+static void CLAP_ABI host_undo_set_wants_context_updates(const clap_host* host, bool isSubscribed) {
+    if (undoHistory) {
+        undoHistory->subscribe(get_instance(host), isSubscribed);
+    }
+}
+
+static const clap_host_undo hostUndo = {
+    host_undo_begin_change, host_undo_cancel_change, host_undo_change_made,
+    host_undo_request_undo, host_undo_request_redo, host_undo_set_wants_context_updates,
+};
+
+// clap_host_transport_control
+// The start point is the beginning of the song.
+static void CLAP_ABI host_transport_request_start(const clap_host* host) {
+    UNREFERENCED_PARAMETER(host);
+    if (hostTransport) {
+        hostTransport->requestJump(0);
+        hostTransport->requestPlay(true);
+    }
+}
+
+static void CLAP_ABI host_transport_request_stop(const clap_host* host) {
+    UNREFERENCED_PARAMETER(host);
+    if (hostTransport) {
+        hostTransport->requestPlay(false);
+        hostTransport->requestJump(0);
+    }
+}
+
+static void CLAP_ABI host_transport_request_continue(const clap_host* host) {
+    UNREFERENCED_PARAMETER(host);
+    if (hostTransport) {
+        hostTransport->requestPlay(true);
+    }
+}
+
+static void CLAP_ABI host_transport_request_pause(const clap_host* host) {
+    UNREFERENCED_PARAMETER(host);
+    if (hostTransport) {
+        hostTransport->requestPlay(false);
+    }
+}
+
+static void CLAP_ABI host_transport_request_toggle_play(const clap_host* host) {
+    UNREFERENCED_PARAMETER(host);
+    if (hostTransport) {
+        hostTransport->requestPlay(!hostTransport->playing());
+    }
+}
+
+static void CLAP_ABI host_transport_request_jump(const clap_host* host, clap_beattime position) {
+    UNREFERENCED_PARAMETER(host);
+    if (hostTransport) {
+        hostTransport->requestJump((double)position / CLAP_BEATTIME_FACTOR);
+    }
+}
+
+static void CLAP_ABI host_transport_request_loop_region(const clap_host* host, clap_beattime start, clap_beattime duration) {
+    UNREFERENCED_PARAMETER(host);
+    if (hostTransport) {
+        hostTransport->requestLoop((double)start / CLAP_BEATTIME_FACTOR, (double)(start + duration) / CLAP_BEATTIME_FACTOR);
+    }
+}
+
+static void CLAP_ABI host_transport_request_toggle_loop(const clap_host* host) {
+    UNREFERENCED_PARAMETER(host);
+    if (hostTransport) {
+        hostTransport->requestLoopEnabled(!hostTransport->looping());
+    }
+}
+
+static void CLAP_ABI host_transport_request_enable_loop(const clap_host* host, bool isEnabled) {
+    UNREFERENCED_PARAMETER(host);
+    if (hostTransport) {
+        hostTransport->requestLoopEnabled(isEnabled);
+    }
+}
+
+static void CLAP_ABI host_transport_request_record(const clap_host* host, bool isRecording) {
+    UNREFERENCED_PARAMETER(host);
+    if (hostTransport) {
+        hostTransport->requestRecord(isRecording);
+    }
+}
+
+static void CLAP_ABI host_transport_request_toggle_record(const clap_host* host) {
+    UNREFERENCED_PARAMETER(host);
+    if (hostTransport) {
+        hostTransport->requestRecord(!hostTransport->recording());
+    }
+}
+
+static const clap_host_transport_control hostTransportControl = {
+    host_transport_request_start, host_transport_request_stop, host_transport_request_continue,
+    host_transport_request_pause, host_transport_request_toggle_play, host_transport_request_jump,
+    host_transport_request_loop_region, host_transport_request_toggle_loop, host_transport_request_enable_loop,
+    host_transport_request_record, host_transport_request_toggle_record,
+};
+
+// clap_host_tuning
+// Without a tuning service every key plays in 12-TET.
+static double CLAP_ABI host_tuning_get_relative(const clap_host* host, clap_id tuningId, int32_t channel, int32_t key,
+                                                uint32_t sampleOffset) {
+    UNREFERENCED_PARAMETER(host);
+    UNREFERENCED_PARAMETER(channel);
+    return hostTuning ? hostTuning->relative(tuningId, key, sampleOffset) : 0;
+}
+
+static bool CLAP_ABI host_tuning_should_play(const clap_host* host, clap_id tuningId, int32_t channel, int32_t key) {
+    UNREFERENCED_PARAMETER(host);
+    UNREFERENCED_PARAMETER(channel);
+    return hostTuning ? hostTuning->shouldPlay(tuningId, key) : true;
+}
+
+static uint32_t CLAP_ABI host_tuning_get_tuning_count(const clap_host* host) {
+    UNREFERENCED_PARAMETER(host);
+    return hostTuning ? hostTuning->count() : 0;
+}
+
+static bool CLAP_ABI host_tuning_get_info(const clap_host* host, uint32_t tuningIndex, clap_tuning_info* info) {
+    UNREFERENCED_PARAMETER(host);
+    return hostTuning && hostTuning->info(tuningIndex, info);
+}
+
+static const clap_host_tuning hostTuningExt = {
+    host_tuning_get_relative, host_tuning_should_play, host_tuning_get_tuning_count, host_tuning_get_info,
+};
+
+// clap_host_event_registry
+static bool CLAP_ABI host_event_registry_query(const clap_host* host, const char* spaceName, uint16_t* spaceId) {
+    UNREFERENCED_PARAMETER(host);
+    if (spaceName && strcmp(spaceName, CLAP_EXT_TUNING) == 0) {
+        *spaceId = TUNING_EVENT_SPACE_ID;
+        return true;
+    }
+    *spaceId = UINT16_MAX;
+    return false;
+}
+
+static const clap_host_event_registry hostEventRegistry = { host_event_registry_query };
+
+//
+// Registry
+//
+struct HostExtension {
+    const char* id;
+    const void* extension;
+};
+
+// Add _COMPAT ids next to the stable id they alias, pointing at the same struct.
+static constexpr HostExtension hostExtensions[] = {
+    { CLAP_EXT_LOG, &hostLog },
+    { CLAP_EXT_THREAD_CHECK, &hostThreadCheck },
+    { CLAP_EXT_LATENCY, &hostLatency },
+    { CLAP_EXT_PARAMS, &hostParams },
+    { CLAP_EXT_STATE, &hostState },
+    { CLAP_EXT_AUDIO_PORTS, &hostAudioPorts },
+    { CLAP_EXT_TAIL, &hostTail },
+    { CLAP_EXT_THREAD_POOL, &hostThreadPool },
+    { CLAP_EXT_TIMER_SUPPORT, &hostTimerSupport },
+    { CLAP_EXT_POSIX_FD_SUPPORT, &hostPosixFdSupport },
+    { CLAP_EXT_VOICE_INFO, &hostVoiceInfo },
+    { CLAP_EXT_UNDO, &hostUndo },
+    { CLAP_EXT_TRANSPORT_CONTROL, &hostTransportControl },
+    { CLAP_EXT_TUNING, &hostTuningExt },
+    { CLAP_EXT_EVENT_REGISTRY, &hostEventRegistry },
+};
+
+static constexpr size_t hostExtensionCount = sizeof(hostExtensions) / sizeof(hostExtensions[0]);
+
+// Power of two, at least twice the number of ids so a seed is found quickly
+static constexpr size_t tableSize = 32;
+static_assert(tableSize >= 2 * hostExtensionCount, "host extension table is too small");
+
+static constexpr uint32_t hash_id(const char* id, uint32_t seed) {
+    uint32_t h = 2166136261u ^ seed;
+    for (; *id; id++) {
+        h = (h ^ (uint8_t)*id) * 16777619u;
+    }
+    return (h ^ (h >> 15)) & (tableSize - 1);
+}
+
+static constexpr bool is_perfect(uint32_t seed) {
+    bool used[tableSize] = {};
+    for (size_t i = 0; i < hostExtensionCount; i++) {
+        uint32_t slot = hash_id(hostExtensions[i].id, seed);
+        if (used[slot]) {
+            return false;
+        }
+        used[slot] = true;
+    }
+    return true;
+}
+
+static constexpr uint32_t find_seed() {
+    for (uint32_t seed = 0; seed < 100000; seed++) {
+        if (is_perfect(seed)) {
+            return seed;
+        }
+    }
+    return UINT32_MAX;
+}
+
+static constexpr uint32_t hashSeed = find_seed();
+static_assert(hashSeed != UINT32_MAX, "no perfect hash seed for the host extension ids");
+
+// Slot -> index in hostExtensions plus one, zero for an empty slot
+static constexpr std::array<uint8_t, tableSize> build_slots() {
+    std::array<uint8_t, tableSize> slots = {};
+    for (size_t i = 0; i < hostExtensionCount; i++) {
+        slots[hash_id(hostExtensions[i].id, hashSeed)] = (uint8_t)(i + 1);
+    }
+    return slots;
+}
+
+static constexpr std::array<uint8_t, tableSize> hostExtensionSlots = build_slots();
+
+const void* clap_host_extension(const char* extensionId) {
+    if (!extensionId) {
+        return nullptr;
+    }
+    uint8_t entry = hostExtensionSlots[hash_id(extensionId, hashSeed)];
+    if (entry == 0 || strcmp(hostExtensions[entry - 1].id, extensionId) != 0) {
+        return nullptr;
+    }
+    return hostExtensions[entry - 1].extension;
+}
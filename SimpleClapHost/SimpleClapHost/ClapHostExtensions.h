@@ -0,0 +1,46 @@
+#pragma once
+
+#include <clap/clap.h>
+
+class ClapHostThreadPool;
+class ClapHostEventLoop;
+class ClapHostUndoHistory;
+class ClapHostTransport;
+class ClapHostTuning;
+struct ClapHostInstance;
+
+// Host extension registry.
+//
+// Plugins probe many extension ids during init, so the ids are placed in a perfect hash table
+// built at compile time: a lookup is one hash of the id and a single string compare.
+// Returns nullptr for extensions the host does not implement.
+// [thread-safe]
+const void* clap_host_extension(const char* extensionId);
+
+// Marks the calling thread as an audio thread for clap_host_thread_check.
+// The thread running the static initialization is taken as the main thread.
+void mark_clap_audio_thread(bool isAudioThread);
+
+// Pool serving clap_host_thread_pool::request_exec, nullptr to let plugins run their own tasks.
+// [main-thread & stream stopped]
+void use_clap_thread_pool(ClapHostThreadPool* pool);
+
+// Loop running the plugins' timers and fds, nullptr to refuse registrations.
+// [main-thread]
+void use_clap_event_loop(ClapHostEventLoop* loop);
+
+// History behind clap_host_undo, nullptr to ignore the plugins' changes.
+// [main-thread]
+void use_clap_undo_history(ClapHostUndoHistory* history);
+
+// Transport the plugins may control through clap_host_transport_control, nullptr to ignore them.
+// [main-thread]
+void use_clap_transport(ClapHostTransport* transport);
+
+// Tunings behind clap_host_tuning, nullptr to give every plugin 12-TET.
+// [main-thread & stream stopped]
+void use_clap_tuning(ClapHostTuning* tuning);
+
+// Drops the timers and fds the instance left registered, and its undo steps.
+// [main-thread]
+void release_clap_host_resources(ClapHostInstance* instance);
@@ -0,0 +1,90 @@
+#ifdef _WIN32
+#include <Windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+#include "ClapHostMappedFile.h"
+
+bool ClapHostMappedFile::open(const char* path, bool sequential) {
+    close();
+#ifdef _WIN32
+    HANDLE file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+                              FILE_ATTRIBUTE_NORMAL | (sequential ? FILE_FLAG_SEQUENTIAL_SCAN : FILE_FLAG_RANDOM_ACCESS), nullptr);
+    if (file == INVALID_HANDLE_VALUE) {
+        return false;
+    }
+    LARGE_INTEGER fileSize;
+    if (GetFileSizeEx(file, &fileSize)) {
+        length = (uint64_t)fileSize.QuadPart;
+        opened = true;
+    }
+    if (opened && length > 0) {
+        mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        view = mapping ? static_cast<const uint8_t*>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0)) : nullptr;
+        opened = view != nullptr;
+    }
+    CloseHandle(file);
+#else
+    int fd = ::open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return false;
+    }
+    struct stat st;
+    if (fstat(fd, &st) == 0) {
+        length = (uint64_t)st.st_size;
+        opened = true;
+    }
+    if (opened && length > 0) {
+        void* mapped = mmap(nullptr, (size_t)length, PROT_READ, MAP_PRIVATE, fd, 0);
+        view = mapped != MAP_FAILED ? static_cast<const uint8_t*>(mapped) : nullptr;
+        opened = view != nullptr;
+        if (view && sequential) {
+            // Read once from the front, pages behind the read position are not needed again
+            madvise(mapped, (size_t)length, MADV_SEQUENTIAL);
+        }
+    }
+    ::close(fd);
+#endif
+    if (!opened) {
+        close();
+    }
+    return opened;
+}
+
+void ClapHostMappedFile::release(uint64_t offset) {
+    if (!view) {
+        return;
+    }
+    uint64_t end = (offset < length ? offset : length) & ~(uint64_t)0xFFFF;  // whole 64 KiB units
+    if (end == 0) {
+        return;
+    }
+#ifdef _WIN32
+    // Unlocking pages which are not locked removes them from the working set
+    VirtualUnlock(const_cast<uint8_t*>(view), (SIZE_T)end);
+#else
+    madvise(const_cast<uint8_t*>(view), (size_t)end, MADV_DONTNEED);
+#endif
+}
+
+void ClapHostMappedFile::close() {
+#ifdef _WIN32
+    if (view) {
+        UnmapViewOfFile(view);
+    }
+    if (mapping) {
+        CloseHandle(mapping);
+    }
+    mapping = nullptr;
+#else
+    if (view) {
+        munmap(const_cast<uint8_t*>(view), (size_t)length);
+    }
+#endif
+    view = nullptr;
+    length = 0;
+    opened = false;
+}
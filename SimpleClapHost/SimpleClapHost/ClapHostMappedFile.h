@@ -0,0 +1,34 @@
+#pragma once
+
+#include <cstdint>
+
+// Read-only mapping of a whole file.
+// An empty file opens with size 0 and no data.
+class ClapHostMappedFile {
+public:
+    ClapHostMappedFile() = default;
+    ~ClapHostMappedFile() { close(); }
+
+    ClapHostMappedFile(const ClapHostMappedFile&) = delete;
+    ClapHostMappedFile& operator=(const ClapHostMappedFile&) = delete;
+
+    // sequential hints that the file is read once from the front
+    bool open(const char* path, bool sequential = false);
+    void close();
+
+    // Takes the pages before offset out of the process' memory, they are read from the file again
+    // if touched
+    void release(uint64_t offset);
+
+    bool isOpen() const { return opened; }
+    const uint8_t* data() const { return view; }
+    uint64_t size() const { return length; }
+
+private:
+#ifdef _WIN32
+    void* mapping = nullptr;
+#endif
+    const uint8_t* view = nullptr;
+    uint64_t length = 0;
+    bool opened = false;
+};
@@ -0,0 +1,505 @@
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <iostream>
+#include "ClapHostMappedFile.h"
+#include "ClapHostMidiFile.h"
+#include "ClapHostTransport.h"
+
+// Tempo files timed in SMPTE frames are played at
+#define MIDI_SMPTE_TEMPO 120.0
+
+namespace {
+
+// Reads the bytes of a file or chunk, failing instead of running past its end
+struct MidiReader {
+    const uint8_t* data;
+    uint64_t size;
+    uint64_t at;
+    bool failed;
+
+    uint8_t byte() {
+        if (at >= size) {
+            failed = true;
+            return 0;
+        }
+        return data[at++];
+    }
+
+    // Big endian
+    uint32_t number(int count) {
+        uint32_t value = 0;
+        for (int i = 0; i < count; i++) {
+            value = value << 8 | byte();
+        }
+        return value;
+    }
+
+    uint32_t varlen() {
+        uint32_t value = 0;
+        for (int i = 0; i < 4; i++) {
+            uint8_t b = byte();
+            value = value << 7 | (b & 0x7f);
+            if (!(b & 0x80)) {
+                return value;
+            }
+        }
+        failed = true;
+        return value;
+    }
+
+    const uint8_t* bytes(uint64_t count) {
+        if (size - at < count) {
+            failed = true;
+            at = size;
+            return nullptr;
+        }
+        const uint8_t* start = data + at;
+        at += count;
+        return start;
+    }
+};
+
+struct TimedEvent {
+    uint64_t tick;
+    uint32_t order;             // in the file, track by track
+    ClapHostMidiEvent event;
+};
+
+struct TimeSignature {
+    uint64_t tick;
+    uint16_t num;
+    uint16_t denom;
+};
+
+bool is_note_off(const ClapHostMidiEvent& event) {
+    uint8_t kind = event.status & 0xf0;
+    return kind == 0x80 || (kind == 0x90 && event.data2 == 0);
+}
+
+}
+
+bool ClapHostMidiFile::read(const char* path) {
+    ClapHostMappedFile mapped;
+    if (!mapped.open(path, true)) {
+        std::cerr << "Failed to open the MIDI file: " << path << std::endl;
+        return false;
+    }
+    MidiReader file = { mapped.data(), mapped.size(), 0, false };
+
+    // Header chunk: format, track count, division
+    const uint8_t* id = file.bytes(4);
+    uint32_t headerSize = file.number(4);
+    if (!id || memcmp(id, "MThd", 4) != 0 || headerSize < 6) {
+        std::cerr << "Not a Standard MIDI File: " << path << std::endl;
+        return false;
+    }
+    uint32_t format = file.number(2);
+    uint32_t trackCount = file.number(2);
+    uint32_t division = file.number(2);
+    file.bytes(headerSize - 6);
+    if (file.failed || division == 0) {
+        std::cerr << "Not a Standard MIDI File: " << path << std::endl;
+        return false;
+    }
+    if (format > 1) {
+        std::cerr << "MIDI file format " << format << " is not supported: " << path << std::endl;
+        return false;
+    }
+
+    // Ticks are counted per beat, or per SMPTE frame with the tempo fixed
+    bool smpte = (division & 0x8000) != 0;
+    double ticksPerBeat = division;
+    if (smpte) {
+        int frameRate = -(int8_t)(division >> 8);
+        double framesPerSecond = frameRate == 29 ? 29.97 : frameRate;
+        ticksPerBeat = framesPerSecond * (division & 0xff) * 60 / MIDI_SMPTE_TEMPO;
+    }
+
+    std::vector<TimedEvent> timed;
+    std::vector<std::pair<uint64_t, uint32_t>> tempoTicks;     // microseconds per beat
+    std::vector<TimeSignature> signatures;
+    std::vector<uint8_t> sysexData;
+    uint64_t endTick = 0;
+    uint32_t order = 0;
+
+    for (uint32_t track = 0; track < trackCount && file.at < file.size;) {
+        const uint8_t* chunkId = file.bytes(4);
+        uint32_t chunkSize = file.number(4);
+        const uint8_t* chunk = file.bytes(chunkSize);
+        if (file.failed) {
+            std::cerr << "Truncated MIDI file: " << path << std::endl;
+            return false;
+        }
+        // Chunks of other kinds are skipped
+        if (memcmp(chunkId, "MTrk", 4) != 0) {
+            continue;
+        }
+        track++;
+
+        MidiReader in = { chunk, chunkSize, 0, false };
+        uint64_t tick = 0;
+        uint8_t running = 0;
+        while (in.at < in.size && !in.failed) {
+            tick += in.varlen();
+            uint8_t status = in.byte();
+            if (status < 0x80) {
+                // Running status: the byte is the first data byte
+                if (!running) {
+                    in.failed = true;
+                    break;
+                }
+                status = running;
+                in.at--;
+            }
+
+            if (status == 0xff) {
+                uint8_t type = in.byte();
+                uint32_t length = in.varlen();
+                const uint8_t* meta = in.bytes(length);
+                running = 0;
+                if (in.failed || type == 0x2f) {
+                    break;
+                }
+                if (type == 0x51 && length >= 3 && !smpte) {
+                    tempoTicks.push_back({ tick, (uint32_t)meta[0] << 16 | meta[1] << 8 | meta[2] });
+                }
+                else if (type == 0x58 && length >= 2 && meta[0] > 0 && meta[1] < 16) {
+                    signatures.push_back({ tick, meta[0], (uint16_t)(1u << meta[1]) });
+                }
+                continue;
+            }
+
+            if (status == 0xf0 || status == 0xf7) {
+                // F7 packets are sent as they are: sysex continuations or escaped messages
+                uint32_t length = in.varlen();
+                const uint8_t* payload = in.bytes(length);
+                running = 0;
+                if (in.failed) {
+                    break;
+                }
+                ClapHostMidiEvent event = {};
+                event.status = status;
+                event.sysexOffset = (uint32_t)sysexData.size();
+                if (status == 0xf0) {
+                    sysexData.push_back(0xf0);
+                }
+                sysexData.insert(sysexData.end(), payload, payload + length);
+                event.sysexSize = (uint32_t)sysexData.size() - event.sysexOffset;
+                if (event.sysexSize > 0) {
+                    timed.push_back({ tick, order++, event });
+                }
+                continue;
+            }
+
+            // System common and real-time messages have no place in a file
+            if (status > 0xf0) {
+                in.failed = true;
+                break;
+            }
+            running = status;
+            ClapHostMidiEvent event = {};
+            event.status = status;
+            event.data1 = in.byte() & 0x7f;
+            uint8_t kind = status & 0xf0;
+            if (kind != 0xc0 && kind != 0xd0) {
+                event.data2 = in.byte() & 0x7f;
+            }
+            timed.push_back({ tick, order++, event });
+        }
+        if (in.failed) {
+            std::cerr << "Corrupt track " << track << " in the MIDI file: " << path << std::endl;
+            return false;
+        }
+        endTick = std::max(endTick, tick);
+    }
+
+    // Note offs go first, so a note struck again at the same time is not cut right away
+    std::sort(timed.begin(), timed.end(), [](const TimedEvent& a, const TimedEvent& b) {
+        if (a.tick != b.tick) {
+            return a.tick < b.tick;
+        }
+        bool offA = is_note_off(a.event);
+        bool offB = is_note_off(b.event);
+        return offA != offB ? offA : a.order < b.order;
+    });
+
+    eventList.clear();
+    eventList.reserve(timed.size());
+    for (TimedEvent& t : timed) {
+        t.event.beat = t.tick / ticksPerBeat;
+        eventList.push_back(t.event);
+    }
+    sysexBytes = std::move(sysexData);
+
+    tempos.clear();
+    if (smpte) {
+        tempos[0] = MIDI_SMPTE_TEMPO;
+    }
+    std::stable_sort(tempoTicks.begin(), tempoTicks.end(),
+                     [](const std::pair<uint64_t, uint32_t>& a, const std::pair<uint64_t, uint32_t>& b) { return a.first < b.first; });
+    for (const auto& tempo : tempoTicks) {
+        if (tempo.second > 0) {
+            tempos[tempo.first / ticksPerBeat] = 60e6 / tempo.second;
+        }
+    }
+
+    // The transport takes meter changes by bar: one placed off a bar line starts the next bar
+    meters.clear();
+    std::stable_sort(signatures.begin(), signatures.end(),
+                     [](const TimeSignature& a, const TimeSignature& b) { return a.tick < b.tick; });
+    int32_t bar = 0;
+    double barBeat = 0;
+    uint16_t num = 4;
+    uint16_t denom = 4;
+    for (const TimeSignature& signature : signatures) {
+        double barLength = num * 4.0 / denom;
+        double bars = std::max(0.0, std::ceil((signature.tick / ticksPerBeat - barBeat) / barLength - 1e-9));
+        bar += (int32_t)bars;
+        barBeat += bars * barLength;
+        num = signature.num;
+        denom = signature.denom;
+        meters[bar] = std::make_pair(num, denom);
+    }
+
+    lengthBeats = endTick / ticksPerBeat;
+    return true;
+}
+
+ClapHostMidiPlayer::ClapHostMidiPlayer() {
+    blockEvents.reserve(MIDI_PLAYER_MAX_EVENTS, MIDI_PLAYER_EVENT_BYTES);
+
+    // Taken by the audio thread's first block
+    auto none = std::make_shared<ClapHostMidiSequence>();
+    none->serial = nextSerial++;
+    sequences.push_back(none);
+    published = none.get();
+}
+
+void ClapHostMidiPlayer::prepare(double rate) {
+    sampleRate = rate;
+}
+
+void ClapHostMidiPlayer::load(std::shared_ptr<const ClapHostMidiFile> file, const ClapHostTempoMap& map) {
+    publish(std::move(file), map);
+}
+
+void ClapHostMidiPlayer::setDialects(uint32_t preferred, uint32_t supported) {
+    preferredDialect.store(preferred, std::memory_order_relaxed);
+    supportedDialects.store(supported, std::memory_order_relaxed);
+}
+
+void ClapHostMidiPlayer::publish(std::shared_ptr<const ClapHostMidiFile> file, const ClapHostTempoMap& tempoMap) {
+    auto next = std::make_shared<ClapHostMidiSequence>();
+    next->file = std::move(file);
+    next->mapGeneration = tempoMap.generation;
+    next->serial = nextSerial++;
+
+    if (next->file) {
+        // One walk over the tempo changes, in step with ClapHostTempoMap::secondsAt()
+        const auto& events = next->file->events();
+        const auto& tempos = tempoMap.tempos();
+        size_t t = 0;
+        next->samples.reserve(events.size());
+        for (const ClapHostMidiEvent& event : events) {
+            while (t + 1 < tempos.size() && tempos[t + 1].beat <= event.beat) {
+                t++;
+            }
+            double seconds = tempos[t].seconds + (event.beat - tempos[t].beat) * 60 / tempos[t].bpm;
+            // Rounded as the transport rounds the song position
+            next->samples.push_back((int64_t)std::ceil(seconds * sampleRate));
+        }
+    }
+    sequences.push_back(next);
+    published.store(next.get(), std::memory_order_release);
+}
+
+void ClapHostMidiPlayer::service(const ClapHostTempoMap& map) {
+    const ClapHostMidiSequence& newest = *sequences.back();
+    if (newest.file && newest.mapGeneration != map.generation) {
+        publish(newest.file, map);
+    }
+
+    // The audio thread only ever takes the newest sequence, the ones before its current are unused
+    uint64_t inUse = adopted.load(std::memory_order_acquire);
+    size_t unused = 0;
+    while (unused + 1 < sequences.size() && sequences[unused]->serial < inUse) {
+        unused++;
+    }
+    sequences.erase(sequences.begin(), sequences.begin() + unused);
+}
+
+int64_t ClapHostMidiPlayer::sample_at(size_t index) const {
+    if (placed) {
+        return sequence->samples[index];
+    }
+    return (int64_t)std::ceil(map->secondsAt(sequence->file->events()[index].beat) * sampleRate);
+}
+
+// Puts the cursor on the first event at or after a song sample
+void ClapHostMidiPlayer::seek(int64_t song) {
+    size_t low = 0;
+    size_t high = sequence->file->events().size();
+    while (low < high) {
+        size_t middle = low + (high - low) / 2;
+        if (sample_at(middle) < song) {
+            low = middle + 1;
+        }
+        else {
+            high = middle;
+        }
+    }
+    cursor = low;
+}
+
+bool ClapHostMidiPlayer::note(bool on, uint8_t channel, uint8_t key, uint8_t velocity, uint32_t frame) {
+    bool pushed = false;
+    if (noteEvents) {
+        clap_event_note event = {};
+        event.header.size = sizeof(clap_event_note);
+        event.header.time = frame;
+        event.header.space_id = CLAP_CORE_EVENT_SPACE_ID;
+        event.header.type = on ? CLAP_EVENT_NOTE_ON : CLAP_EVENT_NOTE_OFF;
+        event.header.flags = 0;
+        event.note_id = -1;
+        event.port_index = 0;
+        event.channel = channel;
+        event.key = key;
+        event.velocity = velocity / 127.0;
+        pushed = blockEvents.push(&event.header);
+    }
+    else if (midiEvents) {
+        clap_event_midi event = {};
+        event.header.size = sizeof(clap_event_midi);
+        event.header.time = frame;
+        event.header.space_id = CLAP_CORE_EVENT_SPACE_ID;
+        event.header.type = CLAP_EVENT_MIDI;
+        event.header.flags = 0;
+        event.port_index = 0;
+        event.data[0] = (uint8_t)((on ? 0x90 : 0x80) | channel);
+        event.data[1] = key;
+        event.data[2] = velocity;
+        pushed = blockEvents.push(&event.header);
+    }
+    if (pushed && held[channel][key] != on) {
+        held[channel][key] = on;
+        if (on) {
+            heldCount++;
+        }
+        else {
+            heldCount--;
+        }
+    }
+    return pushed;
+}
+
+// Ends every held note; one whose note off does not fit is forgotten all the same
+void ClapHostMidiPlayer::release(uint32_t frame) {
+    for (uint8_t channel = 0; heldCount > 0 && channel < MIDI_CHANNELS; channel++) {
+        for (uint8_t key = 0; heldCount > 0 && key < MIDI_KEYS; key++) {
+            if (held[channel][key] && !note(false, channel, key, 0, frame)) {
+                held[channel][key] = false;
+                heldCount--;
+            }
+        }
+    }
+}
+
+void ClapHostMidiPlayer::emit(const ClapHostMidiEvent& event, uint32_t frame) {
+    if (event.sysexSize > 0) {
+        if (midiEvents) {
+            clap_event_midi_sysex sysex = {};
+            sysex.header.size = sizeof(clap_event_midi_sysex);
+            sysex.header.time = frame;
+            sysex.header.space_id = CLAP_CORE_EVENT_SPACE_ID;
+            sysex.header.type = CLAP_EVENT_MIDI_SYSEX;
+            sysex.header.flags = 0;
+            sysex.port_index = 0;
+            sysex.buffer = sequence->file->sysex(event);
+            sysex.size = event.sysexSize;
+            blockEvents.push(&sysex.header);
+        }
+        return;
+    }
+
+    uint8_t kind = event.status & 0xf0;
+    if (kind == 0x80 || kind == 0x90) {
+        // The note off of a note started before the song jumped here has nothing to end
+        bool on = kind == 0x90 && event.data2 > 0;
+        if (on || held[event.status & 0x0f][event.data1]) {
+            note(on, event.status & 0x0f, event.data1, event.data2, frame);
+        }
+        return;
+    }
+    // Controllers, programs, pressure and pitch bend exist in the MIDI dialect only
+    if (midiEvents) {
+        clap_event_midi midi = {};
+        midi.header.size = sizeof(clap_event_midi);
+        midi.header.time = frame;
+        midi.header.space_id = CLAP_CORE_EVENT_SPACE_ID;
+        midi.header.type = CLAP_EVENT_MIDI;
+        midi.header.flags = 0;
+        midi.port_index = 0;
+        midi.data[0] = event.status;
+        midi.data[1] = event.data1;
+        midi.data[2] = event.data2;
+        blockEvents.push(&midi.header);
+    }
+}
+
+void ClapHostMidiPlayer::process(const ClapHostTransport& transport) {
+    blockEvents.clear();
+
+    // Notes go in the preferred dialect, as CLAP events when the input takes no MIDI
+    uint32_t supported = supportedDialects.load(std::memory_order_relaxed);
+    midiEvents = (supported & (CLAP_NOTE_DIALECT_MIDI | CLAP_NOTE_DIALECT_MIDI_MPE)) != 0;
+    noteEvents = (supported & CLAP_NOTE_DIALECT_CLAP) != 0
+              && (preferredDialect.load(std::memory_order_relaxed) == CLAP_NOTE_DIALECT_CLAP || !midiEvents);
+
+    // A new tempo map moves the samples of the song, not the song: the cursor is found again
+    // without ending the notes
+    bool remapped = transport.blockTempoMap() != map;
+    map = transport.blockTempoMap();
+
+    const ClapHostMidiSequence* latest = published.load(std::memory_order_acquire);
+    if (latest != sequence) {
+        // The same file placed again keeps its cursor
+        if (!sequence || latest->file != sequence->file) {
+            release(0);
+            expected = -1;
+        }
+        sequence = latest;
+        adopted.store(sequence->serial, std::memory_order_release);
+    }
+    placed = sequence->mapGeneration == map->generation;
+    if (!sequence->file) {
+        return;
+    }
+
+    const auto& spans = transport.spans();
+    if (spans.empty()) {
+        release(0);
+        expected = -1;
+        return;
+    }
+    const auto& events = sequence->file->events();
+    for (const ClapHostTransport::Span& span : spans) {
+        if (span.song != expected) {
+            if (!remapped) {
+                release(span.frame);
+            }
+            seek(span.song);
+        }
+        remapped = false;
+
+        int64_t end = span.song + span.frames;
+        for (; cursor < events.size(); cursor++) {
+            int64_t sample = sample_at(cursor);
+            if (sample >= end) {
+                break;
+            }
+            emit(events[cursor], span.frame + (uint32_t)(sample - span.song));
+        }
+        expected = end;
+    }
+}
@@ -0,0 +1,135 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <vector>
+#include <clap/clap.h>
+#include "ClapHostEvents.h"
+
+class ClapHostTempoMap;
+class ClapHostTransport;
+
+// Events one block of the MIDI player can carry, with their storage
+#define MIDI_PLAYER_MAX_EVENTS 1024
+#define MIDI_PLAYER_EVENT_BYTES (MIDI_PLAYER_MAX_EVENTS * sizeof(clap_event_note))
+#define MIDI_CHANNELS 16
+#define MIDI_KEYS 128
+
+// One channel or sysex event of a Standard MIDI File
+struct ClapHostMidiEvent {
+    double beat;
+    uint8_t status;             // 0xf0 or 0xf7 for sysex
+    uint8_t data1;
+    uint8_t data2;
+    uint32_t sysexOffset;       // into the file's sysex bytes, the F0 included
+    uint32_t sysexSize;         // 0 for a channel event
+};
+
+// A Standard MIDI File of format 0 or 1, read once into a single list of the channel and sysex
+// events of every track, ordered by time. At the same time note offs go first, then the
+// tracks in file order. Positions are in beats, so the file can be placed on any tempo map;
+// files timed in SMPTE frames are taken at 120 bpm. The tempo and time signature meta events
+// become tempo and meter changes in the form ClapHostTransport takes.
+// Never changed once read.
+class ClapHostMidiFile {
+public:
+    // [main-thread]
+    bool read(const char* path);
+
+    const std::vector<ClapHostMidiEvent>& events() const { return eventList; }
+    const uint8_t* sysex(const ClapHostMidiEvent& event) const { return sysexBytes.data() + event.sysexOffset; }
+    // Tempo by beat and meter by bar
+    const std::map<double, double>& tempoChanges() const { return tempos; }
+    const std::map<int32_t, std::pair<uint16_t, uint16_t>>& meterChanges() const { return meters; }
+    // Up to the last end of track, in beats
+    double length() const { return lengthBeats; }
+
+private:
+    std::vector<ClapHostMidiEvent> eventList;
+    std::vector<uint8_t> sysexBytes;
+    std::map<double, double> tempos;
+    std::map<int32_t, std::pair<uint16_t, uint16_t>> meters;
+    double lengthBeats = 0;
+};
+
+// A file placed on a tempo map: the song sample of each of its events.
+// Never changed once handed to the audio thread.
+struct ClapHostMidiSequence {
+    std::shared_ptr<const ClapHostMidiFile> file;  // nullptr plays nothing
+    std::vector<int64_t> samples;
+    uint64_t mapGeneration = 0;
+    uint64_t serial = 0;
+};
+
+// Plays a MIDI file along the host transport.
+//
+// The main thread places the file on the transport's tempo map, converting the beat of every
+// event to its sample on the song timeline once, and hands the sequence to the audio thread with
+// an atomic pointer store. When the tempo map changes, service() places the file again; until
+// the new sequence arrives, the audio thread converts the events it needs with the map itself.
+// Each block, process() walks the spans of song the transport covered with a cursor into the
+// sequence, and puts the events due in them into a fixed list at their frames, in the dialect
+// the plugin's note input prefers: note on and off as CLAP note events, the rest as MIDI events
+// if the input takes them. Notes still held when the song jumps, the loop wraps or the transport
+// stops are released at that frame. Sysex events point into the file, which lives until the
+// audio thread has let go of its sequence.
+class ClapHostMidiPlayer {
+public:
+    ClapHostMidiPlayer();
+
+    ClapHostMidiPlayer(const ClapHostMidiPlayer&) = delete;
+    ClapHostMidiPlayer& operator=(const ClapHostMidiPlayer&) = delete;
+
+    // Plays the file on the tempo map the transport uses, nullptr for none
+    // [main-thread]
+    void load(std::shared_ptr<const ClapHostMidiFile> file, const ClapHostTempoMap& map);
+    std::shared_ptr<const ClapHostMidiFile> file() const { return sequences.back()->file; }
+
+    // Dialects of the note input the events go to, see clap_note_port_info; none plays nothing
+    // [main-thread]
+    void setDialects(uint32_t preferred, uint32_t supported);
+
+    // Places the file again if the tempo map changed, frees the sequences the audio thread let go of
+    // [main-thread]
+    void service(const ClapHostTempoMap& map);
+
+    // [before the stream starts]
+    void prepare(double sampleRate);
+
+    // Takes the events of the spans the transport covered in this block, call after its process()
+    // [audio-thread]
+    void process(const ClapHostTransport& transport);
+    const clap_input_events* events() const { return blockEvents.list(); }
+
+private:
+    void publish(std::shared_ptr<const ClapHostMidiFile> file, const ClapHostTempoMap& map);
+    int64_t sample_at(size_t index) const;
+    void seek(int64_t song);
+    void emit(const ClapHostMidiEvent& event, uint32_t frame);
+    bool note(bool on, uint8_t channel, uint8_t key, uint8_t velocity, uint32_t frame);
+    void release(uint32_t frame);
+
+    // [main-thread]
+    std::vector<std::shared_ptr<const ClapHostMidiSequence>> sequences;    // handed over, the newest last
+    uint64_t nextSerial = 1;
+
+    std::atomic<const ClapHostMidiSequence*> published{ nullptr };
+    std::atomic<uint64_t> adopted{ 0 };                 // serial of the audio thread's sequence
+    std::atomic<uint32_t> preferredDialect{ 0 };
+    std::atomic<uint32_t> supportedDialects{ 0 };
+    double sampleRate = 48000;
+
+    // owned by the audio thread
+    const ClapHostMidiSequence* sequence = nullptr;
+    const ClapHostTempoMap* map = nullptr;
+    bool placed = false;                // the sequence was placed on map
+    bool noteEvents = false;            // notes go as CLAP note events
+    bool midiEvents = false;            // the rest may go as MIDI events
+    size_t cursor = 0;
+    int64_t expected = -1;              // song sample a span continues from, -1 after a break
+    bool held[MIDI_CHANNELS][MIDI_KEYS] = {};
+    uint32_t heldCount = 0;
+    ClapHostInputEvents blockEvents;
+};
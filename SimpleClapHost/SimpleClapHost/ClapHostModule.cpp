@@ -0,0 +1,86 @@
+#ifdef _WIN32
+#include <Windows.h>
+#else
+#include <dlfcn.h>
+#endif
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <string>
+#include "ClapHostModule.h"
+
+// Entries are never called into by two threads at once while they are being loaded or scanned
+static std::mutex modulesMutex;
+static std::map<std::string, const clap_plugin_entry*> entries;
+
+#ifdef _WIN32
+typedef HMODULE ModuleHandle;
+#else
+typedef void* ModuleHandle;
+#endif
+
+static ModuleHandle open_module(const char* pluginPath, const clap_plugin_entry** pluginEntry) {
+#ifdef _WIN32
+    HMODULE hModule = LoadLibraryA(pluginPath);
+    *pluginEntry = hModule ? reinterpret_cast<const clap_plugin_entry*>(GetProcAddress(hModule, "clap_entry")) : nullptr;
+#else
+    void* hModule = dlopen(pluginPath, RTLD_NOW | RTLD_LOCAL);
+    *pluginEntry = hModule ? static_cast<const clap_plugin_entry*>(dlsym(hModule, "clap_entry")) : nullptr;
+#endif
+    return hModule;
+}
+
+static void close_module(ModuleHandle hModule) {
+#ifdef _WIN32
+    FreeLibrary(hModule);
+#else
+    dlclose(hModule);
+#endif
+}
+
+// Plugin entries are initialized once per module and shared by all instances.
+const clap_plugin_entry* get_clap_entry(const char* pluginPath) {
+    std::lock_guard<std::mutex> lock(modulesMutex);
+
+    auto it = entries.find(pluginPath);
+    if (it != entries.end()) {
+        return it->second;
+    }
+
+    const clap_plugin_entry* pluginEntry = nullptr;
+    if (!open_module(pluginPath, &pluginEntry)) {
+        std::cerr << "Failed to load plugin: " << pluginPath << std::endl;
+        return nullptr;
+    }
+
+    if (!pluginEntry || !pluginEntry->init(pluginPath)) {
+        std::cerr << "Failed to initialize CLAP plugin:" << pluginPath << std::endl;
+        return nullptr;
+    }
+
+    entries[pluginPath] = pluginEntry;
+    return pluginEntry;
+}
+
+bool scan_clap_module(const char* pluginPath, const std::function<void(const clap_plugin_entry* entry, bool shared)>& scan) {
+    std::lock_guard<std::mutex> lock(modulesMutex);
+
+    auto it = entries.find(pluginPath);
+    if (it != entries.end()) {
+        scan(it->second, true);
+        return true;
+    }
+
+    const clap_plugin_entry* pluginEntry = nullptr;
+    ModuleHandle hModule = open_module(pluginPath, &pluginEntry);
+    if (!hModule) {
+        return false;
+    }
+    bool initialized = pluginEntry && pluginEntry->init(pluginPath);
+    if (initialized) {
+        scan(pluginEntry, false);
+        pluginEntry->deinit();
+    }
+    close_module(hModule);
+    return initialized;
+}
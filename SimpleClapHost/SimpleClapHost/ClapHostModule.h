@@ -0,0 +1,16 @@
+#pragma once
+
+#include <functional>
+#include <clap/clap.h>
+
+// Loads the module once and returns its initialized entry, nullptr on failure.
+// Modules stay loaded until the process exits.
+// [main-thread]
+const clap_plugin_entry* get_clap_entry(const char* pluginPath);
+
+// Calls scan with the entry of a module for a quick look at its factories, false if the module
+// does not load. A module already loaded by get_clap_entry() is scanned through its shared
+// entry (shared is true); any other is loaded and initialized for the scan and unloaded again,
+// so a changed file is seen afresh.
+// [thread-safe]
+bool scan_clap_module(const char* pluginPath, const std::function<void(const clap_plugin_entry* entry, bool shared)>& scan);
@@ -0,0 +1,139 @@
+#include <algorithm>
+#include <cstring>
+#include "ClapHost.h"
+#include "ClapHostPool.h"
+
+// clap_ostream / clap_istream over a byte vector, used to copy state between instances
+static int64_t CLAP_ABI vector_write(const clap_ostream* stream, const void* buffer, uint64_t size) {
+    auto* bytes = static_cast<std::vector<uint8_t>*>(stream->ctx);
+    const uint8_t* src = static_cast<const uint8_t*>(buffer);
+    bytes->insert(bytes->end(), src, src + size);
+    return (int64_t)size;
+}
+
+struct VectorReader {
+    const std::vector<uint8_t>* bytes;
+    size_t pos;
+};
+
+static int64_t CLAP_ABI vector_read(const clap_istream* stream, void* buffer, uint64_t size) {
+    auto* reader = static_cast<VectorReader*>(stream->ctx);
+    size_t n = (size_t)std::min<uint64_t>(size, reader->bytes->size() - reader->pos);
+    memcpy(buffer, reader->bytes->data() + reader->pos, n);
+    reader->pos += n;
+    return (int64_t)n;
+}
+
+ClapHostPool::ClapHostPool(double rate, uint32_t minCount, uint32_t maxCount, size_t memoryBudget)
+    : sampleRate(rate), minFrames(minCount), maxFrames(maxCount), budget(memoryBudget) {
+}
+
+ClapHostPool::~ClapHostPool() {
+    for (Slot& slot : slots) {
+        for (ClapHostInstance* instance : slot.ready) {
+            destroy_clap_instance(instance);
+        }
+    }
+}
+
+int ClapHostPool::add(const char* pluginPath, uint32_t count, size_t instanceCost, ClapHostInstance* stateSource) {
+    Slot slot;
+    slot.path = pluginPath;
+    slot.count = count;
+    slot.ready.reserve(count);
+
+    if (stateSource) {
+        auto* state = static_cast<const clap_plugin_state*>(
+            stateSource->plugin->get_extension(stateSource->plugin, CLAP_EXT_STATE));
+        clap_ostream out = { &slot.state, vector_write };
+        if (!state || !state->save(stateSource->plugin, &out)) {
+            std::cerr << "Failed to save the plugin state for the pool: " << pluginPath << std::endl;
+            return -1;
+        }
+    }
+    slot.cost = instanceCost + slot.state.size();
+
+    slots.push_back(std::move(slot));
+    return (int)slots.size() - 1;
+}
+
+int ClapHostPool::find(const char* pluginPath) const {
+    for (size_t i = 0; i < slots.size(); i++) {
+        if (slots[i].path == pluginPath) {
+            return (int)i;
+        }
+    }
+    return -1;
+}
+
+void ClapHostPool::resize(int slot, uint32_t count) {
+    if (slot < 0 || (size_t)slot >= slots.size()) {
+        return;
+    }
+    Slot& s = slots[slot];
+    s.count = count;
+    s.ready.reserve(count);
+    while (s.ready.size() > count) {
+        destroy_clap_instance(s.ready.back());
+        s.ready.pop_back();
+        used -= s.cost;
+    }
+}
+
+ClapHostInstance* ClapHostPool::warm(Slot& slot) {
+    ClapHostInstance* instance = create_clap_instance(slot.path.c_str());
+    if (!instance) {
+        return nullptr;
+    }
+
+    // State is loaded while inactive, so the plugin can rebuild everything in activate()
+    if (!slot.state.empty()) {
+        auto* state = static_cast<const clap_plugin_state*>(
+            instance->plugin->get_extension(instance->plugin, CLAP_EXT_STATE));
+        VectorReader reader = { &slot.state, 0 };
+        clap_istream in = { &reader, vector_read };
+        if (!state || !state->load(instance->plugin, &in)) {
+            std::cerr << "Failed to load the pooled plugin state: " << slot.path << std::endl;
+            destroy_clap_instance(instance);
+            return nullptr;
+        }
+    }
+
+    if (!activate_clap_instance(instance, sampleRate, minFrames, maxFrames)) {
+        destroy_clap_instance(instance);
+        return nullptr;
+    }
+    return instance;
+}
+
+void ClapHostPool::refill() {
+    // Round robin over the slots so a single large slot cannot starve the others
+    bool added = true;
+    while (added) {
+        added = false;
+        for (Slot& slot : slots) {
+            if (slot.ready.size() >= slot.count || used + slot.cost > budget) {
+                continue;
+            }
+            ClapHostInstance* instance = warm(slot);
+            if (!instance) {
+                slot.count = (uint32_t)slot.ready.size(); // don't retry a broken plugin forever
+                continue;
+            }
+            slot.ready.push_back(instance);
+            used += slot.cost;
+            added = true;
+        }
+    }
+}
+
+ClapHostInstance* ClapHostPool::acquire(int slot) {
+    if (slot < 0 || (size_t)slot >= slots.size() || slots[slot].ready.empty()) {
+        return nullptr;
+    }
+    Slot& s = slots[slot];
+    ClapHostInstance* instance = s.ready.back();
+    s.ready.pop_back();
+    used -= s.cost;
+    return instance;
+}
@@ -0,0 +1,61 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include <vector>
+#include <clap/clap.h>
+
+struct ClapHostInstance;
+
+// Keeps activated but sleeping instances of frequently used plugins ready to be swapped in.
+//
+// Creating and activating a plugin can take a long time, so the pool does it ahead of use.
+// Each slot has an optional state blob which is loaded into every warmed instance. The number of
+// warm instances is bounded by a memory budget; the cost of one instance is its state size plus
+// an estimate given when the slot is added, since the host cannot see the plugin's allocations.
+//
+// All calls are [main-thread]. acquire() is constant time and hands out an instance that can be
+// staged on ClapHostSwap right away.
+class ClapHostPool {
+public:
+    ClapHostPool(double sampleRate, uint32_t minFrames, uint32_t maxFrames, size_t memoryBudget);
+    ~ClapHostPool();
+
+    ClapHostPool(const ClapHostPool&) = delete;
+    ClapHostPool& operator=(const ClapHostPool&) = delete;
+
+    // Registers a plugin and returns its slot index, or -1 if the state cannot be captured.
+    // If stateSource is given, its current state is saved and used for every instance of the slot.
+    int add(const char* pluginPath, uint32_t count, size_t instanceCost, ClapHostInstance* stateSource = nullptr);
+    int find(const char* pluginPath) const;
+
+    // Changes how many instances the slot keeps warm; instances above a lower count are destroyed.
+    void resize(int slot, uint32_t count);
+
+    // Creates instances until every slot holds its count, or the budget is exhausted.
+    void refill();
+
+    // Takes a warm instance from the slot, nullptr if none is ready.
+    ClapHostInstance* acquire(int slot);
+
+    size_t memoryUsed() const { return used; }
+    size_t memoryBudget() const { return budget; }
+
+private:
+    struct Slot {
+        std::string path;
+        uint32_t count = 0;
+        size_t cost = 0;
+        std::vector<uint8_t> state;
+        std::vector<ClapHostInstance*> ready; // capacity reserved for count
+    };
+
+    ClapHostInstance* warm(Slot& slot);
+
+    double sampleRate;
+    uint32_t minFrames;
+    uint32_t maxFrames;
+    size_t budget;
+    size_t used = 0;
+    std::vector<Slot> slots;
+};
@@ -0,0 +1,203 @@
+#include "ClapHost.h"
+#include "ClapHostPorts.h"
+
+static uint32_t hostInputChannels = 2;
+static uint32_t hostOutputChannels = 2;
+
+void use_clap_port_layout(uint32_t inputChannels, uint32_t outputChannels) {
+    hostInputChannels = inputChannels;
+    hostOutputChannels = outputChannels;
+}
+
+static const char* port_type(uint32_t channels) {
+    return channels == 1 ? CLAP_PORT_MONO : channels == 2 ? CLAP_PORT_STEREO : nullptr;
+}
+
+static bool configure_exact(ClapHostInstance* instance) {
+    auto* configurable = static_cast<const clap_plugin_configurable_audio_ports*>(
+        instance->plugin->get_extension(instance->plugin, CLAP_EXT_CONFIGURABLE_AUDIO_PORTS));
+    if (!configurable) {
+        configurable = static_cast<const clap_plugin_configurable_audio_ports*>(
+            instance->plugin->get_extension(instance->plugin, CLAP_EXT_CONFIGURABLE_AUDIO_PORTS_COMPAT));
+    }
+    if (!configurable) {
+        return false;
+    }
+
+    clap_audio_port_configuration_request requests[2];
+    uint32_t count = 0;
+    if (hostInputChannels > 0) {
+        requests[count++] = { true, 0, hostInputChannels, port_type(hostInputChannels), nullptr };
+    }
+    requests[count++] = { false, 0, hostOutputChannels, port_type(hostOutputChannels), nullptr };
+
+    return configurable->can_apply_configuration(instance->plugin, requests, count)
+        && configurable->apply_configuration(instance->plugin, requests, count);
+}
+
+// Channels processed in a configuration; ports besides the main ones are assumed as wide as them
+static uint32_t config_cost(const clap_audio_ports_config& config) {
+    uint32_t in = config.has_main_input ? config.main_input_channel_count : 0;
+    uint32_t out = config.has_main_output ? config.main_output_channel_count : 0;
+    uint32_t extraPorts = config.input_port_count - (config.has_main_input ? 1 : 0)
+                        + config.output_port_count - (config.has_main_output ? 1 : 0);
+    return in + out + extraPorts * (in > out ? in : out);
+}
+
+static bool select_cheapest(ClapHostInstance* instance) {
+    auto* configs = static_cast<const clap_plugin_audio_ports_config*>(
+        instance->plugin->get_extension(instance->plugin, CLAP_EXT_AUDIO_PORTS_CONFIG));
+    if (!configs) {
+        return false;
+    }
+
+    clap_id best = CLAP_INVALID_ID;
+    uint32_t bestCost = UINT32_MAX;
+    uint32_t count = configs->count(instance->plugin);
+    for (uint32_t i = 0; i < count; i++) {
+        clap_audio_ports_config config = {};
+        if (!configs->get(instance->plugin, i, &config)) {
+            continue;
+        }
+        bool inputFits = hostInputChannels == 0
+            || (config.has_main_input && config.main_input_channel_count >= hostInputChannels);
+        bool outputFits = config.has_main_output && config.main_output_channel_count >= hostOutputChannels;
+        uint32_t cost = config_cost(config);
+        if (inputFits && outputFits && cost < bestCost) {
+            best = config.id;
+            bestCost = cost;
+        }
+    }
+    return best != CLAP_INVALID_ID && configs->select(instance->plugin, best);
+}
+
+static uint32_t main_port_channels(ClapHostInstance* instance, const clap_plugin_audio_ports* ports, bool isInput) {
+    uint32_t count = ports->count(instance->plugin, isInput);
+    for (uint32_t i = 0; i < count; i++) {
+        clap_audio_port_info info = {};
+        if (ports->get(instance->plugin, i, isInput, &info) && (info.flags & CLAP_AUDIO_PORT_IS_MAIN)) {
+            return info.channel_count;
+        }
+    }
+    return 0;
+}
+
+void choose_clap_ports(ClapHostInstance* instance) {
+    if (instance->portsChosen || instance->active) {
+        return;
+    }
+    instance->portsChosen = true;
+
+    if (!configure_exact(instance)) {
+        select_cheapest(instance);
+    }
+
+    auto* ports = static_cast<const clap_plugin_audio_ports*>(
+        instance->plugin->get_extension(instance->plugin, CLAP_EXT_AUDIO_PORTS));
+    if (ports) {
+        instance->inputChannels = main_port_channels(instance, ports, true);
+        instance->outputChannels = main_port_channels(instance, ports, false);
+    }
+
+    auto* notePorts = static_cast<const clap_plugin_note_ports*>(
+        instance->plugin->get_extension(instance->plugin, CLAP_EXT_NOTE_PORTS));
+    clap_note_port_info info = {};
+    if (notePorts && notePorts->count(instance->plugin, true) > 0 && notePorts->get(instance->plugin, 0, true, &info)) {
+        instance->noteDialects = info.supported_dialects;
+        instance->preferredDialect = info.preferred_dialect;
+    }
+}
+
+static void connect_side(ClapHostInstance* instance, const clap_plugin_audio_ports* ports,
+                         const clap_plugin_audio_ports_activation* activation, bool isInput) {
+    ClapHostPortMap& map = instance->portMap;
+    std::vector<clap_audio_buffer>& buffers = isInput ? map.inputs : map.outputs;
+    std::vector<float*>& channels = isInput ? map.silentChannels : map.sinkChannels;
+    uint32_t& mainPort = isInput ? map.mainInput : map.mainOutput;
+
+    uint32_t count = ports->count(instance->plugin, isInput);
+    buffers.assign(count, clap_audio_buffer{});
+    mainPort = count > 0 ? 0 : UINT32_MAX;
+
+    uint32_t widest = 0;
+    for (uint32_t i = 0; i < count; i++) {
+        clap_audio_port_info info = {};
+        if (!ports->get(instance->plugin, i, isInput, &info)) {
+            continue;
+        }
+        if (info.flags & CLAP_AUDIO_PORT_IS_MAIN) {
+            mainPort = i;
+        }
+        buffers[i].channel_count = info.channel_count;
+        widest = info.channel_count > widest ? info.channel_count : widest;
+    }
+
+    // Every channel of every unconnected port points at the same memory
+    channels.assign(widest, isInput ? map.silence.data() : map.sink.data());
+    for (uint32_t i = 0; i < count; i++) {
+        bool connected = i == mainPort;
+        if (!connected) {
+            buffers[i].data32 = channels.data();
+            buffers[i].constant_mask = isInput ? ~0ull : 0;
+        }
+        if (activation) {
+            activation->set_active(instance->plugin, isInput, i, connected, 32);
+        }
+    }
+}
+
+void connect_clap_ports(ClapHostInstance* instance, uint32_t maxFrames) {
+    ClapHostPortMap& map = instance->portMap;
+    map = ClapHostPortMap();
+
+    auto* ports = static_cast<const clap_plugin_audio_ports*>(
+        instance->plugin->get_extension(instance->plugin, CLAP_EXT_AUDIO_PORTS));
+    if (!ports) {
+        return;     // the host's buffers are passed as they are
+    }
+    auto* activation = static_cast<const clap_plugin_audio_ports_activation*>(
+        instance->plugin->get_extension(instance->plugin, CLAP_EXT_AUDIO_PORTS_ACTIVATION));
+    if (!activation) {
+        activation = static_cast<const clap_plugin_audio_ports_activation*>(
+            instance->plugin->get_extension(instance->plugin, CLAP_EXT_AUDIO_PORTS_ACTIVATION_COMPAT));
+    }
+
+    map.silence.assign(maxFrames, 0.0f);
+    map.sink.assign(maxFrames, 0.0f);
+    connect_side(instance, ports, activation, true);
+    connect_side(instance, ports, activation, false);
+}
+
+clap_process map_clap_ports(ClapHostInstance* instance, const clap_process* process) {
+    ClapHostPortMap& map = instance->portMap;
+    clap_process block = *process;
+    if (map.inputs.empty() && map.outputs.empty()) {
+        return block;
+    }
+
+    if (map.mainInput < map.inputs.size()) {
+        if (process->audio_inputs_count > 0) {
+            map.inputs[map.mainInput] = process->audio_inputs[0];
+        }
+        else {
+            map.inputs[map.mainInput].data32 = map.silentChannels.data();
+            map.inputs[map.mainInput].constant_mask = ~0ull;
+        }
+    }
+    if (map.mainOutput < map.outputs.size() && process->audio_outputs_count > 0) {
+        map.outputs[map.mainOutput] = process->audio_outputs[0];
+    }
+
+    block.audio_inputs = map.inputs.data();
+    block.audio_inputs_count = (uint32_t)map.inputs.size();
+    block.audio_outputs = map.outputs.data();
+    block.audio_outputs_count = (uint32_t)map.outputs.size();
+    return block;
+}
+
+void finish_clap_ports(ClapHostInstance* instance, const clap_process* process) {
+    const ClapHostPortMap& map = instance->portMap;
+    if (map.mainOutput < map.outputs.size() && process->audio_outputs_count > 0) {
+        process->audio_outputs[0].constant_mask = map.outputs[map.mainOutput].constant_mask;
+    }
+}
@@ -0,0 +1,43 @@
+#pragma once
+
+#include <vector>
+#include <clap/clap.h>
+
+struct ClapHostInstance;
+
+// The plugin's full set of audio ports as seen by process(). Only the main ports are connected
+// to the host's buffers; the others are deactivated and get a shared constant zero input or a
+// shared sink output that nobody reads, so neither side spends work on them.
+struct ClapHostPortMap {
+    uint32_t mainInput = UINT32_MAX;    // port indices, UINT32_MAX if there is none
+    uint32_t mainOutput = UINT32_MAX;
+    std::vector<clap_audio_buffer> inputs;      // one per plugin port, empty without audio ports
+    std::vector<clap_audio_buffer> outputs;
+    std::vector<float*> silentChannels;
+    std::vector<float*> sinkChannels;
+    std::vector<float> silence;         // maxFrames zeros
+    std::vector<float> sink;            // maxFrames, overwritten by every unconnected output
+};
+
+// Channel counts the host feeds to and takes from the plugins' main ports, those of the device.
+// [main-thread]
+void use_clap_port_layout(uint32_t inputChannels, uint32_t outputChannels);
+
+// Puts the plugin in its cheapest port layout which still covers the host layout, before the
+// first activation. clap_plugin_configurable_audio_ports is asked for the exact layout first;
+// otherwise the clap_plugin_audio_ports_config entry with the fewest channels whose main ports
+// are wide enough is selected. Plugins offering neither keep their default.
+// Records the resulting main port widths in the instance, and the dialects of its first note input.
+// [main-thread & inactive]
+void choose_clap_ports(ClapHostInstance* instance);
+
+// Lays out the port map for blocks of up to maxFrames and deactivates the unconnected ports
+// through clap_plugin_audio_ports_activation.
+// [main-thread & inactive]
+void connect_clap_ports(ClapHostInstance* instance, uint32_t maxFrames);
+
+// Points the main ports of the map at the host's buffers and returns the block to process.
+// The outputs' constant_mask is copied back with finish_clap_ports().
+// [audio-thread]
+clap_process map_clap_ports(ClapHostInstance* instance, const clap_process* process);
+void finish_clap_ports(ClapHostInstance* instance, const clap_process* process);
@@ -0,0 +1,688 @@
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <iostream>
+#include <thread>
+#include "ClapHost.h"
+#include "ClapHostPresets.h"
+
+#define PRESET_INDEX_MAGIC 0x49504843u      // "CHPI"
+#define PRESET_INDEX_VERSION 1u
+
+// Words of the index records, see ClapHostPresetIndexer::write()
+#define HEADER_WORDS 8
+#define FILE_WORDS 8
+#define PRESET_WORDS 10
+#define TAG_WORDS 2
+
+enum { SECTION_FILES, SECTION_PRESETS, SECTION_ORDER, SECTION_TAGS, SECTION_LISTS, SECTION_STRINGS };
+
+typedef ClapHostPresetIndexer::Preset Preset;
+typedef ClapHostPresetIndexer::File File;
+typedef ClapHostPresetIndexer::Provider Provider;
+
+static std::string lower_case(const char* text) {
+    std::string lower = text ? text : "";
+    for (char& c : lower) {
+        c = (c >= 'A' && c <= 'Z') ? (char)(c - 'A' + 'a') : c;
+    }
+    return lower;
+}
+
+static std::string file_key(const std::string& provider, const std::string& path) {
+    return provider + '\n' + path;
+}
+
+//
+// Provider declarations
+//
+
+static bool CLAP_ABI declare_filetype(const clap_preset_discovery_indexer* indexer,
+                                      const clap_preset_discovery_filetype* filetype) {
+    Provider* provider = static_cast<Provider*>(indexer->indexer_data);
+    if (filetype->file_extension && filetype->file_extension[0]) {
+        provider->extensions.push_back("." + lower_case(filetype->file_extension));
+    }
+    return true;
+}
+
+static bool CLAP_ABI declare_location(const clap_preset_discovery_indexer* indexer,
+                                      const clap_preset_discovery_location* location) {
+    Provider* provider = static_cast<Provider*>(indexer->indexer_data);
+    bool inPlugin = location->kind == CLAP_PRESET_DISCOVERY_LOCATION_PLUGIN;
+    if (!inPlugin && !location->location) {
+        return false;
+    }
+    provider->locations.push_back({ location->flags, location->kind, inPlugin ? "" : location->location });
+    return true;
+}
+
+static bool CLAP_ABI declare_soundpack(const clap_preset_discovery_indexer* indexer,
+                                       const clap_preset_discovery_soundpack* soundpack) {
+    UNREFERENCED_PARAMETER(indexer);
+    UNREFERENCED_PARAMETER(soundpack);
+    return true;
+}
+
+static const void* CLAP_ABI indexer_get_extension(const clap_preset_discovery_indexer* indexer, const char* extensionId) {
+    UNREFERENCED_PARAMETER(indexer);
+    UNREFERENCED_PARAMETER(extensionId);
+    return nullptr;
+}
+
+static clap_preset_discovery_indexer make_indexer(Provider* declarations) {
+    return {
+        CLAP_VERSION,
+        "Clap Test Host",
+        "Device Drivers",
+        "http://www.devdrv.co.jp/",
+        "1.0",
+        declarations,
+        declare_filetype,
+        declare_location,
+        declare_soundpack,
+        indexer_get_extension,
+    };
+}
+
+//
+// Metadata receiver
+//
+
+struct Collector {
+    std::vector<Preset>* presets;
+    std::string fallbackName;
+    bool failed;
+};
+
+static Preset* current_preset(const clap_preset_discovery_metadata_receiver* receiver) {
+    Collector* collector = static_cast<Collector*>(receiver->receiver_data);
+    return collector->presets->empty() ? nullptr : &collector->presets->back();
+}
+
+static void CLAP_ABI on_error(const clap_preset_discovery_metadata_receiver* receiver, int32_t osError, const char* message) {
+    UNREFERENCED_PARAMETER(osError);
+    Collector* collector = static_cast<Collector*>(receiver->receiver_data);
+    collector->failed = true;
+    std::cerr << "Preset indexing error: " << (message ? message : "") << std::endl;
+}
+
+static bool CLAP_ABI begin_preset(const clap_preset_discovery_metadata_receiver* receiver, const char* name, const char* loadKey) {
+    Collector* collector = static_cast<Collector*>(receiver->receiver_data);
+    collector->presets->emplace_back();
+    collector->presets->back().name = name ? name : collector->fallbackName;
+    collector->presets->back().loadKey = loadKey ? loadKey : "";
+    return true;
+}
+
+static void CLAP_ABI add_plugin_id(const clap_preset_discovery_metadata_receiver* receiver, const clap_universal_plugin_id* pluginId) {
+    if (Preset* preset = current_preset(receiver)) {
+        preset->pluginIds.push_back(std::string(pluginId->abi) + ":" + pluginId->id);
+    }
+}
+
+static void CLAP_ABI set_soundpack_id(const clap_preset_discovery_metadata_receiver* receiver, const char* soundpackId) {
+    if (Preset* preset = current_preset(receiver)) {
+        preset->soundpack = soundpackId ? soundpackId : "";
+    }
+}
+
+static void CLAP_ABI set_flags(const clap_preset_discovery_metadata_receiver* receiver, uint32_t flags) {
+    if (Preset* preset = current_preset(receiver)) {
+        preset->flags = flags;
+    }
+}
+
+static void CLAP_ABI add_creator(const clap_preset_discovery_metadata_receiver* receiver, const char* creator) {
+    if (Preset* preset = current_preset(receiver)) {
+        preset->creators.push_back(creator ? creator : "");
+    }
+}
+
+static void CLAP_ABI set_description(const clap_preset_discovery_metadata_receiver* receiver, const char* description) {
+    if (Preset* preset = current_preset(receiver)) {
+        preset->description = description ? description : "";
+    }
+}
+
+static void CLAP_ABI set_timestamps(const clap_preset_discovery_metadata_receiver* receiver,
+                                    clap_timestamp creationTime, clap_timestamp modificationTime) {
+    UNREFERENCED_PARAMETER(receiver);
+    UNREFERENCED_PARAMETER(creationTime);
+    UNREFERENCED_PARAMETER(modificationTime);
+}
+
+static void CLAP_ABI add_feature(const clap_preset_discovery_metadata_receiver* receiver, const char* feature) {
+    if (Preset* preset = current_preset(receiver)) {
+        preset->features.push_back(feature ? feature : "");
+    }
+}
+
+static void CLAP_ABI add_extra_info(const clap_preset_discovery_metadata_receiver* receiver, const char* key, const char* value) {
+    UNREFERENCED_PARAMETER(receiver);
+    UNREFERENCED_PARAMETER(key);
+    UNREFERENCED_PARAMETER(value);
+}
+
+//
+// ClapHostPresetIndexer
+//
+
+bool ClapHostPresetIndexer::addPlugin(const char* pluginPath) {
+    const clap_plugin_entry* entry = get_clap_entry(pluginPath);
+    if (!entry) {
+        return false;
+    }
+    auto* factory = static_cast<const clap_preset_discovery_factory*>(entry->get_factory(CLAP_PRESET_DISCOVERY_FACTORY_ID));
+    if (!factory) {
+        factory = static_cast<const clap_preset_discovery_factory*>(entry->get_factory(CLAP_PRESET_DISCOVERY_FACTORY_ID_COMPAT));
+    }
+    if (!factory) {
+        std::cerr << "The plugin has no preset providers: " << pluginPath << std::endl;
+        return false;
+    }
+
+    uint32_t count = factory->count(factory);
+    for (uint32_t i = 0; i < count; i++) {
+        const clap_preset_discovery_provider_descriptor* desc = factory->get_descriptor(factory, i);
+        if (!desc || std::any_of(providers.begin(), providers.end(), [&](const Provider& p) { return p.id == desc->id; })) {
+            continue;
+        }
+
+        Provider provider;
+        provider.factory = factory;
+        provider.id = desc->id;
+        provider.pluginPath = pluginPath;
+
+        // The declarations are made from init()
+        clap_preset_discovery_indexer indexer = make_indexer(&provider);
+        const clap_preset_discovery_provider* instance = factory->create(factory, &indexer, desc->id);
+        if (!instance) {
+            continue;
+        }
+        bool initialized = instance->init(instance);
+        instance->destroy(instance);
+        if (initialized) {
+            providers.push_back(std::move(provider));
+        }
+    }
+    return !providers.empty();
+}
+
+static void modification_of(const std::filesystem::path& path, int64_t& modified, uint64_t& size) {
+    std::error_code error;
+    modified = (int64_t)std::filesystem::last_write_time(path, error).time_since_epoch().count();
+    size = std::filesystem::file_size(path, error);
+    if (error) {
+        size = 0;
+    }
+}
+
+uint32_t ClapHostPresetIndexer::crawl(uint32_t numThreads) {
+    struct Job {
+        uint32_t provider;
+        File file;
+    };
+    std::vector<Job> jobs;
+
+    for (auto& entry : files) {
+        entry.second.seen = false;
+    }
+    auto visit = [&](uint32_t p, const Provider::Location& location, const std::string& path) {
+        File probe;
+        probe.provider = providers[p].id;
+        probe.path = path;
+        probe.kind = location.kind;
+        probe.flags = location.flags;
+        // Presets inside the plugin change with the plugin binary
+        modification_of(path.empty() ? std::filesystem::u8path(providers[p].pluginPath) : std::filesystem::u8path(path),
+                        probe.modified, probe.size);
+
+        auto known = files.find(file_key(probe.provider, path));
+        if (known != files.end() && known->second.modified == probe.modified && known->second.size == probe.size) {
+            known->second.seen = true;
+            return;
+        }
+        jobs.push_back({ p, std::move(probe) });
+    };
+
+    // Walking the file system is cheap next to the providers reading the files
+    for (uint32_t p = 0; p < providers.size(); p++) {
+        const Provider& provider = providers[p];
+        for (const Provider::Location& location : provider.locations) {
+            if (location.kind == CLAP_PRESET_DISCOVERY_LOCATION_PLUGIN) {
+                visit(p, location, "");
+                continue;
+            }
+            std::error_code error;
+            std::filesystem::path root = std::filesystem::u8path(location.path);
+            if (!std::filesystem::is_directory(root, error)) {
+                visit(p, location, location.path);
+                continue;
+            }
+            auto options = std::filesystem::directory_options::skip_permission_denied;
+            for (auto it = std::filesystem::recursive_directory_iterator(root, options, error);
+                 !error && it != std::filesystem::recursive_directory_iterator(); it.increment(error)) {
+                if (!it->is_regular_file(error)) {
+                    continue;
+                }
+                std::string extension = lower_case(it->path().extension().u8string().c_str());
+                if (provider.extensions.empty()
+                    || std::find(provider.extensions.begin(), provider.extensions.end(), extension) != provider.extensions.end()) {
+                    visit(p, location, it->path().u8string());
+                }
+            }
+        }
+    }
+
+    // Providers are not thread-safe, every worker makes its own from the thread-safe factory
+    std::atomic<size_t> next{ 0 };
+    auto worker = [&]() {
+        std::vector<const clap_preset_discovery_provider*> own(providers.size(), nullptr);
+        Provider declarations;
+        clap_preset_discovery_indexer indexer = make_indexer(&declarations);
+
+        for (size_t j = next++; j < jobs.size(); j = next++) {
+            Job& job = jobs[j];
+            const Provider& provider = providers[job.provider];
+            const clap_preset_discovery_provider*& instance = own[job.provider];
+            if (!instance) {
+                instance = provider.factory->create(provider.factory, &indexer, provider.id.c_str());
+                if (instance && !instance->init(instance)) {
+                    instance->destroy(instance);
+                    instance = nullptr;
+                }
+            }
+            if (!instance) {
+                continue;
+            }
+
+            Collector collector = { &job.file.presets, std::filesystem::u8path(job.file.path).stem().u8string(), false };
+            clap_preset_discovery_metadata_receiver receiver = {
+                &collector, on_error, begin_preset, add_plugin_id, set_soundpack_id, set_flags,
+                add_creator, set_description, set_timestamps, add_feature, add_extra_info,
+            };
+            bool read = instance->get_metadata(instance, job.file.kind,
+                                               job.file.kind == CLAP_PRESET_DISCOVERY_LOCATION_PLUGIN ? nullptr : job.file.path.c_str(),
+                                               &receiver);
+            if (!read || collector.failed) {
+                job.file.presets.clear();
+            }
+        }
+        for (const clap_preset_discovery_provider* instance : own) {
+            if (instance) {
+                instance->destroy(instance);
+            }
+        }
+    };
+
+    numThreads = std::max<uint32_t>(1, std::min<uint32_t>(numThreads, (uint32_t)jobs.size()));
+    std::vector<std::thread> workers;
+    for (uint32_t i = 1; i < numThreads; i++) {
+        workers.emplace_back(worker);
+    }
+    worker();
+    for (std::thread& thread : workers) {
+        thread.join();
+    }
+
+    for (Job& job : jobs) {
+        job.file.seen = true;
+        files[file_key(job.file.provider, job.file.path)] = std::move(job.file);
+    }
+    // Files of providers which were not registered this time were not looked for, they stay
+    for (auto it = files.begin(); it != files.end();) {
+        bool crawled = std::any_of(providers.begin(), providers.end(),
+                                   [&](const Provider& p) { return p.id == it->second.provider; });
+        it = it->second.seen || !crawled ? std::next(it) : files.erase(it);
+    }
+    return (uint32_t)jobs.size();
+}
+
+size_t ClapHostPresetIndexer::presetCount() const {
+    size_t count = 0;
+    for (const auto& entry : files) {
+        count += entry.second.presets.size();
+    }
+    return count;
+}
+
+//
+// Index file: HEADER_WORDS words (magic, version, file, preset, tag, list word and string byte
+// counts, reserved), then the file records, the preset records, the name order, the tag records,
+// the lists (a count followed by string offsets or preset indices) and the strings.
+// Strings are NUL terminated and shared; offset 0 is the empty string.
+//
+
+namespace {
+class IndexWriter {
+public:
+    uint32_t string(const std::string& text) {
+        if (text.empty()) {
+            return 0;
+        }
+        auto it = offsets.find(text);
+        if (it != offsets.end()) {
+            return it->second;
+        }
+        uint32_t offset = (uint32_t)strings.size();
+        strings.insert(strings.end(), text.begin(), text.end());
+        strings.push_back('\0');
+        offsets.emplace(text, offset);
+        return offset;
+    }
+
+    uint32_t list(const std::vector<std::string>& items) {
+        uint32_t offset = (uint32_t)lists.size();
+        lists.push_back((uint32_t)items.size());
+        for (const std::string& item : items) {
+            uint32_t s = string(item);
+            lists.push_back(s);
+        }
+        return offset;
+    }
+
+    uint32_t list(const std::vector<uint32_t>& items) {
+        uint32_t offset = (uint32_t)lists.size();
+        lists.push_back((uint32_t)items.size());
+        lists.insert(lists.end(), items.begin(), items.end());
+        return offset;
+    }
+
+    std::vector<char> strings{ '\0' };
+    std::vector<uint32_t> lists;
+
+private:
+    std::map<std::string, uint32_t> offsets;
+};
+}
+
+bool ClapHostPresetIndexer::write(const char* path) const {
+    IndexWriter writer;
+    std::vector<uint32_t> fileTable, presetTable;
+    std::vector<std::string> keys;
+    std::map<std::string, std::vector<uint32_t>> tags;
+
+    for (const auto& entry : files) {
+        const File& file = entry.second;
+        uint32_t fileIndex = (uint32_t)(fileTable.size() / FILE_WORDS);
+        fileTable.insert(fileTable.end(), {
+            writer.string(file.provider), writer.string(file.path), file.kind, file.flags,
+            (uint32_t)file.modified, (uint32_t)((uint64_t)file.modified >> 32),
+            (uint32_t)file.size, (uint32_t)(file.size >> 32),
+        });
+        for (const Preset& preset : file.presets) {
+            uint32_t presetIndex = (uint32_t)keys.size();
+            keys.push_back(lower_case(preset.name.c_str()));
+            presetTable.insert(presetTable.end(), {
+                writer.string(preset.name), writer.string(keys.back()), writer.string(preset.loadKey),
+                writer.string(preset.description), writer.string(preset.soundpack), preset.flags, fileIndex,
+                writer.list(preset.pluginIds), writer.list(preset.creators), writer.list(preset.features),
+            });
+            for (const std::string& feature : preset.features) {
+                std::vector<uint32_t>& postings = tags[lower_case(feature.c_str())];
+                if (postings.empty() || postings.back() != presetIndex) {
+                    postings.push_back(presetIndex);
+                }
+            }
+        }
+    }
+
+    std::vector<uint32_t> order(keys.size());
+    for (uint32_t i = 0; i < order.size(); i++) {
+        order[i] = i;
+    }
+    std::stable_sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) { return keys[a] < keys[b]; });
+
+    // std::map keeps the tags sorted
+    std::vector<uint32_t> tagTable;
+    for (const auto& tag : tags) {
+        tagTable.push_back(writer.string(tag.first));
+        tagTable.push_back(writer.list(tag.second));
+    }
+    while (writer.strings.size() % 4) {
+        writer.strings.push_back('\0');
+    }
+
+    uint32_t header[HEADER_WORDS] = {
+        PRESET_INDEX_MAGIC, PRESET_INDEX_VERSION,
+        (uint32_t)(fileTable.size() / FILE_WORDS), (uint32_t)keys.size(), (uint32_t)(tagTable.size() / TAG_WORDS),
+        (uint32_t)writer.lists.size(), (uint32_t)writer.strings.size(), 0,
+    };
+
+    std::string tempPath = std::string(path) + ".tmp";
+    FILE* f = fopen(tempPath.c_str(), "wb");
+    if (!f) {
+        std::cerr << "Failed to write the preset index: " << path << std::endl;
+        return false;
+    }
+    auto put = [f](const void* data, size_t bytes) { return bytes == 0 || fwrite(data, bytes, 1, f) == 1; };
+    bool ok = put(header, sizeof(header))
+        && put(fileTable.data(), fileTable.size() * 4)
+        && put(presetTable.data(), presetTable.size() * 4)
+        && put(order.data(), order.size() * 4)
+        && put(tagTable.data(), tagTable.size() * 4)
+        && put(writer.lists.data(), writer.lists.size() * 4)
+        && put(writer.strings.data(), writer.strings.size());
+    ok = fclose(f) == 0 && ok;
+
+    // A mapped index may still be open on it, so the new one is moved in place only when complete
+    std::remove(path);
+    if (!ok || std::rename(tempPath.c_str(), path) != 0) {
+        std::cerr << "Failed to write the preset index: " << path << std::endl;
+        std::remove(tempPath.c_str());
+        return false;
+    }
+    return true;
+}
+
+bool ClapHostPresetIndexer::read(const char* path) {
+    ClapHostPresetIndex index;
+    if (!index.open(path)) {
+        return false;
+    }
+
+    // Rebuilt from the tables open() checked
+    const uint32_t* header = reinterpret_cast<const uint32_t*>(index.file.data());
+    const uint32_t* fileTable = index.table(SECTION_FILES);
+    const uint32_t* presetTable = index.table(SECTION_PRESETS);
+    const uint32_t* lists = index.table(SECTION_LISTS);
+    const char* strings = index.text(0);
+
+    auto strings_of = [&](uint32_t list) {
+        std::vector<std::string> items;
+        for (uint32_t i = 0; i < lists[list]; i++) {
+            items.push_back(strings + lists[list + 1 + i]);
+        }
+        return items;
+    };
+
+    std::vector<File*> byIndex;
+    files.clear();
+    for (uint32_t i = 0; i < header[2]; i++) {
+        const uint32_t* r = fileTable + (size_t)i * FILE_WORDS;
+        File file;
+        file.provider = strings + r[0];
+        file.path = strings + r[1];
+        file.kind = r[2];
+        file.flags = r[3];
+        file.modified = (int64_t)((uint64_t)r[5] << 32 | r[4]);
+        file.size = (uint64_t)r[7] << 32 | r[6];
+        File& stored = files[file_key(file.provider, file.path)] = std::move(file);
+        byIndex.push_back(&stored);
+    }
+    for (uint32_t i = 0; i < header[3]; i++) {
+        const uint32_t* r = presetTable + (size_t)i * PRESET_WORDS;
+        Preset preset;
+        preset.name = strings + r[0];
+        preset.loadKey = strings + r[2];
+        preset.description = strings + r[3];
+        preset.soundpack = strings + r[4];
+        preset.flags = r[5];
+        preset.pluginIds = strings_of(r[7]);
+        preset.creators = strings_of(r[8]);
+        preset.features = strings_of(r[9]);
+        byIndex[r[6]]->presets.push_back(std::move(preset));
+    }
+    return true;
+}
+
+//
+// ClapHostPresetIndex
+//
+
+// Every offset and index of the tables points inside its section, so neither the searches nor
+// ClapHostPresetIndexer::read() need to check them. The sizes of the sections match the file.
+static bool index_is_valid(const uint32_t* header) {
+    uint32_t numFiles = header[2], numPresets = header[3], numTags = header[4];
+    uint32_t listWords = header[5], stringBytes = header[6];
+    const uint32_t* fileTable = header + HEADER_WORDS;
+    const uint32_t* presetTable = fileTable + (size_t)numFiles * FILE_WORDS;
+    const uint32_t* order = presetTable + (size_t)numPresets * PRESET_WORDS;
+    const uint32_t* tagTable = order + numPresets;
+    const uint32_t* lists = tagTable + (size_t)numTags * TAG_WORDS;
+    const char* strings = reinterpret_cast<const char*>(lists + listWords);
+
+    // Strings end with their NUL, so the last byte is one
+    if (stringBytes == 0 || strings[stringBytes - 1] != '\0') {
+        return false;
+    }
+    auto list_is_valid = [&](uint32_t list, uint32_t limit) {
+        if (list >= listWords || lists[list] > listWords - list - 1) {
+            return false;
+        }
+        return std::all_of(lists + list + 1, lists + list + 1 + lists[list], [&](uint32_t item) { return item < limit; });
+    };
+
+    for (uint32_t i = 0; i < numFiles; i++) {
+        const uint32_t* r = fileTable + (size_t)i * FILE_WORDS;
+        if (r[0] >= stringBytes || r[1] >= stringBytes) {
+            return false;
+        }
+    }
+    for (uint32_t i = 0; i < numPresets; i++) {
+        const uint32_t* r = presetTable + (size_t)i * PRESET_WORDS;
+        if (std::any_of(r, r + 5, [&](uint32_t offset) { return offset >= stringBytes; }) || r[6] >= numFiles
+            || !list_is_valid(r[7], stringBytes) || !list_is_valid(r[8], stringBytes) || !list_is_valid(r[9], stringBytes)
+            || order[i] >= numPresets) {
+            return false;
+        }
+    }
+    for (uint32_t i = 0; i < numTags; i++) {
+        const uint32_t* r = tagTable + (size_t)i * TAG_WORDS;
+        if (r[0] >= stringBytes || !list_is_valid(r[1], numPresets)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool ClapHostPresetIndex::open(const char* path) {
+    if (!file.open(path) || file.size() < HEADER_WORDS * 4) {
+        file.close();
+        return false;
+    }
+    const uint32_t* header = reinterpret_cast<const uint32_t*>(file.data());
+    uint64_t words = HEADER_WORDS + (uint64_t)header[2] * FILE_WORDS + (uint64_t)header[3] * (PRESET_WORDS + 1)
+                   + (uint64_t)header[4] * TAG_WORDS + header[5];
+    if (header[0] != PRESET_INDEX_MAGIC || header[1] != PRESET_INDEX_VERSION || words * 4 + header[6] != file.size()
+        || !index_is_valid(header)) {
+        std::cerr << "The preset index is damaged: " << path << std::endl;
+        file.close();
+        return false;
+    }
+    return true;
+}
+
+uint32_t ClapHostPresetIndex::size() const {
+    return file.isOpen() ? reinterpret_cast<const uint32_t*>(file.data())[3] : 0;
+}
+
+const uint32_t* ClapHostPresetIndex::table(uint32_t section) const {
+    const uint32_t* header = reinterpret_cast<const uint32_t*>(file.data());
+    const uint32_t* p = header + HEADER_WORDS;
+    const size_t sizes[] = {
+        (size_t)header[2] * FILE_WORDS, (size_t)header[3] * PRESET_WORDS, header[3], (size_t)header[4] * TAG_WORDS, header[5],
+    };
+    for (uint32_t s = 0; s < section; s++) {
+        p += sizes[s];
+    }
+    return p;
+}
+
+const char* ClapHostPresetIndex::text(uint32_t offset) const {
+    return reinterpret_cast<const char*>(table(SECTION_STRINGS)) + offset;
+}
+
+std::vector<uint32_t> ClapHostPresetIndex::findPrefix(const char* prefix, size_t limit) const {
+    std::vector<uint32_t> found;
+    if (!file.isOpen()) {
+        return found;
+    }
+    std::string key = lower_case(prefix);
+    const uint32_t* presets = table(SECTION_PRESETS);
+    const uint32_t* order = table(SECTION_ORDER);
+    auto keyOf = [&](uint32_t preset) { return text(presets[(size_t)preset * PRESET_WORDS + 1]); };
+
+    const uint32_t* first = std::lower_bound(order, order + size(), key, [&](uint32_t preset, const std::string& k) {
+        return strcmp(keyOf(preset), k.c_str()) < 0;
+    });
+    for (const uint32_t* it = first; it != order + size() && found.size() < limit; ++it) {
+        if (strncmp(keyOf(*it), key.c_str(), key.size()) != 0) {
+            break;
+        }
+        found.push_back(*it);
+    }
+    return found;
+}
+
+std::vector<uint32_t> ClapHostPresetIndex::findTag(const char* feature) const {
+    std::vector<uint32_t> found;
+    if (!file.isOpen()) {
+        return found;
+    }
+    std::string tag = lower_case(feature);
+    const uint32_t* tags = table(SECTION_TAGS);
+    const uint32_t* lists = table(SECTION_LISTS);
+    uint32_t lo = 0, hi = reinterpret_cast<const uint32_t*>(file.data())[4];
+    while (lo < hi) {
+        uint32_t mid = (lo + hi) / 2;
+        int order = strcmp(text(tags[mid * TAG_WORDS]), tag.c_str());
+        if (order == 0) {
+            const uint32_t* postings = lists + tags[mid * TAG_WORDS + 1];
+            found.assign(postings + 1, postings + 1 + postings[0]);
+            break;
+        }
+        if (order < 0) {
+            lo = mid + 1;
+        }
+        else {
+            hi = mid;
+        }
+    }
+    return found;
+}
+
+const char* ClapHostPresetIndex::name(uint32_t preset) const {
+    return text(table(SECTION_PRESETS)[(size_t)preset * PRESET_WORDS]);
+}
+
+const char* ClapHostPresetIndex::loadKey(uint32_t preset) const {
+    return text(table(SECTION_PRESETS)[(size_t)preset * PRESET_WORDS + 2]);
+}
+
+const char* ClapHostPresetIndex::location(uint32_t preset) const {
+    uint32_t fileIndex = table(SECTION_PRESETS)[(size_t)preset * PRESET_WORDS + 6];
+    return text(table(SECTION_FILES)[(size_t)fileIndex * FILE_WORDS + 1]);
+}
+
+std::vector<const char*> ClapHostPresetIndex::pluginIds(uint32_t preset) const {
+    const uint32_t* list = table(SECTION_LISTS) + table(SECTION_PRESETS)[(size_t)preset * PRESET_WORDS + 7];
+    std::vector<const char*> ids;
+    for (uint32_t i = 0; i < list[0]; i++) {
+        ids.push_back(text(list[1 + i]));
+    }
+    return ids;
+}
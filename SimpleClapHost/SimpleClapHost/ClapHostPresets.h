@@ -0,0 +1,112 @@
+#pragma once
+
+#include <cstdint>
+#include <map>
+#include <string>
+#include <vector>
+#include <clap/clap.h>
+#include "ClapHostMappedFile.h"
+
+// Preset browser index built from the plugins' clap_preset_discovery_factory.
+//
+// ClapHostPresetIndexer asks every provider for its file types and locations, walks the
+// locations and has workers call get_metadata() on the preset files. Providers are not
+// thread-safe but their factory is, so each worker creates its own provider instances.
+// Files are remembered with their size and modification time, and a re-crawl only asks the
+// providers about files which changed; the others keep their metadata.
+//
+// The index is written as one file of flat tables that ClapHostPresetIndex maps and searches
+// in place: presets sorted by lower-case name for prefix search, and a sorted feature table with
+// posting lists for tag search.
+
+// Index file of the console commands
+#define PRESET_INDEX_PATH "presets.idx"
+
+class ClapHostPresetIndexer {
+public:
+    ClapHostPresetIndexer() = default;
+
+    ClapHostPresetIndexer(const ClapHostPresetIndexer&) = delete;
+    ClapHostPresetIndexer& operator=(const ClapHostPresetIndexer&) = delete;
+
+    // Registers the preset providers of a plugin module, false if it has none.
+    // [main-thread]
+    bool addPlugin(const char* pluginPath);
+
+    // Crawls every location with numThreads workers; returns the number of files read.
+    // [main-thread]
+    uint32_t crawl(uint32_t numThreads);
+
+    // Writes the index, and reads back the metadata of a previous one so the next crawl is
+    // incremental.
+    bool write(const char* path) const;
+    bool read(const char* path);
+
+    size_t presetCount() const;
+
+    struct Preset {
+        std::string name;
+        std::string loadKey;
+        std::string description;
+        std::string soundpack;
+        uint32_t flags = 0;
+        std::vector<std::string> pluginIds;     // "abi:id"
+        std::vector<std::string> creators;
+        std::vector<std::string> features;
+    };
+
+    struct File {
+        std::string provider;
+        std::string path;                       // empty for presets inside the plugin
+        uint32_t kind = CLAP_PRESET_DISCOVERY_LOCATION_FILE;
+        uint32_t flags = 0;                     // of the location
+        int64_t modified = 0;
+        uint64_t size = 0;
+        bool seen = false;                      // found by the current crawl
+        std::vector<Preset> presets;
+    };
+
+    struct Provider {
+        const clap_preset_discovery_factory* factory = nullptr;
+        std::string id;
+        std::string pluginPath;
+        std::vector<std::string> extensions;    // lower case with the dot, empty for any
+        struct Location {
+            uint32_t flags;
+            uint32_t kind;
+            std::string path;
+        };
+        std::vector<Location> locations;
+    };
+
+private:
+    std::vector<Provider> providers;
+    std::map<std::string, File> files;          // by provider id and path
+};
+
+class ClapHostPresetIndex {
+public:
+    // Rejects an index whose offsets or indices point outside their tables
+    bool open(const char* path);
+    void close() { file.close(); }
+
+    uint32_t size() const;
+
+    // Presets whose name starts with prefix, case-insensitive, in name order
+    std::vector<uint32_t> findPrefix(const char* prefix, size_t limit) const;
+    // Presets with the feature, case-insensitive
+    std::vector<uint32_t> findTag(const char* feature) const;
+
+    const char* name(uint32_t preset) const;
+    const char* location(uint32_t preset) const;
+    const char* loadKey(uint32_t preset) const;
+    std::vector<const char*> pluginIds(uint32_t preset) const;
+
+private:
+    friend class ClapHostPresetIndexer;
+
+    const uint32_t* table(uint32_t section) const;
+    const char* text(uint32_t offset) const;
+
+    ClapHostMappedFile file;
+};
@@ -0,0 +1,192 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <vector>
+#include "ClapHost.h"
+#include "ClapHostExtensions.h"
+#include "ClapHostMidiFile.h"
+#include "ClapHostPorts.h"
+#include "ClapHostRender.h"
+#include "ClapHostTransport.h"
+
+#define RENDER_CHANNELS 2
+#define WAVE_FORMAT_FLOAT 3
+
+static void put_le(std::ofstream& out, uint32_t value, int bytes) {
+    for (int i = 0; i < bytes; i++) {
+        out.put((char)(value >> (8 * i)));
+    }
+}
+
+// Interleaved 32-bit float samples as a RIFF WAVE file
+static bool write_wav(const char* path, const std::vector<float>& samples, uint32_t sampleRate) {
+    std::ofstream out(path, std::ios::binary);
+    if (!out) {
+        std::cerr << "Failed to create the WAV file: " << path << std::endl;
+        return false;
+    }
+    uint32_t dataSize = (uint32_t)(samples.size() * sizeof(float));
+    out.write("RIFF", 4);
+    put_le(out, 36 + dataSize, 4);
+    out.write("WAVEfmt ", 8);
+    put_le(out, 16, 4);
+    put_le(out, WAVE_FORMAT_FLOAT, 2);
+    put_le(out, RENDER_CHANNELS, 2);
+    put_le(out, sampleRate, 4);
+    put_le(out, sampleRate * RENDER_CHANNELS * sizeof(float), 4);
+    put_le(out, RENDER_CHANNELS * sizeof(float), 2);
+    put_le(out, 32, 2);
+    out.write("data", 4);
+    put_le(out, dataSize, 4);
+    for (float sample : samples) {
+        uint32_t bits;
+        memcpy(&bits, &sample, sizeof(bits));
+        put_le(out, bits, 4);
+    }
+    if (!out) {
+        std::cerr << "Failed to write the WAV file: " << path << std::endl;
+        return false;
+    }
+    return true;
+}
+
+bool render_midi_file(const char* pluginPath, const char* midiPath, const char* wavPath, double sampleRate,
+                      uint32_t blockFrames, double tailSeconds, ClapHostRenderReport* report) {
+    auto file = std::make_shared<ClapHostMidiFile>();
+    if (!file->read(midiPath)) {
+        return false;
+    }
+
+    use_clap_port_layout(RENDER_CHANNELS, RENDER_CHANNELS);
+    ClapHostInstance* instance = create_clap_instance(pluginPath);
+    if (!instance) {
+        return false;
+    }
+    if (!activate_clap_instance(instance, sampleRate, 1, blockFrames)) {
+        destroy_clap_instance(instance);
+        return false;
+    }
+
+    // The song is the file: its tempo and meters, played from the start
+    ClapHostTransport transport;
+    ClapHostMidiPlayer player;
+    transport.setTempoChanges(file->tempoChanges());
+    transport.setMeterChanges(file->meterChanges());
+    transport.prepare(sampleRate);
+    player.prepare(sampleRate);
+    player.setDialects(instance->preferredDialect, instance->noteDialects);
+    player.load(file, *transport.tempoMap());
+    transport.requestPlay(true);
+    use_clap_transport(&transport);
+    if (instance->noteDialects == 0) {
+        std::cerr << "The plugin has no note input, rendering without notes." << std::endl;
+    }
+
+    ClapHostInputEvents blockEvents;
+    blockEvents.reserve(TRANSPORT_MAX_EVENTS + MIDI_PLAYER_MAX_EVENTS,
+                        TRANSPORT_MAX_EVENTS * sizeof(clap_event_transport) + MIDI_PLAYER_EVENT_BYTES);
+
+    std::vector<float> silence(blockFrames * RENDER_CHANNELS);
+    std::vector<float> rendered(blockFrames * RENDER_CHANNELS);
+    float* inputs[RENDER_CHANNELS] = { silence.data(), silence.data() + blockFrames };
+    float* outputs[RENDER_CHANNELS] = { rendered.data(), rendered.data() + blockFrames };
+    clap_audio_buffer input = {};
+    clap_audio_buffer output = {};
+    input.data32 = inputs;
+    input.channel_count = RENDER_CHANNELS;
+    output.data32 = outputs;
+    output.channel_count = RENDER_CHANNELS;
+
+    double songSeconds = transport.tempoMap()->secondsAt(file->length()) + tailSeconds;
+    uint64_t total = (uint64_t)std::ceil(songSeconds * sampleRate);
+    std::vector<float> samples;
+    samples.reserve(total * RENDER_CHANNELS);
+
+    *report = ClapHostRenderReport();
+    auto start = std::chrono::steady_clock::now();
+    for (uint64_t done = 0; done < total;) {
+        uint32_t frames = (uint32_t)std::min<uint64_t>(blockFrames, total - done);
+        transport.process(frames);
+        player.process(transport);
+        blockEvents.clear();
+        blockEvents.merge(transport.events(), player.events(), true);
+
+        clap_process process = {};
+        process.frames_count = frames;
+        process.steady_time = transport.steadyTime();
+        process.transport = transport.blockTransport();
+        process.audio_inputs = &input;
+        process.audio_outputs = &output;
+        process.audio_inputs_count = 1;
+        process.audio_outputs_count = 1;
+        process.in_events = blockEvents.list();
+        process.out_events = nullptr;
+
+        mark_clap_audio_thread(true);
+        auto blockStart = std::chrono::steady_clock::now();
+        process_clap_instance(instance, &process);
+        auto elapsed = std::chrono::steady_clock::now() - blockStart;
+        mark_clap_audio_thread(false);
+
+        uint64_t ns = (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count();
+        report->processNs += ns;
+        report->maxBlockNs = std::max(report->maxBlockNs, ns);
+        report->events += blockEvents.size();
+        report->blocks++;
+        for (uint32_t i = 0; i < frames; i++) {
+            samples.push_back(outputs[0][i]);
+            samples.push_back(outputs[1][i]);
+        }
+        done += frames;
+
+        // Between blocks this is the main thread
+        if (instance->callbackRequested.exchange(false)) {
+            instance->plugin->on_main_thread(instance->plugin);
+        }
+        service_clap_outputs(instance);
+        transport.service();
+        player.service(*transport.tempoMap());
+    }
+    report->seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    report->frames = total;
+
+    mark_clap_audio_thread(true);
+    stop_clap_processing(instance);
+    mark_clap_audio_thread(false);
+    destroy_clap_instance(instance);
+    use_clap_transport(nullptr);
+
+    return write_wav(wavPath, samples, (uint32_t)sampleRate);
+}
+
+int run_offline_render(int ac, char** av) {
+    if (ac < 3) {
+        std::cout << "Usage : render <plugin path> <MIDI file> <WAV file> [sample rate] [block frames]" << std::endl;
+        return 1;
+    }
+    double sampleRate = ac > 3 ? atof(av[3]) : RENDER_SAMPLE_RATE;
+    uint32_t blockFrames = ac > 4 ? (uint32_t)strtoul(av[4], nullptr, 10) : RENDER_BLOCK_FRAMES;
+    if (sampleRate <= 0 || blockFrames == 0) {
+        std::cerr << "Invalid sample rate or block size." << std::endl;
+        return 1;
+    }
+
+    ClapHostRenderReport report;
+    if (!render_midi_file(av[0], av[1], av[2], sampleRate, blockFrames, RENDER_TAIL_SECONDS, &report)) {
+        return 1;
+    }
+
+    double audioSeconds = report.frames / sampleRate;
+    double processSeconds = report.processNs > 0 ? report.processNs / 1e9 : 1e-9;
+    std::cout << "Rendered " << audioSeconds << " s in " << report.blocks << " blocks of " << blockFrames
+              << " frames, " << report.events << " events, " << report.seconds << " s in all" << std::endl;
+    std::cout << "Processing: " << report.processNs / 1000000 << " ms, " << audioSeconds / processSeconds
+              << "x real time, " << report.processNs / std::max(report.blocks, 1u) / 1000 << " us per block, longest "
+              << report.maxBlockNs / 1000 << " us of " << (uint64_t)(blockFrames * 1e6 / sampleRate) << " us" << std::endl;
+    return 0;
+}
@@ -0,0 +1,34 @@
+#pragma once
+
+#include <cstdint>
+
+// Defaults of the command line front end
+#define RENDER_SAMPLE_RATE 48000
+#define RENDER_BLOCK_FRAMES 256
+// Rendered past the end of the file, for the release of the last notes
+#define RENDER_TAIL_SECONDS 2.0
+
+// Offline rendering of a plugin playing a MIDI file, without an audio device.
+//
+// The plugin is driven block by block as fast as it goes, through the same transport, MIDI
+// player and process_clap_instance() as the live host, with a silent stereo input, and its
+// stereo output is written to a 32-bit float WAV file. The time spent in process_clap_instance()
+// is measured per block, so the report doubles as a benchmark of the instrument.
+// The calling thread serves the plugin as the main thread between blocks.
+
+struct ClapHostRenderReport {
+    uint64_t frames = 0;
+    uint32_t blocks = 0;
+    uint64_t events = 0;            // sent to the plugin
+    double seconds = 0;             // wall time of the whole render
+    uint64_t processNs = 0;         // spent processing, over every block
+    uint64_t maxBlockNs = 0;
+};
+
+// [main-thread]
+bool render_midi_file(const char* pluginPath, const char* midiPath, const char* wavPath, double sampleRate,
+                      uint32_t blockFrames, double tailSeconds, ClapHostRenderReport* report);
+
+// Command line front end: <plugin path> <MIDI file> <WAV file> [sample rate] [block frames]
+// Prints the report and returns the process exit code.
+int run_offline_render(int ac, char** av);
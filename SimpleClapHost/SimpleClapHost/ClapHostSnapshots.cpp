@@ -0,0 +1,395 @@
+#include <algorithm>
+#include <array>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include "ClapHost.h"
+#include "ClapHostSnapshots.h"
+
+#define SNAPSHOT_FILE_MAGIC 0x53534843u     // "CHSS"
+#define SNAPSHOT_FILE_VERSION 1u
+// Smallest records in the file: a chunk's hash, size and refs, a snapshot without id and chunks
+#define SNAPSHOT_FILE_CHUNK_BYTES 16u
+#define SNAPSHOT_FILE_SNAPSHOT_BYTES 24u
+
+// Random byte to word table of the gear hash, filled by splitmix64 at compile time
+static constexpr std::array<uint64_t, 256> build_gear() {
+    std::array<uint64_t, 256> gear = {};
+    uint64_t x = 0x9e3779b97f4a7c15ull;
+    for (size_t i = 0; i < gear.size(); i++) {
+        x += 0x9e3779b97f4a7c15ull;
+        uint64_t z = x;
+        z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+        z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+        gear[i] = z ^ (z >> 31);
+    }
+    return gear;
+}
+
+static constexpr std::array<uint64_t, 256> gear = build_gear();
+
+// 64-bit FNV-1a; equal hashes are confirmed by comparing the bytes
+static uint64_t chunk_hash(const uint8_t* bytes, uint32_t size) {
+    uint64_t h = 0xcbf29ce484222325ull;
+    for (uint32_t i = 0; i < size; i++) {
+        h = (h ^ bytes[i]) * 0x100000001b3ull;
+    }
+    return h;
+}
+
+// clap_ostream of a capture: cuts the stream into chunks as it arrives
+class ClapHostSnapshotStore::Capture {
+public:
+    Capture(ClapHostSnapshotStore& store, Snapshot& snapshot) : store(store), snapshot(snapshot) {
+        pending.reserve(SNAPSHOT_MAX_CHUNK);
+    }
+
+    int64_t write(const uint8_t* bytes, uint64_t size) {
+        uint64_t start = 0;
+        for (uint64_t i = 0; i < size; i++) {
+            rolling = (rolling << 1) + gear[bytes[i]];
+            // The top bits of the gear hash depend on the last 64 bytes, the low ones on fewer
+            uint64_t length = pending.size() + (i + 1 - start);
+            if ((length >= SNAPSHOT_MIN_CHUNK && ((rolling >> 40) & SNAPSHOT_CHUNK_MASK) == 0)
+                || length == SNAPSHOT_MAX_CHUNK) {
+                pending.insert(pending.end(), bytes + start, bytes + i + 1);
+                cut();
+                start = i + 1;
+            }
+        }
+        pending.insert(pending.end(), bytes + start, bytes + size);
+        snapshot.size += size;
+        return (int64_t)size;
+    }
+
+    void finish() {
+        if (!pending.empty()) {
+            cut();
+        }
+    }
+
+    static int64_t CLAP_ABI stream_write(const clap_ostream* stream, const void* buffer, uint64_t size) {
+        return static_cast<Capture*>(stream->ctx)->write(static_cast<const uint8_t*>(buffer), size);
+    }
+
+private:
+    void cut() {
+        snapshot.chunks.push_back(store.intern(pending.data(), (uint32_t)pending.size()));
+        pending.clear();
+        rolling = 0;
+    }
+
+    ClapHostSnapshotStore& store;
+    Snapshot& snapshot;
+    std::vector<uint8_t> pending;
+    uint64_t rolling = 0;
+};
+
+// clap_istream of a restore: reads the chunks in order, straight from the arena
+struct SnapshotReader {
+    const std::vector<uint8_t>* data;
+    const uint64_t* offsets;            // chunk offset and size pairs
+    size_t count;
+    size_t chunk;
+    uint64_t position;                  // within the chunk
+
+    static int64_t CLAP_ABI stream_read(const clap_istream* stream, void* buffer, uint64_t size) {
+        SnapshotReader* self = static_cast<SnapshotReader*>(stream->ctx);
+        uint8_t* out = static_cast<uint8_t*>(buffer);
+        uint64_t done = 0;
+        while (done < size && self->chunk < self->count) {
+            uint64_t offset = self->offsets[2 * self->chunk];
+            uint64_t length = self->offsets[2 * self->chunk + 1];
+            uint64_t n = std::min(length - self->position, size - done);
+            memcpy(out + done, self->data->data() + offset + self->position, (size_t)n);
+            done += n;
+            self->position += n;
+            if (self->position == length) {
+                self->chunk++;
+                self->position = 0;
+            }
+        }
+        return (int64_t)done;
+    }
+};
+
+uint32_t ClapHostSnapshotStore::intern(const uint8_t* bytes, uint32_t size) {
+    uint64_t hash = chunk_hash(bytes, size);
+    auto range = index.equal_range(hash);
+    for (auto it = range.first; it != range.second; ++it) {
+        Chunk& chunk = chunks[it->second];
+        if (chunk.size == size && memcmp(&data[chunk.offset], bytes, size) == 0) {
+            chunk.refs++;
+            return it->second;
+        }
+    }
+
+    uint32_t id;
+    if (!freeChunks.empty()) {
+        id = freeChunks.back();
+        freeChunks.pop_back();
+    }
+    else {
+        id = (uint32_t)chunks.size();
+        chunks.emplace_back();
+    }
+    Chunk& chunk = chunks[id];
+    chunk.hash = hash;
+    chunk.offset = data.size();
+    chunk.size = size;
+    chunk.refs = 1;
+    data.insert(data.end(), bytes, bytes + size);
+    index.emplace(hash, id);
+    stored += size;
+    return id;
+}
+
+void ClapHostSnapshotStore::unref(uint32_t id) {
+    Chunk& chunk = chunks[id];
+    if (--chunk.refs > 0) {
+        return;
+    }
+    auto range = index.equal_range(chunk.hash);
+    for (auto it = range.first; it != range.second; ++it) {
+        if (it->second == id) {
+            index.erase(it);
+            break;
+        }
+    }
+    stored -= chunk.size;
+    chunk = Chunk();
+    freeChunks.push_back(id);
+}
+
+void ClapHostSnapshotStore::compact() {
+    std::vector<uint8_t> live;
+    live.reserve((size_t)stored);
+    for (Chunk& chunk : chunks) {
+        if (chunk.refs > 0) {
+            uint64_t offset = live.size();
+            live.insert(live.end(), data.begin() + chunk.offset, data.begin() + chunk.offset + chunk.size);
+            chunk.offset = offset;
+        }
+    }
+    data.swap(live);
+}
+
+clap_id ClapHostSnapshotStore::capture(ClapHostInstance* instance, uint32_t contextType) {
+    auto* state = static_cast<const clap_plugin_state*>(
+        instance->plugin->get_extension(instance->plugin, CLAP_EXT_STATE));
+    auto* stateContext = static_cast<const clap_plugin_state_context*>(
+        instance->plugin->get_extension(instance->plugin, CLAP_EXT_STATE_CONTEXT));
+    if (!state) {
+        std::cerr << "The plugin has no state to snapshot." << std::endl;
+        return CLAP_INVALID_ID;
+    }
+
+    uint32_t id;
+    if (!freeSnapshots.empty()) {
+        id = freeSnapshots.back();
+        freeSnapshots.pop_back();
+    }
+    else {
+        id = (uint32_t)snapshots.size();
+        snapshots.emplace_back();
+    }
+    Snapshot& snapshot = snapshots[id];
+    snapshot.pluginId = instance->plugin->desc->id;
+    snapshot.contextType = contextType;
+    snapshot.used = true;
+
+    Capture capture(*this, snapshot);
+    clap_ostream out = { &capture, Capture::stream_write };
+    bool saved = (contextType && stateContext) ? stateContext->save(instance->plugin, &out, contextType)
+                                               : state->save(instance->plugin, &out);
+    capture.finish();
+    logical += snapshot.size;
+
+    if (!saved) {
+        std::cerr << "Failed to snapshot the plugin state." << std::endl;
+        release(id);
+        return CLAP_INVALID_ID;
+    }
+    return id;
+}
+
+bool ClapHostSnapshotStore::restore(ClapHostInstance* instance, clap_id id) {
+    if (id >= snapshots.size() || !snapshots[id].used) {
+        return false;
+    }
+    const Snapshot& snapshot = snapshots[id];
+    if (snapshot.pluginId != instance->plugin->desc->id) {
+        std::cerr << "The snapshot belongs to " << snapshot.pluginId << std::endl;
+        return false;
+    }
+    auto* state = static_cast<const clap_plugin_state*>(
+        instance->plugin->get_extension(instance->plugin, CLAP_EXT_STATE));
+    auto* stateContext = static_cast<const clap_plugin_state_context*>(
+        instance->plugin->get_extension(instance->plugin, CLAP_EXT_STATE_CONTEXT));
+    if (!state) {
+        return false;
+    }
+
+    std::vector<uint64_t> offsets(2 * snapshot.chunks.size());
+    for (size_t i = 0; i < snapshot.chunks.size(); i++) {
+        offsets[2 * i] = chunks[snapshot.chunks[i]].offset;
+        offsets[2 * i + 1] = chunks[snapshot.chunks[i]].size;
+    }
+    SnapshotReader reader = { &data, offsets.data(), snapshot.chunks.size(), 0, 0 };
+    clap_istream in = { &reader, SnapshotReader::stream_read };
+    bool loaded = (snapshot.contextType && stateContext)
+        ? stateContext->load(instance->plugin, &in, snapshot.contextType)
+        : state->load(instance->plugin, &in);
+    if (!loaded) {
+        std::cerr << "Failed to restore the plugin state snapshot." << std::endl;
+    }
+    return loaded;
+}
+
+void ClapHostSnapshotStore::release(clap_id id) {
+    if (id >= snapshots.size() || !snapshots[id].used) {
+        return;
+    }
+    Snapshot& snapshot = snapshots[id];
+    for (uint32_t chunk : snapshot.chunks) {
+        unref(chunk);
+    }
+    logical -= snapshot.size;
+    snapshot = Snapshot();
+    freeSnapshots.push_back(id);
+
+    if (data.size() > 2 * stored + SNAPSHOT_MAX_CHUNK) {
+        compact();
+    }
+}
+
+//
+// Store file: header, the chunk table (hash, size, refs) followed by the chunk bytes,
+// then every slot of the snapshot table. Free chunk slots are written with size 0.
+//
+
+static bool write_u32(FILE* f, uint32_t v) { return fwrite(&v, sizeof(v), 1, f) == 1; }
+static bool write_u64(FILE* f, uint64_t v) { return fwrite(&v, sizeof(v), 1, f) == 1; }
+static bool read_u32(FILE* f, uint32_t& v) { return fread(&v, sizeof(v), 1, f) == 1; }
+static bool read_u64(FILE* f, uint64_t& v) { return fread(&v, sizeof(v), 1, f) == 1; }
+
+bool ClapHostSnapshotStore::write(const char* path) const {
+    FILE* f = fopen(path, "wb");
+    if (!f) {
+        std::cerr << "Failed to open the snapshot store: " << path << std::endl;
+        return false;
+    }
+
+    bool ok = write_u32(f, SNAPSHOT_FILE_MAGIC) && write_u32(f, SNAPSHOT_FILE_VERSION)
+        && write_u32(f, (uint32_t)chunks.size());
+    for (size_t i = 0; ok && i < chunks.size(); i++) {
+        ok = write_u64(f, chunks[i].hash) && write_u32(f, chunks[i].size) && write_u32(f, chunks[i].refs);
+    }
+    for (size_t i = 0; ok && i < chunks.size(); i++) {
+        ok = chunks[i].size == 0 || fwrite(&data[chunks[i].offset], chunks[i].size, 1, f) == 1;
+    }
+
+    ok = ok && write_u32(f, (uint32_t)snapshots.size());
+    for (size_t i = 0; ok && i < snapshots.size(); i++) {
+        const Snapshot& s = snapshots[i];
+        ok = write_u32(f, s.used ? 1 : 0) && write_u32(f, (uint32_t)s.pluginId.size())
+            && fwrite(s.pluginId.data(), 1, s.pluginId.size(), f) == s.pluginId.size()
+            && write_u32(f, s.contextType) && write_u64(f, s.size) && write_u32(f, (uint32_t)s.chunks.size())
+            && (s.chunks.empty() || fwrite(s.chunks.data(), sizeof(uint32_t), s.chunks.size(), f) == s.chunks.size());
+    }
+
+    ok = fclose(f) == 0 && ok;
+    if (!ok) {
+        std::cerr << "Failed to write the snapshot store: " << path << std::endl;
+    }
+    return ok;
+}
+
+bool ClapHostSnapshotStore::read(const char* path) {
+    FILE* f = fopen(path, "rb");
+    if (!f) {
+        std::cerr << "Failed to open the snapshot store: " << path << std::endl;
+        return false;
+    }
+
+    // Counts are checked against the bytes left before anything is sized by them
+    uint64_t fileSize = 0;
+    if (fseek(f, 0, SEEK_END) == 0) {
+        long end = ftell(f);
+        fileSize = end > 0 ? (uint64_t)end : 0;
+    }
+    rewind(f);
+    auto left = [f, fileSize]() {
+        long at = ftell(f);
+        return at >= 0 && (uint64_t)at <= fileSize ? fileSize - (uint64_t)at : 0;
+    };
+
+    ClapHostSnapshotStore loaded;
+    uint32_t magic = 0, version = 0, count = 0;
+    bool ok = read_u32(f, magic) && read_u32(f, version) && magic == SNAPSHOT_FILE_MAGIC
+        && version == SNAPSHOT_FILE_VERSION && read_u32(f, count)
+        && (uint64_t)count * SNAPSHOT_FILE_CHUNK_BYTES <= left();
+
+    loaded.chunks.resize(ok ? count : 0);
+    for (uint32_t i = 0; ok && i < count; i++) {
+        Chunk& chunk = loaded.chunks[i];
+        ok = read_u64(f, chunk.hash) && read_u32(f, chunk.size) && read_u32(f, chunk.refs)
+            && chunk.size <= SNAPSHOT_MAX_CHUNK;
+        chunk.offset = loaded.stored;
+        loaded.stored += chunk.size;
+    }
+    ok = ok && loaded.stored <= left();
+    loaded.data.resize(ok ? (size_t)loaded.stored : 0);
+    ok = ok && (loaded.data.empty() || fread(loaded.data.data(), 1, loaded.data.size(), f) == loaded.data.size());
+    for (uint32_t i = 0; ok && i < count; i++) {
+        if (loaded.chunks[i].size == 0) {
+            loaded.freeChunks.push_back(i);
+        }
+        else {
+            loaded.index.emplace(loaded.chunks[i].hash, i);
+        }
+    }
+
+    ok = ok && read_u32(f, count) && (uint64_t)count * SNAPSHOT_FILE_SNAPSHOT_BYTES <= left();
+    loaded.snapshots.resize(ok ? count : 0);
+    for (uint32_t i = 0; ok && i < count; i++) {
+        Snapshot& s = loaded.snapshots[i];
+        uint32_t used = 0, idLength = 0, chunkCount = 0;
+        ok = read_u32(f, used) && read_u32(f, idLength) && idLength < 4096 && idLength <= left();
+        if (ok) {
+            s.pluginId.resize(idLength);
+            ok = fread(&s.pluginId[0], 1, idLength, f) == idLength && read_u32(f, s.contextType)
+                && read_u64(f, s.size) && read_u32(f, chunkCount);
+        }
+        ok = ok && (uint64_t)chunkCount * sizeof(uint32_t) <= left();
+        if (ok) {
+            s.chunks.resize(chunkCount);
+            ok = chunkCount == 0 || fread(s.chunks.data(), sizeof(uint32_t), chunkCount, f) == chunkCount;
+        }
+        for (uint32_t c : s.chunks) {
+            ok = ok && c < loaded.chunks.size() && loaded.chunks[c].size > 0;
+        }
+        s.used = used != 0;
+        if (s.used) {
+            loaded.logical += s.size;
+        }
+        else {
+            loaded.freeSnapshots.push_back(i);
+        }
+    }
+    fclose(f);
+
+    if (!ok) {
+        std::cerr << "The snapshot store is damaged: " << path << std::endl;
+        return false;
+    }
+    data.swap(loaded.data);
+    chunks.swap(loaded.chunks);
+    freeChunks.swap(loaded.freeChunks);
+    index.swap(loaded.index);
+    snapshots.swap(loaded.snapshots);
+    freeSnapshots.swap(loaded.freeSnapshots);
+    logical = loaded.logical;
+    stored = loaded.stored;
+    return true;
+}
@@ -0,0 +1,81 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include <clap/clap.h>
+
+struct ClapHostInstance;
+
+// Content-defined chunking bounds, the average chunk is about 8 KiB
+#define SNAPSHOT_MIN_CHUNK (2 * 1024)
+#define SNAPSHOT_MAX_CHUNK (64 * 1024)
+#define SNAPSHOT_CHUNK_MASK ((1u << 13) - 1)
+
+// Deduplicating store of plugin state snapshots, for autosave, undo and A/B comparisons.
+//
+// A snapshot streams the plugin state through a gear-hash chunker which cuts where the content
+// says so, not at fixed offsets, so an edit only changes the chunks around it. Each chunk is
+// hashed and kept once however many snapshots or instances share it; a snapshot is the list of
+// its chunks. Restoring feeds the chunks to the plugin one after the other without joining them.
+//
+// Chunks are reference counted. Released snapshots leave garbage in the chunk arena, which is
+// compacted once it outweighs the live data. write() and read() keep the store in one file.
+//
+// All calls are [main-thread].
+class ClapHostSnapshotStore {
+public:
+    ClapHostSnapshotStore() = default;
+
+    ClapHostSnapshotStore(const ClapHostSnapshotStore&) = delete;
+    ClapHostSnapshotStore& operator=(const ClapHostSnapshotStore&) = delete;
+
+    // Saves the plugin state and returns the snapshot id, CLAP_INVALID_ID on failure.
+    // contextType is a clap_plugin_state_context_type, or 0 for plain clap_plugin_state;
+    // plugins without clap_plugin_state_context are saved with clap_plugin_state either way.
+    clap_id capture(ClapHostInstance* instance, uint32_t contextType = 0);
+    // Loads a snapshot, with the context it was captured for
+    bool restore(ClapHostInstance* instance, clap_id snapshot);
+    void release(clap_id snapshot);
+
+    bool write(const char* path) const;
+    bool read(const char* path);
+
+    // Bytes held by the snapshots, and the bytes actually stored for them
+    uint64_t logicalSize() const { return logical; }
+    uint64_t storedSize() const { return stored; }
+    size_t snapshotCount() const { return snapshots.size() - freeSnapshots.size(); }
+
+private:
+    struct Chunk {
+        uint64_t hash = 0;
+        uint64_t offset = 0;            // into data
+        uint32_t size = 0;
+        uint32_t refs = 0;
+    };
+
+    struct Snapshot {
+        std::string pluginId;
+        uint32_t contextType = 0;
+        uint64_t size = 0;
+        std::vector<uint32_t> chunks;   // empty and size 0 when free
+        bool used = false;
+    };
+
+    class Capture;
+
+    uint32_t intern(const uint8_t* bytes, uint32_t size);
+    void unref(uint32_t chunk);
+    void compact();
+
+    std::vector<uint8_t> data;          // chunk arena
+    std::vector<Chunk> chunks;
+    std::vector<uint32_t> freeChunks;
+    std::unordered_multimap<uint64_t, uint32_t> index;  // hash to chunk
+    std::vector<Snapshot> snapshots;
+    std::vector<uint32_t> freeSnapshots;
+    uint64_t logical = 0;
+    uint64_t stored = 0;                // live chunk bytes
+};
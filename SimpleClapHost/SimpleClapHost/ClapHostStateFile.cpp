@@ -0,0 +1,43 @@
+#include <iostream>
+#include "ClapHost.h"
+#include "ClapHostStateFile.h"
+#include "ClapHostStateStream.h"
+
+bool save_clap_state(ClapHostInstance* instance, const char* path) {
+    auto* state = static_cast<const clap_plugin_state*>(
+        instance->plugin->get_extension(instance->plugin, CLAP_EXT_STATE));
+    if (!state) {
+        std::cerr << "The plugin has no state to save." << std::endl;
+        return false;
+    }
+
+    ClapHostStateWriter writer(path);
+    bool saved = state->save(instance->plugin, writer.stream());
+    if (!writer.finish() || !saved) {
+        std::cerr << "Failed to save the plugin state: " << path << std::endl;
+        return false;
+    }
+    instance->stateDirty = false;
+    return true;
+}
+
+bool load_clap_state(ClapHostInstance* instance, const char* path) {
+    auto* state = static_cast<const clap_plugin_state*>(
+        instance->plugin->get_extension(instance->plugin, CLAP_EXT_STATE));
+    if (!state) {
+        std::cerr << "The plugin has no state to load." << std::endl;
+        return false;
+    }
+
+    ClapHostStateReader reader(path);
+    if (!reader.isOpen()) {
+        std::cerr << "Failed to open the plugin state: " << path << std::endl;
+        return false;
+    }
+    if (!state->load(instance->plugin, reader.stream())) {
+        std::cerr << "Failed to load the plugin state: " << path << std::endl;
+        return false;
+    }
+    instance->stateDirty = false;
+    return true;
+}
@@ -0,0 +1,13 @@
+#pragma once
+
+#include <cstdint>
+#include <clap/clap.h>
+
+struct ClapHostInstance;
+
+// Plugin state files, streamed through ClapHostStateWriter and ClapHostStateReader so neither
+// direction holds a copy of the whole state. A failed save leaves the previous file intact.
+
+// [main-thread]
+bool save_clap_state(ClapHostInstance* instance, const char* path);
+bool load_clap_state(ClapHostInstance* instance, const char* path);
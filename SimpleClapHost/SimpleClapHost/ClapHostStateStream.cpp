@@ -0,0 +1,139 @@
+#ifdef _WIN32
+#include <Windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include "ClapHostStateStream.h"
+
+ClapHostStateWriter::ClapHostStateWriter(const char* path)
+    : path(path), tempPath(std::string(path) + ".tmp"), buffer(CLAP_STATE_WRITE_BUFFER) {
+#ifdef _WIN32
+    file = CreateFileA(tempPath.c_str(), GENERIC_WRITE, 0, nullptr, CREATE_ALWAYS,
+                       FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+    failed = file == INVALID_HANDLE_VALUE;
+#else
+    fd = ::open(tempPath.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    failed = fd < 0;
+#endif
+}
+
+ClapHostStateWriter::~ClapHostStateWriter() {
+#ifdef _WIN32
+    bool opened = file != INVALID_HANDLE_VALUE;
+#else
+    bool opened = fd >= 0;
+#endif
+    if (opened) {
+        // Never finished, the target keeps its previous content
+        close_file();
+        std::remove(tempPath.c_str());
+    }
+}
+
+void ClapHostStateWriter::close_file() {
+#ifdef _WIN32
+    failed = !CloseHandle(file) || failed;
+    file = INVALID_HANDLE_VALUE;
+#else
+    failed = ::close(fd) != 0 || failed;
+    fd = -1;
+#endif
+}
+
+int64_t ClapHostStateWriter::write(const void* data, uint64_t size) {
+    if (failed) {
+        return -1;
+    }
+    if (size >= buffer.size()) {
+        // Large blocks skip the copy into the buffer
+        if (!flush() || !write_file(data, size)) {
+            return -1;
+        }
+        total += size;
+        return (int64_t)size;
+    }
+    if (used + size > buffer.size() && !flush()) {
+        return -1;
+    }
+    memcpy(buffer.data() + used, data, (size_t)size);
+    used += (size_t)size;
+    total += size;
+    return (int64_t)size;
+}
+
+bool ClapHostStateWriter::finish() {
+    if (path.empty()) {
+        return false;
+    }
+    flush();
+    close_file();
+
+    bool ok = !failed;
+#ifdef _WIN32
+    ok = ok && MoveFileExA(tempPath.c_str(), path.c_str(), MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH) != 0;
+#else
+    ok = ok && ::rename(tempPath.c_str(), path.c_str()) == 0;
+#endif
+    if (!ok) {
+        std::remove(tempPath.c_str());
+    }
+    path.clear();
+    failed = true;  // nothing more goes to the file
+    return ok;
+}
+
+int64_t CLAP_ABI ClapHostStateWriter::stream_write(const clap_ostream* stream, const void* buffer, uint64_t size) {
+    return static_cast<ClapHostStateWriter*>(stream->ctx)->write(buffer, size);
+}
+
+bool ClapHostStateWriter::flush() {
+    if (failed || used == 0) {
+        return !failed;
+    }
+    bool ok = write_file(buffer.data(), used);
+    used = 0;
+    return ok;
+}
+
+bool ClapHostStateWriter::write_file(const void* data, uint64_t size) {
+    const char* bytes = static_cast<const char*>(data);
+    while (size > 0 && !failed) {
+        uint32_t chunk = size > 0x40000000 ? 0x40000000 : (uint32_t)size;
+#ifdef _WIN32
+        DWORD written = 0;
+        failed = !WriteFile(file, bytes, chunk, &written, nullptr) || written == 0;
+#else
+        ssize_t written = ::write(fd, bytes, chunk);
+        if (written < 0 && errno == EINTR) {
+            continue;   // interrupted by a signal before anything was written
+        }
+        failed = written <= 0;
+#endif
+        if (!failed) {
+            bytes += written;
+            size -= (uint64_t)written;
+        }
+    }
+    return !failed;
+}
+
+int64_t ClapHostStateReader::read(void* buffer, uint64_t count) {
+    uint64_t n = file.size() - position < count ? file.size() - position : count;
+    if (n > 0) {
+        memcpy(buffer, file.data() + position, (size_t)n);
+        position += n;
+    }
+    if (position - released >= CLAP_STATE_READ_RELEASE) {
+        file.release(position);
+        released = position;
+    }
+    return (int64_t)n;
+}
+
+int64_t CLAP_ABI ClapHostStateReader::stream_read(const clap_istream* stream, void* buffer, uint64_t size) {
+    return static_cast<ClapHostStateReader*>(stream->ctx)->read(buffer, size);
+}
@@ -0,0 +1,82 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <clap/clap.h>
+#include "ClapHostMappedFile.h"
+
+// File streams behind the clap_ostream and clap_istream of plugin states.
+//
+// States of sampler plugins can be hundreds of megabytes, so neither direction holds a copy of
+// the whole state: the writer passes writes through a fixed-size buffer, large writes going
+// straight to the file, and the reader serves reads from a read-only mapping of the file, releasing
+// the pages behind it.
+// The writer fills a temporary file that replaces the target only once it is complete, so a
+// failed write leaves the previous file intact.
+
+// Size of the write buffer; writes at least this large bypass it
+#define CLAP_STATE_WRITE_BUFFER (1024 * 1024)
+// The reader gives the pages it went past back in steps of this size
+#define CLAP_STATE_READ_RELEASE (16 * 1024 * 1024)
+
+class ClapHostStateWriter {
+public:
+    explicit ClapHostStateWriter(const char* path);
+    ~ClapHostStateWriter();
+
+    ClapHostStateWriter(const ClapHostStateWriter&) = delete;
+    ClapHostStateWriter& operator=(const ClapHostStateWriter&) = delete;
+
+    int64_t write(const void* data, uint64_t size);
+
+    // Writes out the buffer and moves the file in place, true if everything reached it.
+    // Without it, or when it fails, the target is left as it was.
+    bool finish();
+
+    uint64_t written() const { return total; }
+    const clap_ostream* stream() const { return &out; }
+
+private:
+    bool flush();
+    bool write_file(const void* data, uint64_t size);
+    void close_file();
+
+    static int64_t CLAP_ABI stream_write(const clap_ostream* stream, const void* buffer, uint64_t size);
+
+    std::string path;
+    std::string tempPath;
+#ifdef _WIN32
+    void* file = nullptr;
+#else
+    int fd = -1;
+#endif
+    std::vector<char> buffer;
+    size_t used = 0;
+    uint64_t total = 0;
+    bool failed = false;
+    clap_ostream out = { this, stream_write };
+};
+
+class ClapHostStateReader {
+public:
+    explicit ClapHostStateReader(const char* path) { file.open(path, true); }
+
+    ClapHostStateReader(const ClapHostStateReader&) = delete;
+    ClapHostStateReader& operator=(const ClapHostStateReader&) = delete;
+
+    bool isOpen() const { return file.isOpen(); }
+    uint64_t size() const { return file.size(); }
+
+    int64_t read(void* buffer, uint64_t count);
+
+    const clap_istream* stream() const { return &in; }
+
+private:
+    static int64_t CLAP_ABI stream_read(const clap_istream* stream, void* buffer, uint64_t size);
+
+    ClapHostMappedFile file;
+    uint64_t position = 0;
+    uint64_t released = 0;
+    clap_istream in = { this, stream_read };
+};
@@ -0,0 +1,253 @@
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include "ClapHost.h"
+#include "ClapHostSwap.h"
+#include "ClapHostAudio.h"
+
+static const double kHalfPi = 1.57079632679489661923;
+
+void ClapHostSwap::prepare(uint32_t ports, uint32_t channels, uint32_t frames, uint32_t fade, uint32_t maxLatency) {
+    maxPorts = ports;
+    maxChannels = channels;
+    maxFrames = frames;
+    fadeFrames = fade;
+
+    // Equal-power: the incoming gain is sin(), the outgoing one is the same curve read backwards.
+    fadeGain.resize(fadeFrames + 1);
+    for (uint32_t i = 0; i <= fadeFrames; i++) {
+        fadeGain[i] = fadeFrames ? (float)std::sin(kHalfPi * i / fadeFrames) : 1.0f;
+    }
+
+    scratch.assign((size_t)maxPorts * maxChannels * maxFrames, 0.0f);
+    scratchChannels.resize((size_t)maxPorts * maxChannels);
+    for (size_t i = 0; i < scratchChannels.size(); i++) {
+        scratchChannels[i] = scratch.data() + i * maxFrames;
+    }
+    scratchBuffers.assign(maxPorts, clap_audio_buffer{});
+
+    delays.prepare(2 * maxPorts * maxChannels, maxLatency, maxFrames);
+}
+
+bool ClapHostSwap::stage(ClapHostInstance* next) {
+    ClapHostInstance* expected = nullptr;
+    return pending.compare_exchange_strong(expected, next, std::memory_order_acq_rel);
+}
+
+ClapHostInstance* ClapHostSwap::collect() {
+    return retired.exchange(nullptr, std::memory_order_acq_rel);
+}
+
+void ClapHostSwap::suspend() {
+    suspendRequested.store(true, std::memory_order_release);
+}
+
+ClapHostInstance* ClapHostSwap::suspended() const {
+    return suspendedInstance.load(std::memory_order_acquire);
+}
+
+void ClapHostSwap::resume(bool restarted) {
+    restartFailed.store(!restarted, std::memory_order_relaxed);
+    suspendRequested.store(false, std::memory_order_release);
+}
+
+void ClapHostSwap::pick_up() {
+    // A new instance is only taken once the previous outgoing one has been collected,
+    // so the retired slot is always free when we need it.
+    if (fading || retired.load(std::memory_order_acquire) || !pending.load(std::memory_order_relaxed)) {
+        return;
+    }
+
+    ClapHostInstance* next = pending.exchange(nullptr, std::memory_order_acq_rel);
+    if (!start_clap_processing(next)) {
+        retired.store(next, std::memory_order_release);
+        return;
+    }
+
+    uint32_t latency = std::max(pathLatency.load(std::memory_order_relaxed), next->latency);
+    pathLatency.store(latency, std::memory_order_relaxed);
+
+    // The new path starts on the other bank, without history from an earlier instance
+    currentBank ^= 1;
+    for (uint32_t i = 0; i < maxPorts * maxChannels; i++) {
+        delays.clear(currentBank * maxPorts * maxChannels + i);
+    }
+
+    if (fadeFrames == 0) {
+        if (current) {
+            stop_clap_processing(current);
+            retired.store(current, std::memory_order_release);
+        }
+        current = next;
+    }
+    else {
+        outgoing = current;
+        current = next;
+        fading = true;
+        fadePos = 0;
+    }
+}
+
+clap_process_status ClapHostSwap::process(const clap_process* process) {
+    // The instances were activated for blocks of up to maxFrames: a longer block is cut to that
+    // for them, and its end is left silent
+    if (process->frames_count > maxFrames) {
+        clap_process block = *process;
+        block.frames_count = maxFrames;
+        clap_process_status status = this->process(&block);
+        for (uint32_t p = 0; p < process->audio_outputs_count; p++) {
+            const clap_audio_buffer& out = process->audio_outputs[p];
+            for (uint32_t ch = 0; ch < out.channel_count; ch++) {
+                if (out.data32 && out.data32[ch]) {
+                    memset(out.data32[ch] + maxFrames, 0, sizeof(float) * (process->frames_count - maxFrames));
+                }
+                if (out.data64 && out.data64[ch]) {
+                    memset(out.data64[ch] + maxFrames, 0, sizeof(double) * (process->frames_count - maxFrames));
+                }
+            }
+        }
+        return status;
+    }
+
+    ClapHostInstance* held = suspendedInstance.load(std::memory_order_acquire);
+    bool suspending = suspendRequested.load(std::memory_order_acquire);
+
+    if (held && !suspending) {
+        // Back from a restart: the latency may have changed and the output was silent anyway
+        suspendedInstance.store(nullptr, std::memory_order_release);
+        if (!restartFailed.load(std::memory_order_relaxed) && start_clap_processing(current)) {
+            pathLatency.store(current->latency, std::memory_order_relaxed);
+            for (uint32_t i = 0; i < maxPorts * maxChannels; i++) {
+                delays.clear(currentBank * maxPorts * maxChannels + i);
+            }
+        }
+        else {
+            retired.store(current, std::memory_order_release);
+            current = nullptr;
+        }
+    }
+    else if (!held && suspending && current && !fading && !retired.load(std::memory_order_acquire)) {
+        // The retired slot must be free in case the restarted instance fails to start again
+        stop_clap_processing(current);
+        suspendedInstance.store(current, std::memory_order_release);
+    }
+
+    if (suspendedInstance.load(std::memory_order_relaxed)) {
+        clap_audio_clear(process->audio_outputs, process->audio_outputs_count, process->frames_count);
+        return CLAP_PROCESS_CONTINUE;
+    }
+
+    if (!suspending) {
+        pick_up();
+    }
+
+    if (!current) {
+        clap_audio_clear(process->audio_outputs, process->audio_outputs_count, process->frames_count);
+        return CLAP_PROCESS_CONTINUE;
+    }
+
+    uint32_t frames = process->frames_count;
+    uint32_t latency = pathLatency.load(std::memory_order_relaxed);
+    uint32_t ports = std::min(process->audio_outputs_count, maxPorts);
+
+    clap_process_status status = process_clap_instance(current, process);
+    compensate(process->audio_outputs, ports, currentBank, latency - std::min(latency, current->latency), frames);
+    if (!fading) {
+        return status;
+    }
+
+    if (outgoing) {
+        clap_process old = *process;
+        old.audio_outputs_count = ports;
+        for (uint32_t p = 0; p < ports; p++) {
+            clap_audio_buffer& buf = scratchBuffers[p];
+            buf = process->audio_outputs[p];
+            buf.channel_count = std::min(buf.channel_count, maxChannels);
+            buf.data32 = &scratchChannels[(size_t)p * maxChannels];
+            buf.data64 = nullptr;
+            buf.constant_mask = 0;
+        }
+        old.audio_outputs = scratchBuffers.data();
+        process_clap_instance(outgoing, &old);
+        compensate(scratchBuffers.data(), ports, currentBank ^ 1, latency - std::min(latency, outgoing->latency), frames);
+    }
+
+    crossfade(process, frames);
+
+    fadePos += frames;
+    if (fadePos >= fadeFrames) {
+        fading = false;
+        if (outgoing) {
+            stop_clap_processing(outgoing);
+            retired.store(outgoing, std::memory_order_release);
+            outgoing = nullptr;
+        }
+    }
+    return status;
+}
+
+void ClapHostSwap::stop() {
+    if (outgoing) {
+        stop_clap_processing(outgoing);
+    }
+    if (current) {
+        stop_clap_processing(current);
+    }
+    fading = false;
+}
+
+ClapHostInstance* ClapHostSwap::detach() {
+    ClapHostInstance* instance = collect();
+    if (!instance) {
+        instance = pending.exchange(nullptr, std::memory_order_acq_rel);
+    }
+    if (!instance && outgoing) {
+        std::swap(instance, outgoing);
+    }
+    if (!instance && current) {
+        std::swap(instance, current);
+        suspendedInstance.store(nullptr, std::memory_order_relaxed);
+    }
+    return instance;
+}
+
+void ClapHostSwap::compensate(clap_audio_buffer* outputs, uint32_t count, uint32_t bank, uint32_t delay, uint32_t frames) {
+    for (uint32_t p = 0; p < count; p++) {
+        if (!outputs[p].data32) {
+            continue;
+        }
+        uint32_t channels = std::min(outputs[p].channel_count, maxChannels);
+        for (uint32_t ch = 0; ch < channels; ch++) {
+            uint32_t line = (bank * maxPorts + p) * maxChannels + ch;
+            delays.setDelay(line, delay);
+            delays.process(line, outputs[p].data32[ch], frames);
+        }
+        if (delay > 0) {
+            outputs[p].constant_mask = 0;
+        }
+    }
+}
+
+void ClapHostSwap::crossfade(const clap_process* process, uint32_t frames) {
+    uint32_t ramp = fadePos < fadeFrames ? std::min(frames, fadeFrames - fadePos) : 0;
+    uint32_t ports = std::min(process->audio_outputs_count, maxPorts);
+
+    for (uint32_t p = 0; p < ports; p++) {
+        clap_audio_buffer& out = process->audio_outputs[p];
+        if (!out.data32) {
+            continue;   // 64-bit outputs are switched without fading
+        }
+        uint32_t channels = std::min(out.channel_count, maxChannels);
+        for (uint32_t ch = 0; ch < channels; ch++) {
+            float* dst = out.data32[ch];
+            const float* old = scratchChannels[(size_t)p * maxChannels + ch];
+            const float* gainIn = &fadeGain[fadePos];
+            const float* gainOut = &fadeGain[fadeFrames - fadePos];
+            for (uint32_t i = 0; i < ramp; i++) {
+                float o = outgoing ? old[i] * gainOut[-(int32_t)i] : 0.0f;
+                dst[i] = dst[i] * gainIn[i] + o;
+            }
+        }
+        out.constant_mask = 0;
+    }
+}
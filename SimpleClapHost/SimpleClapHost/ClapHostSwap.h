@@ -0,0 +1,93 @@
+#pragma once
+
+#include <atomic>
+#include <vector>
+#include <clap/clap.h>
+#include "ClapHostDelay.h"
+
+struct ClapHostInstance;
+
+// Replaces the processing plugin instance without stopping the stream.
+//
+// The main thread creates and activates the next instance, then hands it over with stage().
+// The audio thread picks it up at the start of a block, starts processing it and crossfades
+// from the old instance with an equal-power curve. When the fade is done the old instance is
+// stopped and handed back through collect(), so it can be deactivated and destroyed on the
+// main thread. The audio side never allocates or locks; every buffer is sized by prepare().
+//
+// The outputs are delay compensated: both paths of a crossfade are delayed to the larger of the
+// two plugin latencies, so they sum sample-aligned. The path latency only grows while streaming,
+// a jump back would drop audio, and is reset when the instance is restarted.
+class ClapHostSwap {
+public:
+    ClapHostSwap() = default;
+    ~ClapHostSwap() = default;
+
+    ClapHostSwap(const ClapHostSwap&) = delete;
+    ClapHostSwap& operator=(const ClapHostSwap&) = delete;
+
+    // [before the stream starts]
+    void prepare(uint32_t maxPorts, uint32_t maxChannels, uint32_t maxFrames, uint32_t fadeFrames,
+                 uint32_t maxLatency);
+
+    // Returns false while a previous instance is still waiting to be picked up.
+    // [main-thread]
+    bool stage(ClapHostInstance* next);
+
+    // Returns the instance which is not used by the audio thread anymore, or nullptr.
+    // [main-thread]
+    ClapHostInstance* collect();
+
+    // Asks the audio thread to stop processing the current instance, so it can be restarted.
+    // suspended() returns it once the audio thread let it go; the output is silent until resume().
+    // If the restart failed the instance is not used again and comes back through collect().
+    // [main-thread]
+    void suspend();
+    ClapHostInstance* suspended() const;
+    void resume(bool restarted);
+
+    // Latency of the output relative to the input, in samples
+    // [thread-safe]
+    uint32_t latency() const { return pathLatency.load(std::memory_order_relaxed); }
+
+    // Blocks longer than the maxFrames given to prepare() are processed up to it, the rest is silent.
+    // [audio-thread]
+    clap_process_status process(const clap_process* process);
+
+    // Stops processing of the instances in use, after the last process() call.
+    // [audio-thread]
+    void stop();
+
+    // Hands back the remaining instances one by one, nullptr when there is none left.
+    // [main-thread & stream stopped]
+    ClapHostInstance* detach();
+
+private:
+    void pick_up();
+    void compensate(clap_audio_buffer* outputs, uint32_t count, uint32_t bank, uint32_t delay, uint32_t frames);
+    void crossfade(const clap_process* process, uint32_t frames);
+
+    std::atomic<ClapHostInstance*> pending{ nullptr };
+    std::atomic<ClapHostInstance*> retired{ nullptr };
+    std::atomic<bool> suspendRequested{ false };
+    std::atomic<bool> restartFailed{ false };
+    std::atomic<ClapHostInstance*> suspendedInstance{ nullptr };
+    std::atomic<uint32_t> pathLatency{ 0 };
+
+    // owned by the audio thread
+    ClapHostInstance* current = nullptr;
+    ClapHostInstance* outgoing = nullptr;
+    bool fading = false;
+    uint32_t fadePos = 0;
+    uint32_t currentBank = 0;    // delay lines of the current path, the outgoing uses the other
+
+    uint32_t maxPorts = 0;
+    uint32_t maxChannels = 0;
+    uint32_t maxFrames = 0;
+    uint32_t fadeFrames = 0;
+    std::vector<float> fadeGain; // sin(x * pi / 2), fadeFrames + 1 points
+    std::vector<float> scratch;
+    std::vector<float*> scratchChannels;
+    std::vector<clap_audio_buffer> scratchBuffers;
+    ClapHostDelay delays;        // 2 banks of maxPorts * maxChannels lines
+};
@@ -0,0 +1,174 @@
+#ifdef _WIN32
+#include <Windows.h>
+#pragma comment(lib, "Synchronization.lib")
+#else
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <time.h>
+#endif
+#include <chrono>
+#include "ClapHostExtensions.h"
+#include "ClapHostThreadPool.h"
+
+// How long a worker keeps polling for the next request before it parks
+#define THREAD_POOL_SPIN_COUNT 20000
+
+uint64_t clap_thread_time() {
+#ifdef _WIN32
+    return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+#else
+    timespec now;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &now);
+    return (uint64_t)now.tv_sec * 1000000000ull + (uint64_t)now.tv_nsec;
+#endif
+}
+
+static inline void cpu_relax() {
+#ifdef _WIN32
+    YieldProcessor();
+#elif defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#endif
+}
+
+static void park(std::atomic<uint32_t>* address, uint32_t expected) {
+#ifdef _WIN32
+    WaitOnAddress(address, &expected, sizeof(expected), INFINITE);
+#else
+    syscall(SYS_futex, reinterpret_cast<uint32_t*>(address), FUTEX_WAIT_PRIVATE, expected, nullptr, nullptr, 0);
+#endif
+}
+
+static void unpark_all(std::atomic<uint32_t>* address) {
+#ifdef _WIN32
+    WakeByAddressAll(address);
+#else
+    syscall(SYS_futex, reinterpret_cast<uint32_t*>(address), FUTEX_WAKE_PRIVATE, INT32_MAX, nullptr, nullptr, 0);
+#endif
+}
+
+// Keep worker i off the first core, which is left to the audio device thread
+static void pin_to_core(std::thread& thread, uint32_t index) {
+    unsigned cores = std::thread::hardware_concurrency();
+    if (cores < 2) {
+        return;
+    }
+    unsigned core = 1 + index % (cores - 1);
+#ifdef _WIN32
+    SetThreadAffinityMask(thread.native_handle(), (DWORD_PTR)1 << core);
+#else
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(core, &set);
+    pthread_setaffinity_np(thread.native_handle(), sizeof(set), &set);
+#endif
+}
+
+ClapHostThreadPool::~ClapHostThreadPool() {
+    stop();
+}
+
+void ClapHostThreadPool::start(uint32_t numWorkers) {
+    stop();
+    stopping = false;
+    workers.reserve(numWorkers);
+    for (uint32_t i = 0; i < numWorkers; i++) {
+        workers.emplace_back(&ClapHostThreadPool::worker, this, i);
+        pin_to_core(workers.back(), i);
+    }
+}
+
+void ClapHostThreadPool::stop() {
+    if (workers.empty()) {
+        return;
+    }
+    stopping = true;
+    wake.fetch_add(1);
+    unpark_all(&wake);
+    for (std::thread& thread : workers) {
+        thread.join();
+    }
+    workers.clear();
+}
+
+bool ClapHostThreadPool::exec(const clap_plugin* requester, const clap_plugin_thread_pool* requesterPool, uint32_t count,
+                              uint32_t maxWorkers) {
+    if (workers.empty() || maxWorkers == 0 || !requesterPool || !requesterPool->exec || count > THREAD_POOL_MAX_TASKS) {
+        return false;
+    }
+
+    // The previous request is complete and no claim can succeed before the store below, so
+    // nobody reads these while they change
+    plugin = requester;
+    pluginPool = requesterPool;
+    helpers.store(maxWorkers, std::memory_order_relaxed);
+    done.store(0, std::memory_order_relaxed);
+    generation++;
+    work.store((uint64_t)generation << 32 | (uint64_t)count << 16, std::memory_order_release);
+
+    wake.fetch_add(1);
+    if (sleepers.load() > 0) {
+        unpark_all(&wake);
+    }
+
+    // The audio thread takes tasks too, then waits without parking for the stragglers
+    run_tasks(generation, false);
+    while (done.load(std::memory_order_acquire) < count) {
+        cpu_relax();
+    }
+    return true;
+}
+
+void ClapHostThreadPool::run_tasks(uint32_t gen, bool helper) {
+    uint64_t w = work.load(std::memory_order_acquire);
+    while ((uint32_t)(w >> 32) == gen && (uint32_t)(w & 0xFFFF) < (uint32_t)((w >> 16) & 0xFFFF)) {
+        // The word carries the generation and the task count the index is checked against, so a
+        // successful claim is a task of this request, which cannot end before the task is done
+        if (!work.compare_exchange_weak(w, w + 1, std::memory_order_acq_rel)) {
+            continue;
+        }
+        if (!helper) {
+            pluginPool->exec(plugin, (uint32_t)(w & 0xFFFF));
+        }
+        else {
+            // A helper's time is added before the task counts as done, so exec() returns with it
+            uint64_t start = clap_thread_time();
+            pluginPool->exec(plugin, (uint32_t)(w & 0xFFFF));
+            busyNanos.fetch_add(clap_thread_time() - start, std::memory_order_relaxed);
+        }
+        done.fetch_add(1, std::memory_order_release);
+        w = work.load(std::memory_order_acquire);
+    }
+}
+
+void ClapHostThreadPool::worker(uint32_t index) {
+    mark_clap_audio_thread(true);
+
+    uint32_t seen = wake.load();
+    while (!stopping) {
+        uint32_t current = wake.load(std::memory_order_acquire);
+        for (int spins = 0; current == seen && spins < THREAD_POOL_SPIN_COUNT; spins++) {
+            cpu_relax();
+            current = wake.load(std::memory_order_acquire);
+        }
+
+        if (current == seen) {
+            sleepers.fetch_add(1);
+            if (wake.load() == seen && !stopping) {
+                park(&wake, seen);
+            }
+            sleepers.fetch_sub(1);
+            continue;
+        }
+
+        seen = current;
+        uint64_t w = work.load(std::memory_order_acquire);
+        if (index < helpers.load(std::memory_order_relaxed)) {
+            run_tasks((uint32_t)(w >> 32), true);
+        }
+    }
+}
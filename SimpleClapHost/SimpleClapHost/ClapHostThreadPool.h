@@ -0,0 +1,70 @@
+#pragma once
+
+#include <atomic>
+#include <thread>
+#include <vector>
+#include <clap/clap.h>
+
+// Tasks one request may have, the width of the task fields in the request word
+#define THREAD_POOL_MAX_TASKS 0xFFFF
+
+// Nanoseconds the calling thread has run: its CPU time on POSIX, the elapsed time on Windows,
+// which also counts the time the thread waited for a core.
+// [thread-safe]
+uint64_t clap_thread_time();
+
+// Real-time oriented thread pool behind clap_host_thread_pool::request_exec.
+//
+// Workers are spawned and pinned up front. A request publishes its generation, its task count and
+// the next task index in one atomic word, then every worker and the calling audio thread claim
+// task indices from it until none are left, so an idle thread always takes the next pending task.
+// A claim compares the whole word, so a worker late from an earlier request cannot take a task of
+// the next one. Workers spin for a while
+// after a request before parking on the wake counter, which keeps back-to-back blocks free of
+// kernel wake-ups. exec() never allocates nor locks.
+class ClapHostThreadPool {
+public:
+    ClapHostThreadPool() = default;
+    ~ClapHostThreadPool();
+
+    ClapHostThreadPool(const ClapHostThreadPool&) = delete;
+    ClapHostThreadPool& operator=(const ClapHostThreadPool&) = delete;
+
+    // [main-thread]
+    void start(uint32_t numWorkers);
+    void stop();
+
+    uint32_t workerCount() const { return (uint32_t)workers.size(); }
+
+    // Nanoseconds the workers spent running tasks so far, by clap_thread_time(), a request's share
+    // included once exec() returned.
+    // [thread-safe]
+    uint64_t busyTime() const { return busyNanos.load(std::memory_order_relaxed); }
+
+    // Runs exec(plugin, 0 .. numTasks - 1) and returns once every task is done.
+    // Only the first maxWorkers workers help the calling thread; 0 refuses the request, as does
+    // a task count above THREAD_POOL_MAX_TASKS.
+    // [audio-thread]
+    bool exec(const clap_plugin* plugin, const clap_plugin_thread_pool* pluginPool, uint32_t numTasks,
+              uint32_t maxWorkers = UINT32_MAX);
+
+private:
+    void worker(uint32_t index);
+    void run_tasks(uint32_t generation, bool helper);
+
+    std::vector<std::thread> workers;
+    std::atomic<bool> stopping{ false };
+
+    // generation << 32 | task count << 16 | next task index
+    std::atomic<uint64_t> work{ 0 };
+    std::atomic<uint32_t> done{ 0 };
+    std::atomic<uint32_t> wake{ 0 };
+    std::atomic<uint32_t> sleepers{ 0 };
+    std::atomic<uint64_t> busyNanos{ 0 };
+    uint32_t generation = 0;
+
+    // current request, only read after a successful claim, which it cannot change before
+    const clap_plugin* plugin = nullptr;
+    const clap_plugin_thread_pool* pluginPool = nullptr;
+    std::atomic<uint32_t> helpers{ 0 }; // workers with a lower index take part
+};
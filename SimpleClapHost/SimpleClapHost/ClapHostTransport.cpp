@@ -0,0 +1,335 @@
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include "ClapHostTransport.h"
+
+static_assert((TRANSPORT_QUEUE_SIZE & (TRANSPORT_QUEUE_SIZE - 1)) == 0, "the queue size must be a power of 2");
+
+#define DEFAULT_TEMPO 120.0
+
+ClapHostTempoMap::ClapHostTempoMap(const std::map<double, double>& tempoChanges,
+                                   const std::map<int32_t, std::pair<uint16_t, uint16_t>>& meterChanges) {
+    tempoList.reserve(tempoChanges.size() + 1);
+    tempoList.push_back({ 0, 0, DEFAULT_TEMPO });
+    for (const auto& change : tempoChanges) {
+        Tempo& last = tempoList.back();
+        if (change.first <= 0) {
+            last.bpm = change.second;
+            continue;
+        }
+        double seconds = last.seconds + (change.first - last.beat) * 60 / last.bpm;
+        tempoList.push_back({ change.first, seconds, change.second });
+    }
+
+    // Meter changes fall on bar lines, so their beat follows from the meters before them
+    meterList.reserve(meterChanges.size() + 1);
+    meterList.push_back({ 0, 0, 0, 4, 4 });
+    for (const auto& change : meterChanges) {
+        Meter& last = meterList.back();
+        if (change.first <= 0) {
+            last.num = change.second.first;
+            last.denom = change.second.second;
+            continue;
+        }
+        double beat = last.beat + (change.first - last.bar) * last.num * 4.0 / last.denom;
+        meterList.push_back({ beat, secondsAt(beat), change.first, change.second.first, change.second.second });
+    }
+}
+
+double ClapHostTempoMap::secondsAt(double beat) const {
+    auto it = std::upper_bound(tempoList.begin(), tempoList.end(), beat,
+                               [](double b, const Tempo& tempo) { return b < tempo.beat; });
+    const Tempo& tempo = it == tempoList.begin() ? *it : *(it - 1);
+    return tempo.seconds + (beat - tempo.beat) * 60 / tempo.bpm;
+}
+
+double ClapHostTempoMap::beatAt(double seconds) const {
+    const Tempo& tempo = tempoList[tempoAt(seconds)];
+    return tempo.beat + (seconds - tempo.seconds) * tempo.bpm / 60;
+}
+
+size_t ClapHostTempoMap::tempoAt(double seconds) const {
+    auto it = std::upper_bound(tempoList.begin(), tempoList.end(), seconds,
+                               [](double s, const Tempo& tempo) { return s < tempo.seconds; });
+    return it == tempoList.begin() ? 0 : (size_t)(it - tempoList.begin()) - 1;
+}
+
+size_t ClapHostTempoMap::meterAt(double seconds) const {
+    auto it = std::upper_bound(meterList.begin(), meterList.end(), seconds,
+                               [](double s, const Meter& meter) { return s < meter.seconds; });
+    return it == meterList.begin() ? 0 : (size_t)(it - meterList.begin()) - 1;
+}
+
+ClapHostTransport::ClapHostTransport() {
+    blockEvents.reserve(TRANSPORT_MAX_EVENTS, TRANSPORT_MAX_EVENTS * sizeof(clap_event_transport));
+    blockSpans.reserve(TRANSPORT_MAX_EVENTS);
+    publish();
+}
+
+void ClapHostTransport::setTempo(double beat, double bpm) {
+    if (bpm <= 0) {
+        std::cerr << "Tempo must be positive: " << bpm << std::endl;
+        return;
+    }
+    tempoChanges[std::max(0.0, beat)] = bpm;
+    publish();
+}
+
+void ClapHostTransport::setTempoChanges(const std::map<double, double>& changes) {
+    tempoChanges.clear();
+    for (const auto& change : changes) {
+        if (change.second > 0) {
+            tempoChanges[std::max(0.0, change.first)] = change.second;
+        }
+    }
+    publish();
+}
+
+void ClapHostTransport::setMeter(int32_t bar, uint16_t num, uint16_t denom) {
+    if (num == 0 || denom == 0) {
+        std::cerr << "Invalid time signature: " << num << "/" << denom << std::endl;
+        return;
+    }
+    meterChanges[std::max(0, bar)] = std::make_pair(num, denom);
+    publish();
+}
+
+void ClapHostTransport::setMeterChanges(const std::map<int32_t, std::pair<uint16_t, uint16_t>>& changes) {
+    meterChanges.clear();
+    for (const auto& change : changes) {
+        if (change.second.first > 0 && change.second.second > 0) {
+            meterChanges[std::max(0, change.first)] = change.second;
+        }
+    }
+    publish();
+}
+
+void ClapHostTransport::clearTempoChanges() {
+    tempoChanges.clear();
+    meterChanges.clear();
+    publish();
+}
+
+void ClapHostTransport::publish() {
+    auto next = std::make_shared<ClapHostTempoMap>(tempoChanges, meterChanges);
+    next->generation = nextGeneration++;
+    maps.push_back(next);
+    published.store(next.get(), std::memory_order_release);
+}
+
+void ClapHostTransport::service() {
+    // The audio thread only ever takes the newest map, so the ones before its current are unused
+    uint64_t inUse = adopted.load(std::memory_order_acquire);
+    size_t unused = 0;
+    while (unused + 1 < maps.size() && maps[unused]->generation < inUse) {
+        unused++;
+    }
+    maps.erase(maps.begin(), maps.begin() + unused);
+}
+
+double ClapHostTransport::position() const {
+    return tempoMap()->beatAt(songSeconds.load(std::memory_order_relaxed));
+}
+
+bool ClapHostTransport::send(Command::Type type, double a, double b) {
+    uint32_t h = head.load(std::memory_order_relaxed);
+    if (h - tail.load(std::memory_order_acquire) == TRANSPORT_QUEUE_SIZE) {
+        std::cerr << "Too many pending transport requests." << std::endl;
+        return false;
+    }
+    commands[h & (TRANSPORT_QUEUE_SIZE - 1)] = { type, a, b };
+    head.store(h + 1, std::memory_order_release);
+    return true;
+}
+
+bool ClapHostTransport::requestPlay(bool play) {
+    wantPlaying = play;
+    return send(Command::Play, play);
+}
+
+bool ClapHostTransport::requestJump(double beat) {
+    return send(Command::Jump, std::max(0.0, beat));
+}
+
+bool ClapHostTransport::requestLoop(double startBeat, double endBeat) {
+    return send(Command::Loop, std::max(0.0, startBeat), std::max(0.0, endBeat));
+}
+
+bool ClapHostTransport::requestLoopEnabled(bool enabled) {
+    wantLooping = enabled;
+    return send(Command::LoopEnabled, enabled);
+}
+
+bool ClapHostTransport::requestRecord(bool record) {
+    wantRecording = record;
+    return send(Command::Record, record);
+}
+
+void ClapHostTransport::prepare(double rate) {
+    sampleRate = rate;
+    song = 0;
+    steady = 0;
+    blockFrames = 0;
+    map = nullptr;
+}
+
+int64_t ClapHostTransport::sample_of(double seconds) const {
+    return (int64_t)std::ceil(seconds * sampleRate);
+}
+
+// Moves the song position, finding the tempo and meter in effect there
+void ClapHostTransport::seek(int64_t sample) {
+    song = sample;
+    const auto& tempos = map->tempos();
+    const auto& meters = map->meters();
+    tempoIndex = map->tempoAt((double)sample / sampleRate);
+    meterIndex = map->meterAt((double)sample / sampleRate);
+
+    // A change applies from the first sample at or after it, rounding may put the search one off
+    while (tempoIndex + 1 < tempos.size() && sample_of(tempos[tempoIndex + 1].seconds) <= song) {
+        tempoIndex++;
+    }
+    while (tempoIndex > 0 && sample_of(tempos[tempoIndex].seconds) > song) {
+        tempoIndex--;
+    }
+    while (meterIndex + 1 < meters.size() && sample_of(meters[meterIndex + 1].seconds) <= song) {
+        meterIndex++;
+    }
+    while (meterIndex > 0 && sample_of(meters[meterIndex].seconds) > song) {
+        meterIndex--;
+    }
+}
+
+void ClapHostTransport::apply(const Command& command) {
+    switch (command.type) {
+    case Command::Play:
+        isPlaying = command.a != 0;
+        break;
+    case Command::Jump:
+        seek(sample_of(map->secondsAt(command.a)));
+        break;
+    case Command::Loop:
+        loopStart = command.a;
+        loopEnd = command.b;
+        loopStartSample = sample_of(map->secondsAt(loopStart));
+        loopEndSample = sample_of(map->secondsAt(loopEnd));
+        break;
+    case Command::LoopEnabled:
+        isLooping = command.a != 0;
+        break;
+    case Command::Record:
+        isRecording = command.a != 0;
+        break;
+    }
+}
+
+void ClapHostTransport::describe(clap_event_transport* event, uint32_t time) const {
+    const ClapHostTempoMap::Tempo& tempo = map->tempos()[tempoIndex];
+    const ClapHostTempoMap::Meter& meter = map->meters()[meterIndex];
+    double seconds = (double)song / sampleRate;
+    double beat = tempo.beat + (seconds - tempo.seconds) * tempo.bpm / 60;
+
+    // The position may sit a hair before the meter change it is rounded up to
+    double barLength = meter.num * 4.0 / meter.denom;
+    double bars = std::max(0.0, std::floor((beat - meter.beat) / barLength + 1e-9));
+
+    event->header.size = sizeof(clap_event_transport);
+    event->header.time = time;
+    event->header.space_id = CLAP_CORE_EVENT_SPACE_ID;
+    event->header.type = CLAP_EVENT_TRANSPORT;
+    event->header.flags = 0;
+    event->flags = CLAP_TRANSPORT_HAS_TEMPO | CLAP_TRANSPORT_HAS_BEATS_TIMELINE | CLAP_TRANSPORT_HAS_SECONDS_TIMELINE
+                 | CLAP_TRANSPORT_HAS_TIME_SIGNATURE | (isPlaying ? CLAP_TRANSPORT_IS_PLAYING : 0)
+                 | (isRecording ? CLAP_TRANSPORT_IS_RECORDING : 0)
+                 | (isLooping ? CLAP_TRANSPORT_IS_LOOP_ACTIVE : 0);
+    event->song_pos_beats = std::llround(beat * CLAP_BEATTIME_FACTOR);
+    event->song_pos_seconds = std::llround(seconds * CLAP_SECTIME_FACTOR);
+    event->tempo = tempo.bpm;
+    event->tempo_inc = 0;
+    event->loop_start_beats = std::llround(loopStart * CLAP_BEATTIME_FACTOR);
+    event->loop_end_beats = std::llround(loopEnd * CLAP_BEATTIME_FACTOR);
+    event->loop_start_seconds = std::llround((double)loopStartSample / sampleRate * CLAP_SECTIME_FACTOR);
+    event->loop_end_seconds = std::llround((double)loopEndSample / sampleRate * CLAP_SECTIME_FACTOR);
+    event->bar_start = std::llround((meter.beat + bars * barLength) * CLAP_BEATTIME_FACTOR);
+    event->bar_number = meter.bar + (int32_t)bars;
+    event->tsig_num = meter.num;
+    event->tsig_denom = meter.denom;
+}
+
+void ClapHostTransport::process(uint32_t frames) {
+    steady += blockFrames;
+    blockFrames = frames;
+
+    const ClapHostTempoMap* latest = published.load(std::memory_order_acquire);
+    if (latest != map) {
+        // Positions in beats stay, the samples they fall on move with the new tempo
+        double beat = map ? map->beatAt((double)song / sampleRate) : 0;
+        map = latest;
+        adopted.store(map->generation, std::memory_order_release);
+        seek(sample_of(map->secondsAt(beat)));
+        loopStartSample = sample_of(map->secondsAt(loopStart));
+        loopEndSample = sample_of(map->secondsAt(loopEnd));
+    }
+
+    uint32_t t = tail.load(std::memory_order_relaxed);
+    uint32_t h = head.load(std::memory_order_acquire);
+    for (; t != h; t++) {
+        apply(commands[t & (TRANSPORT_QUEUE_SIZE - 1)]);
+    }
+    tail.store(t, std::memory_order_release);
+
+    blockEvents.clear();
+    blockSpans.clear();
+    describe(&atStart, 0);
+
+    const auto& tempos = map->tempos();
+    const auto& meters = map->meters();
+    uint32_t frame = 0;
+    while (isPlaying && frame < frames) {
+        // Next frame where the transport changes, or the end of the block
+        int64_t end = song + (frames - frame);
+        int64_t next = end;
+        if (tempoIndex + 1 < tempos.size()) {
+            next = std::min(next, sample_of(tempos[tempoIndex + 1].seconds));
+        }
+        if (meterIndex + 1 < meters.size()) {
+            next = std::min(next, sample_of(meters[meterIndex + 1].seconds));
+        }
+        bool wraps = isLooping && loopStartSample < loopEndSample && song < loopEndSample && loopEndSample <= next;
+        if (wraps) {
+            next = loopEndSample;
+        }
+
+        // Tempo and meter changes do not break a span, only the loop does
+        uint32_t length = (uint32_t)(next - song);
+        if (!blockSpans.empty() && blockSpans.back().song + blockSpans.back().frames == song) {
+            blockSpans.back().frames += length;
+        }
+        else if (length > 0 && blockSpans.size() < blockSpans.capacity()) {
+            blockSpans.push_back({ frame, length, song });
+        }
+
+        frame += length;
+        if (wraps) {
+            seek(loopStartSample);
+        }
+        else {
+            song = next;
+            while (tempoIndex + 1 < tempos.size() && sample_of(tempos[tempoIndex + 1].seconds) <= song) {
+                tempoIndex++;
+            }
+            while (meterIndex + 1 < meters.size() && sample_of(meters[meterIndex + 1].seconds) <= song) {
+                meterIndex++;
+            }
+        }
+
+        // A change at the end of the block is described by the next block's transport
+        if (frame < frames) {
+            clap_event_transport event;
+            describe(&event, frame);
+            blockEvents.push(&event.header);
+        }
+    }
+
+    songSeconds.store((double)song / sampleRate, std::memory_order_relaxed);
+}
@@ -0,0 +1,174 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <vector>
+#include <clap/clap.h>
+#include <clap/ext/draft/transport-control.h>
+#include "ClapHostEvents.h"
+
+// Capacity of the transport command queue, a power of 2
+#define TRANSPORT_QUEUE_SIZE 64
+// Transport events one block can carry, the block start included; as many spans
+#define TRANSPORT_MAX_EVENTS 64
+
+// Tempo and time signature changes of a song, never changed once built.
+//
+// Tempo changes are placed by beat and meter changes by bar; both lists are kept with their
+// position in beats and seconds, so converting between beats and seconds is a binary search
+// over the tempo changes. The tempo is constant up to the next change.
+class ClapHostTempoMap {
+public:
+    struct Tempo {
+        double beat;
+        double seconds;
+        double bpm;
+    };
+
+    struct Meter {
+        double beat;
+        double seconds;
+        int32_t bar;
+        uint16_t num;
+        uint16_t denom;
+    };
+
+    // Tempo by beat and meter by bar; a song starts at 120 bpm in 4/4 unless changed at 0
+    ClapHostTempoMap(const std::map<double, double>& tempoChanges,
+                     const std::map<int32_t, std::pair<uint16_t, uint16_t>>& meterChanges);
+
+    double secondsAt(double beat) const;
+    double beatAt(double seconds) const;
+
+    // Index of the change in effect at a time in seconds
+    size_t tempoAt(double seconds) const;
+    size_t meterAt(double seconds) const;
+
+    const std::vector<Tempo>& tempos() const { return tempoList; }
+    const std::vector<Meter>& meters() const { return meterList; }
+
+    // Set when published, see ClapHostTransport
+    uint64_t generation = 0;
+
+private:
+    std::vector<Tempo> tempoList;   // by time, the first at beat 0
+    std::vector<Meter> meterList;
+};
+
+// Host transport: play state, song position, loop region and the tempo map.
+//
+// The main thread edits the song and sends play, jump and loop requests through a fixed queue;
+// a new tempo map is published with an atomic pointer store. The audio thread calls process()
+// once per block, before the plugins. It applies the requests at the start of the block,
+// describes the transport at the block start in a clap_event_transport for
+// clap_process::transport, and puts a CLAP_EVENT_TRANSPORT event at each frame of the block
+// where the tempo or meter changes or the loop jumps back, so the plugins follow it sample
+// accurately. The steady time counts every processed frame, playing or not.
+class ClapHostTransport {
+public:
+    // A stretch of the block over which the song plays on without jumping
+    struct Span {
+        uint32_t frame;
+        uint32_t frames;
+        int64_t song;           // position in samples at frame
+    };
+
+    ClapHostTransport();
+
+    ClapHostTransport(const ClapHostTransport&) = delete;
+    ClapHostTransport& operator=(const ClapHostTransport&) = delete;
+
+    // [main-thread] Edits of the song, published right away
+    void setTempo(double beat, double bpm);
+    // Replaces every tempo change at once, for loading a song
+    void setTempoChanges(const std::map<double, double>& changes);
+    void setMeter(int32_t bar, uint16_t num, uint16_t denom);
+    void setMeterChanges(const std::map<int32_t, std::pair<uint16_t, uint16_t>>& changes);
+    void clearTempoChanges();
+    std::shared_ptr<const ClapHostTempoMap> tempoMap() const { return maps.back(); }
+
+    // [main-thread] clap_host_transport_control, requests return false when the queue is full
+    bool requestPlay(bool play);
+    bool requestJump(double beat);
+    bool requestLoop(double startBeat, double endBeat);
+    bool requestLoopEnabled(bool enabled);
+    bool requestRecord(bool record);
+    bool playing() const { return wantPlaying; }
+    bool looping() const { return wantLooping; }
+    bool recording() const { return wantRecording; }
+
+    // Frees the tempo maps the audio thread let go of
+    // [main-thread]
+    void service();
+
+    // Song position in beats as of the last block
+    // [main-thread]
+    double position() const;
+
+    // [before the stream starts]
+    void prepare(double sampleRate);
+
+    // Advances the transport by one block of frames
+    // [audio-thread]
+    void process(uint32_t frames);
+    // Transport at the block start and the events of the block, valid until the next process()
+    const clap_event_transport* blockTransport() const { return &atStart; }
+    const clap_input_events* events() const { return blockEvents.list(); }
+    int64_t steadyTime() const { return steady; }
+    // The song covered by the block in playing order, none while stopped; the tempo map it is
+    // timed with, also valid until the next process()
+    const std::vector<Span>& spans() const { return blockSpans; }
+    const ClapHostTempoMap* blockTempoMap() const { return map; }
+
+private:
+    struct Command {
+        enum Type { Play, Jump, Loop, LoopEnabled, Record } type;
+        double a;
+        double b;
+    };
+
+    bool send(Command::Type type, double a, double b = 0);
+    void publish();
+    void apply(const Command& command);
+    void seek(int64_t sample);
+    void describe(clap_event_transport* event, uint32_t time) const;
+    int64_t sample_of(double seconds) const;
+
+    // [main-thread]
+    std::map<double, double> tempoChanges;
+    std::map<int32_t, std::pair<uint16_t, uint16_t>> meterChanges;
+    std::vector<std::shared_ptr<const ClapHostTempoMap>> maps;     // published, the newest last
+    uint64_t nextGeneration = 1;
+    bool wantPlaying = false;
+    bool wantLooping = false;
+    bool wantRecording = false;
+
+    std::atomic<const ClapHostTempoMap*> published{ nullptr };
+    std::atomic<uint64_t> adopted{ 0 };                 // generation the audio thread uses
+    std::atomic<double> songSeconds{ 0 };
+
+    Command commands[TRANSPORT_QUEUE_SIZE] = {};
+    std::atomic<uint32_t> head{ 0 };                    // written by the main thread
+    std::atomic<uint32_t> tail{ 0 };                    // written by the audio thread
+
+    // owned by the audio thread
+    const ClapHostTempoMap* map = nullptr;
+    double sampleRate = 48000;
+    int64_t song = 0;                   // position in samples
+    int64_t steady = 0;                 // at the block start
+    uint32_t blockFrames = 0;
+    size_t tempoIndex = 0;              // changes in effect at song
+    size_t meterIndex = 0;
+    bool isPlaying = false;
+    bool isLooping = false;
+    bool isRecording = false;
+    double loopStart = 0;               // beats
+    double loopEnd = 0;
+    int64_t loopStartSample = 0;
+    int64_t loopEndSample = 0;
+    clap_event_transport atStart = {};
+    ClapHostInputEvents blockEvents;
+    std::vector<Span> blockSpans;
+};
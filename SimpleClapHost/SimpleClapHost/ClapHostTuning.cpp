@@ -0,0 +1,299 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include "ClapHost.h"
+#include "ClapHostTuning.h"
+
+static_assert((TUNING_QUEUE_SIZE & (TUNING_QUEUE_SIZE - 1)) == 0, "the queue size must be a power of 2");
+
+// Key the scales are anchored to, at its 12-TET pitch
+#define TUNING_ROOT_KEY 60
+
+bool read_scala_scale(const char* path, std::string* name, double relative[TUNING_KEYS]) {
+    std::ifstream file(path);
+    if (!file) {
+        std::cerr << "Failed to open the scale: " << path << std::endl;
+        return false;
+    }
+
+    // Description, note count, then one pitch per note; the last pitch is the period
+    std::string line;
+    std::string description;
+    long count = -1;
+    bool described = false;
+    std::vector<double> cents;
+    while (std::getline(file, line) && (count < 0 || (long)cents.size() < count)) {
+        if (!line.empty() && line.back() == '\r') {
+            line.pop_back();
+        }
+        if (!line.empty() && line[0] == '!') {
+            continue;
+        }
+        if (!described) {
+            description = line;
+            described = true;
+            continue;
+        }
+        const char* text = line.c_str() + strspn(line.c_str(), " \t");
+        if (count < 0) {
+            count = strtol(text, nullptr, 10);
+            continue;
+        }
+        size_t length = strcspn(text, " \t");
+        if (memchr(text, '.', length)) {
+            cents.push_back(atof(text));
+            continue;
+        }
+        char* end = nullptr;
+        double numerator = (double)strtoul(text, &end, 10);
+        double denominator = *end == '/' ? (double)strtoul(end + 1, nullptr, 10) : 1;
+        if (numerator <= 0 || denominator <= 0) {
+            break;
+        }
+        cents.push_back(1200 * std::log2(numerator / denominator));
+    }
+    if (count <= 0 || (long)cents.size() != count) {
+        std::cerr << "Not a valid Scala scale: " << path << std::endl;
+        return false;
+    }
+
+    double period = cents.back();
+    for (int key = 0; key < TUNING_KEYS; key++) {
+        int steps = key - TUNING_ROOT_KEY;
+        int octave = (steps >= 0 ? steps : steps - (int)count + 1) / (int)count;
+        int degree = steps - octave * (int)count;
+        double pitch = octave * period + (degree > 0 ? cents[degree - 1] : 0);
+        relative[key] = pitch / 100 - steps;
+    }
+    *name = description.empty() ? path : description;
+    return true;
+}
+
+ClapHostTuning::ClapHostTuning() {
+    blockEvents.reserve(TUNING_MAX_EVENTS, TUNING_MAX_EVENTS * sizeof(clap_event_tuning));
+
+    // Taken by the audio thread's first block without going through the queue
+    auto pool = std::make_shared<ClapHostTuningPool>();
+    pool->generation = 1;
+    pools.push_back(pool);
+    current = pool.get();
+    next = pool.get();
+}
+
+clap_id ClapHostTuning::load(const char* sclPath) {
+    std::string name;
+    double relative[TUNING_KEYS];
+    if (!read_scala_scale(sclPath, &name, relative)) {
+        return CLAP_INVALID_ID;
+    }
+    return add(name, relative, false);
+}
+
+clap_id ClapHostTuning::add(const std::string& name, const double relative[TUNING_KEYS], bool dynamic) {
+    auto byId = pools.back()->byId;
+    auto tuning = std::make_shared<ClapHostTuningTable>();
+    tuning->id = (clap_id)byId.size();
+    tuning->name = name;
+    tuning->dynamic = dynamic;
+    memcpy(tuning->relative, relative, sizeof(tuning->relative));
+    std::fill(std::begin(tuning->play), std::end(tuning->play), true);
+    byId.push_back(tuning);
+
+    if (!publish(std::move(byId), 0)) {
+        return CLAP_INVALID_ID;
+    }
+    listGeneration++;
+    return tuning->id;
+}
+
+bool ClapHostTuning::remove(clap_id tuningId) {
+    auto byId = pools.back()->byId;
+    if (tuningId >= byId.size() || !byId[tuningId]) {
+        return false;
+    }
+    byId[tuningId] = nullptr;
+    if (!publish(std::move(byId), 0)) {
+        return false;
+    }
+    listGeneration++;
+    return true;
+}
+
+bool ClapHostTuning::retune(clap_id tuningId, const double relative[TUNING_KEYS], int64_t steadyTime) {
+    auto byId = pools.back()->byId;
+    if (tuningId >= byId.size() || !byId[tuningId]) {
+        return false;
+    }
+    auto tuning = std::make_shared<ClapHostTuningTable>(*byId[tuningId]);
+    memcpy(tuning->relative, relative, sizeof(tuning->relative));
+    tuning->dynamic = true;
+    byId[tuningId] = tuning;
+    return publish(std::move(byId), steadyTime);
+}
+
+bool ClapHostTuning::publish(std::vector<std::shared_ptr<const ClapHostTuningTable>> byId, int64_t steadyTime) {
+    auto pool = std::make_shared<ClapHostTuningPool>();
+    pool->generation = pools.back()->generation + 1;
+    pool->byId = std::move(byId);
+    for (const auto& tuning : pool->byId) {
+        if (tuning) {
+            pool->ids.push_back(tuning->id);
+        }
+    }
+
+    Command command = {};
+    command.type = Command::Pool;
+    command.steadyTime = steadyTime;
+    command.pool = pool.get();
+    if (!send(command)) {
+        return false;
+    }
+    pools.push_back(pool);
+    return true;
+}
+
+bool ClapHostTuning::assign(int16_t port, int16_t channel, clap_id tuningId, int64_t steadyTime) {
+    Command command = {};
+    command.type = Command::Assign;
+    command.steadyTime = steadyTime;
+    command.port = port;
+    command.channel = channel;
+    command.tuningId = tuningId;
+    if (!send(command)) {
+        return false;
+    }
+
+    // A global assignment replaces the narrower ones it covers
+    assignments.erase(std::remove_if(assignments.begin(), assignments.end(), [&](const Assignment& a) {
+        return (port < 0 || a.port == port) && (channel < 0 || a.channel == channel);
+    }), assignments.end());
+    assignments.push_back({ port, channel, tuningId });
+    return true;
+}
+
+void ClapHostTuning::reassign() {
+    for (const Assignment& a : assignments) {
+        Command command = {};
+        command.type = Command::Assign;
+        command.port = a.port;
+        command.channel = a.channel;
+        command.tuningId = a.tuningId;
+        send(command);
+    }
+}
+
+bool ClapHostTuning::send(const Command& command) {
+    uint32_t h = head.load(std::memory_order_relaxed);
+    if (h - tail.load(std::memory_order_acquire) == TUNING_QUEUE_SIZE) {
+        std::cerr << "Too many pending tuning changes." << std::endl;
+        return false;
+    }
+    commands[h & (TUNING_QUEUE_SIZE - 1)] = command;
+    head.store(h + 1, std::memory_order_release);
+    return true;
+}
+
+uint32_t ClapHostTuning::count() const {
+    return (uint32_t)pools.back()->ids.size();
+}
+
+bool ClapHostTuning::info(uint32_t index, clap_tuning_info* info) const {
+    const ClapHostTuningPool& pool = *pools.back();
+    if (index >= pool.ids.size()) {
+        return false;
+    }
+    const ClapHostTuningTable& tuning = *pool.byId[pool.ids[index]];
+    info->tuning_id = tuning.id;
+    snprintf(info->name, sizeof(info->name), "%s", tuning.name.c_str());
+    info->is_dynamic = tuning.dynamic;
+    return true;
+}
+
+void ClapHostTuning::service(ClapHostInstance* instance) {
+    // The audio thread takes the pools in order, the ones before its current are unused
+    uint64_t inUse = adopted.load(std::memory_order_acquire);
+    size_t unused = 0;
+    while (unused + 1 < pools.size() && pools[unused]->generation < inUse) {
+        unused++;
+    }
+    pools.erase(pools.begin(), pools.begin() + unused);
+
+    if (instance && instance->tuningExt && instance->tuningsSeen != listGeneration) {
+        instance->tuningsSeen = listGeneration;
+        instance->tuningExt->changed(instance->plugin);
+    }
+}
+
+const ClapHostTuningTable* ClapHostTuning::table(const ClapHostTuningPool* pool, clap_id tuningId) const {
+    return tuningId < pool->byId.size() ? pool->byId[tuningId].get() : nullptr;
+}
+
+double ClapHostTuning::relative(clap_id tuningId, int32_t key, uint32_t sampleOffset) const {
+    const ClapHostTuningPool* pool = sampleOffset >= switchFrame.load(std::memory_order_relaxed)
+        ? next.load(std::memory_order_acquire) : current.load(std::memory_order_acquire);
+    const ClapHostTuningTable* tuning = table(pool, tuningId);
+    if (!tuning || key < 0 || key >= TUNING_KEYS) {
+        return 0;
+    }
+    return tuning->relative[key];
+}
+
+bool ClapHostTuning::shouldPlay(clap_id tuningId, int32_t key) const {
+    const ClapHostTuningTable* tuning = table(current.load(std::memory_order_acquire), tuningId);
+    if (key < 0 || key >= TUNING_KEYS) {
+        return false;
+    }
+    return !tuning || tuning->play[key];
+}
+
+void ClapHostTuning::process(int64_t steadyTime, uint32_t frames) {
+    // The pool the last block ended with
+    const ClapHostTuningPool* pool = next.load(std::memory_order_relaxed);
+    bool switched = false;
+    current.store(pool, std::memory_order_release);
+    switchFrame.store(0, std::memory_order_relaxed);
+    blockEvents.clear();
+
+    // Commands come in time order, a late one is applied at the start of the block
+    uint32_t t = tail.load(std::memory_order_relaxed);
+    uint32_t h = head.load(std::memory_order_acquire);
+    uint32_t frame = 0;
+    for (; t != h; t++) {
+        const Command& command = commands[t & (TUNING_QUEUE_SIZE - 1)];
+        if (command.steadyTime >= steadyTime + frames) {
+            break;
+        }
+        frame = std::max(frame, (uint32_t)std::max<int64_t>(0, command.steadyTime - steadyTime));
+
+        if (command.type == Command::Pool) {
+            // One switch per block: changes at the same frame replace each other, a later one waits
+            // for the following block
+            if (switched && frame != switchFrame.load(std::memory_order_relaxed)) {
+                break;
+            }
+            switched = true;
+            next.store(command.pool, std::memory_order_release);
+            switchFrame.store(frame, std::memory_order_relaxed);
+            if (frame == 0) {
+                current.store(command.pool, std::memory_order_release);
+            }
+        }
+        else {
+            clap_event_tuning event = {};
+            event.header.size = sizeof(clap_event_tuning);
+            event.header.time = frame;
+            event.header.space_id = TUNING_EVENT_SPACE_ID;
+            event.header.type = 0;
+            event.header.flags = 0;
+            event.port_index = command.port;
+            event.channel = command.channel;
+            event.tunning_id = command.tuningId;
+            blockEvents.push(&event.header);
+        }
+    }
+    tail.store(t, std::memory_order_release);
+    adopted.store(current.load(std::memory_order_relaxed)->generation, std::memory_order_release);
+}
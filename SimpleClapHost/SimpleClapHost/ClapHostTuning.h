@@ -0,0 +1,135 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+#include <clap/clap.h>
+#include <clap/ext/draft/tuning.h>
+#include "ClapHostEvents.h"
+
+struct ClapHostInstance;
+
+// Event space of clap_event_tuning, handed out by clap_host_event_registry
+#define TUNING_EVENT_SPACE_ID 1
+#define TUNING_KEYS 128
+// Capacity of the tuning command queue, a power of 2
+#define TUNING_QUEUE_SIZE 64
+// Tuning events one block can carry
+#define TUNING_MAX_EVENTS 64
+
+// One tuning: per key, the offset in semitones from 12-TET with A4 = 440 Hz
+struct ClapHostTuningTable {
+    clap_id id = CLAP_INVALID_ID;
+    std::string name;
+    bool dynamic = false;
+    double relative[TUNING_KEYS] = {};
+    bool play[TUNING_KEYS] = {};
+};
+
+// The tunings at one point in time, never changed once published
+struct ClapHostTuningPool {
+    uint64_t generation = 0;
+    std::vector<std::shared_ptr<const ClapHostTuningTable>> byId;     // nullptr once removed
+    std::vector<clap_id> ids;                                         // the ones present, in order
+};
+
+// Tuning service behind clap_host_tuning.
+//
+// Tunings are loaded from Scala .scl files, or given as tables, and every key's offset is
+// computed once when the tuning is added. The pool of tunings is immutable: a change builds a
+// new pool sharing the unchanged tables and hands it to the audio thread through a fixed queue,
+// together with the tuning assignments of the ports and channels. At the start of each block
+// process() takes the pool and assignments due in that block; a pool due inside the block is
+// used from its frame on, so get_relative() follows a retune sample accurately, and each
+// assignment becomes a clap_event_tuning at its frame for every instance.
+//
+// relative() and shouldPlay() take no lock: the plugins' audio threads read the block's pools
+// through atomic pointers, which only move between blocks. Pools are freed by service() once
+// the audio thread has moved past them.
+class ClapHostTuning {
+public:
+    ClapHostTuning();
+
+    ClapHostTuning(const ClapHostTuning&) = delete;
+    ClapHostTuning& operator=(const ClapHostTuning&) = delete;
+
+    // Adds a tuning, returns its id or CLAP_INVALID_ID.
+    // Key 60 keeps its 12-TET pitch and is degree 0 of the scale.
+    // [main-thread]
+    clap_id load(const char* sclPath);
+    clap_id add(const std::string& name, const double relative[TUNING_KEYS], bool dynamic);
+    bool remove(clap_id tuningId);
+
+    // Changes a tuning's table from a steady time on, 0 for the next block.
+    // Changes must come in time order; the tunings can switch at one frame per block.
+    // [main-thread]
+    bool retune(clap_id tuningId, const double relative[TUNING_KEYS], int64_t steadyTime = 0);
+
+    // Sends a clap_event_tuning to every instance, -1 for every port or channel
+    // [main-thread]
+    bool assign(int16_t port, int16_t channel, clap_id tuningId, int64_t steadyTime = 0);
+    // Sends the assignments again, for an instance which has not seen them
+    void reassign();
+
+    // clap_host_tuning, [main-thread]
+    uint32_t count() const;
+    bool info(uint32_t index, clap_tuning_info* info) const;
+
+    // Tells the instance about added and removed tunings through clap_plugin_tuning::changed(),
+    // frees the pools the audio thread is done with.
+    // [main-thread]
+    void service(ClapHostInstance* instance);
+
+    // [audio-thread & in-process]
+    double relative(clap_id tuningId, int32_t key, uint32_t sampleOffset) const;
+    bool shouldPlay(clap_id tuningId, int32_t key) const;
+
+    // Takes what is due in the block starting at steadyTime; events() holds its tuning events.
+    // [audio-thread]
+    void process(int64_t steadyTime, uint32_t frames);
+    const clap_input_events* events() const { return blockEvents.list(); }
+
+private:
+    struct Command {
+        enum Type { Pool, Assign } type;
+        int64_t steadyTime;
+        const ClapHostTuningPool* pool;
+        int16_t port;
+        int16_t channel;
+        clap_id tuningId;
+    };
+
+    struct Assignment {
+        int16_t port;
+        int16_t channel;
+        clap_id tuningId;
+    };
+
+    bool publish(std::vector<std::shared_ptr<const ClapHostTuningTable>> byId, int64_t steadyTime);
+    bool send(const Command& command);
+    const ClapHostTuningTable* table(const ClapHostTuningPool* pool, clap_id tuningId) const;
+
+    // [main-thread]
+    std::vector<std::shared_ptr<const ClapHostTuningPool>> pools;  // sent, the newest last
+    std::vector<Assignment> assignments;
+    uint64_t listGeneration = 1;        // changes when tunings are added or removed
+
+    Command commands[TUNING_QUEUE_SIZE] = {};
+    std::atomic<uint32_t> head{ 0 };                    // written by the main thread
+    std::atomic<uint32_t> tail{ 0 };                    // written by the audio thread
+    std::atomic<uint64_t> adopted{ 0 };                 // generation of the audio thread's pool
+
+    // Pools of the current block, read by the plugins: next from switchFrame on
+    std::atomic<const ClapHostTuningPool*> current{ nullptr };
+    std::atomic<const ClapHostTuningPool*> next{ nullptr };
+    std::atomic<uint32_t> switchFrame{ 0 };
+
+    // owned by the audio thread
+    ClapHostInputEvents blockEvents;
+};
+
+// Offsets of a Scala scale repeated over the keys, key 60 on degree 0.
+// Returns false if the file is not a valid .scl.
+bool read_scala_scale(const char* path, std::string* name, double relative[TUNING_KEYS]);
@@ -0,0 +1,384 @@
+#ifdef _WIN32
+#include <Windows.h>
+#else
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#endif
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include "ClapHostUmp.h"
+
+static_assert((UMP_RING_PACKETS & (UMP_RING_PACKETS - 1)) == 0, "the ring size must be a power of 2");
+
+// Message types which stay with the host
+#define UMP_UTILITY 0x0
+#define UMP_FLEX_DATA 0xd
+#define UMP_STREAM 0xf
+// Utility statuses
+#define UMP_DELTA_CLOCKSTAMP_TPQ 0x3
+#define UMP_DELTA_CLOCKSTAMP 0x4
+
+// First two words of a MIDI clip file, "SMF2CLIP"
+#define UMP_CLIP_HEADER0 0x534d4632
+#define UMP_CLIP_HEADER1 0x434c4950
+
+#define UMP_READ_BYTES 4096
+
+static uint64_t steady_ns() {
+    return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+uint32_t ump_packet_words(uint32_t word) {
+    static const uint8_t words[16] = { 1, 1, 1, 2, 2, 4, 1, 1, 2, 2, 2, 3, 3, 4, 4, 4 };
+    return words[word >> 28];
+}
+
+ClapHostUmpInput::ClapHostUmpInput() : ring(new Slot[UMP_RING_PACKETS]()) {
+    view.ctx = this;
+    view.size = view_size;
+    view.get = view_get;
+    blockEvents.reserve(UMP_MAX_EVENTS, UMP_EVENT_BYTES);
+}
+
+bool ClapHostUmpInput::open(const char* path) {
+    close();
+#ifdef _WIN32
+    HANDLE file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE, nullptr, OPEN_EXISTING,
+                              FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (file == INVALID_HANDLE_VALUE) {
+        std::cerr << "Failed to open the UMP stream: " << path << std::endl;
+        return false;
+    }
+    stream = file;
+#else
+    // Not blocking, so that a FIFO opens before its writer does and the reads can be given up
+    stream = ::open(path, O_RDONLY | O_NONBLOCK | O_CLOEXEC);
+    if (stream < 0) {
+        std::cerr << "Failed to open the UMP stream: " << path << std::endl;
+        return false;
+    }
+#endif
+    stopping = false;
+    finished = false;
+    receiver = std::thread(&ClapHostUmpInput::receive, this);
+    return true;
+}
+
+void ClapHostUmpInput::close() {
+    if (!receiver.joinable()) {
+        return;
+    }
+    stopping = true;
+    while (!finished) {
+#ifdef _WIN32
+        // A pipe read waits for its writer otherwise
+        CancelSynchronousIo(receiver.native_handle());
+#endif
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    receiver.join();
+#ifdef _WIN32
+    CloseHandle(stream);
+    stream = nullptr;
+#else
+    ::close(stream);
+    stream = -1;
+#endif
+}
+
+void ClapHostUmpInput::setDialects(uint32_t preferred, uint32_t supported) {
+    preferredDialect.store(preferred, std::memory_order_relaxed);
+    supportedDialects.store(supported, std::memory_order_relaxed);
+}
+
+void ClapHostUmpInput::prepare(double rate) {
+    sampleRate = rate;
+    lastBlock = 0;
+}
+
+// Reads what the stream has, got is 0 while a pipe has nothing; false at its end
+bool ClapHostUmpInput::read_stream(uint8_t* buffer, uint32_t size, uint32_t* got) {
+    *got = 0;
+#ifdef _WIN32
+    DWORD read = 0;
+    if (!ReadFile(stream, buffer, size, &read, nullptr) || read == 0) {
+        return false;
+    }
+    *got = read;
+    return true;
+#else
+    pollfd wait = { stream, POLLIN, 0 };
+    if (poll(&wait, 1, 50) <= 0) {
+        return true;
+    }
+    ssize_t read = ::read(stream, buffer, size);
+    if (read > 0) {
+        *got = (uint32_t)read;
+        return true;
+    }
+    // A FIFO without a writer reads as ended, one may come yet
+    struct stat st;
+    if (read == 0 && fstat(stream, &st) == 0 && S_ISFIFO(st.st_mode)) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        return true;
+    }
+    return read < 0 && errno == EAGAIN;
+#endif
+}
+
+// Waits for a free slot, writes the packet into it and hands it over; false when stopping
+bool ClapHostUmpInput::deliver(const uint32_t* words, uint64_t due) {
+    uint32_t h = head.load(std::memory_order_relaxed);
+    while (h - tail.load(std::memory_order_acquire) == UMP_RING_PACKETS) {
+        if (stopping) {
+            return false;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+
+    Slot& slot = ring[h & (UMP_RING_PACKETS - 1)];
+    slot.event.header.size = sizeof(clap_event_midi2);
+    slot.event.header.time = 0;
+    slot.event.header.space_id = CLAP_CORE_EVENT_SPACE_ID;
+    slot.event.header.type = CLAP_EVENT_MIDI2;
+    slot.event.header.flags = 0;
+    slot.event.port_index = 0;
+    memcpy(slot.event.data, words, sizeof(slot.event.data));
+    slot.due = due;
+
+    head.store(h + 1, std::memory_order_release);
+    return true;
+}
+
+void ClapHostUmpInput::receive() {
+    uint8_t buffer[UMP_READ_BYTES];
+    uint32_t packet[4] = {};
+    uint32_t wordCount = 0;             // words of the packet so far
+    uint32_t word = 0;
+    uint32_t byteCount = 0;             // bytes of the word so far
+    uint64_t streamWords = 0;
+
+    // Delta Clockstamps count from the first packet, at the last Set Tempo
+    uint64_t origin = 0;
+    double elapsedNs = 0;
+    double quarterNs = 500000000;
+    uint32_t ticksPerQuarter = 0;
+    bool clocked = false;
+    uint64_t lastDue = 0;
+
+    uint32_t got = 0;
+    while (!stopping && read_stream(buffer, sizeof(buffer), &got)) {
+        // What one read returns arrived together
+        uint64_t now = steady_ns();
+        if (origin == 0) {
+            origin = now;
+        }
+        for (uint32_t i = 0; i < got; i++) {
+            word = word << 8 | buffer[i];
+            if (++byteCount < 4) {
+                continue;
+            }
+            byteCount = 0;
+            if ((streamWords == 0 && word == UMP_CLIP_HEADER0) || (streamWords == 1 && word == UMP_CLIP_HEADER1)) {
+                streamWords++;
+                continue;
+            }
+            streamWords++;
+            packet[wordCount++] = word;
+            if (wordCount < ump_packet_words(packet[0])) {
+                continue;
+            }
+            for (uint32_t k = wordCount; k < 4; k++) {
+                packet[k] = 0;
+            }
+            wordCount = 0;
+
+            uint32_t type = packet[0] >> 28;
+            if (type == UMP_UTILITY) {
+                uint32_t status = (packet[0] >> 20) & 0xf;
+                if (status == UMP_DELTA_CLOCKSTAMP_TPQ) {
+                    ticksPerQuarter = packet[0] & 0xffff;
+                }
+                else if (status == UMP_DELTA_CLOCKSTAMP && ticksPerQuarter > 0) {
+                    elapsedNs += (packet[0] & 0xfffff) * quarterNs / ticksPerQuarter;
+                    clocked = true;
+                }
+                continue;
+            }
+            if (type == UMP_FLEX_DATA) {
+                // Set Tempo, in 10 ns units per quarter note
+                if ((packet[0] & 0xffff) == 0 && packet[1] > 0) {
+                    quarterNs = packet[1] * 10.0;
+                }
+                continue;
+            }
+            if (type == UMP_STREAM) {
+                continue;
+            }
+
+            // In order, as the ring hands them over
+            lastDue = std::max(lastDue, clocked ? origin + (uint64_t)elapsedNs : now);
+            if (!deliver(packet, lastDue)) {
+                break;
+            }
+        }
+    }
+    finished = true;
+}
+
+void ClapHostUmpInput::midi(uint32_t time, uint8_t status, uint8_t data1, uint8_t data2) {
+    if (!midiEvents) {
+        return;
+    }
+    clap_event_midi event = {};
+    event.header.size = sizeof(clap_event_midi);
+    event.header.time = time;
+    event.header.space_id = CLAP_CORE_EVENT_SPACE_ID;
+    event.header.type = CLAP_EVENT_MIDI;
+    event.header.flags = 0;
+    event.port_index = 0;
+    event.data[0] = status;
+    event.data[1] = data1 & 0x7f;
+    event.data[2] = data2 & 0x7f;
+    blockEvents.push(&event.header);
+}
+
+void ClapHostUmpInput::note(uint32_t time, bool on, uint8_t channel, uint8_t key, uint8_t velocity7, double velocity) {
+    if (!noteEvents) {
+        midi(time, (uint8_t)((on ? 0x90 : 0x80) | channel), key, velocity7);
+        return;
+    }
+    clap_event_note event = {};
+    event.header.size = sizeof(clap_event_note);
+    event.header.time = time;
+    event.header.space_id = CLAP_CORE_EVENT_SPACE_ID;
+    event.header.type = on ? CLAP_EVENT_NOTE_ON : CLAP_EVENT_NOTE_OFF;
+    event.header.flags = 0;
+    event.note_id = -1;
+    event.port_index = 0;
+    event.channel = channel;
+    event.key = key & 0x7f;
+    event.velocity = velocity;
+    blockEvents.push(&event.header);
+}
+
+// Channel voice messages of either MIDI version, and system messages, down to the input's
+// dialect. Groups all go to the one note input.
+void ClapHostUmpInput::convert(const clap_event_midi2& packet) {
+    uint32_t word = packet.data[0];
+    uint32_t value = packet.data[1];
+    uint32_t time = packet.header.time;
+    uint8_t status = (uint8_t)(word >> 16);
+    uint8_t channel = status & 0x0f;
+    uint8_t byte3 = (uint8_t)(word >> 8);
+    uint8_t byte4 = (uint8_t)word;
+
+    switch (word >> 28) {
+    case 0x1:
+        midi(time, status, byte3, byte4);
+        break;
+    case 0x2:
+        if ((status & 0xe0) == 0x80) {
+            bool on = (status & 0xf0) == 0x90 && byte4 > 0;
+            note(time, on, channel, byte3, byte4, byte4 / 127.0);
+        }
+        else {
+            midi(time, status, byte3, byte4);
+        }
+        break;
+    case 0x4: {
+        // Scaled down as the MIDI 2.0 specification translates to MIDI 1.0
+        uint16_t velocity = (uint16_t)(value >> 16);
+        switch (status & 0xf0) {
+        case 0x80:
+            note(time, false, channel, byte3, (uint8_t)(velocity >> 9), velocity / 65535.0);
+            break;
+        case 0x90:
+            note(time, true, channel, byte3, (uint8_t)std::max(1, velocity >> 9), velocity / 65535.0);
+            break;
+        case 0xa0:
+        case 0xb0:
+            midi(time, status, byte3, (uint8_t)(value >> 25));
+            break;
+        case 0xc0:
+            if (byte4 & 1) {
+                midi(time, (uint8_t)(0xb0 | channel), 0, (uint8_t)(value >> 8));
+                midi(time, (uint8_t)(0xb0 | channel), 32, (uint8_t)value);
+            }
+            midi(time, status, (uint8_t)(value >> 24), 0);
+            break;
+        case 0xd0:
+            midi(time, status, (uint8_t)(value >> 25), 0);
+            break;
+        case 0xe0:
+            midi(time, status, (uint8_t)(value >> 18), (uint8_t)(value >> 25));
+            break;
+        default:
+            // Per-note controllers and management, RPN and NRPN have no MIDI 1.0 event of their own
+            break;
+        }
+        break;
+    }
+    default:
+        // Sysex and data messages would need reassembling
+        break;
+    }
+}
+
+void ClapHostUmpInput::process(uint32_t frames) {
+    uint64_t now = steady_ns();
+    if (lastBlock == 0) {
+        lastBlock = now - (uint64_t)(frames * 1e9 / sampleRate);
+    }
+
+    // The slots of the last block are done with
+    uint32_t t = tail.load(std::memory_order_relaxed) + taken;
+    tail.store(t, std::memory_order_release);
+    taken = 0;
+    blockEvents.clear();
+
+    uint32_t supported = supportedDialects.load(std::memory_order_relaxed);
+    uint32_t preferred = preferredDialect.load(std::memory_order_relaxed);
+    midiEvents = (supported & (CLAP_NOTE_DIALECT_MIDI | CLAP_NOTE_DIALECT_MIDI_MPE)) != 0;
+    noteEvents = (supported & CLAP_NOTE_DIALECT_CLAP) != 0 && (preferred == CLAP_NOTE_DIALECT_CLAP || !midiEvents);
+    forwarding = (supported & CLAP_NOTE_DIALECT_MIDI2) != 0
+              && (preferred == CLAP_NOTE_DIALECT_MIDI2 || (!midiEvents && !noteEvents));
+
+    // Packets due between the last block and this one, at the same place in this block's frames
+    uint64_t window = std::max<uint64_t>(now - lastBlock, 1);
+    uint32_t h = head.load(std::memory_order_acquire);
+    while (t + taken != h && taken < UMP_MAX_EVENTS) {
+        Slot& slot = ring[(t + taken) & (UMP_RING_PACKETS - 1)];
+        if (slot.due >= now) {
+            break;
+        }
+        if (!forwarding && blockEvents.size() + 3 > UMP_MAX_EVENTS) {
+            break;
+        }
+        slot.event.header.time = slot.due <= lastBlock ? 0 : (uint32_t)((slot.due - lastBlock) * frames / window);
+        if (!forwarding) {
+            convert(slot.event);
+        }
+        taken++;
+    }
+    lastBlock = now;
+}
+
+uint32_t CLAP_ABI ClapHostUmpInput::view_size(const clap_input_events* list) {
+    return static_cast<const ClapHostUmpInput*>(list->ctx)->taken;
+}
+
+const clap_event_header* CLAP_ABI ClapHostUmpInput::view_get(const clap_input_events* list, uint32_t position) {
+    auto* input = static_cast<const ClapHostUmpInput*>(list->ctx);
+    if (position >= input->taken) {
+        return nullptr;
+    }
+    uint32_t t = input->tail.load(std::memory_order_relaxed);
+    return &input->ring[(t + position) & (UMP_RING_PACKETS - 1)].event.header;
+}
@@ -0,0 +1,109 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <thread>
+#include <clap/clap.h>
+#include "ClapHostEvents.h"
+
+// Packets the receive buffer holds, a power of 2
+#define UMP_RING_PACKETS 4096
+// Events one block carries at most
+#define UMP_MAX_EVENTS 1024
+// A MIDI 2.0 program change with a bank becomes three MIDI 1.0 events, still smaller than
+// one CLAP note event each
+#define UMP_EVENT_BYTES (UMP_MAX_EVENTS * sizeof(clap_event_note))
+
+// 32-bit words of a Universal MIDI Packet, from the message type of its first word
+uint32_t ump_packet_words(uint32_t word);
+
+// MIDI 2.0 input from a stream of Universal MIDI Packets.
+//
+// A receive thread reads the stream, a file or a named pipe (a FIFO outside Windows) standing
+// in for a network or device connection, as big-endian 32-bit words, skipping the header of a
+// MIDI clip file. It decodes each packet straight into a slot of a single-producer,
+// single-consumer ring, laid out as a clap_event_midi2, together with the steady clock time the
+// packet is due: its arrival, or for a stream carrying Delta Clockstamps, the time they count
+// from the start of the stream at its Set Tempo (120 bpm until one comes). Utility, Flex Data and
+// UMP Stream messages set the timing and go no further.
+//
+// Each block, process() takes the packets due since the last block and spreads them over its
+// frames in proportion to their due time, one block late but without jitter. For a note input
+// which prefers MIDI 2.0, events() is a view over the ring slots themselves, and the host's block
+// list and the instance's list refer to the slots instead of copying them: the plugin reads the
+// packets where the receive thread wrote them, only their time set. Otherwise the channel voice
+// messages are converted to MIDI 1.0 as the MIDI 2.0 specification translates them, or to CLAP
+// note events; what the dialect cannot carry is dropped.
+class ClapHostUmpInput {
+public:
+    ClapHostUmpInput();
+    ~ClapHostUmpInput() { close(); }
+
+    ClapHostUmpInput(const ClapHostUmpInput&) = delete;
+    ClapHostUmpInput& operator=(const ClapHostUmpInput&) = delete;
+
+    // Starts receiving from a file or pipe, instead of the current stream
+    // [main-thread]
+    bool open(const char* path);
+    void close();
+    bool isOpen() const { return receiver.joinable(); }
+    // Packets received since the start, modulo 2^32
+    uint32_t received() const { return head.load(std::memory_order_relaxed); }
+
+    // Dialects of the note input the events go to, see clap_note_port_info; none takes nothing
+    // [main-thread]
+    void setDialects(uint32_t preferred, uint32_t supported);
+
+    // [before the stream starts]
+    void prepare(double sampleRate);
+
+    // Takes the packets due since the last block, and lets the ring have those of the last block back
+    // [audio-thread]
+    void process(uint32_t frames);
+    // The events of the block, valid until the next process()
+    const clap_input_events* events() const { return forwarding ? &view : blockEvents.list(); }
+
+private:
+    struct Slot {
+        clap_event_midi2 event;
+        uint64_t due;           // steady clock, ns
+    };
+
+    void receive();
+    bool read_stream(uint8_t* buffer, uint32_t size, uint32_t* got);
+    bool deliver(const uint32_t* words, uint64_t due);
+    void convert(const clap_event_midi2& packet);
+    void midi(uint32_t time, uint8_t status, uint8_t data1, uint8_t data2);
+    void note(uint32_t time, bool on, uint8_t channel, uint8_t key, uint8_t velocity7, double velocity);
+
+    static uint32_t CLAP_ABI view_size(const clap_input_events* list);
+    static const clap_event_header* CLAP_ABI view_get(const clap_input_events* list, uint32_t position);
+
+    std::unique_ptr<Slot[]> ring;
+    std::atomic<uint32_t> head{ 0 };    // written by the receive thread
+    std::atomic<uint32_t> tail{ 0 };    // written by the audio thread
+
+    // [main-thread]
+    std::thread receiver;
+    std::atomic<bool> stopping{ false };
+    std::atomic<bool> finished{ false };    // the receive thread is done with the stream
+#ifdef _WIN32
+    void* stream = nullptr;
+#else
+    int stream = -1;
+#endif
+
+    std::atomic<uint32_t> preferredDialect{ 0 };
+    std::atomic<uint32_t> supportedDialects{ 0 };
+    double sampleRate = 48000;
+
+    // owned by the audio thread
+    uint64_t lastBlock = 0;             // steady clock time of the last process()
+    uint32_t taken = 0;                 // slots of the block, from tail on
+    bool forwarding = false;            // events() is the view over the slots
+    bool noteEvents = false;            // notes go as CLAP note events
+    bool midiEvents = false;            // channel voice messages may go as MIDI 1.0 events
+    clap_input_events view;
+    ClapHostInputEvents blockEvents;
+};
@@ -0,0 +1,326 @@
+#include <cstring>
+#include <iostream>
+#include "ClapHost.h"
+#include "ClapHostUndo.h"
+
+ClapHostUndoHistory::ClapHostUndoHistory(uint64_t budget, uint32_t deltaArena)
+    : budget(budget), arenaSize(deltaArena) {
+}
+
+ClapHostUndoHistory::Member* ClapHostUndoHistory::member(ClapHostInstance* instance) {
+    auto it = members.find(instance);
+    return it != members.end() ? &it->second : nullptr;
+}
+
+void ClapHostUndoHistory::attach(ClapHostInstance* instance) {
+    if (member(instance)) {
+        return;
+    }
+    Member& m = members[instance];
+
+    auto* deltaExt = static_cast<const clap_plugin_undo_delta*>(
+        instance->plugin->get_extension(instance->plugin, CLAP_EXT_UNDO_DELTA));
+    if (deltaExt) {
+        clap_undo_delta_properties properties = { false, false, CLAP_INVALID_ID };
+        deltaExt->get_delta_properties(instance->plugin, &properties);
+        m.deltaExt = properties.has_delta ? deltaExt : nullptr;
+        m.formatVersion = properties.format_version;
+    }
+    m.contextExt = static_cast<const clap_plugin_undo_context*>(
+        instance->plugin->get_extension(instance->plugin, CLAP_EXT_UNDO_CONTEXT));
+
+    // Steps made from here on start from this state
+    m.origin = snapshots.capture(instance);
+    m.originSerial = nextSerial - 1;
+}
+
+void ClapHostUndoHistory::detach(ClapHostInstance* instance) {
+    Member* m = member(instance);
+    if (!m) {
+        return;
+    }
+    size_t kept = 0;
+    size_t keptBeforePosition = 0;
+    for (size_t i = 0; i < steps.size(); i++) {
+        if (steps[i].instance == instance) {
+            // Its delta bytes stay behind as a gap until the ring passes them
+            release_step(steps[i]);
+            continue;
+        }
+        keptBeforePosition += i < position ? 1 : 0;
+        steps[kept++] = steps[i];
+    }
+    steps.resize(kept);
+    position = keptBeforePosition;
+
+    if (m->origin != CLAP_INVALID_ID) {
+        snapshots.release(m->origin);
+    }
+    members.erase(instance);
+    notify_context();
+}
+
+void ClapHostUndoHistory::beginChange(ClapHostInstance* instance) {
+    if (Member* m = member(instance)) {
+        m->changing = true;
+    }
+}
+
+void ClapHostUndoHistory::cancelChange(ClapHostInstance* instance) {
+    if (Member* m = member(instance)) {
+        m->changing = false;
+    }
+}
+
+void ClapHostUndoHistory::subscribe(ClapHostInstance* instance, bool subscribed) {
+    if (Member* m = member(instance)) {
+        m->subscribed = subscribed && m->contextExt;
+        notify_context();
+    }
+}
+
+void ClapHostUndoHistory::changeMade(ClapHostInstance* instance, const char* name, const void* delta, size_t deltaSize,
+                                     bool deltaCanUndo) {
+    Member* m = member(instance);
+    if (!m) {
+        // The state before the change is gone, this step can be redone only
+        attach(instance);
+        m = member(instance);
+        m->originSerial = nextSerial;
+    }
+    m->changing = false;
+    drop_redo();
+
+    Step step = {};
+    step.instance = instance;
+    step.name = name ? name : "";
+    step.serial = nextSerial++;
+    step.formatVersion = m->formatVersion;
+    step.after = CLAP_INVALID_ID;
+
+    // A delta which cannot undo is no use here, the state is captured instead
+    step.isDelta = delta && deltaSize > 0 && deltaCanUndo && m->deltaExt && deltaSize <= arenaSize
+                && store_delta(delta, deltaSize, &step.deltaOffset);
+    if (step.isDelta) {
+        step.deltaSize = (uint32_t)deltaSize;
+    }
+    else {
+        step.after = snapshots.capture(instance);
+        if (step.after == CLAP_INVALID_ID) {
+            std::cerr << "Undo step lost, the plugin state cannot be saved: " << step.name << std::endl;
+            return;
+        }
+    }
+    steps.push_back(std::move(step));
+    position = steps.size();
+
+    trim();
+    notify_context();
+}
+
+// Copies the delta at the head of the ring, dropping the oldest steps until it fits
+bool ClapHostUndoHistory::store_delta(const void* delta, size_t size, uint32_t* offset) {
+    if (arena.empty()) {
+        arena.resize(arenaSize);
+    }
+    uint32_t n = (uint32_t)size;
+    for (;;) {
+        if (deltaBytes == 0) {
+            head = tail = 0;
+        }
+        bool wrapped = deltaBytes > 0 && head <= tail;
+        if (!wrapped && arenaSize - head >= n) {
+            *offset = head;
+            break;
+        }
+        if (!wrapped && tail >= n) {
+            *offset = 0;
+            break;
+        }
+        if (wrapped && tail - head >= n) {
+            *offset = head;
+            break;
+        }
+        if (position == 0) {
+            return false;
+        }
+        drop_oldest();
+    }
+    memcpy(arena.data() + *offset, delta, n);
+    head = *offset + n;
+    deltaBytes += n;
+    return true;
+}
+
+void ClapHostUndoHistory::release_step(const Step& step) {
+    if (step.isDelta) {
+        deltaBytes -= step.deltaSize;
+    }
+    else {
+        snapshots.release(step.after);
+    }
+}
+
+// A new change takes the place of the steps undone before it
+void ClapHostUndoHistory::drop_redo() {
+    while (steps.size() > position) {
+        const Step& step = steps.back();
+        if (step.isDelta) {
+            head = step.deltaOffset;
+        }
+        release_step(step);
+        steps.pop_back();
+    }
+}
+
+void ClapHostUndoHistory::drop_oldest() {
+    const Step& step = steps.front();
+    Member& m = members[step.instance];
+    if (m.origin != CLAP_INVALID_ID) {
+        snapshots.release(m.origin);
+    }
+    if (step.isDelta) {
+        // Nothing rebuilds the state before the instance's later snapshot steps any more
+        m.origin = CLAP_INVALID_ID;
+        deltaBytes -= step.deltaSize;
+    }
+    else {
+        m.origin = step.after;
+        m.originSerial = step.serial;
+    }
+    steps.pop_front();
+    position--;
+
+    for (const Step& next : steps) {
+        if (next.isDelta) {
+            tail = next.deltaOffset;
+            break;
+        }
+    }
+}
+
+void ClapHostUndoHistory::trim() {
+    while (memoryUsed() > budget && position > 1) {
+        drop_oldest();
+    }
+}
+
+// Brings the instance of the snapshot step at index back to the state before it
+bool ClapHostUndoHistory::rebuild_before(size_t index) {
+    const Step& step = steps[index];
+    Member& m = members[step.instance];
+
+    clap_id base = CLAP_INVALID_ID;
+    size_t first = 0;
+    for (size_t i = index; i-- > 0;) {
+        if (steps[i].instance == step.instance && !steps[i].isDelta) {
+            base = steps[i].after;
+            first = i + 1;
+            break;
+        }
+    }
+    if (base == CLAP_INVALID_ID) {
+        if (m.origin == CLAP_INVALID_ID || step.serial <= m.originSerial) {
+            return false;
+        }
+        base = m.origin;
+    }
+    if (!snapshots.restore(step.instance, base)) {
+        return false;
+    }
+    for (size_t i = first; i < index; i++) {
+        const Step& replay = steps[i];
+        if (replay.instance == step.instance && replay.isDelta
+            && !m.deltaExt->redo(step.instance->plugin, replay.formatVersion, arena.data() + replay.deltaOffset, replay.deltaSize)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool ClapHostUndoHistory::canUndo() const {
+    if (position == 0) {
+        return false;
+    }
+    for (const auto& entry : members) {
+        if (entry.second.changing) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool ClapHostUndoHistory::canRedo() const {
+    if (position == steps.size()) {
+        return false;
+    }
+    for (const auto& entry : members) {
+        if (entry.second.changing) {
+            return false;
+        }
+    }
+    return true;
+}
+
+const char* ClapHostUndoHistory::undoName() const {
+    return position > 0 ? steps[position - 1].name.c_str() : nullptr;
+}
+
+const char* ClapHostUndoHistory::redoName() const {
+    return position < steps.size() ? steps[position].name.c_str() : nullptr;
+}
+
+bool ClapHostUndoHistory::undo() {
+    if (!canUndo()) {
+        return false;
+    }
+    const Step& step = steps[position - 1];
+    const clap_plugin* plugin = step.instance->plugin;
+    bool undone = step.isDelta
+        ? members[step.instance].deltaExt->undo(plugin, step.formatVersion, arena.data() + step.deltaOffset, step.deltaSize)
+        : rebuild_before(position - 1);
+    if (undone) {
+        position--;
+        notify_context();
+    }
+    return undone;
+}
+
+bool ClapHostUndoHistory::redo() {
+    if (!canRedo()) {
+        return false;
+    }
+    const Step& step = steps[position];
+    const clap_plugin* plugin = step.instance->plugin;
+    bool redone = step.isDelta
+        ? members[step.instance].deltaExt->redo(plugin, step.formatVersion, arena.data() + step.deltaOffset, step.deltaSize)
+        : snapshots.restore(step.instance, step.after);
+    if (redone) {
+        position++;
+        notify_context();
+    }
+    return redone;
+}
+
+void ClapHostUndoHistory::service() {
+    for (; undoRequests > 0; undoRequests--) {
+        undo();
+    }
+    for (; redoRequests > 0; redoRequests--) {
+        redo();
+    }
+}
+
+void ClapHostUndoHistory::notify_context() {
+    for (const auto& entry : members) {
+        const Member& m = entry.second;
+        if (!m.subscribed) {
+            continue;
+        }
+        const clap_plugin* plugin = entry.first->plugin;
+        m.contextExt->set_can_undo(plugin, canUndo());
+        m.contextExt->set_can_redo(plugin, canRedo());
+        m.contextExt->set_undo_name(plugin, undoName() ? undoName() : "");
+        m.contextExt->set_redo_name(plugin, redoName() ? redoName() : "");
+    }
+}
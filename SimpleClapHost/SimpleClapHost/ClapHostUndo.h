@@ -0,0 +1,113 @@
+#pragma once
+
+#include <cstdint>
+#include <deque>
+#include <map>
+#include <string>
+#include <vector>
+#include <clap/clap.h>
+#include <clap/ext/draft/undo.h>
+#include "ClapHostSnapshots.h"
+
+struct ClapHostInstance;
+
+// Memory the history may hold, deltas and snapshot chunks together
+#define UNDO_HISTORY_BUDGET (64u * 1024 * 1024)
+// Ring arena of the plugins' deltas, part of the budget
+#define UNDO_DELTA_ARENA (16u * 1024 * 1024)
+
+// One undo history shared by the host and its plugins, behind clap_host_undo.
+//
+// Plugins with clap_plugin_undo_delta hand a delta to change_made(); it is copied into a ring
+// arena and undone and redone by the plugin itself. Changes without a usable delta are recorded
+// as a state snapshot taken after the change, in a ClapHostSnapshotStore, so consecutive
+// snapshots of a plugin share every chunk the change did not touch. Undoing such a step loads
+// the instance's previous snapshot and redoes its delta steps since then.
+//
+// The state of an instance before its first change is captured by attach(). When the oldest
+// steps are dropped to stay within the budget, a snapshot step whose earlier state went with them
+// can still be redone but no longer undone; undo stops there.
+//
+// All calls are [main-thread].
+class ClapHostUndoHistory {
+public:
+    explicit ClapHostUndoHistory(uint64_t budget = UNDO_HISTORY_BUDGET, uint32_t deltaArena = UNDO_DELTA_ARENA);
+
+    ClapHostUndoHistory(const ClapHostUndoHistory&) = delete;
+    ClapHostUndoHistory& operator=(const ClapHostUndoHistory&) = delete;
+
+    // Captures the state changes of the instance start from
+    void attach(ClapHostInstance* instance);
+    // Drops the instance and its steps; the steps of other instances stay
+    void detach(ClapHostInstance* instance);
+
+    // clap_host_undo
+    void beginChange(ClapHostInstance* instance);
+    void cancelChange(ClapHostInstance* instance);
+    void changeMade(ClapHostInstance* instance, const char* name, const void* delta, size_t deltaSize, bool deltaCanUndo);
+    void subscribe(ClapHostInstance* instance, bool subscribed);
+
+    // Refused while a long running change is open
+    bool undo();
+    bool redo();
+    bool canUndo() const;
+    bool canRedo() const;
+    const char* undoName() const;
+    const char* redoName() const;
+
+    // Undo and redo asked for by the plugins, run from the main loop with service()
+    void request(bool redoing) { (redoing ? redoRequests : undoRequests)++; }
+    void service();
+
+    size_t stepCount() const { return steps.size(); }
+    uint64_t memoryUsed() const { return deltaBytes + snapshots.storedSize(); }
+
+private:
+    struct Step {
+        ClapHostInstance* instance;
+        std::string name;
+        uint64_t serial;
+        // Delta steps
+        bool isDelta;
+        clap_id formatVersion;
+        uint32_t deltaOffset;
+        uint32_t deltaSize;
+        // Snapshot steps: the state after the change
+        clap_id after;
+    };
+
+    struct Member {
+        const clap_plugin_undo_delta* deltaExt = nullptr;
+        const clap_plugin_undo_context* contextExt = nullptr;
+        clap_id formatVersion = CLAP_INVALID_ID;
+        clap_id origin = CLAP_INVALID_ID;   // the state before the instance's oldest kept step
+        uint64_t originSerial = 0;          // delta steps after it lead to the current state
+        bool changing = false;
+        bool subscribed = false;
+    };
+
+    Member* member(ClapHostInstance* instance);
+    bool store_delta(const void* delta, size_t size, uint32_t* offset);
+    void drop_redo();
+    void drop_oldest();
+    void release_step(const Step& step);
+    void trim();
+    bool rebuild_before(size_t index);
+    void notify_context();
+
+    ClapHostSnapshotStore snapshots;
+    std::map<ClapHostInstance*, Member> members;
+    std::deque<Step> steps;
+    size_t position = 0;                    // steps before it are done, the others can be redone
+    uint64_t nextSerial = 1;
+
+    uint64_t budget;
+    std::vector<uint8_t> arena;             // allocated with the first delta
+    uint32_t arenaSize;
+    uint32_t head = 0;                      // next free byte
+    uint32_t tail = 0;                      // oldest live delta
+    uint64_t deltaBytes = 0;                // live, including the gaps left by wrapping
+
+    uint32_t undoRequests = 0;
+    uint32_t redoRequests = 0;
+};
@@ -2,13 +2,37 @@
 #include <audioclient.h>
 #include <Propsys.h>
 #include <Functiondiscoverykeys_devpkey.h>
+#include <algorithm>
+#include <cstring>
 #include <iostream>
 #include <thread>
 #include <chrono>
 #include <vector>
+#include <atomic>
+#include <string>
+#include <deque>
+#include <mutex>
 #include <clap/clap.h>
 #include <clap/process.h>
 #include "ClapHost.h"
+#include "ClapHostSwap.h"
+#include "ClapHostPool.h"
+#include "ClapHostExtensions.h"
+#include "ClapHostThreadPool.h"
+#include "ClapHostEventLoop.h"
+#include "ClapHostStateFile.h"
+#include "ClapHostSnapshots.h"
+#include "ClapHostPorts.h"
+#include "ClapHostPresets.h"
+#include "ClapHostConverter.h"
+#include "ClapHostCatalog.h"
+#include "ClapHostUndo.h"
+#include "ClapHostTransport.h"
+#include "ClapHostTuning.h"
+#include "ClapHostMidiFile.h"
+#include "ClapHostRender.h"
+#include "ClapHostAutomation.h"
+#include "ClapHostUmp.h"
 
 //#include "SimpleClapHost.hh"
 
@@ -23,15 +47,46 @@ void process_audio_data(DWORD* pCaptureData, DWORD* pRenderData, UINT32 numFrame
 
 #define REFTIME_PER_MILLICEC (10) 
 
+// Default length of the plugin swap crossfade
+#define CROSSFADE_FRAMES 4800
+
+// Longest plugin latency the delay compensation can absorb
+#define MAX_LATENCY_FRAMES 48000
+
+// Memory allowed for warm plugin instances, and the assumed size of one instance
+#define POOL_MEMORY_BUDGET (512u * 1024 * 1024)
+#define POOL_INSTANCE_COST (16u * 1024 * 1024)
+
 extern clap_plugin* plugin;
+extern ClapHostInstance* clapInstance;
+
+static ClapHostSwap clapSwap;
+static ClapHostThreadPool clapThreadPool;
+static ClapHostEventLoop clapEventLoop;
+static ClapHostCatalog clapCatalog;
+static ClapHostUndoHistory clapUndo;
+static ClapHostTransport clapTransport;
+static ClapHostTuning clapTuning;
+static ClapHostMidiPlayer clapMidi;
+static ClapHostAutomation clapAutomation;
+static ClapHostUmpInput clapUmp;
+static uint32_t crossfadeFrames = CROSSFADE_FRAMES;
+static std::atomic<bool> audioRunning{ true };
+static std::atomic<uint32_t> streamSampleRate{ 0 };
+
+// [audio-thread] Host events of the block, merged from the transport, the tunings, the MIDI player,
+// the automation and the UMP input
+static ClapHostInputEvents blockEvents;
+
+// Instance the audio thread is playing, as seen from the main thread
+static ClapHostInstance* activeInstance = nullptr;
+
+// Lines read from the console, consumed by the main thread
+static std::mutex commandMutex;
+static std::deque<std::string> commands;
 
 #pragma comment(lib, "Propsys.lib")
 
-uint32_t event_size_zero(const struct clap_input_events* list) {
-	UNREFERENCED_PARAMETER(list);
-	return 0;
-}
-
 // Show device information
 void PrintDeviceInfo(IMMDevice* pDevice) {
     if (pDevice == nullptr) {
@@ -80,6 +135,8 @@ void HandleAudioStream(IAudioClient* pAudioClientIn,
     input = new ClapHostBuffer();
     output = new ClapHostBuffer();
 
+    mark_clap_audio_thread(true);
+
     pAudioClientIn->Start();
     pAudioClientOut->Start();
 
@@ -88,7 +145,7 @@ void HandleAudioStream(IAudioClient* pAudioClientIn,
         return;
     }
 
-    while (true) {
+    while (audioRunning) {
         pCaptureClient->GetNextPacketSize(&packetLength);
         if (packetLength == 0) {
             // If no data is available, sleep for a while
@@ -140,6 +197,8 @@ void HandleAudioStream(IAudioClient* pAudioClientIn,
         }
     }
 
+    clapSwap.stop();
+
     pAudioClientIn->Stop();
     pAudioClientOut->Stop();
 
@@ -166,7 +225,7 @@ void HandleAudioStreamPlane(IAudioClient* pAudioClientIn, IAudioClient* pAudioCl
         return;
     }
 
-    while (true) {
+    while (audioRunning) {
         pCaptureClient->GetNextPacketSize(&packetLength);
         if (packetLength == 0) {
             // If no data is available, sleep for a while
@@ -326,6 +385,15 @@ HRESULT StartAudioProcessing(UINT Mode) {
     std::wcout << L"Sample Rate: " << pwfx->nSamplesPerSec << std::endl;
     std::wcout << L"Bits Per Sample: " << pwfx->wBitsPerSample << std::endl;
 
+    // The plugin is activated by the main thread once the sample rate is known
+    clapSwap.prepare(1, 2, BUFFER_SIZE / 2, crossfadeFrames, MAX_LATENCY_FRAMES);
+    clapTransport.prepare(pwfx->nSamplesPerSec);
+    clapMidi.prepare(pwfx->nSamplesPerSec);
+    clapAutomation.prepare(pwfx->nSamplesPerSec);
+    clapUmp.prepare(pwfx->nSamplesPerSec);
+    blockEvents.reserve(CLAP_BLOCK_MAX_EVENTS, CLAP_BLOCK_EVENT_BYTES);
+    streamSampleRate = pwfx->nSamplesPerSec;
+
     if (Mode > 0)
         // Mode=1,2,3,...
         HandleAudioStream(pAudioClientIn, pAudioClientOut, pCaptureClient, pRenderClient, pwfx, Mode);
@@ -388,12 +456,28 @@ void process_audio_data(DWORD* pCaptureData, DWORD* pRenderData, UINT32 numFrame
     process_data.audio_inputs_count = 1;
     process_data.audio_outputs_count = 1;
 
-    static clap_input_events_t inEvt ={ nullptr, event_size_zero, nullptr };
-	process_data.in_events = &inEvt;
+    // The transport of the block, with an event wherever it changes inside the block,
+    // the tuning changes, the notes of the MIDI file, the automated parameter values and the
+    // UMP packets due in the block
+    clapTransport.process(numFrames);
+    clapTuning.process(clapTransport.steadyTime(), numFrames);
+    clapMidi.process(clapTransport);
+    clapAutomation.process(clapTransport);
+    clapUmp.process(numFrames);
+    process_data.transport = clapTransport.blockTransport();
+    process_data.steady_time = clapTransport.steadyTime();
+    blockEvents.clear();
+    // At equal times the transport goes first, then the tunings, the notes, the parameter values
+    // and the live input. The sources keep their events until their next process(), so the
+    // block's list refers to them instead of copying them.
+    blockEvents.merge({ clapTransport.events(), clapTuning.events(), clapMidi.events(), clapAutomation.events(0),
+                        clapUmp.events() }, true);
+    process_data.in_events = blockEvents.list();
+    // Each instance pushes into its own list, see ClapHostInstance::outEvents
     process_data.out_events = nullptr;
 
-    // Call process function of plugin of external module
-    plugin->process(plugin, &process_data);
+    // Call process function of plugin of external module, crossfading on a plugin swap
+    clapSwap.process(&process_data);
 
     // Now reordering the render buffer
     index = 0;
@@ -403,17 +487,446 @@ void process_audio_data(DWORD* pCaptureData, DWORD* pRenderData, UINT32 numFrame
 	}
 }
 
+// Activate an instance and hand it to the audio thread, then tear down the one it replaces
+bool SwapPlugin(ClapHostInstance* next, bool replacing) {
+    if (!activate_clap_instance(next, streamSampleRate, 1, BUFFER_SIZE / 2)) {
+        destroy_clap_instance(next);
+        return false;
+    }
+
+    while (!clapSwap.stage(next)) {
+        if (!audioRunning) {
+            destroy_clap_instance(next);
+            return false;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(REFTIME_PER_MILLICEC));
+    }
+
+    ClapHostInstance* old = nullptr;
+    while (replacing && audioRunning && !(old = clapSwap.collect())) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(REFTIME_PER_MILLICEC));
+    }
+    destroy_clap_instance(old);
+    if (old == next) {
+        std::cerr << "Failed to start processing of the new plugin." << std::endl;
+        return false;
+    }
+    activeInstance = next;
+    clapUndo.attach(next);
+    // The new instance has not seen the tunings in use
+    clapTuning.reassign();
+    clapMidi.setDialects(next->preferredDialect, next->noteDialects);
+    clapUmp.setDialects(next->preferredDialect, next->noteDialects);
+    return true;
+}
+
+// Deactivate and activate the playing instance again, e.g. after its latency changed
+void RestartPlugin(ClapHostInstance* instance) {
+    clapSwap.suspend();
+    while (audioRunning && clapSwap.suspended() != instance) {
+        destroy_clap_instance(clapSwap.collect());
+        std::this_thread::sleep_for(std::chrono::milliseconds(REFTIME_PER_MILLICEC));
+    }
+    if (!audioRunning) {
+        clapSwap.resume(false);
+        return;
+    }
+
+    bool restarted = restart_clap_instance(instance);
+    clapSwap.resume(restarted);
+    if (restarted) {
+        std::cout << "Plugin restarted, latency: " << instance->latency << " samples" << std::endl;
+    }
+}
+
+// Serve what the plugin asked for through clap_host
+void ServicePlugin() {
+    ClapHostInstance* old = clapSwap.collect();
+    if (old == activeInstance) {
+        activeInstance = nullptr;
+    }
+    destroy_clap_instance(old);
+
+    if (!activeInstance) {
+        return;
+    }
+    if (activeInstance->restartRequested) {
+        RestartPlugin(activeInstance);
+    }
+    if (activeInstance && activeInstance->callbackRequested.exchange(false)) {
+        activeInstance->plugin->on_main_thread(activeInstance->plugin);
+    }
+    if (activeInstance) {
+        service_clap_outputs(activeInstance);
+        for (clap_id paramId : activeInstance->clearedAutomation) {
+            clapAutomation.removeLane(0, paramId);
+        }
+        activeInstance->clearedAutomation.clear();
+    }
+    clapUndo.service();
+    clapTransport.service();
+    clapTuning.service(activeInstance);
+    clapMidi.service(*clapTransport.tempoMap());
+    clapAutomation.service(*clapTransport.tempoMap());
+    if (activeInstance) {
+        schedule_clap_instance(activeInstance, clapThreadPool.workerCount());
+    }
+}
+
+// The console is read on its own thread so the main thread keeps serving the plugin
+void ReadCommands() {
+    std::string line;
+    while (std::getline(std::cin, line)) {
+        {
+            std::lock_guard<std::mutex> lock(commandMutex);
+            commands.push_back(line);
+        }
+        clapEventLoop.wakeUp();
+    }
+    {
+        std::lock_guard<std::mutex> lock(commandMutex);
+        commands.push_back("quit");
+    }
+    clapEventLoop.wakeUp();
+}
+
+bool NextCommand(std::string& line) {
+    std::lock_guard<std::mutex> lock(commandMutex);
+    if (commands.empty()) {
+        return false;
+    }
+    line = commands.front();
+    commands.pop_front();
+    return true;
+}
+
+void ServiceTimer(void* context, clap_id timerId) {
+    UNREFERENCED_PARAMETER(context);
+    UNREFERENCED_PARAMETER(timerId);
+    ServicePlugin();
+}
+
+// Main thread commands while the audio thread is running.
+// The thread sleeps in the event loop, woken by plugin timers and fds, console input
+// and the service timer that also notices the audio thread stopping.
+void RunControlLoop() {
+    ClapHostPool pool(streamSampleRate, 1, BUFFER_SIZE / 2, POOL_MEMORY_BUDGET);
+    ClapHostSnapshotStore snapshots;
+    std::string line;
+    clap_id serviceTimer = CLAP_INVALID_ID;
+
+    clapEventLoop.addTimer(REFTIME_PER_MILLICEC, ServiceTimer, nullptr, &serviceTimer);
+    std::thread(ReadCommands).detach();
+
+    while (audioRunning) {
+        if (!NextCommand(line)) {
+            clapEventLoop.run(-1);
+            continue;
+        }
+
+        if (line == "quit") {
+            break;
+        }
+        else if (line.compare(0, 5, "warm ") == 0) {
+            size_t pos = line.find(' ', 5);
+            if (pos == std::string::npos) {
+                std::cout << "warm <count> <plugin path>" << std::endl;
+                continue;
+            }
+            uint32_t count = (uint32_t)atoi(line.substr(5, pos - 5).c_str());
+            // Warming a plugin again changes the count of its slot
+            std::string path = line.substr(pos + 1);
+            int slot = pool.find(path.c_str());
+            if (slot < 0) {
+                pool.add(path.c_str(), count, POOL_INSTANCE_COST);
+            }
+            else {
+                pool.resize(slot, count);
+            }
+            pool.refill();
+            std::cout << "Pool memory: " << pool.memoryUsed() << " / " << pool.memoryBudget() << std::endl;
+        }
+        else if (line.compare(0, 5, "swap ") == 0) {
+            // Take a warm instance if there is one, otherwise create it now
+            std::string path = line.substr(5);
+            ClapHostInstance* next = pool.acquire(pool.find(path.c_str()));
+            if (!next) {
+                next = create_clap_instance(path.c_str());
+            }
+            if (next && SwapPlugin(next, true)) {
+                std::cout << "Swapped to " << path << ", latency: " << clapSwap.latency() << " samples" << std::endl;
+            }
+            pool.refill();
+        }
+        else if (line.compare(0, 6, "param ") == 0) {
+            // Sent with the next block, or flushed without waking the plugin if it sleeps
+            size_t pos = line.find(' ', 6);
+            if (pos == std::string::npos || !activeInstance) {
+                std::cout << "param <id> <value>" << std::endl;
+                continue;
+            }
+            clap_id paramId = (clap_id)strtoul(line.substr(6, pos - 6).c_str(), nullptr, 10);
+            if (!set_clap_param(activeInstance, paramId, atof(line.substr(pos + 1).c_str()))) {
+                std::cerr << "Too many pending parameter changes." << std::endl;
+            }
+        }
+        else if (line.compare(0, 5, "save ") == 0 || line.compare(0, 5, "load ") == 0) {
+            if (!activeInstance) {
+                std::cout << "No plugin is playing." << std::endl;
+            }
+            else if (line[0] == 's' && save_clap_state(activeInstance, line.substr(5).c_str())) {
+                std::cout << "State saved to " << line.substr(5) << std::endl;
+            }
+            else if (line[0] == 'l' && load_clap_state(activeInstance, line.substr(5).c_str())) {
+                std::cout << "State loaded from " << line.substr(5) << std::endl;
+            }
+        }
+        else if (line == "snap" || line.compare(0, 5, "snap ") == 0) {
+            std::string context = line.size() > 5 ? line.substr(5) : "";
+            uint32_t contextType = context == "preset" ? CLAP_STATE_CONTEXT_FOR_PRESET
+                : context == "duplicate" ? CLAP_STATE_CONTEXT_FOR_DUPLICATE
+                : context == "project" ? CLAP_STATE_CONTEXT_FOR_PROJECT : 0;
+            clap_id snapshot = activeInstance ? snapshots.capture(activeInstance, contextType) : CLAP_INVALID_ID;
+            if (snapshot != CLAP_INVALID_ID) {
+                std::cout << "Snapshot " << snapshot << ", stored " << snapshots.storedSize() << " of "
+                          << snapshots.logicalSize() << " bytes" << std::endl;
+            }
+        }
+        else if (line.compare(0, 9, "snapsave ") == 0) {
+            if (snapshots.write(line.substr(9).c_str())) {
+                std::cout << snapshots.snapshotCount() << " snapshots saved to " << line.substr(9) << std::endl;
+            }
+        }
+        else if (line.compare(0, 9, "snapload ") == 0) {
+            // Replaces every snapshot taken so far, their ids are the ones of the file
+            if (snapshots.read(line.substr(9).c_str())) {
+                std::cout << snapshots.snapshotCount() << " snapshots loaded from " << line.substr(9) << std::endl;
+            }
+        }
+        else if (line.compare(0, 8, "restore ") == 0) {
+            clap_id snapshot = (clap_id)strtoul(line.substr(8).c_str(), nullptr, 10);
+            if (activeInstance && snapshots.restore(activeInstance, snapshot)) {
+                std::cout << "Snapshot " << snapshot << " restored" << std::endl;
+            }
+        }
+        else if (line == "stats") {
+            if (activeInstance) {
+                std::cout << "Voices: " << activeInstance->voiceCount << " / " << activeInstance->voiceCapacity
+                          << ", block cost: " << activeInstance->blockCost / 1000 << " us"
+                          << ", predicted: " << activeInstance->predictedCost / 1000 << " us"
+                          << ", workers: " << std::min(activeInstance->poolWorkers.load(), clapThreadPool.workerCount())
+                          << " / " << clapThreadPool.workerCount() << std::endl;
+                std::cout << "Reported parameters: " << activeInstance->reportedParams.size()
+                          << ", in gesture: " << activeInstance->paramGestures.size()
+                          << ", notes ended: " << activeInstance->notesEnded << std::endl;
+                if (clapUmp.isOpen()) {
+                    std::cout << "UMP packets received: " << clapUmp.received() << std::endl;
+                }
+            }
+        }
+        else if (line.compare(0, 6, "index ") == 0) {
+            // Only the files changed since the last index are read again
+            ClapHostPresetIndexer indexer;
+            indexer.read(PRESET_INDEX_PATH);
+            if (indexer.addPlugin(line.substr(6).c_str())) {
+                uint32_t filesRead = indexer.crawl(std::max(1u, std::thread::hardware_concurrency()));
+                if (indexer.write(PRESET_INDEX_PATH)) {
+                    std::cout << "Indexed " << indexer.presetCount() << " presets, " << filesRead << " files read" << std::endl;
+                }
+            }
+        }
+        else if (line.compare(0, 5, "find ") == 0 || line.compare(0, 4, "tag ") == 0) {
+            ClapHostPresetIndex index;
+            if (!index.open(PRESET_INDEX_PATH)) {
+                std::cout << "No preset index, use index <plugin path>" << std::endl;
+                continue;
+            }
+            std::vector<uint32_t> presets = line[0] == 'f' ? index.findPrefix(line.substr(5).c_str(), 50)
+                                                            : index.findTag(line.substr(4).c_str());
+            for (uint32_t preset : presets) {
+                std::cout << "  " << index.name(preset) << "  " << index.location(preset) << std::endl;
+            }
+            std::cout << presets.size() << " of " << index.size() << " presets" << std::endl;
+        }
+        else if (line == "plugins" || line.compare(0, 8, "plugins ") == 0) {
+            // Lists the catalog as it is now, the scanner may publish a newer one meanwhile
+            std::string filter = line.size() > 8 ? line.substr(8) : "";
+            auto catalog = clapCatalog.snapshot();
+            for (const auto& bundle : catalog->bundles) {
+                for (const ClapHostCatalogPlugin& plugin : bundle.second->plugins) {
+                    if (plugin.id.find(filter) != std::string::npos || plugin.name.find(filter) != std::string::npos) {
+                        std::cout << "  " << plugin.id << "  " << plugin.name << "  " << bundle.first
+                                  << (bundle.second->needsReload ? "  (restart to reload)" : "") << std::endl;
+                    }
+                }
+            }
+            std::cout << catalog->pluginCount() << " plugins in " << catalog->bundles.size() << " bundles" << std::endl;
+        }
+        else if (line == "rescan") {
+            clapCatalog.invalidate();
+        }
+        else if (line == "undo" || line == "redo") {
+            const char* name = line == "undo" ? clapUndo.undoName() : clapUndo.redoName();
+            std::string step = name ? name : "";
+            if (line == "undo" ? clapUndo.undo() : clapUndo.redo()) {
+                std::cout << (line == "undo" ? "Undone: " : "Redone: ") << step << std::endl;
+            }
+            else {
+                std::cout << "Nothing to " << line << std::endl;
+            }
+        }
+        else if (line == "play" || line == "stop") {
+            clapTransport.requestPlay(line == "play");
+        }
+        else if (line.compare(0, 5, "jump ") == 0) {
+            clapTransport.requestJump(atof(line.substr(5).c_str()));
+        }
+        else if (line.compare(0, 6, "tempo ") == 0) {
+            // tempo <bpm> [beat]
+            char* end = nullptr;
+            double bpm = strtod(line.c_str() + 6, &end);
+            clapTransport.setTempo(strtod(end, nullptr), bpm);
+        }
+        else if (line.compare(0, 6, "meter ") == 0) {
+            // meter <num> <denom> [bar]
+            char* end = nullptr;
+            uint16_t num = (uint16_t)strtoul(line.c_str() + 6, &end, 10);
+            uint16_t denom = (uint16_t)strtoul(end, &end, 10);
+            clapTransport.setMeter((int32_t)strtol(end, nullptr, 10), num, denom);
+        }
+        else if (line == "loop off") {
+            clapTransport.requestLoopEnabled(false);
+        }
+        else if (line.compare(0, 5, "loop ") == 0) {
+            char* end = nullptr;
+            double start = strtod(line.c_str() + 5, &end);
+            clapTransport.requestLoop(start, strtod(end, nullptr));
+            clapTransport.requestLoopEnabled(true);
+        }
+        else if (line.compare(0, 6, "scale ") == 0) {
+            // Loaded and applied to every port and channel
+            clap_id tuningId = clapTuning.load(line.substr(6).c_str());
+            if (tuningId != CLAP_INVALID_ID && clapTuning.assign(-1, -1, tuningId)) {
+                std::cout << "Tuning " << tuningId << " in use, " << clapTuning.count() << " tunings" << std::endl;
+            }
+        }
+        else if (line.compare(0, 7, "tuning ") == 0) {
+            // tuning <id> [channel], CLAP_INVALID_ID goes back to 12-TET
+            char* end = nullptr;
+            clap_id tuningId = (clap_id)strtoul(line.c_str() + 7, &end, 10);
+            int16_t channel = *end ? (int16_t)strtol(end, nullptr, 10) : -1;
+            clapTuning.assign(-1, channel, tuningId);
+        }
+        else if (line == "midi off") {
+            clapMidi.load(nullptr, *clapTransport.tempoMap());
+        }
+        else if (line.compare(0, 5, "midi ") == 0) {
+            // The file brings its tempo and meters, and plays along the transport from its start
+            auto file = std::make_shared<ClapHostMidiFile>();
+            if (file->read(line.substr(5).c_str())) {
+                clapTransport.setTempoChanges(file->tempoChanges());
+                clapTransport.setMeterChanges(file->meterChanges());
+                clapMidi.load(file, *clapTransport.tempoMap());
+                std::cout << "MIDI file: " << file->events().size() << " events, " << file->length() << " beats" << std::endl;
+            }
+        }
+        else if (line.compare(0, 9, "automate ") == 0) {
+            // automate <param id> <beat> <value> [<beat> <value>]... | off
+            char* end = nullptr;
+            clap_id paramId = (clap_id)strtoul(line.c_str() + 9, &end, 10);
+            if (strcmp(end, " off") == 0) {
+                clapAutomation.removeLane(0, paramId);
+                continue;
+            }
+            std::vector<ClapHostAutomationPoint> points;
+            for (char* at = end;; at = end) {
+                double beat = strtod(at, &end);
+                if (end == at) {
+                    break;
+                }
+                at = end;
+                double value = strtod(at, &end);
+                if (end == at) {
+                    break;
+                }
+                points.push_back({ beat, value, false });
+            }
+            if (points.empty()) {
+                std::cout << "automate <param id> <beat> <value> [<beat> <value>]...|off" << std::endl;
+                continue;
+            }
+            // The tolerance follows the parameter's range
+            double range = 1;
+            if (activeInstance && activeInstance->paramsExt) {
+                uint32_t count = activeInstance->paramsExt->count(activeInstance->plugin);
+                for (uint32_t i = 0; i < count; i++) {
+                    clap_param_info info = {};
+                    if (activeInstance->paramsExt->get_info(activeInstance->plugin, i, &info) && info.id == paramId) {
+                        range = info.max_value - info.min_value;
+                        break;
+                    }
+                }
+            }
+            if (clapAutomation.setLane(0, paramId, points, AUTOMATION_TOLERANCE * range)) {
+                std::cout << "Automation: " << clapAutomation.laneCount() << " lanes" << std::endl;
+            }
+        }
+        else if (line == "ump off") {
+            clapUmp.close();
+        }
+        else if (line.compare(0, 4, "ump ") == 0) {
+            // A UMP file or pipe, played as it arrives
+            if (clapUmp.open(line.substr(4).c_str())) {
+                std::cout << "Receiving UMP from " << line.substr(4) << std::endl;
+            }
+        }
+        else if (line == "transport") {
+            std::cout << (clapTransport.playing() ? "Playing" : "Stopped") << " at beat " << clapTransport.position()
+                      << ", " << clapTransport.tempoMap()->tempos().size() << " tempos, "
+                      << clapTransport.tempoMap()->meters().size() << " meters"
+                      << (clapTransport.looping() ? ", looping" : "") << std::endl;
+        }
+        else if (line == "history") {
+            std::cout << "Undo steps: " << clapUndo.stepCount() << ", memory: " << clapUndo.memoryUsed() << " bytes" << std::endl;
+        }
+        else {
+            std::cout << "Commands: warm <count> <plugin path>, swap <plugin path>, param <id> <value>, "
+                         "save <state path>, load <state path>, snap [preset|duplicate|project], "
+                         "snapsave <path>, snapload <path>, restore <snapshot>, stats, index <plugin path>, find <name prefix>, tag <feature>, "
+                         "plugins [filter], rescan, undo, redo, history, play, stop, jump <beat>, "
+                         "tempo <bpm> [beat], meter <num> <denom> [bar], loop <start> <end>|off, transport, "
+                         "scale <scl path>, tuning <id> [channel], midi <file>|off, "
+                         "automate <param id> <beat> <value>...|off, ump <file or pipe>|off, quit" << std::endl;
+        }
+    }
+
+    clapEventLoop.removeTimer(serviceTimer, nullptr);
+}
+
 // Entry point
 int main(int ac, char **av) {
     UINT mode = 0;
 
     if (ac <= 1) {
     }
+    else if (strcmp(av[1], "convert") == 0) {
+        // Batch state migration, without the audio device
+        return run_state_conversion(ac - 2, av + 2);
+    }
+    else if (strcmp(av[1], "render") == 0) {
+        // Offline rendering of a MIDI file, without the audio device
+        return run_offline_render(ac - 2, av + 2);
+    }
     else if (isdigit(av[1][0])) {
         mode = av[1][0] - '0';
+        if (ac > 2 && isdigit(av[2][0])) {
+            crossfadeFrames = (uint32_t)atoi(av[2]);
+        }
     }
     else {
-        std::cout << "Usage : " << av[0] << ": [Filter Mode (0..3)]" << std::endl;
+        std::cout << "Usage : " << av[0] << ": [Filter Mode (0..3)] [Crossfade Frames]" << std::endl;
+        std::cout << "        " << av[0] << ": convert <source dir> <destination dir> <converter module>..." << std::endl;
+        std::cout << "        " << av[0] << ": render <plugin path> <MIDI file> <WAV file> [sample rate] [block frames]" << std::endl;
         return 1;
     }
 
@@ -421,6 +934,17 @@ int main(int ac, char **av) {
 
     std::cout << "Sound Play! Filter=" << mode << std::endl;
 
+    // Plugins may register timers from init()
+    use_clap_event_loop(&clapEventLoop);
+    // The device is opened as stereo in and out
+    use_clap_port_layout(2, 2);
+    use_clap_undo_history(&clapUndo);
+    use_clap_transport(&clapTransport);
+    use_clap_tuning(&clapTuning);
+    // Installed plugins are scanned in the background, then kept current
+    clapCatalog.addDefaultDirectories();
+    clapCatalog.start();
+
 	if (!load_clap_plugin(PLUGIN_PATH)) {
 		std::cerr << "Failed to load CLAP plugin." << std::endl;
 		return -1;
@@ -428,7 +952,46 @@ int main(int ac, char **av) {
 
     std::wcout << L"Starting audio processing..." << std::endl;
 
-    StartAudioProcessing(mode);
+    // One worker per core besides the audio thread, which takes tasks as well
+    unsigned cores = std::thread::hardware_concurrency();
+    clapThreadPool.start(cores > 1 ? cores - 1 : 0);
+    use_clap_thread_pool(&clapThreadPool);
+
+    std::thread audioThread([mode]() {
+        StartAudioProcessing(mode);
+        audioRunning = false;
+    });
+
+    // Mode=0 plays without the plugin
+    if (mode > 0) {
+        while (audioRunning && streamSampleRate == 0) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(REFTIME_PER_MILLICEC));
+        }
+        if (audioRunning && SwapPlugin(clapInstance, false)) {
+            std::cout << "Plugin latency: " << clapInstance->latency << " samples" << std::endl;
+            std::cout << "Plugin ports: " << clapInstance->inputChannels << " in, "
+                      << clapInstance->outputChannels << " out" << std::endl;
+            RunControlLoop();
+        }
+        audioRunning = false;
+    }
+    audioThread.join();
+
+    use_clap_thread_pool(nullptr);
+    clapThreadPool.stop();
+
+    if (mode == 0) {
+        destroy_clap_instance(clapInstance);
+    }
+    while (ClapHostInstance* instance = clapSwap.detach()) {
+        destroy_clap_instance(instance);
+    }
+    use_clap_event_loop(nullptr);
+    use_clap_undo_history(nullptr);
+    use_clap_transport(nullptr);
+    use_clap_tuning(nullptr);
+    clapCatalog.stop();
+    clapUmp.close();
 
     std::wcout << L"Audio processing end." << std::endl;
 
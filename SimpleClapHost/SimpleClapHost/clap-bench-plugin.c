@@ -0,0 +1,1374 @@
+// Synthetic plugins for clap-bench, each exercising one of the host's services with a known cost.
+//
+//   bench.effect  stereo echo with a lowpass in the feedback; reports its decay through
+//                 clap_plugin_tail and returns CLAP_PROCESS_TAIL
+//   bench.params  stereo gain with one parameter, taken in process() and in flush();
+//                 returns CLAP_PROCESS_CONTINUE_IF_NOT_QUIET
+//   bench.state   BENCH_STATE_PARAMS parameters and a table of BENCH_STATE_TABLE bytes, the same
+//                 in every instance, saved and loaded through clap_plugin_state
+//   bench.layout  a filter per channel, in a 5.1, stereo or mono layout chosen through
+//                 clap_plugin_audio_ports_config; starts in 5.1
+//   bench.multiout  instrument droning a filtered saw on each of BENCH_MULTIOUT_PORTS stereo
+//                 outputs; skips the outputs turned off through clap_plugin_audio_ports_activation
+//   bench.poly    instrument holding a number of additive voices set by a parameter, rendered
+//                 through clap_host_thread_pool when the host lets it; reports them through
+//                 clap_plugin_voice_info
+//   bench.undo    bench.state which also undoes and redoes its parameter changes through
+//                 clap_plugin_undo_delta; a delta is a bench_undo_delta
+//   bench.spew    stereo pass-through reporting, every block, a value for each of
+//                 BENCH_SPEW_PARAMS parameters twice, the block number both times, a gesture
+//                 of parameter 0 beginning or ending, and BENCH_SPEW_NOTES ended notes
+//   bench.catalog/<file name>  bench.params under an id of its own in every copy of the module,
+//                 for the catalog benchmark
+//
+// The module also has a preset provider, bench.presets, for bench.poly. Its presets are the
+// .benchpreset files under the directory named by the CLAP_BENCH_PRESETS environment variable,
+// each holding a name, a creator and a line of features.
+//
+// Build it as a module of its own:
+//   cc -shared -fPIC -O2 -I.. clap-bench-plugin.c -o clap-bench-plugin.clap -lm
+
+#include <string.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <math.h>
+
+#include <clap/clap.h>
+#include <clap/ext/draft/undo.h>
+
+#define BENCH_ECHO_SECONDS 0.1
+#define BENCH_ECHO_FEEDBACK 0.5f
+#define BENCH_ECHO_REPEATS 10 // about -60 dB with BENCH_ECHO_FEEDBACK
+#define BENCH_STATE_PARAMS 16
+#define BENCH_STATE_TABLE (1024 * 1024)
+#define BENCH_STATE_WRITE (64 * 1024)
+#define BENCH_LAYOUT_CHANNELS 6
+#define BENCH_MULTIOUT_PORTS 16
+#define BENCH_POLY_VOICES 64
+#define BENCH_POLY_PARTIALS 256
+#define BENCH_SPEW_PARAMS 256
+#define BENCH_SPEW_NOTES 16
+
+static const clap_plugin_descriptor_t s_bench_effect_desc = {
+   .clap_version = CLAP_VERSION_INIT,
+   .id = "bench.effect",
+   .name = "clap-bench effect",
+   .vendor = "clap-bench",
+   .version = "0.0.1",
+   .description = "Echo with a tail, for the idle benchmark",
+   .features = (const char *[]){
+      CLAP_PLUGIN_FEATURE_AUDIO_EFFECT,
+      CLAP_PLUGIN_FEATURE_DELAY,
+      CLAP_PLUGIN_FEATURE_STEREO,
+      NULL
+   },
+};
+
+static const clap_plugin_descriptor_t s_bench_params_desc = {
+   .clap_version = CLAP_VERSION_INIT,
+   .id = "bench.params",
+   .name = "clap-bench params",
+   .vendor = "clap-bench",
+   .version = "0.0.1",
+   .description = "Gain with a parameter, for the flush benchmark",
+   .features = (const char *[]){
+      CLAP_PLUGIN_FEATURE_AUDIO_EFFECT,
+      CLAP_PLUGIN_FEATURE_UTILITY,
+      CLAP_PLUGIN_FEATURE_STEREO,
+      NULL
+   },
+};
+
+static const clap_plugin_descriptor_t s_bench_state_desc = {
+   .clap_version = CLAP_VERSION_INIT,
+   .id = "bench.state",
+   .name = "clap-bench state",
+   .vendor = "clap-bench",
+   .version = "0.0.1",
+   .description = "Parameters and a shared table in its state, for the snapshot benchmark",
+   .features = (const char *[]){
+      CLAP_PLUGIN_FEATURE_AUDIO_EFFECT,
+      CLAP_PLUGIN_FEATURE_UTILITY,
+      NULL
+   },
+};
+
+static const clap_plugin_descriptor_t s_bench_undo_desc = {
+   .clap_version = CLAP_VERSION_INIT,
+   .id = "bench.undo",
+   .name = "clap-bench undo",
+   .vendor = "clap-bench",
+   .version = "0.0.1",
+   .description = "bench.state with undo deltas, for the undo benchmark",
+   .features = (const char *[]){
+      CLAP_PLUGIN_FEATURE_AUDIO_EFFECT,
+      CLAP_PLUGIN_FEATURE_UTILITY,
+      NULL
+   },
+};
+
+static const clap_plugin_descriptor_t s_bench_spew_desc = {
+   .clap_version = CLAP_VERSION_INIT,
+   .id = "bench.spew",
+   .name = "clap-bench spew",
+   .vendor = "clap-bench",
+   .version = "0.0.1",
+   .description = "Parameter changes, gestures and ended notes every block, for the output events benchmark",
+   .features = (const char *[]){
+      CLAP_PLUGIN_FEATURE_AUDIO_EFFECT,
+      CLAP_PLUGIN_FEATURE_UTILITY,
+      NULL
+   },
+};
+
+static const clap_plugin_descriptor_t s_bench_layout_desc = {
+   .clap_version = CLAP_VERSION_INIT,
+   .id = "bench.layout",
+   .name = "clap-bench layout",
+   .vendor = "clap-bench",
+   .version = "0.0.1",
+   .description = "Filter with a layout per channel count, for the port layout benchmark",
+   .features = (const char *[]){
+      CLAP_PLUGIN_FEATURE_AUDIO_EFFECT,
+      CLAP_PLUGIN_FEATURE_FILTER,
+      CLAP_PLUGIN_FEATURE_SURROUND,
+      NULL
+   },
+};
+
+static const clap_plugin_descriptor_t s_bench_multiout_desc = {
+   .clap_version = CLAP_VERSION_INIT,
+   .id = "bench.multiout",
+   .name = "clap-bench multiout",
+   .vendor = "clap-bench",
+   .version = "0.0.1",
+   .description = "Instrument with many outputs, for the port activation benchmark",
+   .features = (const char *[]){
+      CLAP_PLUGIN_FEATURE_INSTRUMENT,
+      CLAP_PLUGIN_FEATURE_SYNTHESIZER,
+      CLAP_PLUGIN_FEATURE_STEREO,
+      NULL
+   },
+};
+
+static const clap_plugin_descriptor_t s_bench_poly_desc = {
+   .clap_version = CLAP_VERSION_INIT,
+   .id = "bench.poly",
+   .name = "clap-bench poly",
+   .vendor = "clap-bench",
+   .version = "0.0.1",
+   .description = "Polyphonic instrument with a thread pool, for the scheduling benchmark",
+   .features = (const char *[]){
+      CLAP_PLUGIN_FEATURE_INSTRUMENT,
+      CLAP_PLUGIN_FEATURE_SYNTHESIZER,
+      CLAP_PLUGIN_FEATURE_MONO,
+      NULL
+   },
+};
+
+// Set from the module's file name in entry_init()
+static char s_bench_catalog_id[256] = "bench.catalog";
+
+static const clap_plugin_descriptor_t s_bench_catalog_desc = {
+   .clap_version = CLAP_VERSION_INIT,
+   .id = s_bench_catalog_id,
+   .name = "clap-bench catalog",
+   .vendor = "clap-bench",
+   .version = "0.0.1",
+   .description = "Gain named after its module file, for the catalog benchmark",
+   .features = (const char *[]){
+      CLAP_PLUGIN_FEATURE_AUDIO_EFFECT,
+      CLAP_PLUGIN_FEATURE_UTILITY,
+      CLAP_PLUGIN_FEATURE_STEREO,
+      NULL
+   },
+};
+
+// The table stands for the samples or wavetables a preset carries, identical across instances
+static unsigned char s_bench_table[BENCH_STATE_TABLE];
+
+typedef struct {
+   clap_plugin_t      plugin;
+   const clap_host_t *host;
+
+   // bench.effect
+   float   *echo;        // 2 channels of echo_frames
+   uint32_t echo_frames;
+   uint32_t echo_pos;
+   float    lowpass[2];
+
+   // bench.params
+   double gain;
+
+   // bench.state
+   double values[BENCH_STATE_PARAMS];
+
+   // bench.layout
+   uint32_t channels;
+   float    biquad[BENCH_LAYOUT_CHANNELS][4]; // x1, x2, y1, y2
+
+   // bench.multiout
+   uint32_t active_outputs; // a bit per output port
+   float    phase[BENCH_MULTIOUT_PORTS];
+   float    voice[BENCH_MULTIOUT_PORTS];
+
+   // bench.poly
+   const clap_host_thread_pool_t *host_pool;
+   const clap_host_voice_info_t  *host_voice_info;
+   uint32_t voices;
+   uint32_t partials;
+   bool     voices_changed; // [audio-thread] reported from on_main_thread()
+   uint32_t frames;         // of the block the pool's tasks render
+   float   *voice_out;      // BENCH_POLY_VOICES blocks of max_frames_count
+   uint32_t max_frames;
+   float    voice_phase[BENCH_POLY_VOICES];
+
+   // bench.spew
+   uint64_t spew_blocks;
+   int32_t  spew_notes;
+} bench_plug_t;
+
+/////////////////////////////
+// clap_plugin_audio_ports //
+/////////////////////////////
+
+static uint32_t bench_audio_ports_count(const clap_plugin_t *plugin, bool is_input) { return 1; }
+
+static bool bench_audio_ports_get(const clap_plugin_t    *plugin,
+                                  uint32_t                index,
+                                  bool                    is_input,
+                                  clap_audio_port_info_t *info) {
+   if (index > 0)
+      return false;
+   info->id = 0;
+   snprintf(info->name, sizeof(info->name), "%s", is_input ? "In" : "Out");
+   info->channel_count = 2;
+   info->flags = CLAP_AUDIO_PORT_IS_MAIN;
+   info->port_type = CLAP_PORT_STEREO;
+   info->in_place_pair = CLAP_INVALID_ID;
+   return true;
+}
+
+static const clap_plugin_audio_ports_t s_bench_audio_ports = {
+   .count = bench_audio_ports_count,
+   .get = bench_audio_ports_get,
+};
+
+// The layouts of bench.layout, the default first
+static const struct {
+   uint32_t    channels;
+   const char *name;
+   const char *port_type;
+} s_bench_layouts[] = {
+   { BENCH_LAYOUT_CHANNELS, "5.1", CLAP_PORT_SURROUND },
+   { 2, "Stereo", CLAP_PORT_STEREO },
+   { 1, "Mono", CLAP_PORT_MONO },
+};
+
+static bool bench_layout_ports_get(const clap_plugin_t    *plugin,
+                                   uint32_t                index,
+                                   bool                    is_input,
+                                   clap_audio_port_info_t *info) {
+   bench_plug_t *plug = plugin->plugin_data;
+   if (!bench_audio_ports_get(plugin, index, is_input, info))
+      return false;
+   info->channel_count = plug->channels;
+   for (uint32_t i = 0; i < sizeof(s_bench_layouts) / sizeof(s_bench_layouts[0]); ++i)
+      if (s_bench_layouts[i].channels == plug->channels)
+         info->port_type = s_bench_layouts[i].port_type;
+   return true;
+}
+
+static const clap_plugin_audio_ports_t s_bench_layout_ports = {
+   .count = bench_audio_ports_count,
+   .get = bench_layout_ports_get,
+};
+
+static uint32_t bench_multiout_ports_count(const clap_plugin_t *plugin, bool is_input) {
+   return is_input ? 0 : BENCH_MULTIOUT_PORTS;
+}
+
+static bool bench_multiout_ports_get(const clap_plugin_t    *plugin,
+                                     uint32_t                index,
+                                     bool                    is_input,
+                                     clap_audio_port_info_t *info) {
+   if (is_input || index >= BENCH_MULTIOUT_PORTS)
+      return false;
+   info->id = index;
+   snprintf(info->name, sizeof(info->name), "Out %u", index + 1);
+   info->channel_count = 2;
+   info->flags = index == 0 ? CLAP_AUDIO_PORT_IS_MAIN : 0;
+   info->port_type = CLAP_PORT_STEREO;
+   info->in_place_pair = CLAP_INVALID_ID;
+   return true;
+}
+
+static const clap_plugin_audio_ports_t s_bench_multiout_ports = {
+   .count = bench_multiout_ports_count,
+   .get = bench_multiout_ports_get,
+};
+
+// bench.poly: the first output alone
+static uint32_t bench_poly_ports_count(const clap_plugin_t *plugin, bool is_input) {
+   return is_input ? 0 : 1;
+}
+
+static const clap_plugin_audio_ports_t s_bench_poly_ports = {
+   .count = bench_poly_ports_count,
+   .get = bench_multiout_ports_get,
+};
+
+/////////////////////////////////
+// clap_audio_ports_activation //
+/////////////////////////////////
+
+static bool bench_ports_activation_can_activate_while_processing(const clap_plugin_t *plugin) {
+   return false;
+}
+
+static bool bench_ports_activation_set_active(const clap_plugin_t *plugin,
+                                              bool                 is_input,
+                                              uint32_t             port_index,
+                                              bool                 is_active,
+                                              uint32_t             sample_size) {
+   bench_plug_t *plug = plugin->plugin_data;
+   if (is_input || port_index >= BENCH_MULTIOUT_PORTS)
+      return false;
+   if (is_active)
+      plug->active_outputs |= 1u << port_index;
+   else
+      plug->active_outputs &= ~(1u << port_index);
+   return true;
+}
+
+static const clap_plugin_audio_ports_activation_t s_bench_ports_activation = {
+   .can_activate_while_processing = bench_ports_activation_can_activate_while_processing,
+   .set_active = bench_ports_activation_set_active,
+};
+
+/////////////////////////////
+// clap_audio_ports_config //
+/////////////////////////////
+
+static uint32_t bench_ports_config_count(const clap_plugin_t *plugin) {
+   return sizeof(s_bench_layouts) / sizeof(s_bench_layouts[0]);
+}
+
+static bool bench_ports_config_get(const clap_plugin_t       *plugin,
+                                   uint32_t                   index,
+                                   clap_audio_ports_config_t *config) {
+   if (index >= bench_ports_config_count(plugin))
+      return false;
+   memset(config, 0, sizeof(*config));
+   config->id = index;
+   snprintf(config->name, sizeof(config->name), "%s", s_bench_layouts[index].name);
+   config->input_port_count = 1;
+   config->output_port_count = 1;
+   config->has_main_input = true;
+   config->main_input_channel_count = s_bench_layouts[index].channels;
+   config->main_input_port_type = s_bench_layouts[index].port_type;
+   config->has_main_output = true;
+   config->main_output_channel_count = s_bench_layouts[index].channels;
+   config->main_output_port_type = s_bench_layouts[index].port_type;
+   return true;
+}
+
+static bool bench_ports_config_select(const clap_plugin_t *plugin, clap_id config_id) {
+   bench_plug_t *plug = plugin->plugin_data;
+   if (config_id >= bench_ports_config_count(plugin))
+      return false;
+   plug->channels = s_bench_layouts[config_id].channels;
+   return true;
+}
+
+static const clap_plugin_audio_ports_config_t s_bench_ports_config = {
+   .count = bench_ports_config_count,
+   .get = bench_ports_config_get,
+   .select = bench_ports_config_select,
+};
+
+///////////////
+// clap_tail //
+///////////////
+
+static uint32_t bench_tail_get(const clap_plugin_t *plugin) {
+   bench_plug_t *plug = plugin->plugin_data;
+   return plug->echo_frames * BENCH_ECHO_REPEATS;
+}
+
+static const clap_plugin_tail_t s_bench_tail = {
+   .get = bench_tail_get,
+};
+
+/////////////////
+// clap_params //
+/////////////////
+
+static uint32_t bench_poly_params_count(const clap_plugin_t *plugin) { return 2; }
+
+static void bench_params_apply(bench_plug_t *plug, const clap_input_events_t *in) {
+   for (uint32_t i = 0; i < in->size(in); ++i) {
+      const clap_event_header_t *hdr = in->get(in, i);
+      if (hdr->space_id == CLAP_CORE_EVENT_SPACE_ID && hdr->type == CLAP_EVENT_PARAM_VALUE)
+         plug->gain = ((const clap_event_param_value_t *)hdr)->value;
+   }
+}
+
+static uint32_t bench_params_count(const clap_plugin_t *plugin) { return 1; }
+
+static bool bench_params_get_info(const clap_plugin_t *plugin,
+                                  uint32_t             index,
+                                  clap_param_info_t   *info) {
+   if (index > 0)
+      return false;
+   memset(info, 0, sizeof(*info));
+   info->id = 0;
+   info->flags = CLAP_PARAM_IS_AUTOMATABLE;
+   snprintf(info->name, sizeof(info->name), "%s", "Gain");
+   info->max_value = 1;
+   info->default_value = 1;
+   return true;
+}
+
+static bool bench_params_get_value(const clap_plugin_t *plugin, clap_id param_id, double *value) {
+   bench_plug_t *plug = plugin->plugin_data;
+   *value = plug->gain;
+   return param_id == 0;
+}
+
+static void bench_params_flush(const clap_plugin_t        *plugin,
+                               const clap_input_events_t  *in,
+                               const clap_output_events_t *out) {
+   bench_params_apply(plugin->plugin_data, in);
+}
+
+static const clap_plugin_params_t s_bench_params = {
+   .count = bench_params_count,
+   .get_info = bench_params_get_info,
+   .get_value = bench_params_get_value,
+   .flush = bench_params_flush,
+};
+
+static void bench_state_apply(bench_plug_t *plug, const clap_input_events_t *in) {
+   for (uint32_t i = 0; i < in->size(in); ++i) {
+      const clap_event_header_t *hdr = in->get(in, i);
+      if (hdr->space_id != CLAP_CORE_EVENT_SPACE_ID || hdr->type != CLAP_EVENT_PARAM_VALUE)
+         continue;
+      const clap_event_param_value_t *ev = (const clap_event_param_value_t *)hdr;
+      if (ev->param_id < BENCH_STATE_PARAMS)
+         plug->values[ev->param_id] = ev->value;
+   }
+}
+
+static uint32_t bench_state_params_count(const clap_plugin_t *plugin) { return BENCH_STATE_PARAMS; }
+
+static bool bench_state_params_get_info(const clap_plugin_t *plugin,
+                                        uint32_t             index,
+                                        clap_param_info_t   *info) {
+   if (index >= BENCH_STATE_PARAMS)
+      return false;
+   memset(info, 0, sizeof(*info));
+   info->id = index;
+   info->flags = CLAP_PARAM_IS_AUTOMATABLE;
+   snprintf(info->name, sizeof(info->name), "Value %u", index);
+   info->max_value = 1;
+   return true;
+}
+
+static bool bench_state_params_get_value(const clap_plugin_t *plugin, clap_id param_id, double *value) {
+   bench_plug_t *plug = plugin->plugin_data;
+   if (param_id >= BENCH_STATE_PARAMS)
+      return false;
+   *value = plug->values[param_id];
+   return true;
+}
+
+static void bench_state_params_flush(const clap_plugin_t        *plugin,
+                                     const clap_input_events_t  *in,
+                                     const clap_output_events_t *out) {
+   bench_state_apply(plugin->plugin_data, in);
+}
+
+static const clap_plugin_params_t s_bench_state_params = {
+   .count = bench_state_params_count,
+   .get_info = bench_state_params_get_info,
+   .get_value = bench_state_params_get_value,
+   .flush = bench_state_params_flush,
+};
+
+// bench.poly: voices held and partials per voice
+static bool bench_poly_params_get_info(const clap_plugin_t *plugin,
+                                       uint32_t             index,
+                                       clap_param_info_t   *info) {
+   if (index > 1)
+      return false;
+   memset(info, 0, sizeof(*info));
+   info->id = index;
+   info->flags = CLAP_PARAM_IS_STEPPED;
+   snprintf(info->name, sizeof(info->name), "%s", index == 0 ? "Voices" : "Partials");
+   info->min_value = index == 0 ? 0 : 1;
+   info->max_value = index == 0 ? BENCH_POLY_VOICES : BENCH_POLY_PARTIALS;
+   info->default_value = index == 0 ? 1 : 16;
+   return true;
+}
+
+static bool bench_poly_params_get_value(const clap_plugin_t *plugin, clap_id param_id, double *value) {
+   bench_plug_t *plug = plugin->plugin_data;
+   if (param_id > 1)
+      return false;
+   *value = param_id == 0 ? plug->voices : plug->partials;
+   return true;
+}
+
+static void bench_poly_apply(bench_plug_t *plug, const clap_input_events_t *in) {
+   for (uint32_t i = 0; i < in->size(in); ++i) {
+      const clap_event_header_t *hdr = in->get(in, i);
+      if (hdr->space_id != CLAP_CORE_EVENT_SPACE_ID || hdr->type != CLAP_EVENT_PARAM_VALUE)
+         continue;
+      const clap_event_param_value_t *ev = (const clap_event_param_value_t *)hdr;
+      uint32_t value = (uint32_t)ev->value;
+      if (ev->param_id == 0 && value <= BENCH_POLY_VOICES && value != plug->voices) {
+         plug->voices = value;
+         plug->voices_changed = true;
+         plug->host->request_callback(plug->host);
+      } else if (ev->param_id == 1 && value >= 1 && value <= BENCH_POLY_PARTIALS)
+         plug->partials = value;
+   }
+}
+
+static void bench_poly_params_flush(const clap_plugin_t        *plugin,
+                                    const clap_input_events_t  *in,
+                                    const clap_output_events_t *out) {
+   bench_poly_apply(plugin->plugin_data, in);
+}
+
+static const clap_plugin_params_t s_bench_poly_params = {
+   .count = bench_poly_params_count,
+   .get_info = bench_poly_params_get_info,
+   .get_value = bench_poly_params_get_value,
+   .flush = bench_poly_params_flush,
+};
+
+/////////////////////
+// clap_voice_info //
+/////////////////////
+
+static bool bench_voice_info_get(const clap_plugin_t *plugin, clap_voice_info_t *info) {
+   bench_plug_t *plug = plugin->plugin_data;
+   info->voice_count = plug->voices;
+   info->voice_capacity = BENCH_POLY_VOICES;
+   info->flags = CLAP_VOICE_INFO_SUPPORTS_OVERLAPPING_NOTES;
+   return true;
+}
+
+static const clap_plugin_voice_info_t s_bench_voice_info = {
+   .get = bench_voice_info_get,
+};
+
+//////////////////////
+// clap_thread_pool //
+//////////////////////
+
+// One voice: a sum of partials of a saw-like shape, into its own block
+static void bench_poly_exec(const clap_plugin_t *plugin, uint32_t task_index) {
+   bench_plug_t *plug = plugin->plugin_data;
+   float *out = plug->voice_out + (size_t)task_index * plug->max_frames;
+   float  phase = plug->voice_phase[task_index];
+   float  step = (55.0f + 5.0f * task_index) / 48000.0f;
+   for (uint32_t i = 0; i < plug->frames; ++i) {
+      float sum = 0;
+      for (uint32_t partial = 1; partial <= plug->partials; ++partial) {
+         float x = phase * partial;
+         x -= (float)(int)x;
+         sum += x * (1 - x) / partial;
+      }
+      out[i] = sum;
+      phase += step;
+      if (phase >= 1.0f)
+         phase -= 1.0f;
+   }
+   plug->voice_phase[task_index] = phase;
+}
+
+static const clap_plugin_thread_pool_t s_bench_thread_pool = {
+   .exec = bench_poly_exec,
+};
+
+////////////////
+// clap_state //
+////////////////
+
+static bool bench_write_all(const clap_ostream_t *stream, const void *data, uint64_t size) {
+   const char *bytes = data;
+   while (size > 0) {
+      int64_t n = stream->write(stream, bytes, size);
+      if (n <= 0)
+         return false;
+      bytes += n;
+      size -= (uint64_t)n;
+   }
+   return true;
+}
+
+static bool bench_read_all(const clap_istream_t *stream, void *data, uint64_t size) {
+   char *bytes = data;
+   while (size > 0) {
+      int64_t n = stream->read(stream, bytes, size);
+      if (n <= 0)
+         return false;
+      bytes += n;
+      size -= (uint64_t)n;
+   }
+   return true;
+}
+
+static bool bench_state_save(const clap_plugin_t *plugin, const clap_ostream_t *stream) {
+   bench_plug_t *plug = plugin->plugin_data;
+   if (!bench_write_all(stream, plug->values, sizeof(plug->values)))
+      return false;
+   for (uint32_t at = 0; at < BENCH_STATE_TABLE; at += BENCH_STATE_WRITE)
+      if (!bench_write_all(stream, s_bench_table + at, BENCH_STATE_WRITE))
+         return false;
+   return true;
+}
+
+static bool bench_state_load(const clap_plugin_t *plugin, const clap_istream_t *stream) {
+   bench_plug_t *plug = plugin->plugin_data;
+   static unsigned char table[BENCH_STATE_WRITE];
+   if (!bench_read_all(stream, plug->values, sizeof(plug->values)))
+      return false;
+   for (uint32_t at = 0; at < BENCH_STATE_TABLE; at += BENCH_STATE_WRITE)
+      if (!bench_read_all(stream, table, BENCH_STATE_WRITE) ||
+          memcmp(table, s_bench_table + at, BENCH_STATE_WRITE))
+         return false;
+   return true;
+}
+
+static const clap_plugin_state_t s_bench_state = {
+   .save = bench_state_save,
+   .load = bench_state_load,
+};
+
+/////////////////
+// clap_plugin //
+/////////////////
+
+static bool bench_init(const struct clap_plugin *plugin) { return true; }
+
+static void bench_destroy(const struct clap_plugin *plugin) {
+   bench_plug_t *plug = plugin->plugin_data;
+   free(plug->echo);
+   free(plug);
+}
+
+static bool bench_effect_activate(const struct clap_plugin *plugin,
+                                  double                    sample_rate,
+                                  uint32_t                  min_frames_count,
+                                  uint32_t                  max_frames_count) {
+   bench_plug_t *plug = plugin->plugin_data;
+   plug->echo_frames = (uint32_t)(sample_rate * BENCH_ECHO_SECONDS);
+   plug->echo = calloc(2 * (size_t)plug->echo_frames, sizeof(float));
+   plug->echo_pos = 0;
+   return plug->echo != NULL;
+}
+
+static void bench_effect_deactivate(const struct clap_plugin *plugin) {
+   bench_plug_t *plug = plugin->plugin_data;
+   free(plug->echo);
+   plug->echo = NULL;
+}
+
+static bool bench_start_processing(const struct clap_plugin *plugin) { return true; }
+
+static void bench_stop_processing(const struct clap_plugin *plugin) {}
+
+static void bench_effect_reset(const struct clap_plugin *plugin) {
+   bench_plug_t *plug = plugin->plugin_data;
+   memset(plug->echo, 0, 2 * (size_t)plug->echo_frames * sizeof(float));
+   plug->lowpass[0] = plug->lowpass[1] = 0;
+}
+
+static clap_process_status bench_effect_process(const struct clap_plugin *plugin,
+                                                const clap_process_t     *process) {
+   bench_plug_t *plug = plugin->plugin_data;
+
+   for (uint32_t i = 0; i < process->frames_count; ++i) {
+      for (uint32_t ch = 0; ch < 2; ++ch) {
+         float *line = plug->echo + ch * plug->echo_frames;
+         float  in = process->audio_inputs[0].data32[ch][i];
+         float  delayed = line[plug->echo_pos];
+         plug->lowpass[ch] += 0.5f * (delayed - plug->lowpass[ch]);
+         if (fabsf(plug->lowpass[ch]) < 1e-15f) // keep the decay out of denormals
+            plug->lowpass[ch] = 0;
+         line[plug->echo_pos] = in + BENCH_ECHO_FEEDBACK * plug->lowpass[ch];
+         process->audio_outputs[0].data32[ch][i] = in + delayed;
+      }
+      if (++plug->echo_pos == plug->echo_frames)
+         plug->echo_pos = 0;
+   }
+   return CLAP_PROCESS_TAIL;
+}
+
+static const void *bench_effect_get_extension(const struct clap_plugin *plugin, const char *id) {
+   if (!strcmp(id, CLAP_EXT_AUDIO_PORTS))
+      return &s_bench_audio_ports;
+   if (!strcmp(id, CLAP_EXT_TAIL))
+      return &s_bench_tail;
+   return NULL;
+}
+
+static bool bench_activate(const struct clap_plugin *plugin,
+                           double                    sample_rate,
+                           uint32_t                  min_frames_count,
+                           uint32_t                  max_frames_count) {
+   return true;
+}
+
+static void bench_deactivate(const struct clap_plugin *plugin) {}
+
+static void bench_reset(const struct clap_plugin *plugin) {}
+
+static clap_process_status bench_params_process(const struct clap_plugin *plugin,
+                                                const clap_process_t     *process) {
+   bench_plug_t *plug = plugin->plugin_data;
+   bench_params_apply(plug, process->in_events);
+   for (uint32_t ch = 0; ch < 2; ++ch)
+      for (uint32_t i = 0; i < process->frames_count; ++i)
+         process->audio_outputs[0].data32[ch][i] =
+            (float)plug->gain * process->audio_inputs[0].data32[ch][i];
+   return CLAP_PROCESS_CONTINUE_IF_NOT_QUIET;
+}
+
+static const void *bench_params_get_extension(const struct clap_plugin *plugin, const char *id) {
+   if (!strcmp(id, CLAP_EXT_AUDIO_PORTS))
+      return &s_bench_audio_ports;
+   if (!strcmp(id, CLAP_EXT_PARAMS))
+      return &s_bench_params;
+   return NULL;
+}
+
+static clap_process_status bench_state_process(const struct clap_plugin *plugin,
+                                               const clap_process_t     *process) {
+   bench_state_apply(plugin->plugin_data, process->in_events);
+   for (uint32_t ch = 0; ch < 2; ++ch)
+      memcpy(process->audio_outputs[0].data32[ch], process->audio_inputs[0].data32[ch],
+             process->frames_count * sizeof(float));
+   return CLAP_PROCESS_CONTINUE_IF_NOT_QUIET;
+}
+
+static const void *bench_state_get_extension(const struct clap_plugin *plugin, const char *id) {
+   if (!strcmp(id, CLAP_EXT_AUDIO_PORTS))
+      return &s_bench_audio_ports;
+   if (!strcmp(id, CLAP_EXT_PARAMS))
+      return &s_bench_state_params;
+   if (!strcmp(id, CLAP_EXT_STATE))
+      return &s_bench_state;
+   return NULL;
+}
+
+// A parameter change of bench.undo, as its deltas carry it
+typedef struct {
+   uint32_t param_id;
+   double   before;
+   double   after;
+} bench_undo_delta;
+
+#define BENCH_UNDO_FORMAT 1
+
+static void bench_undo_get_delta_properties(const clap_plugin_t          *plugin,
+                                            clap_undo_delta_properties_t *properties) {
+   properties->has_delta = true;
+   properties->are_deltas_persistent = true;
+   properties->format_version = BENCH_UNDO_FORMAT;
+}
+
+static bool bench_undo_can_use_delta_format_version(const clap_plugin_t *plugin, clap_id format_version) {
+   return format_version == BENCH_UNDO_FORMAT;
+}
+
+static bool bench_undo_apply(const clap_plugin_t *plugin,
+                             clap_id              format_version,
+                             const void          *delta,
+                             size_t               delta_size,
+                             bool                 undoing) {
+   bench_plug_t *plug = plugin->plugin_data;
+   bench_undo_delta change;
+   if (format_version != BENCH_UNDO_FORMAT || delta_size != sizeof(change))
+      return false;
+   memcpy(&change, delta, sizeof(change));
+   if (change.param_id >= BENCH_STATE_PARAMS)
+      return false;
+   plug->values[change.param_id] = undoing ? change.before : change.after;
+   return true;
+}
+
+static bool bench_undo_undo(const clap_plugin_t *plugin,
+                            clap_id              format_version,
+                            const void          *delta,
+                            size_t               delta_size) {
+   return bench_undo_apply(plugin, format_version, delta, delta_size, true);
+}
+
+static bool bench_undo_redo(const clap_plugin_t *plugin,
+                            clap_id              format_version,
+                            const void          *delta,
+                            size_t               delta_size) {
+   return bench_undo_apply(plugin, format_version, delta, delta_size, false);
+}
+
+static const clap_plugin_undo_delta_t s_bench_undo_delta = {
+   .get_delta_properties = bench_undo_get_delta_properties,
+   .can_use_delta_format_version = bench_undo_can_use_delta_format_version,
+   .undo = bench_undo_undo,
+   .redo = bench_undo_redo,
+};
+
+static const void *bench_undo_get_extension(const struct clap_plugin *plugin, const char *id) {
+   if (!strcmp(id, CLAP_EXT_UNDO_DELTA))
+      return &s_bench_undo_delta;
+   return bench_state_get_extension(plugin, id);
+}
+
+static clap_process_status bench_spew_process(const struct clap_plugin *plugin,
+                                              const clap_process_t     *process) {
+   bench_plug_t *plug = plugin->plugin_data;
+   const clap_output_events_t *out = process->out_events;
+   uint32_t frames = process->frames_count;
+
+   clap_event_param_gesture_t gesture = {
+      .header = {
+         .size = sizeof(gesture),
+         .time = 0,
+         .space_id = CLAP_CORE_EVENT_SPACE_ID,
+         .type = plug->spew_blocks % 2 ? CLAP_EVENT_PARAM_GESTURE_END : CLAP_EVENT_PARAM_GESTURE_BEGIN,
+      },
+      .param_id = 0,
+   };
+   out->try_push(out, &gesture.header);
+
+   // Events go out in time order, spread over the block
+   const uint32_t count = 2 * BENCH_SPEW_PARAMS;
+   for (uint32_t i = 0; i < count; ++i) {
+      clap_event_param_value_t value = {
+         .header = {
+            .size = sizeof(value),
+            .time = (uint32_t)((uint64_t)i * frames / count),
+            .space_id = CLAP_CORE_EVENT_SPACE_ID,
+            .type = CLAP_EVENT_PARAM_VALUE,
+         },
+         .param_id = i % BENCH_SPEW_PARAMS,
+         .note_id = -1,
+         .port_index = -1,
+         .channel = -1,
+         .key = -1,
+         .value = (double)plug->spew_blocks,
+      };
+      out->try_push(out, &value.header);
+   }
+   for (uint32_t i = 0; i < BENCH_SPEW_NOTES; ++i) {
+      clap_event_note_t note = {
+         .header = {
+            .size = sizeof(note),
+            .time = frames > 0 ? frames - 1 : 0,
+            .space_id = CLAP_CORE_EVENT_SPACE_ID,
+            .type = CLAP_EVENT_NOTE_END,
+         },
+         .note_id = plug->spew_notes++,
+         .port_index = 0,
+         .channel = 0,
+         .key = (int16_t)(i % 128),
+      };
+      out->try_push(out, &note.header);
+   }
+   plug->spew_blocks++;
+
+   for (uint32_t ch = 0; ch < 2; ++ch)
+      memcpy(process->audio_outputs[0].data32[ch], process->audio_inputs[0].data32[ch], frames * sizeof(float));
+   return CLAP_PROCESS_CONTINUE;
+}
+
+static const void *bench_spew_get_extension(const struct clap_plugin *plugin, const char *id) {
+   if (!strcmp(id, CLAP_EXT_AUDIO_PORTS))
+      return &s_bench_audio_ports;
+   return NULL;
+}
+
+static void bench_layout_reset(const struct clap_plugin *plugin) {
+   bench_plug_t *plug = plugin->plugin_data;
+   memset(plug->biquad, 0, sizeof(plug->biquad));
+}
+
+// A lowpass biquad on each channel of the layout
+static clap_process_status bench_layout_process(const struct clap_plugin *plugin,
+                                                const clap_process_t     *process) {
+   static const float b0 = 0.0675f, b1 = 0.135f, b2 = 0.0675f, a1 = -1.143f, a2 = 0.413f;
+   bench_plug_t *plug = plugin->plugin_data;
+
+   for (uint32_t ch = 0; ch < plug->channels; ++ch) {
+      const float *in = process->audio_inputs[0].data32[ch];
+      float       *out = process->audio_outputs[0].data32[ch];
+      float       *z = plug->biquad[ch];
+      for (uint32_t i = 0; i < process->frames_count; ++i) {
+         float y = b0 * in[i] + b1 * z[0] + b2 * z[1] - a1 * z[2] - a2 * z[3];
+         z[1] = z[0];
+         z[0] = in[i];
+         z[3] = z[2];
+         z[2] = y;
+         out[i] = y;
+      }
+   }
+   return CLAP_PROCESS_CONTINUE;
+}
+
+static const void *bench_layout_get_extension(const struct clap_plugin *plugin, const char *id) {
+   if (!strcmp(id, CLAP_EXT_AUDIO_PORTS))
+      return &s_bench_layout_ports;
+   if (!strcmp(id, CLAP_EXT_AUDIO_PORTS_CONFIG))
+      return &s_bench_ports_config;
+   return NULL;
+}
+
+static void bench_multiout_reset(const struct clap_plugin *plugin) {
+   bench_plug_t *plug = plugin->plugin_data;
+   memset(plug->phase, 0, sizeof(plug->phase));
+   memset(plug->voice, 0, sizeof(plug->voice));
+}
+
+// Each active output drones its own pitch, panned by its index; inactive ones are not touched
+static clap_process_status bench_multiout_process(const struct clap_plugin *plugin,
+                                                  const clap_process_t     *process) {
+   bench_plug_t *plug = plugin->plugin_data;
+
+   for (uint32_t port = 0; port < process->audio_outputs_count && port < BENCH_MULTIOUT_PORTS; ++port) {
+      if (!(plug->active_outputs & (1u << port)))
+         continue;
+      float *left = process->audio_outputs[port].data32[0];
+      float *right = process->audio_outputs[port].data32[1];
+      float  step = (110.0f + 55.0f * port) / 48000.0f;
+      float  pan = (float)port / BENCH_MULTIOUT_PORTS;
+      float  phase = plug->phase[port];
+      float  voice = plug->voice[port];
+      for (uint32_t i = 0; i < process->frames_count; ++i) {
+         phase += step;
+         if (phase >= 1.0f)
+            phase -= 1.0f;
+         voice += 0.2f * (2.0f * phase - 1.0f - voice);
+         left[i] = (1.0f - pan) * voice;
+         right[i] = pan * voice;
+      }
+      plug->phase[port] = phase;
+      plug->voice[port] = voice;
+   }
+   return CLAP_PROCESS_CONTINUE;
+}
+
+static const void *bench_multiout_get_extension(const struct clap_plugin *plugin, const char *id) {
+   if (!strcmp(id, CLAP_EXT_AUDIO_PORTS))
+      return &s_bench_multiout_ports;
+   if (!strcmp(id, CLAP_EXT_AUDIO_PORTS_ACTIVATION))
+      return &s_bench_ports_activation;
+   return NULL;
+}
+
+static bool bench_poly_init(const struct clap_plugin *plugin) {
+   bench_plug_t *plug = plugin->plugin_data;
+   plug->host_pool = plug->host->get_extension(plug->host, CLAP_EXT_THREAD_POOL);
+   plug->host_voice_info = plug->host->get_extension(plug->host, CLAP_EXT_VOICE_INFO);
+   return true;
+}
+
+static bool bench_poly_activate(const struct clap_plugin *plugin,
+                                double                    sample_rate,
+                                uint32_t                  min_frames_count,
+                                uint32_t                  max_frames_count) {
+   bench_plug_t *plug = plugin->plugin_data;
+   plug->max_frames = max_frames_count;
+   plug->voice_out = calloc(BENCH_POLY_VOICES * (size_t)max_frames_count, sizeof(float));
+   return plug->voice_out != NULL;
+}
+
+static void bench_poly_deactivate(const struct clap_plugin *plugin) {
+   bench_plug_t *plug = plugin->plugin_data;
+   free(plug->voice_out);
+   plug->voice_out = NULL;
+}
+
+static void bench_poly_reset(const struct clap_plugin *plugin) {
+   bench_plug_t *plug = plugin->plugin_data;
+   memset(plug->voice_phase, 0, sizeof(plug->voice_phase));
+}
+
+// Each voice is a task for the host's pool; without its help they run here, one after another
+static clap_process_status bench_poly_process(const struct clap_plugin *plugin,
+                                              const clap_process_t     *process) {
+   bench_plug_t *plug = plugin->plugin_data;
+   bench_poly_apply(plug, process->in_events);
+   plug->frames = process->frames_count;
+
+   if (plug->voices > 0 &&
+       !(plug->host_pool && plug->host_pool->request_exec(plug->host, plug->voices))) {
+      for (uint32_t v = 0; v < plug->voices; ++v)
+         bench_poly_exec(plugin, v);
+   }
+
+   float *out = process->audio_outputs[0].data32[0];
+   memset(out, 0, process->frames_count * sizeof(float));
+   for (uint32_t v = 0; v < plug->voices; ++v) {
+      const float *voice = plug->voice_out + (size_t)v * plug->max_frames;
+      for (uint32_t i = 0; i < process->frames_count; ++i)
+         out[i] += voice[i] / BENCH_POLY_VOICES;
+   }
+   for (uint32_t ch = 1; ch < process->audio_outputs[0].channel_count; ++ch)
+      memcpy(process->audio_outputs[0].data32[ch], out, process->frames_count * sizeof(float));
+   return CLAP_PROCESS_CONTINUE;
+}
+
+static const void *bench_poly_get_extension(const struct clap_plugin *plugin, const char *id) {
+   if (!strcmp(id, CLAP_EXT_AUDIO_PORTS))
+      return &s_bench_poly_ports;
+   if (!strcmp(id, CLAP_EXT_PARAMS))
+      return &s_bench_poly_params;
+   if (!strcmp(id, CLAP_EXT_VOICE_INFO))
+      return &s_bench_voice_info;
+   if (!strcmp(id, CLAP_EXT_THREAD_POOL))
+      return &s_bench_thread_pool;
+   return NULL;
+}
+
+// The voice count changed in process(), the host hears of it on the main thread
+static void bench_poly_on_main_thread(const struct clap_plugin *plugin) {
+   bench_plug_t *plug = plugin->plugin_data;
+   if (plug->voices_changed && plug->host_voice_info) {
+      plug->voices_changed = false;
+      plug->host_voice_info->changed(plug->host);
+   }
+}
+
+static void bench_on_main_thread(const struct clap_plugin *plugin) {}
+
+static bench_plug_t *bench_create(const clap_host_t *host, const clap_plugin_descriptor_t *desc) {
+   bench_plug_t *p = calloc(1, sizeof(*p));
+   p->host = host;
+   p->plugin.desc = desc;
+   p->plugin.plugin_data = p;
+   p->plugin.init = bench_init;
+   p->plugin.destroy = bench_destroy;
+   p->plugin.start_processing = bench_start_processing;
+   p->plugin.stop_processing = bench_stop_processing;
+   p->plugin.activate = bench_activate;
+   p->plugin.deactivate = bench_deactivate;
+   p->plugin.reset = bench_reset;
+   p->plugin.on_main_thread = bench_on_main_thread;
+   return p;
+}
+
+static clap_plugin_t *bench_effect_create(const clap_host_t *host) {
+   bench_plug_t *p = bench_create(host, &s_bench_effect_desc);
+   p->plugin.activate = bench_effect_activate;
+   p->plugin.deactivate = bench_effect_deactivate;
+   p->plugin.reset = bench_effect_reset;
+   p->plugin.process = bench_effect_process;
+   p->plugin.get_extension = bench_effect_get_extension;
+   return &p->plugin;
+}
+
+static clap_plugin_t *bench_params_create(const clap_host_t *host) {
+   bench_plug_t *p = bench_create(host, &s_bench_params_desc);
+   p->gain = 1;
+   p->plugin.process = bench_params_process;
+   p->plugin.get_extension = bench_params_get_extension;
+   return &p->plugin;
+}
+
+static clap_plugin_t *bench_catalog_create(const clap_host_t *host) {
+   clap_plugin_t *plugin = bench_params_create(host);
+   plugin->desc = &s_bench_catalog_desc;
+   return plugin;
+}
+
+static clap_plugin_t *bench_state_create(const clap_host_t *host) {
+   // Filled here rather than in entry_init, which a catalog scan runs for every bundle
+   static bool filled = false;
+   if (!filled) {
+      uint32_t x = 1;
+      for (uint32_t i = 0; i < BENCH_STATE_TABLE; ++i) {
+         x = x * 1664525u + 1013904223u;
+         s_bench_table[i] = (unsigned char)(x >> 24);
+      }
+      filled = true;
+   }
+   bench_plug_t *p = bench_create(host, &s_bench_state_desc);
+   p->plugin.process = bench_state_process;
+   p->plugin.get_extension = bench_state_get_extension;
+   return &p->plugin;
+}
+
+static clap_plugin_t *bench_undo_create(const clap_host_t *host) {
+   clap_plugin_t *plugin = bench_state_create(host);
+   plugin->desc = &s_bench_undo_desc;
+   plugin->get_extension = bench_undo_get_extension;
+   return plugin;
+}
+
+static clap_plugin_t *bench_spew_create(const clap_host_t *host) {
+   bench_plug_t *p = bench_create(host, &s_bench_spew_desc);
+   p->plugin.process = bench_spew_process;
+   p->plugin.get_extension = bench_spew_get_extension;
+   return &p->plugin;
+}
+
+static clap_plugin_t *bench_layout_create(const clap_host_t *host) {
+   bench_plug_t *p = bench_create(host, &s_bench_layout_desc);
+   p->channels = s_bench_layouts[0].channels;
+   p->plugin.reset = bench_layout_reset;
+   p->plugin.process = bench_layout_process;
+   p->plugin.get_extension = bench_layout_get_extension;
+   return &p->plugin;
+}
+
+static clap_plugin_t *bench_multiout_create(const clap_host_t *host) {
+   bench_plug_t *p = bench_create(host, &s_bench_multiout_desc);
+   p->active_outputs = (1u << BENCH_MULTIOUT_PORTS) - 1; // ports start active
+   p->plugin.reset = bench_multiout_reset;
+   p->plugin.process = bench_multiout_process;
+   p->plugin.get_extension = bench_multiout_get_extension;
+   return &p->plugin;
+}
+
+static clap_plugin_t *bench_poly_create(const clap_host_t *host) {
+   bench_plug_t *p = bench_create(host, &s_bench_poly_desc);
+   p->voices = 1;
+   p->partials = 16;
+   p->plugin.init = bench_poly_init;
+   p->plugin.activate = bench_poly_activate;
+   p->plugin.deactivate = bench_poly_deactivate;
+   p->plugin.reset = bench_poly_reset;
+   p->plugin.process = bench_poly_process;
+   p->plugin.get_extension = bench_poly_get_extension;
+   p->plugin.on_main_thread = bench_poly_on_main_thread;
+   return &p->plugin;
+}
+
+///////////////////////////////////
+// clap_preset_discovery_factory //
+///////////////////////////////////
+
+static const clap_preset_discovery_provider_descriptor_t s_bench_presets_desc = {
+   .clap_version = CLAP_VERSION_INIT,
+   .id = "bench.presets",
+   .name = "clap-bench presets",
+   .vendor = "clap-bench",
+};
+
+typedef struct {
+   clap_preset_discovery_provider_t       provider;
+   const clap_preset_discovery_indexer_t *indexer;
+} bench_presets_t;
+
+static bool bench_presets_init(const clap_preset_discovery_provider_t *provider) {
+   bench_presets_t *presets = provider->provider_data;
+   const char      *root = getenv("CLAP_BENCH_PRESETS");
+   if (!root)
+      return false;
+   clap_preset_discovery_filetype_t filetype = {
+      .name = "clap-bench preset",
+      .file_extension = "benchpreset",
+   };
+   clap_preset_discovery_location_t location = {
+      .flags = CLAP_PRESET_DISCOVERY_IS_FACTORY_CONTENT,
+      .name = "clap-bench presets",
+      .kind = CLAP_PRESET_DISCOVERY_LOCATION_FILE,
+      .location = root,
+   };
+   return presets->indexer->declare_filetype(presets->indexer, &filetype) &&
+          presets->indexer->declare_location(presets->indexer, &location);
+}
+
+static void bench_presets_destroy(const clap_preset_discovery_provider_t *provider) {
+   free(provider->provider_data);
+}
+
+// Cuts the next field off *cursor at sep; providers run on several threads, so no strtok()
+static char *bench_field(char **cursor, char sep) {
+   char *field = *cursor;
+   while (*field == sep)
+      ++field;
+   if (!*field)
+      return NULL;
+   char *end = strchr(field, sep);
+   if (end)
+      *end++ = 0;
+   *cursor = end ? end : field + strlen(field);
+   return field;
+}
+
+static bool bench_presets_get_metadata(const clap_preset_discovery_provider_t        *provider,
+                                       uint32_t                                       location_kind,
+                                       const char                                    *location,
+                                       const clap_preset_discovery_metadata_receiver_t *receiver) {
+   char  text[512];
+   FILE *file = location ? fopen(location, "rb") : NULL;
+   if (!file)
+      return false;
+   size_t size = fread(text, 1, sizeof(text) - 1, file);
+   fclose(file);
+   text[size] = 0;
+
+   // name, creator and features, one line each
+   char *cursor = text;
+   char *name = bench_field(&cursor, '\n');
+   char *creator = name ? bench_field(&cursor, '\n') : NULL;
+   char *features = creator ? bench_field(&cursor, '\n') : NULL;
+   if (!name || !receiver->begin_preset(receiver, name, NULL))
+      return false;
+   clap_universal_plugin_id_t plugin_id = { .abi = "clap", .id = "bench.poly" };
+   receiver->add_plugin_id(receiver, &plugin_id);
+   receiver->set_flags(receiver, CLAP_PRESET_DISCOVERY_IS_FACTORY_CONTENT);
+   if (creator)
+      receiver->add_creator(receiver, creator);
+   for (char *feature; features && (feature = bench_field(&features, ' '));)
+      receiver->add_feature(receiver, feature);
+   return true;
+}
+
+static const void *bench_presets_get_extension(const clap_preset_discovery_provider_t *provider,
+                                               const char                             *id) {
+   return NULL;
+}
+
+static uint32_t preset_factory_count(const clap_preset_discovery_factory_t *factory) { return 1; }
+
+static const clap_preset_discovery_provider_descriptor_t *
+preset_factory_get_descriptor(const clap_preset_discovery_factory_t *factory, uint32_t index) {
+   return index == 0 ? &s_bench_presets_desc : NULL;
+}
+
+static const clap_preset_discovery_provider_t *
+preset_factory_create(const clap_preset_discovery_factory_t *factory,
+                      const clap_preset_discovery_indexer_t *indexer,
+                      const char                            *provider_id) {
+   if (strcmp(provider_id, s_bench_presets_desc.id))
+      return NULL;
+   bench_presets_t *presets = calloc(1, sizeof(*presets));
+   presets->indexer = indexer;
+   presets->provider.desc = &s_bench_presets_desc;
+   presets->provider.provider_data = presets;
+   presets->provider.init = bench_presets_init;
+   presets->provider.destroy = bench_presets_destroy;
+   presets->provider.get_metadata = bench_presets_get_metadata;
+   presets->provider.get_extension = bench_presets_get_extension;
+   return &presets->provider;
+}
+
+static const clap_preset_discovery_factory_t s_preset_factory = {
+   .count = preset_factory_count,
+   .get_descriptor = preset_factory_get_descriptor,
+   .create = preset_factory_create,
+};
+
+/////////////////////////
+// clap_plugin_factory //
+/////////////////////////
+
+static struct {
+   const clap_plugin_descriptor_t *desc;
+   clap_plugin_t *(*create)(const clap_host_t *host);
+} s_plugins[] = {
+   {
+      .desc = &s_bench_effect_desc,
+      .create = bench_effect_create,
+   },
+   {
+      .desc = &s_bench_params_desc,
+      .create = bench_params_create,
+   },
+   {
+      .desc = &s_bench_state_desc,
+      .create = bench_state_create,
+   },
+   {
+      .desc = &s_bench_undo_desc,
+      .create = bench_undo_create,
+   },
+   {
+      .desc = &s_bench_layout_desc,
+      .create = bench_layout_create,
+   },
+   {
+      .desc = &s_bench_multiout_desc,
+      .create = bench_multiout_create,
+   },
+   {
+      .desc = &s_bench_poly_desc,
+      .create = bench_poly_create,
+   },
+   {
+      .desc = &s_bench_spew_desc,
+      .create = bench_spew_create,
+   },
+   {
+      .desc = &s_bench_catalog_desc,
+      .create = bench_catalog_create,
+   },
+};
+
+static uint32_t plugin_factory_get_plugin_count(const struct clap_plugin_factory *factory) {
+   return sizeof(s_plugins) / sizeof(s_plugins[0]);
+}
+
+static const clap_plugin_descriptor_t *
+plugin_factory_get_plugin_descriptor(const struct clap_plugin_factory *factory, uint32_t index) {
+   return index < plugin_factory_get_plugin_count(factory) ? s_plugins[index].desc : NULL;
+}
+
+static const clap_plugin_t *plugin_factory_create_plugin(const struct clap_plugin_factory *factory,
+                                                         const clap_host_t                *host,
+                                                         const char *plugin_id) {
+   if (!clap_version_is_compatible(host->clap_version)) {
+      return NULL;
+   }
+
+   const int N = sizeof(s_plugins) / sizeof(s_plugins[0]);
+   for (int i = 0; i < N; ++i)
+      if (!strcmp(plugin_id, s_plugins[i].desc->id))
+         return s_plugins[i].create(host);
+
+   return NULL;
+}
+
+static const clap_plugin_factory_t s_plugin_factory = {
+   .get_plugin_count = plugin_factory_get_plugin_count,
+   .get_plugin_descriptor = plugin_factory_get_plugin_descriptor,
+   .create_plugin = plugin_factory_create_plugin,
+};
+
+////////////////
+// clap_entry //
+////////////////
+
+static bool entry_init(const char *plugin_path) {
+   const char *file = strrchr(plugin_path, '/');
+   const char *windows = strrchr(plugin_path, '\\');
+   if (windows && (!file || windows > file))
+      file = windows;
+   snprintf(s_bench_catalog_id, sizeof(s_bench_catalog_id), "bench.catalog/%s", file ? file + 1 : plugin_path);
+
+   return true;
+}
+
+static void entry_deinit(void) {}
+
+static const void *entry_get_factory(const char *factory_id) {
+   if (!strcmp(factory_id, CLAP_PLUGIN_FACTORY_ID))
+      return &s_plugin_factory;
+   if (!strcmp(factory_id, CLAP_PRESET_DISCOVERY_FACTORY_ID))
+      return &s_preset_factory;
+   return NULL;
+}
+
+CLAP_EXPORT const clap_plugin_entry_t clap_entry = {
+   .clap_version = CLAP_VERSION_INIT,
+   .init = entry_init,
+   .deinit = entry_deinit,
+   .get_factory = entry_get_factory,
+};
@@ -0,0 +1,2688 @@
+// Benchmarks of the host's services, run from the command line without an audio device.
+// Build it on its own, with the host's sources:
+//   g++ -std=c++17 -O2 -I.. -o clap-bench clap-bench.cpp ClapHost*.cpp -ldl -pthread
+// Usage: clap-bench <benchmark> [arguments], without arguments it lists the benchmarks.
+// Numbers are printed per operation: the mean, and the worst (or a percentile) as the tail.
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <filesystem>
+#include <iostream>
+#include <map>
+#include <new>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+#include <unistd.h>
+#include <sys/eventfd.h>
+#include <clap/ext/draft/undo.h>
+#include "ClapHost.h"
+#include "ClapHostAudio.h"
+#include "ClapHostAutomation.h"
+#include "ClapHostCatalog.h"
+#include "ClapHostConverter.h"
+#include "ClapHostDelay.h"
+#include "ClapHostEventLoop.h"
+#include "ClapHostExtensions.h"
+#include "ClapHostMidiFile.h"
+#include "ClapHostPool.h"
+#include "ClapHostPorts.h"
+#include "ClapHostPresets.h"
+#include "ClapHostSnapshots.h"
+#include "ClapHostStateStream.h"
+#include "ClapHostSwap.h"
+#include "ClapHostThreadPool.h"
+#include "ClapHostTransport.h"
+#include "ClapHostTuning.h"
+#include "ClapHostUmp.h"
+#include "ClapHostUndo.h"
+
+#define BENCH_SAMPLE_RATE 48000
+#define BENCH_BLOCK_FRAMES 256
+
+typedef std::chrono::steady_clock BenchClock;
+
+static double elapsed_us(BenchClock::time_point start) {
+    return std::chrono::duration<double, std::micro>(BenchClock::now() - start).count();
+}
+
+// Allocations made by threads which set benchCountAllocations, through operator new.
+// GCC sees the inlined library operator new paired with free() below and warns.
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic ignored "-Wmismatched-new-delete"
+#endif
+static thread_local bool benchCountAllocations = false;
+static std::atomic<uint64_t> benchAllocations{ 0 };
+
+void* operator new(size_t size) {
+    if (benchCountAllocations) {
+        benchAllocations.fetch_add(1, std::memory_order_relaxed);
+    }
+    if (void* memory = malloc(size ? size : 1)) {
+        return memory;
+    }
+    throw std::bad_alloc();
+}
+
+void operator delete(void* memory) noexcept {
+    free(memory);
+}
+
+void operator delete(void* memory, size_t) noexcept {
+    free(memory);
+}
+
+// Mean and worst of a series, in microseconds
+static void report(const char* name, const std::vector<double>& us) {
+    double total = 0;
+    for (double value : us) {
+        total += value;
+    }
+    double worst = us.empty() ? 0 : *std::max_element(us.begin(), us.end());
+    std::cout << "  " << name << ": " << (us.empty() ? 0 : total / us.size()) << " us mean, " << worst
+              << " us worst, " << us.size() << " runs" << std::endl;
+}
+
+// Switching to an instrument: creating and activating it cold, against taking it from the pool
+static int bench_pool(int ac, char** av) {
+    if (ac < 1) {
+        std::cout << "Usage : pool <plugin path> [switches]" << std::endl;
+        return 1;
+    }
+    uint32_t switches = ac > 1 ? (uint32_t)strtoul(av[1], nullptr, 10) : 20;
+
+    std::vector<double> cold;
+    for (uint32_t i = 0; i < switches; i++) {
+        auto start = BenchClock::now();
+        ClapHostInstance* instance = create_clap_instance(av[0]);
+        if (!instance || !activate_clap_instance(instance, BENCH_SAMPLE_RATE, 1, BENCH_BLOCK_FRAMES)) {
+            destroy_clap_instance(instance);
+            return 1;
+        }
+        cold.push_back(elapsed_us(start));
+        destroy_clap_instance(instance);
+    }
+
+    ClapHostPool pool(BENCH_SAMPLE_RATE, 1, BENCH_BLOCK_FRAMES, SIZE_MAX);
+    int slot = pool.add(av[0], switches, 0);
+    auto start = BenchClock::now();
+    pool.refill();
+    double refill = elapsed_us(start);
+    std::vector<double> warm;
+    std::vector<ClapHostInstance*> taken;
+    for (uint32_t i = 0; i < switches; i++) {
+        start = BenchClock::now();
+        ClapHostInstance* instance = pool.acquire(slot);
+        warm.push_back(elapsed_us(start));
+        if (instance) {
+            taken.push_back(instance);
+        }
+    }
+    for (ClapHostInstance* instance : taken) {
+        destroy_clap_instance(instance);
+    }
+
+    std::cout << "Switch latency of " << av[0] << std::endl;
+    report("cold creation and activation", cold);
+    report("from the pool", warm);
+    std::cout << "  warming the pool: " << refill << " us for " << taken.size() << " instances" << std::endl;
+    return 0;
+}
+
+// One block of silence through process_clap_instance(), as the audio thread runs it
+struct BenchBlock {
+    std::vector<float> silence = std::vector<float>(2 * BENCH_BLOCK_FRAMES);
+    std::vector<float> rendered = std::vector<float>(2 * BENCH_BLOCK_FRAMES);
+    float* inputs[2] = { silence.data(), silence.data() + BENCH_BLOCK_FRAMES };
+    float* outputs[2] = { rendered.data(), rendered.data() + BENCH_BLOCK_FRAMES };
+    clap_audio_buffer input = {};
+    clap_audio_buffer output = {};
+    ClapHostInputEvents events;
+
+    BenchBlock() {
+        input.data32 = inputs;
+        input.channel_count = 2;
+        output.data32 = outputs;
+        output.channel_count = 2;
+    }
+
+    void process(ClapHostInstance* instance) {
+        clap_process process = {};
+        process.frames_count = BENCH_BLOCK_FRAMES;
+        process.steady_time = -1;
+        process.audio_inputs = &input;
+        process.audio_outputs = &output;
+        process.audio_inputs_count = 1;
+        process.audio_outputs_count = 1;
+        process.in_events = events.list();
+        process_clap_instance(instance, &process);
+    }
+};
+
+// A parameter change reaching a sleeping plugin: through clap_plugin_params::flush(), against
+// waking it with process() and running it until it sleeps again. Transport events alone must not
+// wake it.
+static int bench_flush(int ac, char** av) {
+    if (ac < 1) {
+        std::cout << "Usage : flush <clap-bench-plugin path> [changes]" << std::endl;
+        return 1;
+    }
+    uint32_t changes = ac > 1 ? (uint32_t)strtoul(av[1], nullptr, 10) : 10000;
+
+    use_clap_port_layout(2, 2);
+    ClapHostInstance* instance = create_clap_instance(av[0], "bench.params");
+    if (!instance || !activate_clap_instance(instance, BENCH_SAMPLE_RATE, 1, BENCH_BLOCK_FRAMES)) {
+        destroy_clap_instance(instance);
+        return 1;
+    }
+
+    BenchBlock block;
+    mark_clap_audio_thread(true);
+    std::vector<double> flushed;
+    std::vector<double> woken;
+    std::vector<double> blocks;
+    for (uint32_t i = 0; i < changes; i++) {
+        double value = (i & 1) ? 1 : 0.5;
+        set_clap_param(instance, 0, value);
+        auto start = BenchClock::now();
+        block.process(instance);
+        flushed.push_back(elapsed_us(start));
+        if (instance->processing) {
+            std::cerr << "The plugin does not go to sleep on silence." << std::endl;
+            break;
+        }
+
+        set_clap_param(instance, 0, value);
+        instance->processRequested = true;
+        start = BenchClock::now();
+        uint32_t awake = 0;
+        do {
+            block.process(instance);
+            awake++;
+        } while (instance->processing && awake < 100);
+        woken.push_back(elapsed_us(start));
+        blocks.push_back(awake);
+    }
+
+    clap_event_transport transport = {};
+    transport.header.size = sizeof(transport);
+    transport.header.space_id = CLAP_CORE_EVENT_SPACE_ID;
+    transport.header.type = CLAP_EVENT_TRANSPORT;
+    transport.flags = CLAP_TRANSPORT_HAS_TEMPO | CLAP_TRANSPORT_IS_PLAYING;
+    transport.tempo = 120;
+    uint32_t wakes = 0;
+    for (uint32_t i = 0; i < changes && !instance->processing; i++) {
+        block.events.clear();
+        block.events.push(&transport.header);
+        block.process(instance);
+        wakes += instance->processing;
+    }
+    block.events.clear();
+    mark_clap_audio_thread(false);
+    destroy_clap_instance(instance);
+
+    std::cout << "A parameter change to a sleeping plugin" << std::endl;
+    report("flushed", flushed);
+    report("woken until asleep again", woken);
+    double awake = 0;
+    for (double count : blocks) {
+        awake += count / blocks.size();
+    }
+    std::cout << "  awake for " << awake << " blocks of " << BENCH_BLOCK_FRAMES << " frames on average" << std::endl;
+    std::cout << "  woken by " << wakes << " of " << changes << " transport events" << std::endl;
+    return 0;
+}
+
+// A voice of a synthetic instrument: a few oscillators summed over one block
+struct BenchVoices {
+    std::vector<std::atomic<uint32_t>> runs;
+    std::vector<float> out;
+    uint32_t partials;
+};
+
+static BenchVoices* benchVoices = nullptr;
+
+static void CLAP_ABI bench_voice_exec(const clap_plugin*, uint32_t task) {
+    BenchVoices* voices = benchVoices;
+    float* out = &voices->out[(size_t)task * BENCH_BLOCK_FRAMES];
+    float phase = 0.001f * (task + 1);
+    for (uint32_t frame = 0; frame < BENCH_BLOCK_FRAMES; frame++) {
+        float sum = 0;
+        for (uint32_t partial = 1; partial <= voices->partials; partial++) {
+            float x = phase * partial * frame;
+            x -= (float)(int)x;
+            sum += x * (1 - x) / partial;
+        }
+        out[frame] = sum;
+    }
+    voices->runs[task].fetch_add(1, std::memory_order_relaxed);
+}
+
+// request_exec of a voice-heavy instrument, one task per voice, with 0 .. N workers helping.
+// Each count also checks that every task of every request ran exactly once.
+static int bench_threads(int ac, char** av) {
+    uint32_t numVoices = ac > 0 ? (uint32_t)strtoul(av[0], nullptr, 10) : 64;
+    uint32_t maxWorkers = ac > 1 ? (uint32_t)strtoul(av[1], nullptr, 10) : 64;
+    uint32_t requests = ac > 2 ? (uint32_t)strtoul(av[2], nullptr, 10) : 2000;
+    if (numVoices == 0 || numVoices > THREAD_POOL_MAX_TASKS) {
+        std::cout << "Usage : threads [voices] [workers] [requests]" << std::endl;
+        return 1;
+    }
+
+    BenchVoices voices;
+    voices.runs = std::vector<std::atomic<uint32_t>>(numVoices);
+    voices.out.resize((size_t)numVoices * BENCH_BLOCK_FRAMES);
+    voices.partials = 16;
+    benchVoices = &voices;
+    clap_plugin_thread_pool pluginPool = { bench_voice_exec };
+
+    std::cout << numVoices << " voices of " << BENCH_BLOCK_FRAMES << " frames, " << requests << " requests, "
+              << std::thread::hardware_concurrency() << " cores" << std::endl;
+    double single = 0;
+    for (uint32_t numWorkers = 0; numWorkers <= maxWorkers; numWorkers = numWorkers ? numWorkers * 2 : 1) {
+        for (auto& runs : voices.runs) {
+            runs.store(0);
+        }
+        std::vector<double> us;
+        us.reserve(requests);
+        if (numWorkers == 0) {
+            for (uint32_t i = 0; i < requests; i++) {
+                auto start = BenchClock::now();
+                for (uint32_t task = 0; task < numVoices; task++) {
+                    bench_voice_exec(nullptr, task);
+                }
+                us.push_back(elapsed_us(start));
+            }
+        } else {
+            ClapHostThreadPool pool;
+            pool.start(numWorkers);
+            for (uint32_t i = 0; i < requests; i++) {
+                auto start = BenchClock::now();
+                pool.exec(nullptr, &pluginPool, numVoices);
+                us.push_back(elapsed_us(start));
+            }
+            pool.stop();
+        }
+        for (auto& runs : voices.runs) {
+            if (runs.load() != requests) {
+                std::cerr << "a task ran " << runs.load() << " times in " << requests << " requests" << std::endl;
+                return 1;
+            }
+        }
+
+        std::sort(us.begin(), us.end());
+        double mean = 0;
+        for (double value : us) {
+            mean += value / us.size();
+        }
+        if (numWorkers == 0) {
+            single = mean;
+        }
+        std::cout << "  " << numWorkers << " workers: " << mean << " us mean, " << us[us.size() * 99 / 100]
+                  << " us p99, " << us.back() << " us worst, speed-up " << single / mean << std::endl;
+    }
+    return 0;
+}
+
+// Polyphonic instruments sharing the pool: one heavy, the others near idle with two voices.
+// Every instance may use the whole pool, against schedule_clap_instance() on each service tick
+// from their voice info and cost; halfway the heavy one drops most of its voices.
+static int bench_poly(int ac, char** av) {
+    if (ac < 1) {
+        std::cout << "Usage : poly <clap-bench-plugin path> [instances] [heavy voices] [partials] [workers] [blocks]" << std::endl;
+        return 1;
+    }
+    uint32_t count = ac > 1 ? (uint32_t)strtoul(av[1], nullptr, 10) : 8;
+    uint32_t heavyVoices = ac > 2 ? (uint32_t)strtoul(av[2], nullptr, 10) : 64;
+    uint32_t partials = ac > 3 ? (uint32_t)strtoul(av[3], nullptr, 10) : 64;
+    uint32_t numWorkers = ac > 4 ? (uint32_t)strtoul(av[4], nullptr, 10) : 3;
+    uint32_t blocks = ac > 5 ? (uint32_t)strtoul(av[5], nullptr, 10) : 600;
+    const uint32_t tick = 16;   // blocks between two services of the main thread
+    const uint32_t lightVoices = 2;
+    uint32_t droppedVoices = heavyVoices / 8 > 1 ? heavyVoices / 8 : 2;
+
+    use_clap_port_layout(0, 2);
+    ClapHostThreadPool pool;
+    pool.start(numWorkers);
+    use_clap_thread_pool(&pool);
+    BenchBlock block;
+
+    auto print = [&](const char* when, ClapHostInstance* instance) {
+        std::cout << "    " << when << ": " << instance->voiceCount << " voices, cost "
+                  << instance->blockCost.load() / 1000 << " us, predicted " << instance->predictedCost / 1000
+                  << " us, workers " << std::min(instance->poolWorkers.load(), pool.workerCount()) << " / "
+                  << pool.workerCount() << std::endl;
+    };
+
+    auto run = [&](bool schedule) {
+        std::vector<ClapHostInstance*> instances;
+        for (uint32_t i = 0; i < count; i++) {
+            ClapHostInstance* instance = create_clap_instance(av[0], "bench.poly");
+            if (!instance) {
+                break;
+            }
+            set_clap_param(instance, 0, i == 0 ? heavyVoices : lightVoices);
+            set_clap_param(instance, 1, partials);
+            if (!activate_clap_instance(instance, BENCH_SAMPLE_RATE, 1, BENCH_BLOCK_FRAMES)) {
+                destroy_clap_instance(instance);
+                break;
+            }
+            start_clap_processing(instance);
+            instances.push_back(instance);
+        }
+        if (instances.size() < 2) {
+            return;
+        }
+
+        std::vector<double> us;
+        us.reserve(blocks);
+        std::vector<double> light;
+        light.reserve(blocks);
+        uint64_t predictedAfterDrop = 0;
+        for (uint32_t b = 0; b < blocks; b++) {
+            if (b % tick == 0) {
+                for (ClapHostInstance* instance : instances) {
+                    if (instance->callbackRequested.exchange(false)) {
+                        instance->plugin->on_main_thread(instance->plugin);
+                    }
+                    if (schedule) {
+                        schedule_clap_instance(instance, pool.workerCount());
+                    }
+                }
+                if (b == blocks / 2 / tick * tick + tick) {
+                    predictedAfterDrop = instances[0]->predictedCost;
+                }
+            }
+            if (b == blocks / 2 / tick * tick) {
+                if (schedule) {
+                    print("heavy, before the drop", instances[0]);
+                    print("light", instances[1]);
+                }
+                set_clap_param(instances[0], 0, droppedVoices);
+            }
+
+            auto start = BenchClock::now();
+            block.process(instances[0]);
+            us.push_back(elapsed_us(start));
+            start = BenchClock::now();
+            for (uint32_t i = 1; i < instances.size(); i++) {
+                block.process(instances[i]);
+            }
+            light.push_back(elapsed_us(start));
+        }
+        report(schedule ? "heavy instance, scheduled" : "heavy instance, whole pool", us);
+        report(schedule ? "light instances, scheduled" : "light instances, whole pool", light);
+        if (schedule) {
+            std::cout << "    heavy, first prediction after the drop to " << droppedVoices << " voices: "
+                      << predictedAfterDrop / 1000 << " us" << std::endl;
+            print("heavy, at the end", instances[0]);
+        }
+
+        for (ClapHostInstance* instance : instances) {
+            stop_clap_processing(instance);
+            destroy_clap_instance(instance);
+        }
+    };
+
+    std::cout << count << " instruments of " << partials << " partials per voice, one with " << heavyVoices
+              << " voices, the others with " << lightVoices << ", " << numWorkers << " workers on "
+              << std::thread::hardware_concurrency() << " cores, " << blocks << " blocks of "
+              << BENCH_BLOCK_FRAMES << " frames" << std::endl;
+    run(false);
+    run(true);
+    use_clap_thread_pool(nullptr);
+    pool.stop();
+    return 0;
+}
+
+// Lookups of a tuning task, and its time per lookup in each block
+#define BENCH_TUNING_LOOKUPS 4096
+
+struct BenchTuning {
+    const clap_host_tuning* ext;
+    clap_host host;
+    clap_id tuningId;
+    std::vector<double> ns;         // per task
+    double sink;
+};
+
+static BenchTuning* benchTuning = nullptr;
+
+static void CLAP_ABI bench_tuning_exec(const clap_plugin*, uint32_t task) {
+    BenchTuning* tuning = benchTuning;
+    double sum = 0;
+    auto start = BenchClock::now();
+    for (uint32_t i = 0; i < BENCH_TUNING_LOOKUPS; i++) {
+        sum += tuning->ext->get_relative(&tuning->host, tuning->tuningId, -1, (int32_t)(i % TUNING_KEYS),
+                                         i % BENCH_BLOCK_FRAMES);
+    }
+    tuning->ns[task] = elapsed_us(start) * 1000 / BENCH_TUNING_LOOKUPS;
+    tuning->sink += sum;
+}
+
+// get_relative() from 1 .. N of a plugin's audio threads at once, while the main thread keeps
+// retuning every block; each reader is a thread pool task of the block, as a plugin would run it
+static int bench_tuning(int ac, char** av) {
+    uint32_t maxReaders = ac > 0 ? (uint32_t)strtoul(av[0], nullptr, 10) : 16;
+    uint32_t blocks = ac > 1 ? (uint32_t)strtoul(av[1], nullptr, 10) : 2000;
+    if (maxReaders == 0 || blocks == 0) {
+        std::cout << "Usage : tuning [readers] [blocks]" << std::endl;
+        return 1;
+    }
+
+    ClapHostTuning tuning;
+    double relative[TUNING_KEYS] = {};
+    BenchTuning context = {};
+    context.ext = static_cast<const clap_host_tuning*>(clap_host_extension(CLAP_EXT_TUNING));
+    context.tuningId = tuning.add("bench", relative, true);
+    benchTuning = &context;
+    use_clap_tuning(&tuning);
+    clap_plugin_thread_pool pluginPool = { bench_tuning_exec };
+
+    std::cout << "get_relative() over " << blocks << " blocks of " << BENCH_BLOCK_FRAMES << " frames, "
+              << std::thread::hardware_concurrency() << " cores" << std::endl;
+    for (uint32_t readers = 1; readers <= maxReaders; readers *= 2) {
+        context.ns.assign(readers, 0);
+        ClapHostThreadPool pool;
+        if (readers > 1) {
+            pool.start(readers - 1);
+        }
+
+        std::atomic<uint32_t> played{ 0 };
+        std::atomic<uint32_t> retuned{ 0 };
+        std::vector<double> ns;
+        ns.reserve((size_t)blocks * readers);
+        std::thread audio([&]() {
+            mark_clap_audio_thread(true);
+            for (uint32_t block = 0; block < blocks; block++) {
+                // Like a device, wait for the main thread to get its turn between blocks
+                while (retuned.load() < block) {
+                    std::this_thread::yield();
+                }
+                tuning.process((int64_t)block * BENCH_BLOCK_FRAMES, BENCH_BLOCK_FRAMES);
+                if (readers > 1) {
+                    pool.exec(nullptr, &pluginPool, readers);
+                }
+                else {
+                    bench_tuning_exec(nullptr, 0);
+                }
+                ns.insert(ns.end(), context.ns.begin(), context.ns.end());
+                played++;
+            }
+            mark_clap_audio_thread(false);
+        });
+
+        // The main thread retunes once a block, every block switching to a new pool
+        uint32_t retunes = 0;
+        for (uint32_t seen = 0; seen < blocks;) {
+            if (played.load() == seen) {
+                std::this_thread::yield();
+                continue;
+            }
+            seen = played.load();
+            relative[retunes % TUNING_KEYS] += 0.01;
+            retunes += tuning.retune(context.tuningId, relative) ? 1 : 0;
+            tuning.service(nullptr);
+            retuned = seen;
+        }
+        audio.join();
+        pool.stop();
+
+        std::sort(ns.begin(), ns.end());
+        double mean = 0;
+        for (double value : ns) {
+            mean += value / ns.size();
+        }
+        std::cout << "  " << readers << " readers: " << mean << " ns mean, " << ns[ns.size() * 99 / 100]
+                  << " ns p99, " << ns.back() << " ns worst per lookup, " << retunes << " retunes" << std::endl;
+    }
+    use_clap_tuning(nullptr);
+    return 0;
+}
+
+// Value of a lane at a song sample, straight from its points placed at sample positions
+static double bench_curve(const std::vector<ClapHostAutomationPoint>& points, const std::vector<int64_t>& at, int64_t song) {
+    if (song < at[0]) {
+        return points[0].value;
+    }
+    size_t k = 0;
+    while (k + 1 < points.size() && at[k + 1] <= song) {
+        k++;
+    }
+    if (k + 1 == points.size() || points[k].hold) {
+        return points[k].value;
+    }
+    return points[k].value + (points[k + 1].value - points[k].value) * (double)(song - at[k]) / (double)(at[k + 1] - at[k]);
+}
+
+// Playing random lanes of 32 points, ramps and holds, along the transport: the events thinning
+// leaves, the time process() takes per block, and how far the first lane strays from its curve
+static int bench_automation(int ac, char** av) {
+    uint32_t targets = ac > 0 ? (uint32_t)strtoul(av[0], nullptr, 10) : 100;
+    uint32_t perTarget = ac > 1 ? (uint32_t)strtoul(av[1], nullptr, 10) : 10;
+    uint32_t seconds = ac > 2 ? (uint32_t)strtoul(av[2], nullptr, 10) : 60;
+    if (targets == 0 || perTarget == 0 || (uint64_t)targets * perTarget > AUTOMATION_MAX_LANES) {
+        std::cout << "Usage : automation [targets] [lanes per target] [seconds]" << std::endl;
+        return 1;
+    }
+
+    ClapHostTransport transport;
+    transport.prepare(BENCH_SAMPLE_RATE);
+    ClapHostAutomation automation(targets);
+    automation.prepare(BENCH_SAMPLE_RATE);
+    std::mt19937 random(1);
+    std::uniform_real_distribution<double> uniform(0, 1);
+    std::vector<ClapHostAutomationPoint> first;
+    for (uint32_t target = 0; target < targets; target++) {
+        for (clap_id paramId = 0; paramId < perTarget; paramId++) {
+            std::vector<ClapHostAutomationPoint> points;
+            double beat = 0;
+            for (int i = 0; i < 32; i++) {
+                points.push_back({ beat, uniform(random), uniform(random) < 0.2 });
+                beat += 0.5 + 6 * uniform(random);
+            }
+            if (first.empty()) {
+                first = points;
+            }
+            automation.setLane(target, paramId, std::move(points), AUTOMATION_TOLERANCE);
+        }
+    }
+    automation.service(*transport.tempoMap());
+    transport.requestPlay(true);
+
+    std::vector<int64_t> at;
+    for (const ClapHostAutomationPoint& point : first) {
+        at.push_back((int64_t)std::ceil(transport.tempoMap()->secondsAt(point.beat) * BENCH_SAMPLE_RATE));
+    }
+    double held = NAN;
+    double maxError = 0;
+    int64_t song = 0;
+    uint64_t events = 0;
+    std::vector<double> us;
+    uint64_t total = (uint64_t)seconds * BENCH_SAMPLE_RATE;
+    for (uint64_t done = 0; done < total; done += BENCH_BLOCK_FRAMES) {
+        transport.process(BENCH_BLOCK_FRAMES);
+        auto start = BenchClock::now();
+        automation.process(transport);
+        us.push_back(elapsed_us(start));
+        for (uint32_t target = 0; target < targets; target++) {
+            events += automation.eventCount(target);
+        }
+
+        // The value the plugin holds at each frame, against the curve
+        const clap_input_events* in = automation.events(0);
+        uint32_t count = in->size(in);
+        uint32_t e = 0;
+        for (uint32_t frame = 0; frame < BENCH_BLOCK_FRAMES; frame++, song++) {
+            for (; e < count && in->get(in, e)->time == frame; e++) {
+                auto* value = reinterpret_cast<const clap_event_param_value*>(in->get(in, e));
+                if (value->param_id == 0) {
+                    held = value->value;
+                }
+            }
+            if (transport.playing()) {
+                maxError = std::max(maxError, std::fabs(held - bench_curve(first, at, song)));
+            }
+        }
+        transport.service();
+        automation.service(*transport.tempoMap());
+    }
+
+    uint64_t lanes = (uint64_t)targets * perTarget;
+    std::cout << lanes << " lanes over " << targets << " targets, " << seconds << " s of song" << std::endl;
+    report("process() per block", us);
+    std::cout << "  " << events << " events, " << events / (double)seconds << " per second, "
+              << 100.0 * events / ((double)total * lanes) << " % of one per lane and sample" << std::endl;
+    std::cout << "  largest error of the first lane: " << maxError << ", tolerance " << AUTOMATION_TOLERANCE << std::endl;
+    return 0;
+}
+
+// Keeps what a benchmark reads from being optimized away
+static volatile uint32_t benchSink;
+
+// MIDI 2.0 note on and off packets on 16 channels, as the big-endian words of a stream
+static bool write_ump_stream(const char* path, uint32_t packets) {
+    FILE* f = fopen(path, "wb");
+    if (!f) {
+        std::cerr << "Failed to write the UMP stream: " << path << std::endl;
+        return false;
+    }
+    for (uint32_t i = 0; i < packets; i++) {
+        uint32_t words[2] = { ((i & 1) ? 0x40803c00u : 0x40903c00u) | (i % 16) << 16, 0x80000000u };
+        for (uint32_t word : words) {
+            uint8_t bytes[4] = { (uint8_t)(word >> 24), (uint8_t)(word >> 16), (uint8_t)(word >> 8), (uint8_t)word };
+            fwrite(bytes, 1, 4, f);
+        }
+    }
+    return fclose(f) == 0;
+}
+
+// The cost of a UMP packet: receiving and decoding it into the ring, then per dialect taking it
+// in a block and handing it through the host's block list and the instance's list to the plugin,
+// copied into each list or referred to
+static int bench_ump(int ac, char** av) {
+    if (ac < 1) {
+        std::cout << "Usage : ump <scratch stream path> [packets]" << std::endl;
+        return 1;
+    }
+    uint32_t packets = ac > 1 ? (uint32_t)strtoul(av[1], nullptr, 10) : 2000000;
+    if (packets < 2 * UMP_RING_PACKETS || !write_ump_stream(av[0], packets)) {
+        return 1;
+    }
+    std::cout << packets << " packets of 64 bits, " << std::thread::hardware_concurrency() << " cores" << std::endl;
+
+    // The receive thread's CPU time is the process's, less the audio side's
+    {
+        ClapHostUmpInput input;
+        input.prepare(BENCH_SAMPLE_RATE);
+        input.setDialects(CLAP_NOTE_DIALECT_MIDI2, CLAP_NOTE_DIALECT_MIDI2);
+        uint64_t consumed = 0;
+        double audio = 0;
+        std::clock_t cpu = std::clock();
+        input.open(av[0]);
+        while (consumed < packets) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            auto start = BenchClock::now();
+            for (int k = 0; k < 4; k++) {
+                input.process(BENCH_BLOCK_FRAMES);
+                consumed += input.events()->size(input.events());
+            }
+            audio += elapsed_us(start);
+        }
+        double total = (std::clock() - cpu) * 1e6 / CLOCKS_PER_SEC;
+        input.close();
+        std::cout << "  receiving: " << (total - audio) * 1000 / packets << " ns of CPU per packet" << std::endl;
+    }
+
+    const uint32_t dialects[] = { CLAP_NOTE_DIALECT_MIDI2, CLAP_NOTE_DIALECT_MIDI, CLAP_NOTE_DIALECT_CLAP };
+    const char* names[] = { "MIDI 2.0", "MIDI 1.0", "CLAP notes" };
+    for (uint32_t d = 0; d < 3; d++) {
+        for (bool referring : { false, true }) {
+            ClapHostUmpInput input;
+            input.prepare(BENCH_SAMPLE_RATE);
+            input.setDialects(dialects[d], dialects[d]);
+            ClapHostInputEvents block;
+            ClapHostInputEvents instance;
+            block.reserve(UMP_MAX_EVENTS, UMP_EVENT_BYTES);
+            // The host's instance list only copies parameter changes, this one may copy the packets too
+            instance.reserve(CLAP_INSTANCE_MAX_EVENTS, CLAP_INSTANCE_EVENT_BYTES + UMP_EVENT_BYTES);
+            input.open(av[0]);
+
+            double processUs = 0;
+            double handUs = 0;
+            uint64_t taken = 0;
+            uint64_t inPlace = 0;
+            uint32_t sum = 0;
+            for (int round = 0; round < 200; round++) {
+                // A full ring, so every block takes as many packets as it can
+                while (input.received() - taken < UMP_RING_PACKETS - UMP_MAX_EVENTS) {
+                    std::this_thread::yield();
+                }
+                std::this_thread::sleep_for(std::chrono::microseconds(100));
+                for (int k = 0; k < 3; k++) {
+                    auto start = BenchClock::now();
+                    input.process(BENCH_BLOCK_FRAMES);
+                    processUs += elapsed_us(start);
+
+                    start = BenchClock::now();
+                    const clap_input_events* events = input.events();
+                    block.clear();
+                    block.merge({ events }, referring);
+                    instance.clear();
+                    instance.append(block.list(), referring);
+                    const clap_input_events* plugin = instance.list();
+                    for (uint32_t i = 0; i < plugin->size(plugin); i++) {
+                        sum += plugin->get(plugin, i)->time;
+                    }
+                    handUs += elapsed_us(start);
+
+                    uint32_t count = events->size(events);
+                    for (uint32_t i = 0; i < count && i < plugin->size(plugin); i++) {
+                        inPlace += plugin->get(plugin, i) == events->get(events, i);
+                    }
+                    taken += count;
+                }
+            }
+            input.close();
+            std::cout << "  " << names[d] << (referring ? ", referred: " : ", copied: ") << processUs * 1000 / taken
+                      << " ns per packet to take it, " << handUs * 1000 / taken << " ns to hand it to the plugin, "
+                      << 100.0 * inPlace / taken << " % read in place" << std::endl;
+            benchSink = sum;
+        }
+    }
+    return 0;
+}
+
+// Hot swaps while a simulated device thread pulls blocks in real time: the time of each block
+// against its period, the allocations made on the device thread, and the largest step between
+// two output samples of a sine going through the swaps
+static int bench_swap(int ac, char** av) {
+    if (ac < 1) {
+        std::cout << "Usage : swap <plugin path> [swaps] [blocks between swaps]" << std::endl;
+        return 1;
+    }
+    uint32_t swaps = ac > 1 ? (uint32_t)strtoul(av[1], nullptr, 10) : 50;
+    uint32_t spacing = ac > 2 ? std::max((uint32_t)strtoul(av[2], nullptr, 10), 1u) : 20;
+    const uint32_t fadeFrames = BENCH_BLOCK_FRAMES * 4;
+
+    use_clap_port_layout(2, 2);
+    ClapHostSwap swap;
+    swap.prepare(1, 2, BENCH_BLOCK_FRAMES, fadeFrames, BENCH_SAMPLE_RATE);
+    auto make = [&]() {
+        ClapHostInstance* instance = create_clap_instance(av[0]);
+        if (instance && !activate_clap_instance(instance, BENCH_SAMPLE_RATE, 1, BENCH_BLOCK_FRAMES)) {
+            destroy_clap_instance(instance);
+            instance = nullptr;
+        }
+        return instance;
+    };
+    ClapHostInstance* first = make();
+    if (!first) {
+        return 1;
+    }
+    swap.stage(first);
+
+    std::atomic<bool> running{ true };
+    std::atomic<uint64_t> blocks{ 0 };
+    std::vector<double> blockUs;
+    blockUs.reserve((size_t)(swaps + 2) * spacing * 4);
+    uint32_t overruns = 0;
+    float largestStep = 0;
+    std::thread device([&]() {
+        BenchBlock block;
+        const double period = 1e6 * BENCH_BLOCK_FRAMES / BENCH_SAMPLE_RATE;
+        const double step = 2 * M_PI * 441 / BENCH_SAMPLE_RATE;
+        double phase = 0;
+        float last = 0;
+        auto deadline = BenchClock::now();
+        benchCountAllocations = true;
+        while (running.load(std::memory_order_acquire)) {
+            for (uint32_t i = 0; i < BENCH_BLOCK_FRAMES; i++, phase += step) {
+                block.silence[i] = block.silence[BENCH_BLOCK_FRAMES + i] = 0.5f * (float)sin(phase);
+            }
+            clap_process process = {};
+            process.frames_count = BENCH_BLOCK_FRAMES;
+            process.steady_time = -1;
+            process.audio_inputs = &block.input;
+            process.audio_outputs = &block.output;
+            process.audio_inputs_count = 1;
+            process.audio_outputs_count = 1;
+            process.in_events = block.events.list();
+            auto start = BenchClock::now();
+            swap.process(&process);
+            double us = elapsed_us(start);
+            if (blockUs.size() < blockUs.capacity()) {
+                blockUs.push_back(us);
+            }
+            overruns += us > period;
+            for (uint32_t i = 0; i < BENCH_BLOCK_FRAMES; i++) {
+                largestStep = std::max(largestStep, std::fabs(block.outputs[0][i] - last));
+                last = block.outputs[0][i];
+            }
+            blocks.fetch_add(1, std::memory_order_release);
+            deadline += std::chrono::microseconds((int64_t)period);
+            std::this_thread::sleep_until(deadline);
+        }
+        swap.stop();
+        benchCountAllocations = false;
+    });
+
+    uint32_t done = 0;
+    for (; done < swaps; done++) {
+        uint64_t until = blocks.load(std::memory_order_acquire) + spacing;
+        ClapHostInstance* next = make();
+        if (!next) {
+            break;
+        }
+        while (!swap.stage(next)) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        while (blocks.load(std::memory_order_acquire) < until) {
+            destroy_clap_instance(swap.collect());
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        destroy_clap_instance(swap.collect());
+    }
+    running.store(false, std::memory_order_release);
+    device.join();
+    destroy_clap_instance(swap.collect());
+    while (ClapHostInstance* instance = swap.detach()) {
+        destroy_clap_instance(instance);
+    }
+
+    std::cout << "Hot swaps of " << av[0] << ", " << BENCH_BLOCK_FRAMES << " frames per block, "
+              << fadeFrames << " frames of crossfade" << std::endl;
+    report("device block", blockUs);
+    std::cout << "  " << done << " swaps over " << blocks.load() << " blocks, " << overruns
+              << " blocks over their period, " << benchAllocations.load() << " allocations on the device thread"
+              << std::endl;
+    std::cout << "  largest step between output samples: " << largestStep << " (the sine alone: "
+              << 0.5 * 2 * M_PI * 441 / BENCH_SAMPLE_RATE << ")" << std::endl;
+    return 0;
+}
+
+// Delay compensation: blocks through delay lines of random delays, against the bare block, and
+// the memory of the lines' arena
+static int bench_delay(int ac, char** av) {
+    uint32_t lineCount = ac > 0 ? std::max((uint32_t)strtoul(av[0], nullptr, 10), 1u) : 8;
+    uint32_t maxDelay = ac > 1 ? (uint32_t)strtoul(av[1], nullptr, 10) : BENCH_SAMPLE_RATE;
+    uint32_t blocks = ac > 2 ? (uint32_t)strtoul(av[2], nullptr, 10) : 10000;
+
+    ClapHostDelay delays;
+    delays.prepare(lineCount, maxDelay, BENCH_BLOCK_FRAMES);
+    std::mt19937 random(1);
+    for (uint32_t line = 0; line < lineCount; line++) {
+        delays.setDelay(line, maxDelay ? random() % (maxDelay + 1) : 0);
+    }
+    std::vector<float> data((size_t)lineCount * BENCH_BLOCK_FRAMES);
+    for (float& sample : data) {
+        sample = (float)(random() % 2001) / 1000 - 1;
+    }
+
+    std::vector<double> compensated;
+    compensated.reserve(blocks);
+    for (uint32_t b = 0; b < blocks; b++) {
+        auto start = BenchClock::now();
+        for (uint32_t line = 0; line < lineCount; line++) {
+            delays.process(line, data.data() + (size_t)line * BENCH_BLOCK_FRAMES, BENCH_BLOCK_FRAMES);
+        }
+        compensated.push_back(elapsed_us(start));
+    }
+    benchSink = (uint32_t)data[0];
+
+    // What the block costs without the lines: touching its samples once
+    std::vector<float> copy(data.size());
+    std::vector<double> bare;
+    bare.reserve(blocks);
+    for (uint32_t b = 0; b < blocks; b++) {
+        auto start = BenchClock::now();
+        memcpy(copy.data(), data.data(), sizeof(float) * data.size());
+        bare.push_back(elapsed_us(start));
+        data[b % data.size()] = copy[(b + 1) % copy.size()];
+    }
+
+    std::cout << lineCount << " delay lines of up to " << maxDelay << " samples, " << BENCH_BLOCK_FRAMES
+              << " frames per block" << std::endl;
+    report("compensated block", compensated);
+    report("copying the block", bare);
+    std::cout << "  arena: " << delays.memoryUsed() / 1024 << " KiB, "
+              << 1e6 * BENCH_BLOCK_FRAMES / BENCH_SAMPLE_RATE << " us per block at "
+              << BENCH_SAMPLE_RATE << " Hz" << std::endl;
+    return 0;
+}
+
+// A session of mostly silent effects: every instance gets one loud block, then only the first
+// few keep getting sound. Calling every plugin each block, as without the quiet check, against
+// process_clap_instance(), which puts an instance to sleep once its tail has rendered
+static int bench_idle(int ac, char** av) {
+    if (ac < 1) {
+        std::cout << "Usage : idle <clap-bench-plugin path> [instances] [loud instances] [blocks]" << std::endl;
+        return 1;
+    }
+    uint32_t count = ac > 1 ? (uint32_t)strtoul(av[1], nullptr, 10) : 100;
+    uint32_t loud = ac > 2 ? (uint32_t)strtoul(av[2], nullptr, 10) : 5;
+    uint32_t blocks = ac > 3 ? (uint32_t)strtoul(av[3], nullptr, 10) : 2000;
+
+    use_clap_port_layout(2, 2);
+    std::vector<ClapHostInstance*> instances;
+    for (uint32_t i = 0; i < count; i++) {
+        ClapHostInstance* instance = create_clap_instance(av[0], "bench.effect");
+        if (!instance || !activate_clap_instance(instance, BENCH_SAMPLE_RATE, 1, BENCH_BLOCK_FRAMES)) {
+            destroy_clap_instance(instance);
+            break;
+        }
+        instances.push_back(instance);
+    }
+
+    BenchBlock block;
+    std::vector<float> noise(2 * BENCH_BLOCK_FRAMES);
+    std::mt19937 random(1);
+    for (float& sample : noise) {
+        sample = (float)(random() % 2001) / 4000 - 0.25f;
+    }
+    float* noiseChannels[2] = { noise.data(), noise.data() + BENCH_BLOCK_FRAMES };
+    clap_audio_buffer noiseInput = block.input;
+    noiseInput.data32 = noiseChannels;
+
+    auto run = [&](bool host, uint32_t& awake) {
+        std::vector<double> us;
+        us.reserve(blocks);
+        for (uint32_t b = 0; b < blocks; b++) {
+            awake = 0;
+            auto start = BenchClock::now();
+            for (uint32_t i = 0; i < instances.size(); i++) {
+                clap_process process = {};
+                process.frames_count = BENCH_BLOCK_FRAMES;
+                process.steady_time = -1;
+                process.audio_inputs = (b == 0 || i < loud) ? &noiseInput : &block.input;
+                process.audio_outputs = &block.output;
+                process.audio_inputs_count = 1;
+                process.audio_outputs_count = 1;
+                process.in_events = block.events.list();
+                if (host) {
+                    process_clap_instance(instances[i], &process);
+                    awake += instances[i]->processing;
+                }
+                else {
+                    instances[i]->plugin->process(instances[i]->plugin, &process);
+                    awake++;
+                }
+            }
+            us.push_back(elapsed_us(start));
+        }
+        return us;
+    };
+
+    uint32_t awakeAlways = 0;
+    for (ClapHostInstance* instance : instances) {
+        start_clap_processing(instance);
+    }
+    std::vector<double> always = run(false, awakeAlways);
+    for (ClapHostInstance* instance : instances) {
+        stop_clap_processing(instance);
+        instance->plugin->reset(instance->plugin);
+    }
+    uint32_t awakeHost = 0;
+    std::vector<double> hosted = run(true, awakeHost);
+
+    // The quiet check alone, on a silent block
+    std::vector<double> scans;
+    uint32_t quiet = 0;
+    for (uint32_t b = 0; b < blocks; b++) {
+        auto start = BenchClock::now();
+        quiet += clap_audio_is_quiet(&block.input, 1, BENCH_BLOCK_FRAMES);
+        scans.push_back(elapsed_us(start));
+    }
+    benchSink = quiet;
+
+    for (ClapHostInstance* instance : instances) {
+        stop_clap_processing(instance);
+        destroy_clap_instance(instance);
+    }
+
+    std::cout << instances.size() << " effects, " << std::min(loud, (uint32_t)instances.size())
+              << " with sound, " << blocks << " blocks of " << BENCH_BLOCK_FRAMES << " frames" << std::endl;
+    report("every plugin called", always);
+    report("quiet instances asleep", hosted);
+    std::cout << "  awake at the end: " << awakeAlways << " against " << awakeHost << std::endl;
+    report("quiet check of a stereo block", scans);
+    return 0;
+}
+
+// A session of filters on a mono and on a stereo device: each instance left in the plugin's
+// default 5.1 layout, as the host ran it before it chose layouts, against the layout
+// choose_clap_ports() picks for the device
+static int bench_layout(int ac, char** av) {
+    if (ac < 1) {
+        std::cout << "Usage : layout <clap-bench-plugin path> [instances] [blocks]" << std::endl;
+        return 1;
+    }
+    uint32_t count = ac > 1 ? (uint32_t)strtoul(av[1], nullptr, 10) : 32;
+    uint32_t blocks = ac > 2 ? (uint32_t)strtoul(av[2], nullptr, 10) : 2000;
+    const uint32_t widest = 6;
+
+    // Wide enough for any layout of the plugin; each port reads the channels it declares
+    std::vector<float> noise(widest * BENCH_BLOCK_FRAMES);
+    std::vector<float> rendered(widest * BENCH_BLOCK_FRAMES);
+    std::mt19937 random(1);
+    for (float& sample : noise) {
+        sample = (float)(random() % 2001) / 4000 - 0.25f;
+    }
+    float* inputs[widest];
+    float* outputs[widest];
+    for (uint32_t ch = 0; ch < widest; ch++) {
+        inputs[ch] = noise.data() + ch * BENCH_BLOCK_FRAMES;
+        outputs[ch] = rendered.data() + ch * BENCH_BLOCK_FRAMES;
+    }
+    ClapHostInputEvents events;
+
+    auto run = [&](uint32_t deviceChannels, bool choose, uint32_t& channels) {
+        use_clap_port_layout(deviceChannels, deviceChannels);
+        std::vector<ClapHostInstance*> instances;
+        for (uint32_t i = 0; i < count; i++) {
+            ClapHostInstance* instance = create_clap_instance(av[0], "bench.layout");
+            if (!instance) {
+                break;
+            }
+            instance->portsChosen = !choose;
+            if (!activate_clap_instance(instance, BENCH_SAMPLE_RATE, 1, BENCH_BLOCK_FRAMES)) {
+                destroy_clap_instance(instance);
+                break;
+            }
+            start_clap_processing(instance);
+            instances.push_back(instance);
+        }
+
+        channels = 0;
+        auto* ports = instances.empty() ? nullptr : static_cast<const clap_plugin_audio_ports*>(
+            instances[0]->plugin->get_extension(instances[0]->plugin, CLAP_EXT_AUDIO_PORTS));
+        clap_audio_port_info info = {};
+        if (ports && ports->get(instances[0]->plugin, 0, true, &info)) {
+            channels = info.channel_count;
+        }
+
+        clap_audio_buffer input = {};
+        input.data32 = inputs;
+        input.channel_count = channels;
+        clap_audio_buffer output = {};
+        output.data32 = outputs;
+        output.channel_count = channels;
+
+        std::vector<double> us;
+        us.reserve(blocks);
+        for (uint32_t b = 0; b < blocks; b++) {
+            auto start = BenchClock::now();
+            for (ClapHostInstance* instance : instances) {
+                clap_process process = {};
+                process.frames_count = BENCH_BLOCK_FRAMES;
+                process.steady_time = -1;
+                process.audio_inputs = &input;
+                process.audio_outputs = &output;
+                process.audio_inputs_count = 1;
+                process.audio_outputs_count = 1;
+                process.in_events = events.list();
+                process_clap_instance(instance, &process);
+            }
+            us.push_back(elapsed_us(start));
+        }
+        benchSink = (uint32_t)(rendered[0] * 1000);
+
+        for (ClapHostInstance* instance : instances) {
+            stop_clap_processing(instance);
+            destroy_clap_instance(instance);
+        }
+        return us;
+    };
+
+    auto mean = [](const std::vector<double>& us) {
+        double total = 0;
+        for (double value : us) {
+            total += value;
+        }
+        return us.empty() ? 0 : total / us.size();
+    };
+
+    std::cout << count << " filters, " << blocks << " blocks of " << BENCH_BLOCK_FRAMES << " frames" << std::endl;
+    uint32_t defaultChannels = 0;
+    std::vector<double> kept = run(2, false, defaultChannels);
+    report("default layout", kept);
+    std::cout << "    channels per port: " << defaultChannels << std::endl;
+    for (uint32_t device : { 2u, 1u }) {
+        uint32_t channels = 0;
+        std::vector<double> chosen = run(device, true, channels);
+        std::string name = device == 1 ? "chosen for a mono device" : "chosen for a stereo device";
+        report(name.c_str(), chosen);
+        std::cout << "    channels per port: " << channels << ", "
+                  << 100 * (1 - mean(chosen) / mean(kept)) << "% less time than the default" << std::endl;
+    }
+    return 0;
+}
+
+// A multi-out instrument wired to the device's two outputs: calling it with a buffer for every
+// output, all of them active as a host leaves them, against process_clap_instance() after the
+// host turned the unconnected outputs off and pointed them at its shared sink
+static int bench_multiout(int ac, char** av) {
+    if (ac < 1) {
+        std::cout << "Usage : multiout <clap-bench-plugin path> [instances] [blocks]" << std::endl;
+        return 1;
+    }
+    uint32_t count = ac > 1 ? (uint32_t)strtoul(av[1], nullptr, 10) : 8;
+    uint32_t blocks = ac > 2 ? (uint32_t)strtoul(av[2], nullptr, 10) : 2000;
+
+    use_clap_port_layout(0, 2);
+    BenchBlock block;
+    ClapHostInstance* probe = create_clap_instance(av[0], "bench.multiout");
+    auto* ports = probe ? static_cast<const clap_plugin_audio_ports*>(
+        probe->plugin->get_extension(probe->plugin, CLAP_EXT_AUDIO_PORTS)) : nullptr;
+    uint32_t outputs = ports ? ports->count(probe->plugin, false) : 0;
+    destroy_clap_instance(probe);
+    if (outputs == 0) {
+        return 1;
+    }
+
+    // A stereo buffer per output, as a host routing every output needs
+    std::vector<float> rendered(outputs * 2 * BENCH_BLOCK_FRAMES);
+    std::vector<float*> channels(outputs * 2);
+    std::vector<clap_audio_buffer> buffers(outputs, clap_audio_buffer{});
+    for (uint32_t i = 0; i < outputs; i++) {
+        channels[2 * i] = rendered.data() + 2 * i * BENCH_BLOCK_FRAMES;
+        channels[2 * i + 1] = channels[2 * i] + BENCH_BLOCK_FRAMES;
+        buffers[i].data32 = &channels[2 * i];
+        buffers[i].channel_count = 2;
+    }
+
+    auto run = [&](bool host, double& level) {
+        std::vector<ClapHostInstance*> instances;
+        for (uint32_t i = 0; i < count; i++) {
+            ClapHostInstance* instance = create_clap_instance(av[0], "bench.multiout");
+            if (!instance) {
+                break;
+            }
+            bool activated = host ? activate_clap_instance(instance, BENCH_SAMPLE_RATE, 1, BENCH_BLOCK_FRAMES)
+                : instance->plugin->activate(instance->plugin, BENCH_SAMPLE_RATE, 1, BENCH_BLOCK_FRAMES);
+            if (!activated) {
+                destroy_clap_instance(instance);
+                break;
+            }
+            instance->active = true;
+            start_clap_processing(instance);
+            instances.push_back(instance);
+        }
+
+        std::vector<double> us;
+        us.reserve(blocks);
+        level = 0;
+        for (uint32_t b = 0; b < blocks; b++) {
+            auto start = BenchClock::now();
+            for (ClapHostInstance* instance : instances) {
+                clap_process process = {};
+                process.frames_count = BENCH_BLOCK_FRAMES;
+                process.steady_time = -1;
+                process.in_events = block.events.list();
+                if (host) {
+                    process.audio_outputs = &block.output;
+                    process.audio_outputs_count = 1;
+                    process_clap_instance(instance, &process);
+                }
+                else {
+                    process.audio_outputs = buffers.data();
+                    process.audio_outputs_count = outputs;
+                    instance->plugin->process(instance->plugin, &process);
+                }
+            }
+            us.push_back(elapsed_us(start));
+            float* left = host ? block.outputs[0] : channels[0];
+            for (uint32_t i = 0; i < BENCH_BLOCK_FRAMES; i++) {
+                level += std::fabs(left[i]);
+            }
+        }
+        level /= (double)blocks * BENCH_BLOCK_FRAMES;
+
+        for (ClapHostInstance* instance : instances) {
+            stop_clap_processing(instance);
+            destroy_clap_instance(instance);
+        }
+        return us;
+    };
+
+    std::cout << count << " instruments of " << outputs << " stereo outputs, " << blocks << " blocks of "
+              << BENCH_BLOCK_FRAMES << " frames" << std::endl;
+    double levelAll = 0;
+    double levelWired = 0;
+    report("every output active", run(false, levelAll));
+    std::cout << "    output buffers: " << rendered.size() * sizeof(float) / 1024 << " KiB, main output level "
+              << levelAll << std::endl;
+    report("2 outputs wired", run(true, levelWired));
+    std::cout << "    output buffers: " << (block.rendered.size() + BENCH_BLOCK_FRAMES) * sizeof(float) / 1024
+              << " KiB with the shared sink, main output level " << levelWired << std::endl;
+    return 0;
+}
+
+struct BenchLoop {
+    std::vector<double> lateUs;     // behind the timer's period, per dispatch
+    uint32_t periodMs = 0;
+    uint64_t timerCalls = 0;
+    uint64_t fdCalls = 0;
+};
+
+struct BenchTimer {
+    BenchLoop* loop;
+    BenchClock::time_point added;
+};
+
+static void bench_loop_timer(void* context, clap_id) {
+    auto* timer = static_cast<BenchTimer*>(context);
+    BenchLoop* loop = timer->loop;
+    if (loop->lateUs.size() < loop->lateUs.capacity()) {
+        loop->lateUs.push_back(fmod(elapsed_us(timer->added), 1000.0 * loop->periodMs));
+    }
+    loop->timerCalls++;
+}
+
+static void bench_loop_fd(void* context, int fd, clap_posix_fd_flags_t) {
+    uint64_t value;
+    ssize_t n = ::read(fd, &value, sizeof(value));
+    (void)n;
+    static_cast<BenchLoop*>(context)->fdCalls++;
+}
+
+// The main thread's event loop with thousands of plugin timers and fds: how late timers fire,
+// and the cost of one run() and of each handler it dispatches
+static int bench_loop(int ac, char** av) {
+    uint32_t timerCount = ac > 0 ? (uint32_t)strtoul(av[0], nullptr, 10) : 2000;
+    uint32_t fdCount = ac > 1 ? (uint32_t)strtoul(av[1], nullptr, 10) : 2000;
+    double seconds = ac > 2 ? atof(av[2]) : 2;
+
+    BenchLoop state;
+    state.periodMs = 100;
+    state.lateUs.reserve((size_t)(timerCount * seconds * 1000 / state.periodMs) + 1);
+    ClapHostEventLoop loop;
+    std::vector<BenchTimer> timers(timerCount);
+    std::vector<clap_id> timerIds;
+    for (BenchTimer& timer : timers) {
+        clap_id id;
+        timer = { &state, BenchClock::now() };
+        if (!loop.addTimer(state.periodMs, bench_loop_timer, &timer, &id)) {
+            break;
+        }
+        timerIds.push_back(id);
+    }
+    std::vector<int> fds;
+    for (uint32_t i = 0; i < fdCount; i++) {
+        int fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        if (fd < 0 || !loop.addFd(fd, CLAP_POSIX_FD_READ, bench_loop_fd, &state)) {
+            if (fd >= 0) {
+                ::close(fd);
+            }
+            break;
+        }
+        fds.push_back(fd);
+    }
+
+    // Each round signals a few fds, then runs the loop once: they and the due timers are served
+    std::mt19937 random(1);
+    std::vector<double> runs;
+    std::clock_t cpu = std::clock();
+    auto start = BenchClock::now();
+    uint64_t dispatched = 0;
+    while (elapsed_us(start) < seconds * 1e6) {
+        for (uint32_t i = 0; i < 8 && !fds.empty(); i++) {
+            uint64_t one = 1;
+            ssize_t n = ::write(fds[random() % fds.size()], &one, sizeof(one));
+            (void)n;
+        }
+        auto runStart = BenchClock::now();
+        dispatched += loop.run(1);
+        runs.push_back(elapsed_us(runStart));
+    }
+    double cpuMs = 1000.0 * (std::clock() - cpu) / CLOCKS_PER_SEC;
+
+    for (int fd : fds) {
+        loop.removeFd(fd, &state);
+        ::close(fd);
+    }
+    for (size_t i = 0; i < timerIds.size(); i++) {
+        loop.removeTimer(timerIds[i], &timers[i]);
+    }
+
+    std::sort(state.lateUs.begin(), state.lateUs.end());
+    std::cout << timerIds.size() << " timers of " << state.periodMs << " ms, " << fds.size() << " fds, " << seconds
+              << " s" << std::endl;
+    report("run()", runs);
+    std::cout << "  " << state.timerCalls << " timer and " << state.fdCalls << " fd handlers, "
+              << (dispatched ? 1e3 * cpuMs / dispatched : 0) << " us of CPU per handler, the writes signalling the fds included" << std::endl;
+    if (!state.lateUs.empty()) {
+        std::cout << "  timer lateness: " << state.lateUs[state.lateUs.size() / 2] << " us median, "
+                  << state.lateUs[state.lateUs.size() * 99 / 100] << " us p99" << std::endl;
+    }
+    return 0;
+}
+
+// Peak resident memory of the process in KiB, and its reset; Linux only
+static uint64_t bench_peak_kib() {
+    FILE* status = fopen("/proc/self/status", "r");
+    char line[256];
+    uint64_t peak = 0;
+    while (status && fgets(line, sizeof(line), status)) {
+        if (strncmp(line, "VmHWM:", 6) == 0) {
+            peak = strtoull(line + 6, nullptr, 10);
+        }
+    }
+    if (status) {
+        fclose(status);
+    }
+    return peak;
+}
+
+static bool bench_reset_peak() {
+    FILE* refs = fopen("/proc/self/clear_refs", "w");
+    bool reset = refs && fputs("5", refs) >= 0;
+    if (refs) {
+        fclose(refs);
+    }
+    return reset;
+}
+
+// A large plugin state written in mixed small and large chunks: through ClapHostStateWriter and
+// read back through ClapHostStateReader, against collecting it in memory first as a byte vector
+static int bench_state(int ac, char** av) {
+    if (ac < 1) {
+        std::cout << "Usage : state <scratch state path> [MiB]" << std::endl;
+        return 1;
+    }
+    uint64_t size = (ac > 1 ? strtoull(av[1], nullptr, 10) : 256) << 20;
+
+    // The "plugin" repeats a pattern, so its own memory stays small
+    std::vector<char> pattern(2 << 20);
+    for (size_t i = 0; i < pattern.size(); i++) {
+        pattern[i] = (char)(i * 31 + (i >> 12));
+    }
+    auto produce = [&](auto&& write) {
+        uint64_t done = 0;
+        for (uint32_t n = 0; done < size; n++) {
+            uint64_t chunk = std::min<uint64_t>(n % 8 == 7 ? pattern.size() : 4096, size - done);
+            write(pattern.data() + done % (pattern.size() - chunk + 1), chunk);
+            done += chunk;
+        }
+    };
+    bool peaks = bench_reset_peak();
+    uint64_t base = bench_peak_kib();
+
+    auto start = BenchClock::now();
+    ClapHostStateWriter writer(av[0]);
+    produce([&](const char* data, uint64_t chunk) { writer.write(data, chunk); });
+    if (!writer.finish()) {
+        std::cerr << "Failed to write " << av[0] << std::endl;
+        return 1;
+    }
+    double writeUs = elapsed_us(start);
+    uint64_t writePeak = bench_peak_kib() - base;
+
+    bench_reset_peak();
+    base = bench_peak_kib();
+    start = BenchClock::now();
+    uint64_t sum = 0;
+    {
+        ClapHostStateReader reader(av[0]);
+        std::vector<char> chunk(64 * 1024);
+        int64_t n;
+        while ((n = reader.read(chunk.data(), chunk.size())) > 0) {
+            sum += (uint8_t)chunk[0] + (uint8_t)chunk[(size_t)n - 1];
+        }
+    }
+    double readUs = elapsed_us(start);
+    uint64_t readPeak = bench_peak_kib() - base;
+    benchSink = (uint32_t)sum;
+
+    bench_reset_peak();
+    base = bench_peak_kib();
+    start = BenchClock::now();
+    {
+        std::vector<uint8_t> copy;
+        produce([&](const char* data, uint64_t chunk) { copy.insert(copy.end(), data, data + chunk); });
+        FILE* file = fopen(av[0], "wb");
+        bool written = file && fwrite(copy.data(), 1, copy.size(), file) == copy.size();
+        if (file) {
+            fclose(file);
+        }
+        if (!written) {
+            std::cerr << "Failed to write " << av[0] << std::endl;
+            return 1;
+        }
+    }
+    double copyUs = elapsed_us(start);
+    uint64_t copyPeak = bench_peak_kib() - base;
+    std::remove(av[0]);
+
+    double mib = (double)size / (1 << 20);
+    std::cout << "A state of " << mib << " MiB in 4 KiB and 2 MiB writes" << std::endl;
+    std::cout << "  streamed save: " << mib / (writeUs / 1e6) << " MiB/s, " << writePeak / 1024 << " MiB peak growth" << std::endl;
+    std::cout << "  streamed load: " << mib / (readUs / 1e6) << " MiB/s, " << readPeak / 1024 << " MiB peak growth" << std::endl;
+    std::cout << "  save through a copy in memory: " << mib / (copyUs / 1e6) << " MiB/s, " << copyPeak / 1024
+              << " MiB peak growth" << std::endl;
+    if (!peaks) {
+        std::cout << "  (the peak could not be reset, growth is against the earlier peak)" << std::endl;
+    }
+    return 0;
+}
+
+// Autosave of a session: snapshots of many instances of a plugin whose states share a large table
+// and differ in their parameters, a few rounds of edits, then the store through its file
+static int bench_snapshots(int ac, char** av) {
+    if (ac < 2) {
+        std::cout << "Usage : snapshots <clap-bench-plugin path> <scratch store path> [instances] [edit rounds]" << std::endl;
+        return 1;
+    }
+    uint32_t count = ac > 2 ? (uint32_t)strtoul(av[2], nullptr, 10) : 500;
+    uint32_t rounds = ac > 3 ? (uint32_t)strtoul(av[3], nullptr, 10) : 4;
+
+    std::vector<ClapHostInstance*> instances;
+    for (uint32_t i = 0; i < count; i++) {
+        ClapHostInstance* instance = create_clap_instance(av[0], "bench.state");
+        if (!instance) {
+            break;
+        }
+        for (clap_id param = 0; param < 16; param++) {
+            set_clap_param(instance, param, (double)((i * 16 + param) % 1000) / 1000);
+        }
+        instances.push_back(instance);
+    }
+
+    ClapHostSnapshotStore store;
+    std::vector<clap_id> ids;
+    std::vector<double> captures;
+    for (uint32_t round = 0; round <= rounds; round++) {
+        for (size_t i = 0; i < instances.size(); i++) {
+            if (round > 0) {
+                set_clap_param(instances[i], round % 16, (double)(round * 7 + i) / 10000);
+            }
+            auto start = BenchClock::now();
+            ids.push_back(store.capture(instances[i]));
+            captures.push_back(elapsed_us(start));
+        }
+    }
+
+    // The plugin checks its table on load, so a restore only succeeds with the right bytes
+    std::vector<double> restores;
+    uint32_t restored = 0;
+    for (size_t i = 0; i < instances.size(); i++) {
+        auto start = BenchClock::now();
+        restored += store.restore(instances[i], ids[i]);
+        restores.push_back(elapsed_us(start));
+    }
+
+    auto start = BenchClock::now();
+    bool written = store.write(av[1]);
+    double writeUs = elapsed_us(start);
+    ClapHostSnapshotStore loaded;
+    start = BenchClock::now();
+    bool read = written && loaded.read(av[1]);
+    double readUs = elapsed_us(start);
+
+    // A chunk count the file cannot hold is refused before anything is sized by it
+    bool refused = false;
+    if (FILE* f = fopen(av[1], "r+b")) {
+        uint32_t count = 0x7fffffff;
+        refused = fseek(f, 8, SEEK_SET) == 0 && fwrite(&count, sizeof(count), 1, f) == 1;
+        fclose(f);
+        ClapHostSnapshotStore damaged;
+        refused = refused && !damaged.read(av[1]);
+    }
+    std::remove(av[1]);
+    for (ClapHostInstance* instance : instances) {
+        destroy_clap_instance(instance);
+    }
+
+    std::cout << instances.size() << " instances, " << rounds << " rounds of edits, " << ids.size() << " snapshots" << std::endl;
+    report("capture", captures);
+    report("restore", restores);
+    std::cout << "  " << restored << " of " << instances.size() << " restores succeeded" << std::endl;
+    std::cout << "  stored " << store.storedSize() / 1024 << " KiB for " << store.logicalSize() / 1024
+              << " KiB of states, " << (double)store.logicalSize() / std::max<uint64_t>(store.storedSize(), 1)
+              << " times less" << std::endl;
+    std::cout << "  store file: written in " << writeUs / 1000 << " ms, read in " << readUs / 1000 << " ms, "
+              << (read && loaded.snapshotCount() == store.snapshotCount() ? "every snapshot back" : "snapshots lost")
+              << ", damaged count " << (refused ? "refused" : "accepted") << std::endl;
+    return read && refused ? 0 : 1;
+}
+
+// Syllables of the synthetic preset names, and the features they are tagged with
+static const char* const benchSyllables[] = { "ba", "ko", "ri", "zen", "lu", "ma", "tor", "vex", "nu", "pa", "dri", "sol" };
+static const char* const benchFeatures[] = {
+    "bass", "lead", "pad", "pluck", "keys", "drums", "fx", "ambient",
+    "dark", "bright", "analog", "digital", "mono", "poly", "arp", "evolving",
+};
+
+// A .benchpreset file of clap-bench-plugin's provider: name, creator and features
+static bool write_bench_preset(const std::filesystem::path& path, std::mt19937& random) {
+    std::string text;
+    for (uint32_t i = 0, n = 2 + random() % 3; i < n; i++) {
+        text += benchSyllables[random() % 12];
+    }
+    text += " " + std::to_string(random() % 1000) + "\ncreator " + std::to_string(random() % 8) + "\n";
+    for (uint32_t i = 0, n = 2 + random() % 3; i < n; i++) {
+        text += std::string(i ? " " : "") + benchFeatures[random() % 16];
+    }
+    text += "\n";
+    FILE* file = fopen(path.string().c_str(), "wb");
+    bool written = file && fwrite(text.data(), 1, text.size(), file) == text.size();
+    if (file) {
+        fclose(file);
+    }
+    return written;
+}
+
+// The preset browser on a synthetic corpus: a full crawl and the index file, an unchanged and an
+// incremental crawl against the previous index, and the prefix and tag queries on the mapped file
+static int bench_presets(int ac, char** av) {
+    if (ac < 2) {
+        std::cout << "Usage : presets <clap-bench-plugin path> <scratch directory> [files] [threads] [queries]" << std::endl;
+        return 1;
+    }
+    uint32_t count = ac > 2 ? (uint32_t)strtoul(av[2], nullptr, 10) : 5000;
+    uint32_t numThreads = ac > 3 ? (uint32_t)strtoul(av[3], nullptr, 10) : 4;
+    uint32_t queries = ac > 4 ? (uint32_t)strtoul(av[4], nullptr, 10) : 10000;
+    const uint32_t perBank = 100;
+
+    std::filesystem::path root = std::filesystem::u8path(av[1]) / "presets";
+    std::string indexPath = (std::filesystem::u8path(av[1]) / "presets.idx").string();
+    std::error_code error;
+    std::filesystem::remove_all(root, error);
+    std::mt19937 random(1);
+    std::vector<std::filesystem::path> paths;
+    for (uint32_t i = 0; i < count; i++) {
+        std::filesystem::path bank = root / ("bank" + std::to_string(i / perBank));
+        if (i % perBank == 0) {
+            std::filesystem::create_directories(bank, error);
+        }
+        paths.push_back(bank / ("preset" + std::to_string(i) + ".benchpreset"));
+        if (!write_bench_preset(paths.back(), random)) {
+            std::cerr << "Failed to write " << paths.back() << std::endl;
+            return 1;
+        }
+    }
+    setenv("CLAP_BENCH_PRESETS", root.string().c_str(), 1);
+
+    // One crawl of a fresh indexer, from the previous index when there is one
+    auto crawl = [&](bool incremental, uint32_t& read, double& writeUs) {
+        ClapHostPresetIndexer indexer;
+        if (!indexer.addPlugin(av[0]) || (incremental && !indexer.read(indexPath.c_str()))) {
+            return -1.0;
+        }
+        auto start = BenchClock::now();
+        read = indexer.crawl(numThreads);
+        double us = elapsed_us(start);
+        start = BenchClock::now();
+        if (!indexer.write(indexPath.c_str())) {
+            return -1.0;
+        }
+        writeUs = elapsed_us(start);
+        return us;
+    };
+
+    std::cout << count << " preset files in banks of " << perBank << ", " << numThreads << " threads on "
+              << std::thread::hardware_concurrency() << " cores" << std::endl;
+    uint32_t read = 0;
+    double writeUs = 0;
+    double full = crawl(false, read, writeUs);
+    if (full < 0) {
+        return 1;
+    }
+    std::cout << "  full crawl: " << full / 1000 << " ms, " << read << " files read, index written in "
+              << writeUs / 1000 << " ms, " << std::filesystem::file_size(indexPath, error) / 1024 << " KiB" << std::endl;
+    double unchanged = crawl(true, read, writeUs);
+    std::cout << "  crawl without changes: " << unchanged / 1000 << " ms, " << read << " files read" << std::endl;
+
+    // A percent of the files edited; a new size or time is what the crawl looks at
+    uint32_t edited = std::max<uint32_t>(1, count / 100);
+    for (uint32_t i = 0; i < edited; i++) {
+        std::filesystem::path path = paths[random() % count];
+        write_bench_preset(path, random);
+        std::filesystem::last_write_time(path, std::filesystem::last_write_time(path, error) + std::chrono::seconds(1), error);
+    }
+    double incremental = crawl(true, read, writeUs);
+    std::cout << "  crawl after editing " << edited << " files: " << incremental / 1000 << " ms, " << read
+              << " files read, index written in " << writeUs / 1000 << " ms" << std::endl;
+
+    ClapHostPresetIndex index;
+    if (!index.open(indexPath.c_str())) {
+        return 1;
+    }
+    std::vector<double> prefixUs;
+    std::vector<double> tagUs;
+    size_t prefixHits = 0;
+    size_t tagHits = 0;
+    for (uint32_t q = 0; q < queries; q++) {
+        std::string prefix = benchSyllables[random() % 12];
+        if (q % 2) {
+            prefix += benchSyllables[random() % 12];
+        }
+        auto start = BenchClock::now();
+        prefixHits += index.findPrefix(prefix.c_str(), 50).size();
+        prefixUs.push_back(elapsed_us(start));
+        start = BenchClock::now();
+        tagHits += index.findTag(benchFeatures[random() % 16]).size();
+        tagUs.push_back(elapsed_us(start));
+    }
+    std::cout << "  " << index.size() << " presets in the index" << std::endl;
+    report("name prefix, up to 50 results", prefixUs);
+    std::cout << "    " << (double)prefixHits / queries << " results on average" << std::endl;
+    report("tag", tagUs);
+    std::cout << "    " << (double)tagHits / queries << " results on average" << std::endl;
+    index.close();
+    std::filesystem::remove_all(root, error);
+    return 0;
+}
+
+// A version 1 moss-clap state of moss-converter.c: float parameter values
+static bool write_bench_state(const std::filesystem::path& path, size_t bytes) {
+    std::vector<float> values(bytes / sizeof(float) + 1, 0.5f);
+    FILE* file = fopen(path.string().c_str(), "wb");
+    bool written = file && fwrite(values.data(), 1, bytes, file) == bytes;
+    if (file) {
+        fclose(file);
+    }
+    return written;
+}
+
+// A batch migration through the converter of moss-converter.c: mostly small states, a few
+// large ones, a truncated one and one of a plugin without a converter, converted with 1 .. N
+// workers. Peak memory shows the states are streamed rather than held.
+static int bench_convert(int ac, char** av) {
+    if (ac < 2) {
+        std::cout << "Usage : convert <moss-converter path> <scratch directory> [states] [workers] [large state MiB]" << std::endl;
+        return 1;
+    }
+    uint32_t count = ac > 2 ? (uint32_t)strtoul(av[2], nullptr, 10) : 2000;
+    uint32_t maxWorkers = ac > 3 ? (uint32_t)strtoul(av[3], nullptr, 10) : 4;
+    const uint32_t largeEvery = 500;
+    size_t largeBytes = (ac > 4 ? (size_t)strtoul(av[4], nullptr, 10) : 16) << 20;
+
+    std::filesystem::path scratch = std::filesystem::u8path(av[1]);
+    std::filesystem::path source = scratch / "states";
+    std::filesystem::path plugin = source / "clap" / "de.mossgrabers.MossClap";
+    std::filesystem::path other = source / "clap" / "com.example.NoConverter";
+    std::error_code error;
+    std::filesystem::remove_all(source, error);
+    std::filesystem::create_directories(plugin, error);
+    std::filesystem::create_directories(other, error);
+
+    std::mt19937 random(1);
+    uint64_t total = 0;
+    bool written = true;
+    for (uint32_t i = 0; i < count && written; i++) {
+        size_t bytes = (i + 1) % largeEvery == 0 ? largeBytes : (1 + random() % 32) * 4096;
+        written = write_bench_state(plugin / ("state" + std::to_string(i) + ".bin"), bytes);
+        total += bytes;
+    }
+    written = written && write_bench_state(plugin / "truncated.bin", 4096 + 2)
+                      && write_bench_state(other / "state.bin", 4096);
+    if (!written) {
+        std::cerr << "Failed to write the states under " << source << std::endl;
+        return 1;
+    }
+
+    std::cout << count << " states of " << total / (1 << 20) << " MiB, " << count / largeEvery << " of them of "
+              << (largeBytes >> 20) << " MiB, on " << std::thread::hardware_concurrency() << " cores" << std::endl;
+    bool peaks = bench_reset_peak();
+    uint64_t base = bench_peak_kib();
+    for (uint32_t workers = 1; workers <= maxWorkers; workers *= 2) {
+        std::filesystem::path destination = scratch / "converted";
+        std::filesystem::remove_all(destination, error);
+        ClapHostStateConverter converter;
+        if (!converter.addModule(av[0])) {
+            return 1;
+        }
+        if (peaks) {
+            bench_reset_peak();
+            base = bench_peak_kib();
+        }
+        ClapHostConversionReport result = converter.convert(source.string().c_str(), destination.string().c_str(), workers);
+        double mib = 1.0 * (1 << 20);
+        std::cout << "  " << workers << " workers: " << result.seconds * 1000 << " ms, "
+                  << result.converted / result.seconds << " states/s, " << result.bytesRead / mib / result.seconds
+                  << " MiB/s read, " << result.bytesWritten / mib / result.seconds << " MiB/s written" << std::endl;
+        std::cout << "    " << result.converted << " converted, " << result.failed << " failed, " << result.skipped
+                  << " skipped";
+        if (peaks) {
+            std::cout << ", peak memory +" << bench_peak_kib() - base << " KiB";
+        }
+        std::cout << std::endl;
+        std::filesystem::remove_all(destination, error);
+    }
+    std::filesystem::remove_all(source, error);
+    return 0;
+}
+
+// ClapHostCatalogSnapshot::find() as it was: every plugin of every bundle, in path order
+static const ClapHostCatalogBundle* bench_find_linear(const ClapHostCatalogSnapshot& catalog, const std::string& pluginId) {
+    for (const auto& entry : catalog.bundles) {
+        for (const ClapHostCatalogPlugin& plugin : entry.second->plugins) {
+            if (plugin.id == pluginId) {
+                return entry.second.get();
+            }
+        }
+    }
+    return nullptr;
+}
+
+// The plugin catalog on thousands of copies of clap-bench-plugin, each with a plugin id of its own:
+// the full scan, the time from a change on disk or an invalidation to the new snapshot, and
+// lookups by plugin id through the snapshot's index against walking every bundle
+static int bench_catalog(int ac, char** av) {
+    if (ac < 2) {
+        std::cout << "Usage : catalog <clap-bench-plugin path> <scratch directory> [bundles] [changes] [lookups]" << std::endl;
+        return 1;
+    }
+    uint32_t count = ac > 2 ? (uint32_t)strtoul(av[2], nullptr, 10) : 2000;
+    uint32_t changes = ac > 3 ? (uint32_t)strtoul(av[3], nullptr, 10) : 20;
+    uint32_t lookups = ac > 4 ? (uint32_t)strtoul(av[4], nullptr, 10) : 20000;
+    const uint32_t perDirectory = 100;
+
+    std::filesystem::path root = std::filesystem::u8path(av[1]) / "catalog";
+    std::error_code error;
+    std::filesystem::remove_all(root, error);
+    std::vector<std::filesystem::path> paths;
+    for (uint32_t i = 0; i < count; i++) {
+        std::filesystem::path directory = root / ("vendor" + std::to_string(i / perDirectory));
+        std::filesystem::create_directories(directory, error);
+        paths.push_back(directory / ("bundle" + std::to_string(i) + ".clap"));
+        if (!std::filesystem::copy_file(std::filesystem::u8path(av[0]), paths.back(), error)) {
+            std::cerr << "Failed to copy " << av[0] << " to " << paths.back() << std::endl;
+            return 1;
+        }
+    }
+
+    ClapHostCatalog catalog;
+    catalog.addDirectory(root.string());
+    auto start = BenchClock::now();
+    if (!catalog.start() || !catalog.waitForUpdate(0, 600000)) {
+        return 1;
+    }
+    double scan = elapsed_us(start);
+    auto snapshot = catalog.snapshot();
+    std::cout << count << " bundles, " << snapshot->pluginCount() << " plugins, on "
+              << std::thread::hardware_concurrency() << " cores" << std::endl;
+    std::cout << "  full scan: " << scan / 1000 << " ms" << std::endl;
+
+    // A change is published once the settle window has passed without another one
+    std::mt19937 random(1);
+    std::vector<double> touched;
+    std::vector<double> invalidated;
+    for (uint32_t i = 0; i < changes; i++) {
+        const std::filesystem::path& path = paths[random() % count];
+        uint64_t generation = catalog.snapshot()->generation;
+        start = BenchClock::now();
+        std::filesystem::last_write_time(path, std::filesystem::last_write_time(path, error) + std::chrono::seconds(1), error);
+        if (catalog.waitForUpdate(generation, 10000)) {
+            touched.push_back(elapsed_us(start));
+        }
+
+        generation = catalog.snapshot()->generation;
+        start = BenchClock::now();
+        catalog.invalidate(paths[random() % count].string());
+        if (catalog.waitForUpdate(generation, 10000)) {
+            invalidated.push_back(elapsed_us(start));
+        }
+    }
+    report("bundle changed on disk to new snapshot", touched);
+    report("invalidate() to new snapshot", invalidated);
+
+    std::filesystem::path added = root / "vendor-new" / "added.clap";
+    uint64_t generation = catalog.snapshot()->generation;
+    start = BenchClock::now();
+    std::filesystem::create_directories(added.parent_path(), error);
+    std::filesystem::copy_file(std::filesystem::u8path(av[0]), added, error);
+    bool seen = catalog.waitForUpdate(generation, 10000);
+    double addUs = elapsed_us(start);
+    generation = catalog.snapshot()->generation;
+    start = BenchClock::now();
+    std::filesystem::remove(paths[0], error);
+    bool gone = catalog.waitForUpdate(generation, 10000);
+    double removeUs = elapsed_us(start);
+    snapshot = catalog.snapshot();
+    std::cout << "  bundle added in a new directory: " << addUs / 1000 << " ms"
+              << (seen && snapshot->find("bench.catalog/added.clap") ? "" : ", not found") << std::endl;
+    std::cout << "  bundle removed: " << removeUs / 1000 << " ms"
+              << (gone && !snapshot->find("bench.catalog/bundle0.clap") ? "" : ", still listed") << std::endl;
+
+    std::vector<std::string> ids;
+    for (uint32_t i = 0; i < lookups; i++) {
+        ids.push_back("bench.catalog/bundle" + std::to_string(1 + random() % (count - 1)) + ".clap");
+    }
+    std::vector<double> indexed;
+    std::vector<double> linear;
+    uint32_t found = 0;
+    for (const std::string& id : ids) {
+        start = BenchClock::now();
+        const ClapHostCatalogBundle* bundle = snapshot->find(id.c_str());
+        indexed.push_back(elapsed_us(start));
+        start = BenchClock::now();
+        found += bundle && bench_find_linear(*snapshot, id) == bundle;
+        linear.push_back(elapsed_us(start));
+    }
+    report("find() through the id index", indexed);
+    report("walking every bundle", linear);
+    std::cout << "    " << found << " of " << lookups << " found alike" << std::endl;
+
+    catalog.stop();
+    std::filesystem::remove_all(root, error);
+    return 0;
+}
+
+// A parameter change of bench.undo, as its deltas carry it
+struct BenchUndoDelta {
+    uint32_t paramId;
+    double before;
+    double after;
+};
+
+// Parameter values of every instance, through clap_plugin_params
+static std::vector<double> bench_undo_values(const std::vector<ClapHostInstance*>& instances) {
+    std::vector<double> values;
+    for (ClapHostInstance* instance : instances) {
+        for (clap_id param = 0; param < 16; param++) {
+            double value = 0;
+            instance->paramsExt->get_value(instance->plugin, param, &value);
+            values.push_back(value);
+        }
+    }
+    return values;
+}
+
+// Undo history of parameter edits across a few instances: a plugin handing a delta with each change,
+// bench.undo, against bench.state, whose steps are snapshots of its state. Memory per step, the
+// time to record a change, then to undo every step and redo it, checked against the values
+static int bench_undo(int ac, char** av) {
+    if (ac < 1) {
+        std::cout << "Usage : undo <clap-bench-plugin path> [instances] [steps]" << std::endl;
+        return 1;
+    }
+    uint32_t count = ac > 1 ? (uint32_t)strtoul(av[1], nullptr, 10) : 8;
+    uint32_t stepCount = ac > 2 ? (uint32_t)strtoul(av[2], nullptr, 10) : 2000;
+
+    bool matched = true;
+    for (const char* pluginId : { "bench.undo", "bench.state" }) {
+        std::vector<ClapHostInstance*> instances;
+        for (uint32_t i = 0; i < count; i++) {
+            if (ClapHostInstance* instance = create_clap_instance(av[0], pluginId)) {
+                instances.push_back(instance);
+            }
+        }
+        if (instances.empty()) {
+            return 1;
+        }
+
+        ClapHostUndoHistory history;
+        for (ClapHostInstance* instance : instances) {
+            history.attach(instance);
+        }
+        uint64_t attached = history.memoryUsed();
+        std::vector<double> initial = bench_undo_values(instances);
+
+        // The change is made, then reported as the plugin would through clap_host_undo::change_made
+        std::mt19937 random(1);
+        std::vector<double> changes;
+        for (uint32_t i = 0; i < stepCount; i++) {
+            ClapHostInstance* instance = instances[random() % instances.size()];
+            BenchUndoDelta delta = { (uint32_t)(random() % 16), 0, (double)(random() % 1000) / 1000 };
+            instance->paramsExt->get_value(instance->plugin, delta.paramId, &delta.before);
+            set_clap_param(instance, delta.paramId, delta.after);
+            bool hasDelta = !strcmp(pluginId, "bench.undo");
+            auto start = BenchClock::now();
+            history.changeMade(instance, "Edit", hasDelta ? &delta : nullptr, hasDelta ? sizeof(delta) : 0, true);
+            changes.push_back(elapsed_us(start));
+        }
+        std::vector<double> final = bench_undo_values(instances);
+        uint64_t steps = history.stepCount();
+        uint64_t memory = history.memoryUsed() - attached;
+
+        std::vector<double> undos;
+        while (history.canUndo()) {
+            auto start = BenchClock::now();
+            if (!history.undo()) {
+                break;
+            }
+            undos.push_back(elapsed_us(start));
+        }
+        bool undoneAll = undos.size() == steps && bench_undo_values(instances) == initial;
+        std::vector<double> redos;
+        while (history.canRedo()) {
+            auto start = BenchClock::now();
+            if (!history.redo()) {
+                break;
+            }
+            redos.push_back(elapsed_us(start));
+        }
+        bool redoneAll = redos.size() == undos.size() && bench_undo_values(instances) == final;
+        matched = matched && redoneAll && (undoneAll || undos.size() < steps);
+
+        std::cout << pluginId << ": " << instances.size() << " instances, " << steps << " of " << stepCount
+                  << " steps kept" << std::endl;
+        std::cout << "  memory per step: " << (double)memory / std::max<uint64_t>(steps, 1) << " bytes, "
+                  << memory / 1024 << " KiB in all" << std::endl;
+        report("change_made", changes);
+        report("undo", undos);
+        report("redo", redos);
+        std::cout << "    " << (undoneAll ? "every step undone back to the first values" : "undo stopped early")
+                  << ", " << (redoneAll ? "redone to the last ones" : "redo lost values") << std::endl;
+
+        for (ClapHostInstance* instance : instances) {
+            history.detach(instance);
+            destroy_clap_instance(instance);
+        }
+    }
+    return matched ? 0 : 1;
+}
+
+// ClapHostTempoMap::secondsAt() without the binary search, walking the tempo changes from the start
+static double bench_seconds_linear(const ClapHostTempoMap& map, double beat) {
+    const auto& tempos = map.tempos();
+    size_t i = 0;
+    while (i + 1 < tempos.size() && tempos[i + 1].beat <= beat) {
+        i++;
+    }
+    return tempos[i].seconds + (beat - tempos[i].beat) * 60 / tempos[i].bpm;
+}
+
+// A song with thousands of tempo changes and a meter change every few bars: publishing its tempo
+// map, beat to time lookups through the map against walking it, then playing the song through
+// process() and jumping around in it. Each change falling inside a block must give one event.
+static int bench_transport(int ac, char** av) {
+    uint32_t count = ac > 0 ? (uint32_t)strtoul(av[0], nullptr, 10) : 5000;
+    uint32_t lookups = ac > 1 ? (uint32_t)strtoul(av[1], nullptr, 10) : 100000;
+    uint32_t jumps = ac > 2 ? (uint32_t)strtoul(av[2], nullptr, 10) : 10000;
+
+    // A change every beat or half beat, wandering between 60 and 180 bpm
+    std::mt19937 random(1);
+    std::uniform_real_distribution<double> uniform(0, 1);
+    std::map<double, double> tempoChanges;
+    double beat = 0;
+    for (uint32_t i = 0; i < count; i++) {
+        tempoChanges[beat] = 60 + 120 * uniform(random);
+        beat += random() % 2 ? 1 : 0.5;
+    }
+    double songBeats = beat;
+    std::map<int32_t, std::pair<uint16_t, uint16_t>> meterChanges;
+    const std::pair<uint16_t, uint16_t> meters[] = { { 4, 4 }, { 3, 4 }, { 7, 8 } };
+    for (int32_t bar = 0; bar * 4 < songBeats; bar += 8) {
+        meterChanges[bar] = meters[(bar / 8) % 3];
+    }
+
+    ClapHostTransport transport;
+    transport.prepare(BENCH_SAMPLE_RATE);
+    auto start = BenchClock::now();
+    transport.setTempoChanges(tempoChanges);
+    transport.setMeterChanges(meterChanges);
+    double publishUs = elapsed_us(start);
+    std::shared_ptr<const ClapHostTempoMap> map = transport.tempoMap();
+
+    std::vector<double> beats;
+    for (uint32_t i = 0; i < lookups; i++) {
+        beats.push_back(songBeats * uniform(random));
+    }
+    double sum = 0;
+    start = BenchClock::now();
+    for (double b : beats) {
+        sum += map->secondsAt(b);
+    }
+    double searchedNs = elapsed_us(start) * 1000 / lookups;
+    double linearSum = 0;
+    start = BenchClock::now();
+    for (double b : beats) {
+        linearSum += bench_seconds_linear(*map, b);
+    }
+    double linearNs = elapsed_us(start) * 1000 / lookups;
+    double roundTrip = 0;
+    start = BenchClock::now();
+    for (double b : beats) {
+        roundTrip = std::max(roundTrip, std::abs(map->beatAt(map->secondsAt(b)) - b));
+    }
+    double roundTripNs = elapsed_us(start) * 1000 / lookups;
+    benchSink = (uint32_t)(sum + linearSum);
+
+    // Changes falling inside a block, the others are described by the block's transport
+    double songSeconds = map->secondsAt(songBeats);
+    int64_t songEnd = (int64_t)std::ceil(songSeconds * BENCH_SAMPLE_RATE);
+    std::vector<int64_t> changes;
+    for (const auto& tempo : map->tempos()) {
+        changes.push_back((int64_t)std::ceil(tempo.seconds * BENCH_SAMPLE_RATE));
+    }
+    for (const auto& meter : map->meters()) {
+        changes.push_back((int64_t)std::ceil(meter.seconds * BENCH_SAMPLE_RATE));
+    }
+    std::sort(changes.begin(), changes.end());
+    changes.erase(std::unique(changes.begin(), changes.end()), changes.end());
+    uint64_t expected = std::count_if(changes.begin(), changes.end(), [&](int64_t sample) {
+        return sample < songEnd && sample % BENCH_BLOCK_FRAMES != 0;
+    });
+
+    transport.requestPlay(true);
+    std::vector<double> blocks;
+    uint64_t events = 0;
+    for (int64_t played = 0; played < songEnd; played += BENCH_BLOCK_FRAMES) {
+        uint32_t frames = (uint32_t)std::min<int64_t>(BENCH_BLOCK_FRAMES, songEnd - played);
+        start = BenchClock::now();
+        transport.process(frames);
+        blocks.push_back(elapsed_us(start));
+        events += transport.events()->size(transport.events());
+    }
+
+    std::vector<double> jumped;
+    for (uint32_t i = 0; i < jumps; i++) {
+        transport.requestJump(songBeats * uniform(random));
+        start = BenchClock::now();
+        transport.process(BENCH_BLOCK_FRAMES);
+        jumped.push_back(elapsed_us(start));
+        transport.service();
+    }
+
+    std::cout << map->tempos().size() << " tempo changes, " << map->meters().size() << " meter changes, "
+              << songSeconds / 60 << " minutes" << std::endl;
+    std::cout << "  publishing the tempo map: " << publishUs / 1000 << " ms" << std::endl;
+    std::cout << "  secondsAt(): " << searchedNs << " ns, walking the changes: " << linearNs << " ns, "
+              << (sum == linearSum ? "same times" : "times differ") << std::endl;
+    std::cout << "  beatAt(secondsAt()): " << roundTripNs << " ns, off by " << roundTrip << " beats at most" << std::endl;
+    report("block playing through the song", blocks);
+    std::cout << "    " << events << " transport events for " << expected << " changes inside blocks" << std::endl;
+    report("block after a jump", jumped);
+    return events == expected && sum == linearSum ? 0 : 1;
+}
+
+// The index entries of ClapHostInputEvents, time above push position, sorted by insertion as
+// list() does below EVENT_INSERTION_SORT events
+static void bench_insertion_sort(std::vector<uint64_t>& keys) {
+    for (size_t i = 1; i < keys.size(); i++) {
+        uint64_t entry = keys[i];
+        size_t j = i;
+        for (; j > 0 && keys[j - 1] > entry; j--) {
+            keys[j] = keys[j - 1];
+        }
+        keys[j] = entry;
+    }
+}
+
+// The block's input event list from 10 to 100000 note events at random times of a block: push()
+// per event, the sort list() does then, an insertion sort of the same keys, and get() in order.
+// The sort is checked to keep the push order at equal times.
+static int bench_events(int ac, char** av) {
+    uint32_t blockFrames = ac > 0 ? (uint32_t)strtoul(av[0], nullptr, 10) : 4096;
+    uint32_t rounds = ac > 1 ? (uint32_t)strtoul(av[1], nullptr, 10) : 20;
+    const uint32_t sizes[] = { 10, 32, 64, 128, 256, 1000, 10000, 100000 };
+
+    bool stable = true;
+    std::mt19937 random(1);
+    std::cout << "Events at random times of a " << blockFrames << " frame block, ns per event" << std::endl;
+    for (uint32_t count : sizes) {
+        ClapHostInputEvents list;
+        list.reserve(count, count * sizeof(clap_event_note));
+        std::vector<clap_event_note> notes(count);
+        for (uint32_t i = 0; i < count; i++) {
+            clap_event_note& note = notes[i];
+            note = {};
+            note.header.size = sizeof(note);
+            note.header.time = random() % blockFrames;
+            note.header.space_id = CLAP_CORE_EVENT_SPACE_ID;
+            note.header.type = CLAP_EVENT_NOTE_ON;
+            note.note_id = (int32_t)i;
+            note.key = (int16_t)(i % 128);
+        }
+
+        double pushUs = 0;
+        double sortUs = 0;
+        double getUs = 0;
+        double insertionUs = 0;
+        // Insertion sort is quadratic, it stops being worth timing well before the largest sizes
+        bool insertion = count <= 10000;
+        for (uint32_t round = 0; round < rounds; round++) {
+            list.clear();
+            auto start = BenchClock::now();
+            for (const clap_event_note& note : notes) {
+                list.push(&note.header);
+            }
+            pushUs += elapsed_us(start);
+
+            start = BenchClock::now();
+            const clap_input_events* events = list.list();
+            sortUs += elapsed_us(start);
+
+            start = BenchClock::now();
+            uint32_t sum = 0;
+            for (uint32_t i = 0; i < count; i++) {
+                sum += events->get(events, i)->time;
+            }
+            getUs += elapsed_us(start);
+            benchSink = sum;
+
+            for (uint32_t i = 1; i < count; i++) {
+                auto* a = reinterpret_cast<const clap_event_note*>(list.get(i - 1));
+                auto* b = reinterpret_cast<const clap_event_note*>(list.get(i));
+                stable = stable && (a->header.time < b->header.time
+                                    || (a->header.time == b->header.time && a->note_id < b->note_id));
+            }
+
+            if (insertion) {
+                std::vector<uint64_t> keys;
+                for (uint32_t i = 0; i < count; i++) {
+                    keys.push_back((uint64_t)notes[i].header.time << 32 | i);
+                }
+                start = BenchClock::now();
+                bench_insertion_sort(keys);
+                insertionUs += elapsed_us(start);
+            }
+        }
+        double perEvent = 1000.0 / ((double)count * rounds);
+        std::cout << "  " << count << " events: push " << pushUs * perEvent << ", list() " << sortUs * perEvent;
+        if (insertion) {
+            std::cout << ", insertion sort " << insertionUs * perEvent;
+        }
+        std::cout << ", get " << getUs * perEvent << std::endl;
+    }
+    std::cout << "  " << (stable ? "sorted by time, push order kept at equal times" : "order broken") << std::endl;
+    return stable ? 0 : 1;
+}
+
+// bench.spew's output events through ClapHostOutputChannel: the audio thread runs its blocks, flat
+// out and then paced at the block period, while the main thread takes the batches every period.
+// Then the plugin stops processing and the audio thread goes on with silent blocks, as it does for
+// a sleeping instance. Every parameter must end up at its last value and every ended note be
+// either delivered or counted as dropped.
+static int bench_outputs(int ac, char** av) {
+    if (ac < 1) {
+        std::cout << "Usage : outputs <clap-bench-plugin path> [blocks] [paced blocks] [main thread period us]" << std::endl;
+        return 1;
+    }
+    uint32_t flatBlocks = ac > 1 ? (uint32_t)strtoul(av[1], nullptr, 10) : 20000;
+    uint32_t pacedBlocks = ac > 2 ? (uint32_t)strtoul(av[2], nullptr, 10) : 500;
+    uint32_t period = ac > 3 ? (uint32_t)strtoul(av[3], nullptr, 10) : 1000;
+    const uint32_t params = 256;        // BENCH_SPEW_PARAMS
+    const uint32_t notes = 16;          // BENCH_SPEW_NOTES
+    const uint32_t perBlock = 2 * params + 1 + notes;
+    const auto blockPeriod = std::chrono::microseconds(1000000 * BENCH_BLOCK_FRAMES / BENCH_SAMPLE_RATE);
+
+    use_clap_port_layout(2, 2);
+    bool correct = true;
+    for (bool paced : { false, true }) {
+        uint32_t blocks = paced ? pacedBlocks : flatBlocks;
+        ClapHostInstance* instance = create_clap_instance(av[0], "bench.spew");
+        if (!instance || !activate_clap_instance(instance, BENCH_SAMPLE_RATE, 1, BENCH_BLOCK_FRAMES)) {
+            destroy_clap_instance(instance);
+            return 1;
+        }
+        start_clap_processing(instance);
+
+        std::atomic<bool> done{ false };
+        std::atomic<bool> stopping{ false };
+        std::vector<double> blockUs;
+        blockUs.reserve(blocks);
+        std::thread audio([&]() {
+            BenchBlock block;
+            auto next = BenchClock::now();
+            for (uint32_t b = 0; b < blocks; b++) {
+                auto start = BenchClock::now();
+                block.process(instance);
+                blockUs.push_back(elapsed_us(start));
+                if (paced) {
+                    next += blockPeriod;
+                    std::this_thread::sleep_until(next);
+                }
+            }
+            stop_clap_processing(instance);
+            done = true;
+            while (!stopping) {
+                block.process(instance);
+                std::this_thread::sleep_for(std::chrono::microseconds(period));
+            }
+        });
+
+        std::vector<double> lastValue(params, -1);
+        bool inGesture = false;
+        uint64_t updates = 0;
+        uint64_t noteEnds = 0;
+        uint64_t dropped = 0;
+        int32_t nextNote = 0;
+        bool notesInOrder = true;
+        std::vector<double> consumeUs;
+        // Done after a few looks finding nothing once the spewing ended
+        for (uint32_t idle = 0; idle < 3;) {
+            bool ended = done.load();
+            uint64_t before = updates + noteEnds;
+            auto start = BenchClock::now();
+            dropped += instance->outputs.consume(
+                [&](const ClapHostParamUpdate& update) {
+                    updates++;
+                    if (update.hasValue && update.paramId < params) {
+                        lastValue[update.paramId] = update.value;
+                    }
+                    if (update.hasGesture && update.paramId == 0) {
+                        inGesture = update.isBegin;
+                    }
+                },
+                [&](const ClapHostNoteEnd& note) {
+                    noteEnds++;
+                    notesInOrder = notesInOrder && note.noteId >= nextNote;
+                    nextNote = note.noteId + 1;
+                });
+            if (updates + noteEnds > before) {
+                consumeUs.push_back(elapsed_us(start));
+                idle = 0;
+            }
+            else if (ended) {
+                idle++;
+            }
+            std::this_thread::sleep_for(std::chrono::microseconds(period));
+        }
+        stopping = true;
+        audio.join();
+        destroy_clap_instance(instance);
+
+        uint32_t latest = 0;
+        for (double value : lastValue) {
+            latest += value == blocks - 1;
+        }
+        bool gestureRight = inGesture == ((blocks - 1) % 2 == 0);
+        bool notesRight = notesInOrder && noteEnds + dropped == (uint64_t)blocks * notes;
+        correct = correct && latest == params && gestureRight && notesRight;
+
+        double meanBlock = 0;
+        for (double us : blockUs) {
+            meanBlock += us / blockUs.size();
+        }
+        std::cout << (paced ? "Paced at " : "Flat out, ") << (paced ? std::to_string(blockPeriod.count()) + " us a block, " : "")
+                  << blocks << " blocks of " << perBlock << " events, the main thread every " << period << " us" << std::endl;
+        report("block, bench.spew pushing and the host collecting", blockUs);
+        std::cout << "    " << meanBlock * 1000 / perBlock << " ns per event, "
+                  << (double)perBlock * blocks / (meanBlock * blocks) << " million events/s" << std::endl;
+        report("consume() of a batch", consumeUs);
+        std::cout << "    " << consumeUs.size() << " batches, " << updates << " parameter updates for "
+                  << (uint64_t)blocks * (2 * params + 1) << " events, " << noteEnds << " ended notes delivered, "
+                  << dropped << " dropped" << std::endl;
+        std::cout << "    " << latest << " of " << params << " parameters at their last value, gesture "
+                  << (gestureRight ? "right" : "wrong") << ", ended notes " << (notesRight ? "all accounted for" : "lost")
+                  << std::endl;
+    }
+    return correct ? 0 : 1;
+}
+
+// A track chunk of a Standard MIDI File being written, events at absolute ticks
+struct BenchMidiTrack {
+    std::vector<uint8_t> bytes;
+    uint64_t tick = 0;
+
+    void event(uint64_t at, std::initializer_list<uint8_t> data) {
+        uint64_t delta = at - tick;
+        tick = at;
+        uint8_t varlen[4];
+        int n = 0;
+        do {
+            varlen[n++] = (uint8_t)(delta & 0x7f);
+            delta >>= 7;
+        } while (delta > 0);
+        while (n-- > 0) {
+            bytes.push_back(varlen[n] | (n > 0 ? 0x80 : 0));
+        }
+        bytes.insert(bytes.end(), data);
+    }
+};
+
+static void bench_midi_number(std::vector<uint8_t>& out, uint32_t value, int count) {
+    for (int i = count - 1; i >= 0; i--) {
+        out.push_back((uint8_t)(value >> (8 * i)));
+    }
+}
+
+// Playing a synthetic format 1 file: a tempo track with a change every bar, and tracks of short
+// notes on their own channel, with a controller every 4 notes and a sysex every 64. Reading it,
+// placing it on the tempo map, then process() per block for a note input preferring CLAP and
+// one preferring MIDI, and with the song jumping around. Every note played must be ended.
+static int bench_midi(int ac, char** av) {
+    if (ac < 1) {
+        std::cout << "Usage : midi <scratch MIDI file path> [notes per track] [tracks] [jump every blocks]" << std::endl;
+        return 1;
+    }
+    uint32_t notes = ac > 1 ? (uint32_t)strtoul(av[1], nullptr, 10) : 20000;
+    uint32_t tracks = ac > 2 ? (uint32_t)strtoul(av[2], nullptr, 10) : 16;
+    uint32_t jumpEvery = ac > 3 ? (uint32_t)strtoul(av[3], nullptr, 10) : 50;
+    const uint32_t division = 480;
+
+    std::mt19937 random(1);
+    std::vector<BenchMidiTrack> chunks(tracks + 1);
+    uint64_t songTicks = 0;
+    uint64_t controllers = 0;
+    uint64_t sysexes = 0;
+    for (uint32_t t = 1; t <= tracks; t++) {
+        BenchMidiTrack& track = chunks[t];
+        uint8_t channel = (uint8_t)((t - 1) % 16);
+        for (uint32_t i = 0; i < notes; i++) {
+            uint64_t on = (uint64_t)i * division / 2 + random() % 8;
+            uint8_t key = (uint8_t)(36 + random() % 60);
+            if (i % 64 == 0) {
+                track.event(on, { 0xf0, 4, 0x7e, 0x7f, (uint8_t)(i & 0x7f), 0xf7 });
+                sysexes++;
+            }
+            if (i % 4 == 0) {
+                track.event(on, { (uint8_t)(0xb0 | channel), 1, (uint8_t)(random() % 128) });
+                controllers++;
+            }
+            track.event(on, { (uint8_t)(0x90 | channel), key, (uint8_t)(1 + random() % 127) });
+            track.event(on + division / 4, { (uint8_t)(0x80 | channel), key, 64 });
+        }
+        songTicks = std::max(songTicks, chunks[t].tick);
+    }
+    for (uint64_t bar = 0; bar * 4 * division < songTicks; bar++) {
+        uint32_t tempo = 60000000 / (90 + random() % 90);
+        chunks[0].event(bar * 4 * division, { 0xff, 0x51, 3, (uint8_t)(tempo >> 16), (uint8_t)(tempo >> 8), (uint8_t)tempo });
+    }
+    std::vector<uint8_t> bytes = { 'M', 'T', 'h', 'd', 0, 0, 0, 6, 0, 1 };
+    bench_midi_number(bytes, tracks + 1, 2);
+    bench_midi_number(bytes, division, 2);
+    for (BenchMidiTrack& track : chunks) {
+        track.event(songTicks, { 0xff, 0x2f, 0 });
+        bytes.insert(bytes.end(), { 'M', 'T', 'r', 'k' });
+        bench_midi_number(bytes, (uint32_t)track.bytes.size(), 4);
+        bytes.insert(bytes.end(), track.bytes.begin(), track.bytes.end());
+    }
+    if (FILE* f = fopen(av[0], "wb")) {
+        fwrite(bytes.data(), 1, bytes.size(), f);
+        fclose(f);
+    }
+
+    auto file = std::make_shared<ClapHostMidiFile>();
+    auto start = BenchClock::now();
+    bool read = file->read(av[0]);
+    double readUs = elapsed_us(start);
+    std::remove(av[0]);
+    if (!read) {
+        return 1;
+    }
+    uint64_t noteCount = (uint64_t)notes * tracks;
+
+    bool balanced = true;
+    auto play = [&](const char* name, uint32_t preferred, uint32_t jumps) {
+        ClapHostTransport transport;
+        transport.prepare(BENCH_SAMPLE_RATE);
+        transport.setTempoChanges(file->tempoChanges());
+        transport.setMeterChanges(file->meterChanges());
+        ClapHostMidiPlayer player;
+        player.prepare(BENCH_SAMPLE_RATE);
+        player.setDialects(preferred, CLAP_NOTE_DIALECT_CLAP | CLAP_NOTE_DIALECT_MIDI);
+        auto placeStart = BenchClock::now();
+        player.load(file, *transport.tempoMap());
+        double placeUs = elapsed_us(placeStart);
+        transport.requestPlay(true);
+
+        int64_t songEnd = (int64_t)std::ceil(transport.tempoMap()->secondsAt(file->length()) * BENCH_SAMPLE_RATE);
+        std::vector<double> blocks;
+        uint64_t ons = 0;
+        uint64_t offs = 0;
+        uint64_t midi = 0;
+        uint64_t sysex = 0;
+        std::uniform_real_distribution<double> uniform(0, file->length());
+        for (int64_t played = 0, b = 0; played < songEnd; played += BENCH_BLOCK_FRAMES, b++) {
+            if (jumps > 0 && b % jumps == jumps - 1) {
+                transport.requestJump(uniform(random));
+            }
+            // The last block stops the transport, which ends the notes still held
+            if (played + BENCH_BLOCK_FRAMES >= songEnd) {
+                transport.requestPlay(false);
+            }
+            transport.process(BENCH_BLOCK_FRAMES);
+            auto blockStart = BenchClock::now();
+            player.process(transport);
+            blocks.push_back(elapsed_us(blockStart));
+            const clap_input_events* events = player.events();
+            for (uint32_t i = 0; i < events->size(events); i++) {
+                const clap_event_header* event = events->get(events, i);
+                if (event->type == CLAP_EVENT_NOTE_ON) {
+                    ons++;
+                }
+                else if (event->type == CLAP_EVENT_NOTE_OFF) {
+                    offs++;
+                }
+                else if (event->type == CLAP_EVENT_MIDI) {
+                    uint8_t kind = reinterpret_cast<const clap_event_midi*>(event)->data[0] & 0xf0;
+                    uint8_t velocity = reinterpret_cast<const clap_event_midi*>(event)->data[2];
+                    ons += kind == 0x90 && velocity > 0;
+                    offs += kind == 0x80 || (kind == 0x90 && velocity == 0);
+                    midi += kind != 0x80 && kind != 0x90;
+                }
+                else if (event->type == CLAP_EVENT_MIDI_SYSEX) {
+                    sysex++;
+                }
+            }
+            transport.service();
+            player.service(*transport.tempoMap());
+        }
+        // Without jumps every event of the file is played once
+        bool complete = ons == offs && (jumps > 0 || (ons == noteCount && midi == controllers && sysex == sysexes));
+        balanced = balanced && complete;
+
+        uint64_t total = ons + offs + midi + sysex;
+        double sum = 0;
+        for (double us : blocks) {
+            sum += us;
+        }
+        std::cout << name << ": placed on the tempo map in " << placeUs / 1000 << " ms" << std::endl;
+        report("process() of a block", blocks);
+        std::cout << "    " << sum * 1000 / std::max<uint64_t>(total, 1) << " ns per event, " << ons << " notes on, "
+                  << offs << " off, " << midi << " other MIDI, " << sysex << " sysex"
+                  << (complete ? "" : ", notes left hanging or events lost") << std::endl;
+    };
+
+    std::cout << tracks << " tracks of " << notes << " notes, " << file->events().size() << " events, "
+              << file->tempoChanges().size() << " tempo changes, " << bytes.size() / 1024 << " KiB" << std::endl;
+    std::cout << "  read in " << readUs / 1000 << " ms, " << bytes.size() / readUs << " MB/s" << std::endl;
+    play("  CLAP dialect preferred", CLAP_NOTE_DIALECT_CLAP, 0);
+    play("  MIDI dialect preferred", CLAP_NOTE_DIALECT_MIDI, 0);
+    std::string jumping = "  CLAP dialect preferred, a jump every " + std::to_string(jumpEvery) + " blocks";
+    play(jumping.c_str(), CLAP_NOTE_DIALECT_CLAP, jumpEvery);
+    return balanced ? 0 : 1;
+}
+
+// ClapHostInputEvents::merge() as it goes below EVENT_INSERTION_SORT events, at any size: a heap of
+// the next time of each list in fixed arrays, taking the events in time order into the list
+static void bench_heap_merge(ClapHostInputEvents& into, const std::vector<const clap_input_events*>& lists) {
+    const clap_event_header* heads[CLAP_MERGE_MAX_LISTS];
+    uint32_t counts[CLAP_MERGE_MAX_LISTS];
+    uint32_t positions[CLAP_MERGE_MAX_LISTS];
+    uint64_t heap[2 * CLAP_MERGE_MAX_LISTS + 1];
+    uint32_t heapSize = 0;
+    std::fill(std::begin(heap), std::end(heap), UINT64_MAX);
+    for (uint32_t i = 0; i < lists.size(); i++) {
+        counts[i] = lists[i]->size(lists[i]);
+        positions[i] = 0;
+        if (counts[i] > 0) {
+            heads[i] = lists[i]->get(lists[i], 0);
+            heap[heapSize++] = (uint64_t)heads[i]->time << 32 | i;
+        }
+    }
+    std::make_heap(heap, heap + heapSize, std::greater<uint64_t>());
+    while (heapSize > 0) {
+        uint32_t source = (uint32_t)heap[0];
+        into.refer(heads[source]);
+        if (++positions[source] < counts[source]) {
+            heads[source] = lists[source]->get(lists[source], positions[source]);
+            heap[0] = (uint64_t)heads[source]->time << 32 | source;
+        }
+        else {
+            heap[0] = heap[--heapSize];
+            heap[heapSize] = UINT64_MAX;
+        }
+        uint32_t i = 0;
+        uint64_t key = heap[0];
+        for (uint32_t child = 1; child < heapSize; child = 2 * i + 1) {
+            child += heap[child + 1] < heap[child];
+            if (key <= heap[child]) {
+                break;
+            }
+            heap[i] = heap[child];
+            i = child;
+        }
+        heap[i] = key;
+    }
+}
+
+// The block's event sources, each in time order, into one list at 2 .. 16 sources and 1 .. 1024
+// events per source: merge(), which merges over a heap below EVENT_INSERTION_SORT events in all and
+// appends then sorts above, against a heap merge at every size and against always appending and
+// sorting. The three must give the same order.
+static int bench_merge(int ac, char** av) {
+    uint32_t rounds = ac > 0 ? (uint32_t)strtoul(av[0], nullptr, 10) : 2000;
+    const uint32_t sourceCounts[] = { 2, 4, 8, 16 };
+    const uint32_t densities[] = { 1, 4, 16, 64, 256, 1024 };
+
+    std::mt19937 random(1);
+    bool same = true;
+    std::cout << "ns per event: merge(), heap merge, append and sort" << std::endl;
+    for (uint32_t sourceCount : sourceCounts) {
+        for (uint32_t density : densities) {
+            std::vector<std::unique_ptr<ClapHostInputEvents>> sources;
+            std::vector<std::vector<clap_event_param_value>> storage(sourceCount);
+            std::vector<const clap_input_events*> lists;
+            for (uint32_t s = 0; s < sourceCount; s++) {
+                std::vector<uint32_t> times;
+                for (uint32_t i = 0; i < density; i++) {
+                    times.push_back(random() % BENCH_BLOCK_FRAMES);
+                }
+                std::sort(times.begin(), times.end());
+                sources.push_back(std::make_unique<ClapHostInputEvents>());
+                sources.back()->reserve(density, 0);
+                storage[s].resize(density);
+                for (uint32_t i = 0; i < density; i++) {
+                    clap_event_param_value& event = storage[s][i];
+                    event = {};
+                    event.header.size = sizeof(event);
+                    event.header.time = times[i];
+                    event.header.space_id = CLAP_CORE_EVENT_SPACE_ID;
+                    event.header.type = CLAP_EVENT_PARAM_VALUE;
+                    event.param_id = s;
+                    sources.back()->refer(&event.header);
+                }
+                lists.push_back(sources.back()->list());
+            }
+
+            uint32_t total = sourceCount * density;
+            ClapHostInputEvents merged;
+            merged.reserve(total, 0);
+            std::vector<const clap_event_header*> orders[3];
+            double us[3] = {};
+            for (int way = 0; way < 3; way++) {
+                auto start = BenchClock::now();
+                // The first round warms the caches and is not timed
+                for (uint32_t r = 0; r <= rounds; r++) {
+                    if (r == 1) {
+                        start = BenchClock::now();
+                    }
+                    merged.clear();
+                    if (way == 0) {
+                        switch (sourceCount) {
+                        case 2: merged.merge({ lists[0], lists[1] }, true); break;
+                        case 4: merged.merge({ lists[0], lists[1], lists[2], lists[3] }, true); break;
+                        case 8: merged.merge({ lists[0], lists[1], lists[2], lists[3], lists[4], lists[5], lists[6], lists[7] }, true); break;
+                        default:
+                            merged.merge({ lists[0], lists[1], lists[2], lists[3], lists[4], lists[5], lists[6], lists[7],
+                                           lists[8], lists[9], lists[10], lists[11], lists[12], lists[13], lists[14], lists[15] }, true);
+                            break;
+                        }
+                    }
+                    else if (way == 1) {
+                        bench_heap_merge(merged, lists);
+                    }
+                    else {
+                        for (const clap_input_events* list : lists) {
+                            merged.append(list, true);
+                        }
+                    }
+                    benchSink += merged.list()->size(merged.list());
+                }
+                us[way] = elapsed_us(start);
+                for (uint32_t i = 0; i < merged.size(); i++) {
+                    orders[way].push_back(merged.get(i));
+                }
+            }
+            same = same && orders[0] == orders[1] && orders[1] == orders[2];
+            double perEvent = 1000.0 / ((double)total * rounds);
+            std::cout << "  " << sourceCount << " sources of " << density << ": " << us[0] * perEvent << ", "
+                      << us[1] * perEvent << ", " << us[2] * perEvent << std::endl;
+        }
+    }
+    std::cout << "  " << (same ? "the same order every way" : "orders differ") << std::endl;
+    return same ? 0 : 1;
+}
+
+// The ids a plugin probes during init: the host's extensions, their _COMPAT aliases and some
+// the host does not implement
+static const char* const benchExtensionIds[] = {
+    CLAP_EXT_LOG, CLAP_EXT_THREAD_CHECK, CLAP_EXT_LATENCY, CLAP_EXT_PARAMS, CLAP_EXT_STATE,
+    CLAP_EXT_AUDIO_PORTS, CLAP_EXT_TAIL, CLAP_EXT_THREAD_POOL, CLAP_EXT_TIMER_SUPPORT,
+    CLAP_EXT_POSIX_FD_SUPPORT, CLAP_EXT_VOICE_INFO, CLAP_EXT_UNDO, CLAP_EXT_TRANSPORT_CONTROL,
+    CLAP_EXT_TUNING, CLAP_EXT_EVENT_REGISTRY, CLAP_EXT_GUI, CLAP_EXT_NOTE_NAME, CLAP_EXT_NOTE_PORTS,
+    CLAP_EXT_AUDIO_PORTS_CONFIG, CLAP_EXT_PRESET_LOAD, CLAP_EXT_REMOTE_CONTROLS, CLAP_EXT_RENDER,
+    CLAP_EXT_CONTEXT_MENU, CLAP_EXT_TRACK_INFO, CLAP_EXT_PRESET_LOAD_COMPAT, CLAP_EXT_TRACK_INFO_COMPAT,
+    "com.example.unknown",
+};
+
+// clap_host::get_extension: the perfect hash registry, against comparing the id with every
+// entry of a table in order
+static int bench_registry(int ac, char** av) {
+    uint32_t rounds = ac > 0 ? (uint32_t)strtoul(av[0], nullptr, 10) : 100000;
+    const size_t idCount = sizeof(benchExtensionIds) / sizeof(benchExtensionIds[0]);
+
+    struct Entry {
+        const char* id;
+        const void* extension;
+    };
+    std::vector<Entry> table;
+    for (const char* id : benchExtensionIds) {
+        if (const void* extension = clap_host_extension(id)) {
+            table.push_back({ id, extension });
+        }
+    }
+    // Ids are copied so neither lookup can compare pointers
+    std::vector<std::string> probes(benchExtensionIds, benchExtensionIds + idCount);
+
+    auto start = BenchClock::now();
+    uintptr_t found = 0;
+    for (uint32_t r = 0; r < rounds; r++) {
+        for (const std::string& id : probes) {
+            found += (uintptr_t)clap_host_extension(id.c_str());
+        }
+    }
+    double hashed = elapsed_us(start);
+    benchSink = (uint32_t)found;
+
+    start = BenchClock::now();
+    uintptr_t scanned = 0;
+    for (uint32_t r = 0; r < rounds; r++) {
+        for (const std::string& id : probes) {
+            for (const Entry& entry : table) {
+                if (strcmp(entry.id, id.c_str()) == 0) {
+                    scanned += (uintptr_t)entry.extension;
+                    break;
+                }
+            }
+        }
+    }
+    double linear = elapsed_us(start);
+    benchSink = (uint32_t)scanned;
+
+    double lookups = (double)rounds * idCount;
+    std::cout << "Extension lookups of " << idCount << " ids, " << table.size() << " implemented" << std::endl;
+    std::cout << "  perfect hash: " << 1e3 * hashed / lookups << " ns per lookup" << std::endl;
+    std::cout << "  linear strcmp: " << 1e3 * linear / lookups << " ns per lookup" << std::endl;
+    return found == scanned ? 0 : 1;
+}
+
+struct Benchmark {
+    const char* name;
+    int (*run)(int ac, char** av);
+    const char* arguments;
+};
+
+static const Benchmark benchmarks[] = {
+    { "pool", bench_pool, "<plugin path> [switches]" },
+    { "automation", bench_automation, "[targets] [lanes per target] [seconds]" },
+    { "flush", bench_flush, "<clap-bench-plugin path> [changes]" },
+    { "threads", bench_threads, "[voices] [workers] [requests]" },
+    { "poly", bench_poly, "<clap-bench-plugin path> [instances] [heavy voices] [partials] [workers] [blocks]" },
+    { "merge", bench_merge, "[rounds]" },
+    { "midi", bench_midi, "<scratch MIDI file path> [notes per track] [tracks] [jump every blocks]" },
+    { "outputs", bench_outputs, "<clap-bench-plugin path> [blocks] [paced blocks] [main thread period us]" },
+    { "events", bench_events, "[block frames] [rounds]" },
+    { "transport", bench_transport, "[tempo changes] [lookups] [jumps]" },
+    { "tuning", bench_tuning, "[readers] [blocks]" },
+    { "ump", bench_ump, "<scratch stream path> [packets]" },
+    { "undo", bench_undo, "<clap-bench-plugin path> [instances] [steps]" },
+    { "catalog", bench_catalog, "<clap-bench-plugin path> <scratch directory> [bundles] [changes] [lookups]" },
+    { "convert", bench_convert, "<moss-converter path> <scratch directory> [states] [workers] [large state MiB]" },
+    { "delay", bench_delay, "[lines] [max delay] [blocks]" },
+    { "layout", bench_layout, "<clap-bench-plugin path> [instances] [blocks]" },
+    { "multiout", bench_multiout, "<clap-bench-plugin path> [instances] [blocks]" },
+    { "idle", bench_idle, "<clap-bench-plugin path> [instances] [loud instances] [blocks]" },
+    { "loop", bench_loop, "[timers] [fds] [seconds]" },
+    { "presets", bench_presets, "<clap-bench-plugin path> <scratch directory> [files] [threads] [queries]" },
+    { "registry", bench_registry, "[rounds]" },
+    { "snapshots", bench_snapshots, "<clap-bench-plugin path> <scratch store path> [instances] [edit rounds]" },
+    { "state", bench_state, "<scratch state path> [MiB]" },
+    { "swap", bench_swap, "<plugin path> [swaps] [blocks between swaps]" },
+};
+
+int main(int ac, char** av) {
+    for (const Benchmark& benchmark : benchmarks) {
+        if (ac > 1 && strcmp(av[1], benchmark.name) == 0) {
+            return benchmark.run(ac - 2, av + 2);
+        }
+    }
+    std::cout << "Usage : " << av[0] << " <benchmark> [arguments]" << std::endl;
+    for (const Benchmark& benchmark : benchmarks) {
+        std::cout << "        " << benchmark.name << " " << benchmark.arguments << std::endl;
+    }
+    return 1;
+}
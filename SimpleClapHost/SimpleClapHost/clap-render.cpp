@@ -0,0 +1,14 @@
+// Headless offline renderer, for benchmarking instruments on machines without an audio device.
+// SimpleClapHost.exe render ... does the same on Windows; elsewhere build it on its own:
+//   g++ -std=c++17 -O2 -I.. -o clap-render clap-render.cpp ClapHostRender.cpp ClapHostMidiFile.cpp
+//       ClapHost.cpp ClapHostEvents.cpp ClapHostExtensions.cpp ClapHostPorts.cpp ClapHostAudio.cpp
+//       ClapHostModule.cpp ClapHostMappedFile.cpp ClapHostTransport.cpp ClapHostTuning.cpp
+//       ClapHostThreadPool.cpp ClapHostEventLoop.cpp ClapHostUndo.cpp ClapHostSnapshots.cpp
+//       ClapHostStateStream.cpp -ldl -pthread
+// and try it with the instrument of moss-main.c.
+
+#include "ClapHostRender.h"
+
+int main(int ac, char **av) {
+    return run_offline_render(ac - 1, av + 1);
+}
@@ -0,0 +1,11 @@
+// Headless batch state converter, for machines without an audio device.
+// SimpleClapHost.exe convert ... does the same on Windows; elsewhere build it on its own:
+//   g++ -std=c++17 -O2 -I.. -o clap-state-convert clap-state-convert.cpp ClapHostConverter.cpp
+//       ClapHostStateStream.cpp ClapHostMappedFile.cpp ClapHostModule.cpp -ldl -pthread
+// and try it with the converter of moss-converter.c.
+
+#include "ClapHostConverter.h"
+
+int main(int ac, char **av) {
+    return run_state_conversion(ac - 1, av + 1);
+}
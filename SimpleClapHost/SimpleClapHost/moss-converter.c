@@ -0,0 +1,150 @@
+// State converter for moss-clap, to exercise the host's batch state conversion.
+//
+// Version 1 states are a bare array of float parameter values. Version 2 states start with
+// the "MOSS" magic and a version word, followed by the values as doubles. The conversion
+// streams the state through a fixed buffer, so states of any size can be converted.
+//
+// Build it as a module of its own:
+//   cc -shared -fPIC -O2 -I.. moss-converter.c -o moss-converter.clap
+
+#include <string.h>
+#include <stdlib.h>
+#include <stdio.h>
+
+#include <clap/clap.h>
+#include <clap/factory/draft/plugin-state-converter.h>
+
+#define MOSS_STATE_VERSION 2
+#define MOSS_CHUNK_VALUES 4096
+
+static const clap_plugin_state_converter_descriptor_t s_my_conv_desc = {
+   .clap_version = CLAP_VERSION_INIT,
+   .src_plugin_id = {.abi = "clap", .id = "de.mossgrabers.MossClap"},
+   .dst_plugin_id = {.abi = "clap", .id = "de.mossgrabers.MossClap2"},
+   .id = "de.mossgrabers.MossClap-converter",
+   .name = "moss-clap converter",
+   .vendor = "MOSS",
+   .version = "0.0.1",
+   .description = "Upgrades moss-clap states to version 2",
+};
+
+static bool write_all(const clap_ostream_t *dst, const void *data, uint64_t size) {
+   const char *bytes = data;
+   while (size > 0) {
+      int64_t n = dst->write(dst, bytes, size);
+      if (n <= 0)
+         return false;
+      bytes += n;
+      size -= (uint64_t)n;
+   }
+   return true;
+}
+
+static void my_conv_destroy(clap_plugin_state_converter_t *converter) { free(converter); }
+
+static bool my_conv_convert_state(clap_plugin_state_converter_t *converter,
+                                  const clap_istream_t          *src,
+                                  const clap_ostream_t          *dst,
+                                  char                          *error_buffer,
+                                  size_t                         error_buffer_size) {
+   uint32_t header[2] = {0x53534f4d /* "MOSS" */, MOSS_STATE_VERSION};
+   float    in[MOSS_CHUNK_VALUES];
+   double   out[MOSS_CHUNK_VALUES];
+   size_t   pending = 0; // bytes of in[] filled
+
+   if (!write_all(dst, header, sizeof(header)))
+      goto write_error;
+
+   for (;;) {
+      int64_t n = src->read(src, (char *)in + pending, sizeof(in) - pending);
+      if (n < 0) {
+         snprintf(error_buffer, error_buffer_size, "%s", "read error");
+         return false;
+      }
+      pending += (size_t)n;
+      size_t values = pending / sizeof(float);
+      if (values > 0 && (n == 0 || pending == sizeof(in))) {
+         for (size_t i = 0; i < values; ++i)
+            out[i] = in[i];
+         if (!write_all(dst, out, values * sizeof(double)))
+            goto write_error;
+         pending -= values * sizeof(float);
+         memmove(in, (char *)in + values * sizeof(float), pending);
+      }
+      if (n == 0)
+         break;
+   }
+   if (pending != 0) {
+      snprintf(error_buffer, error_buffer_size, "%s", "truncated version 1 state");
+      return false;
+   }
+   return true;
+
+write_error:
+   snprintf(error_buffer, error_buffer_size, "%s", "write error");
+   return false;
+}
+
+// Parameters keep their ids and ranges
+static bool my_conv_convert_value(clap_plugin_state_converter_t *converter,
+                                  clap_id                        src_param_id,
+                                  double                         src_value,
+                                  clap_id                       *dst_param_id,
+                                  double                        *dst_value) {
+   *dst_param_id = src_param_id;
+   *dst_value = src_value;
+   return true;
+}
+
+static uint32_t converter_factory_count(const clap_plugin_state_converter_factory_t *factory) {
+   return 1;
+}
+
+static const clap_plugin_state_converter_descriptor_t *
+converter_factory_get_descriptor(const clap_plugin_state_converter_factory_t *factory,
+                                 uint32_t                                     index) {
+   return index == 0 ? &s_my_conv_desc : NULL;
+}
+
+static clap_plugin_state_converter_t *
+converter_factory_create(const clap_plugin_state_converter_factory_t *factory,
+                         const char                                  *converter_id) {
+   if (strcmp(converter_id, s_my_conv_desc.id))
+      return NULL;
+
+   clap_plugin_state_converter_t *converter = calloc(1, sizeof(*converter));
+   converter->desc = &s_my_conv_desc;
+   converter->converter_data = NULL;
+   converter->destroy = my_conv_destroy;
+   converter->convert_state = my_conv_convert_state;
+   converter->convert_normalized_value = my_conv_convert_value;
+   converter->convert_plain_value = my_conv_convert_value;
+   return converter;
+}
+
+static const clap_plugin_state_converter_factory_t s_converter_factory = {
+   .count = converter_factory_count,
+   .get_descriptor = converter_factory_get_descriptor,
+   .create = converter_factory_create,
+};
+
+////////////////
+// clap_entry //
+////////////////
+
+static bool entry_init(const char *plugin_path) { return true; }
+
+static void entry_deinit(void) {}
+
+static const void *entry_get_factory(const char *factory_id) {
+   if (!strcmp(factory_id, CLAP_PLUGIN_STATE_CONVERTER_FACTORY_ID))
+      return &s_converter_factory;
+   return NULL;
+}
+
+CLAP_EXPORT const clap_plugin_entry_t clap_entry = {
+   .clap_version = CLAP_VERSION_INIT,
+   .init = entry_init,
+   .deinit = entry_deinit,
+   .get_factory = entry_get_factory,
+};